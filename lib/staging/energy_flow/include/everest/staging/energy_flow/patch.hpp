@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#ifndef EVEREST_STAGING_ENERGY_FLOW_PATCH_HPP
+#define EVEREST_STAGING_ENERGY_FLOW_PATCH_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <generated/types/energy.hpp>
+
+namespace everest::staging::energy_flow {
+
+/// \brief Checks if \p patch is a complete snapshot of the tree of the publishing node
+/// \returns true if the path is empty and the patch contains the complete node
+bool is_snapshot(const types::energy::EnergyFlowRequestPatch& patch);
+
+/// \brief Applies \p patch to \p tree, the cached tree of the node that published the patch
+/// \returns false if the node addressed by the path of the patch does not exist in \p tree
+bool apply_patch(types::energy::EnergyFlowRequest& tree, const types::energy::EnergyFlowRequestPatch& patch);
+
+/// \brief Creates the patch that a node with \p uuid publishes after it applied \p child_patch of one of its
+/// children: the same change with the uuid of the child prepended to the path
+types::energy::EnergyFlowRequestPatch forward_patch(const types::energy::EnergyFlowRequestPatch& child_patch,
+                                                    const std::string& uuid);
+
+/// \brief Creates a patch that replaces the child \p child of a node with \p uuid
+types::energy::EnergyFlowRequestPatch child_patch(const types::energy::EnergyFlowRequest& child,
+                                                  const std::string& uuid);
+
+/// \brief Adds \p patch to the \p pending patches of a node that are not published yet. Changes of the same node are
+/// merged, a node that is replaced completely also contains all later changes of its subtree. Applying the resulting
+/// patches in order gives the same tree as applying all patches one by one.
+void merge_patch(std::vector<types::energy::EnergyFlowRequestPatch>& pending,
+                 types::energy::EnergyFlowRequestPatch patch);
+
+/// \brief Checks if \p request or any node below it is a priority request
+bool is_priority_request(const types::energy::EnergyFlowRequest& request);
+
+/// \brief Checks the versions of the patches received from several publishers
+class PatchSequence {
+public:
+    enum class Result {
+        Apply,         ///< the patch follows the last one of its publisher or is a snapshot
+        RequestResync, ///< a version is missing (or no snapshot was received yet), a snapshot needs to be requested
+        Ignore,        ///< a version is missing and a snapshot was already requested
+    };
+
+    /// \brief Checks if \p patch can be applied and remembers its version
+    Result check(const types::energy::EnergyFlowRequestPatch& patch);
+
+    /// \brief Marks the publisher with \p uuid as out of sync, e.g. because a patch could not be applied. The
+    /// caller requests the snapshot, further patches are ignored until it arrives.
+    void resync_requested(const std::string& uuid);
+
+private:
+    static constexpr int patches_before_resync_retry = 10;
+
+    struct Publisher {
+        bool synced{false};
+        std::uint32_t version{0};
+        int ignored{0}; // patches ignored since the last snapshot request
+    };
+    std::map<std::string, Publisher> publishers;
+};
+
+} // namespace everest::staging::energy_flow
+
+#endif
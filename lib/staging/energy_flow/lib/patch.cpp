@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include <everest/staging/energy_flow/patch.hpp>
+
+#include <algorithm>
+
+namespace everest::staging::energy_flow {
+
+bool is_snapshot(const types::energy::EnergyFlowRequestPatch& patch) {
+    return patch.path.empty() and patch.node.has_value();
+}
+
+bool apply_patch(types::energy::EnergyFlowRequest& tree, const types::energy::EnergyFlowRequestPatch& patch) {
+    // find the changed node
+    types::energy::EnergyFlowRequest* node = &tree;
+    for (std::size_t i = 0; i < patch.path.size(); i++) {
+        types::energy::EnergyFlowRequest* next = nullptr;
+        for (auto& child : node->children) {
+            if (child.uuid == patch.path[i]) {
+                next = &child;
+                break;
+            }
+        }
+
+        if (next == nullptr) {
+            // a new child is only added by a patch that contains the complete node
+            if (i + 1 != patch.path.size() or not patch.node.has_value()) {
+                return false;
+            }
+            node->children.push_back(patch.node.value());
+            return true;
+        }
+        node = next;
+    }
+
+    if (patch.node.has_value()) {
+        *node = patch.node.value();
+    }
+
+    if (patch.energy_usage_root.has_value()) {
+        node->energy_usage_root = patch.energy_usage_root;
+    }
+
+    if (patch.schedule_import.has_value()) {
+        node->schedule_import = patch.schedule_import;
+    }
+
+    if (patch.schedule_export.has_value()) {
+        node->schedule_export = patch.schedule_export;
+    }
+
+    return true;
+}
+
+types::energy::EnergyFlowRequestPatch forward_patch(const types::energy::EnergyFlowRequestPatch& child_patch,
+                                                    const std::string& uuid) {
+    types::energy::EnergyFlowRequestPatch patch = child_patch;
+    patch.uuid = uuid;
+    patch.path.insert(patch.path.begin(), child_patch.uuid);
+    return patch;
+}
+
+types::energy::EnergyFlowRequestPatch child_patch(const types::energy::EnergyFlowRequest& child,
+                                                  const std::string& uuid) {
+    types::energy::EnergyFlowRequestPatch patch;
+    patch.uuid = uuid;
+    patch.version = 0; // set by the publisher
+    patch.path = {child.uuid};
+    patch.node = child;
+    return patch;
+}
+
+// true if prefix is the path of node or of one of its parents
+static bool is_prefix(const std::vector<std::string>& prefix, const std::vector<std::string>& path) {
+    return prefix.size() <= path.size() and std::equal(prefix.begin(), prefix.end(), path.begin());
+}
+
+void merge_patch(std::vector<types::energy::EnergyFlowRequestPatch>& pending,
+                 types::energy::EnergyFlowRequestPatch patch) {
+    // change inside of a node that is replaced anyway
+    for (auto& p : pending) {
+        if (p.node.has_value() and is_prefix(p.path, patch.path)) {
+            types::energy::EnergyFlowRequestPatch relative = patch;
+            relative.path.erase(relative.path.begin(), relative.path.begin() + p.path.size());
+            if (apply_patch(p.node.value(), relative)) {
+                return;
+            }
+        }
+    }
+
+    if (patch.node.has_value()) {
+        // replaces all pending changes of this node and its subtree
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [&patch](const types::energy::EnergyFlowRequestPatch& p) {
+                                         return is_prefix(patch.path, p.path);
+                                     }),
+                      pending.end());
+        pending.push_back(std::move(patch));
+        return;
+    }
+
+    for (auto& p : pending) {
+        if (p.path == patch.path) {
+            if (patch.energy_usage_root.has_value()) {
+                p.energy_usage_root = std::move(patch.energy_usage_root);
+            }
+            if (patch.schedule_import.has_value()) {
+                p.schedule_import = std::move(patch.schedule_import);
+            }
+            if (patch.schedule_export.has_value()) {
+                p.schedule_export = std::move(patch.schedule_export);
+            }
+            return;
+        }
+    }
+
+    pending.push_back(std::move(patch));
+}
+
+bool is_priority_request(const types::energy::EnergyFlowRequest& request) {
+    if (request.priority_request.value_or(false)) {
+        return true;
+    }
+    return std::any_of(request.children.begin(), request.children.end(),
+                       [](const types::energy::EnergyFlowRequest& c) { return is_priority_request(c); });
+}
+
+PatchSequence::Result PatchSequence::check(const types::energy::EnergyFlowRequestPatch& patch) {
+    auto& publisher = publishers[patch.uuid];
+    const auto version = static_cast<std::uint32_t>(patch.version);
+
+    if (is_snapshot(patch) or (publisher.synced and version == publisher.version + 1)) {
+        publisher.synced = true;
+        publisher.version = version;
+        publisher.ignored = 0;
+        return Result::Apply;
+    }
+
+    // A version is missing or no snapshot was received yet. Request a snapshot once and only request it again if it
+    // does not arrive within the next patches.
+    publisher.synced = false;
+    if (publisher.ignored == 0 or publisher.ignored >= patches_before_resync_retry) {
+        publisher.ignored = 1;
+        return Result::RequestResync;
+    }
+
+    publisher.ignored++;
+    return Result::Ignore;
+}
+
+void PatchSequence::resync_requested(const std::string& uuid) {
+    auto& publisher = publishers[uuid];
+    publisher.synced = false;
+    publisher.ignored = 1;
+}
+
+} // namespace everest::staging::energy_flow
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include <gtest/gtest.h>
+
+#include <everest/staging/energy_flow/patch.hpp>
+
+using namespace everest::staging::energy_flow;
+
+namespace {
+
+types::energy::EnergyFlowRequest node(const std::string& uuid,
+                                      std::vector<types::energy::EnergyFlowRequest> children = {}) {
+    types::energy::EnergyFlowRequest r;
+    r.uuid = uuid;
+    r.node_type = children.empty() ? types::energy::NodeType::Evse : types::energy::NodeType::Generic;
+    r.children = std::move(children);
+    return r;
+}
+
+types::energy::EnergyFlowRequestPatch patch(const std::string& uuid, int version, std::vector<std::string> path) {
+    types::energy::EnergyFlowRequestPatch p;
+    p.uuid = uuid;
+    p.version = version;
+    p.path = std::move(path);
+    return p;
+}
+
+} // namespace
+
+TEST(EnergyFlowPatchTest, apply_patch) {
+    auto tree = node("root", {node("fuse", {node("evse1"), node("evse2")})});
+
+    // only the powermeter of one evse changed
+    auto p = patch("root", 1, {"fuse", "evse2"});
+    p.energy_usage_root.emplace();
+    p.energy_usage_root->timestamp = "2024-03-27T12:00:00.000Z";
+    EXPECT_TRUE(apply_patch(tree, p));
+    ASSERT_TRUE(tree.children[0].children[1].energy_usage_root.has_value());
+    EXPECT_EQ(tree.children[0].children[1].energy_usage_root->timestamp, "2024-03-27T12:00:00.000Z");
+    EXPECT_FALSE(tree.children[0].children[0].energy_usage_root.has_value());
+
+    // a new evse is added with its complete node
+    p = patch("root", 2, {"fuse", "evse3"});
+    p.node = node("evse3");
+    EXPECT_TRUE(apply_patch(tree, p));
+    ASSERT_EQ(tree.children[0].children.size(), 3);
+    EXPECT_EQ(tree.children[0].children[2].uuid, "evse3");
+
+    // unknown nodes can only be added, not modified
+    p = patch("root", 3, {"other_fuse", "evse1"});
+    p.schedule_import.emplace();
+    EXPECT_FALSE(apply_patch(tree, p));
+
+    // a snapshot replaces everything
+    p = patch("root", 4, {});
+    p.node = node("root", {node("evse4")});
+    EXPECT_TRUE(is_snapshot(p));
+    EXPECT_TRUE(apply_patch(tree, p));
+    ASSERT_EQ(tree.children.size(), 1);
+    EXPECT_EQ(tree.children[0].uuid, "evse4");
+}
+
+TEST(EnergyFlowPatchTest, forward_patch) {
+    auto p = forward_patch(child_patch(node("evse1"), "fuse"), "root");
+    EXPECT_EQ(p.uuid, "root");
+    EXPECT_EQ(p.path, (std::vector<std::string>{"fuse", "evse1"}));
+    ASSERT_TRUE(p.node.has_value());
+    EXPECT_EQ(p.node->uuid, "evse1");
+}
+
+TEST(EnergyFlowPatchTest, patch_sequence) {
+    PatchSequence sequence;
+    auto snapshot = patch("fuse", 7, {});
+    snapshot.node = node("fuse");
+
+    // patches are only applied after a snapshot
+    EXPECT_EQ(sequence.check(patch("fuse", 5, {"evse1"})), PatchSequence::Result::RequestResync);
+    EXPECT_EQ(sequence.check(patch("fuse", 6, {"evse1"})), PatchSequence::Result::Ignore);
+    EXPECT_EQ(sequence.check(snapshot), PatchSequence::Result::Apply);
+    EXPECT_EQ(sequence.check(patch("fuse", 8, {"evse1"})), PatchSequence::Result::Apply);
+
+    // publishers are independent
+    EXPECT_EQ(sequence.check(patch("other", 1, {"evse1"})), PatchSequence::Result::RequestResync);
+    EXPECT_EQ(sequence.check(patch("fuse", 9, {"evse1"})), PatchSequence::Result::Apply);
+
+    // a gap requests a snapshot once, and again if it does not arrive
+    EXPECT_EQ(sequence.check(patch("fuse", 11, {"evse1"})), PatchSequence::Result::RequestResync);
+    for (int version = 12; version < 21; version++) {
+        EXPECT_EQ(sequence.check(patch("fuse", version, {"evse1"})), PatchSequence::Result::Ignore);
+    }
+    EXPECT_EQ(sequence.check(patch("fuse", 21, {"evse1"})), PatchSequence::Result::RequestResync);
+
+    snapshot.version = 30;
+    EXPECT_EQ(sequence.check(snapshot), PatchSequence::Result::Apply);
+    EXPECT_EQ(sequence.check(patch("fuse", 31, {"evse1"})), PatchSequence::Result::Apply);
+
+    // a patch that could not be applied
+    sequence.resync_requested("fuse");
+    EXPECT_EQ(sequence.check(patch("fuse", 32, {"evse1"})), PatchSequence::Result::Ignore);
+}
+
+TEST(EnergyFlowPatchTest, merge_patch) {
+    std::vector<types::energy::EnergyFlowRequestPatch> pending;
+
+    // changes of the same node are merged
+    auto p = patch("fuse", 0, {"evse1"});
+    p.energy_usage_root.emplace();
+    p.energy_usage_root->timestamp = "2024-03-27T12:00:00.000Z";
+    merge_patch(pending, p);
+    p.energy_usage_root->timestamp = "2024-03-27T12:00:01.000Z";
+    merge_patch(pending, p);
+    p = patch("fuse", 0, {"evse1"});
+    p.schedule_import.emplace();
+    merge_patch(pending, p);
+    ASSERT_EQ(pending.size(), 1);
+    EXPECT_EQ(pending[0].energy_usage_root->timestamp, "2024-03-27T12:00:01.000Z");
+    EXPECT_TRUE(pending[0].schedule_import.has_value());
+
+    // other nodes are kept separately
+    p = patch("fuse", 0, {"evse2"});
+    p.schedule_export.emplace();
+    merge_patch(pending, p);
+    ASSERT_EQ(pending.size(), 2);
+
+    // a replaced node drops the pending changes of its subtree
+    p = patch("fuse", 0, {"evse1"});
+    p.node = node("evse1");
+    merge_patch(pending, p);
+    ASSERT_EQ(pending.size(), 2);
+    EXPECT_EQ(pending[0].path, (std::vector<std::string>{"evse2"}));
+    EXPECT_TRUE(pending[1].node.has_value());
+
+    // and contains all later changes
+    p = patch("fuse", 0, {"evse1"});
+    p.energy_usage_root.emplace();
+    merge_patch(pending, p);
+    ASSERT_EQ(pending.size(), 2);
+    EXPECT_TRUE(pending[1].node->energy_usage_root.has_value());
+}
+
+TEST(EnergyFlowPatchTest, is_priority_request) {
+    auto tree = node("root", {node("fuse", {node("evse1"), node("evse2")})});
+    EXPECT_FALSE(is_priority_request(tree));
+    tree.children[0].children[1].priority_request = true;
+    EXPECT_TRUE(is_priority_request(tree));
+}
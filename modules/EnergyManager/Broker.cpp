@@ -9,10 +9,11 @@ namespace module {
 
 Broker::Broker(Market& _market, BrokerContext& _context) :
     local_market(_market),
+    optimizer_context(_market.optimizer_context()),
     context(_context),
-    first_trade(globals.schedule_length, true),
-    slot_type(globals.schedule_length, SlotType::Undecided),
-    num_phases(globals.schedule_length, 0) {
+    first_trade(optimizer_context.schedule_length, true),
+    slot_type(optimizer_context.schedule_length, SlotType::Undecided),
+    num_phases(optimizer_context.schedule_length, 0) {
 }
 
 Market& Broker::get_local_market() {
@@ -11,49 +11,20 @@ BrokerFastCharging::BrokerFastCharging(Market& _market, BrokerContext& _context,
     Broker(_market, _context), config(_config) {
 }
 
-static auto to_timestamp(const types::energy::ScheduleReqEntry& entry) {
-    return Everest::Date::from_rfc3339(entry.timestamp);
-}
-
-static bool time_slot_active(const int i, const ScheduleReq& offer) {
-    const auto& now = globals.start_time;
-    const auto t_i = to_timestamp(offer[i]);
-
-    int active_slot = 0;
-    // Get active slot:
-    if (now < to_timestamp(offer[0])) {
-        // First element already in the future
-        active_slot = 0;
-    } else if (now > to_timestamp(offer[offer.size() - 1])) {
-        // Last element in the past
-        active_slot = offer.size() - 1;
-    } else {
-        // Somewhere in between
-        for (int n = 0; n < offer.size() - 1; n++) {
-            if (now > to_timestamp(offer[n]) and now < to_timestamp(offer[n + 1])) {
-                active_slot = n;
-                break;
-            }
-        }
-    }
-
-    return active_slot == i;
-}
-
 bool BrokerFastCharging::trade(Offer& _offer) {
     // the offer contains all data we need to decide on a trade
     // we can now buy from/sell to according to the offer at our local market place for this evse
     // our strategy is to charge if we can, and only discharge if charging is not possible.
     offer = &_offer;
-    if (globals.debug)
+    if (optimizer_context.debug)
         EVLOG_info << local_market.energy_flow_request.uuid << " Broker: " << *offer;
 
     // create a new schedules that contains everything we want to buy
-    trading = globals.empty_schedule_res;
+    trading = optimizer_context.empty_schedule_res;
 
     // buy/sell nothing in the beginning
 
-    for (int i = 0; i < globals.schedule_length; i++) {
+    for (int i = 0; i < optimizer_context.schedule_length; i++) {
         // make this more readable
         auto& max_current = offer->import_offer[i].limits_to_root.ac_max_current_A;
         auto& total_power = offer->import_offer[i].limits_to_root.total_power_W;
@@ -73,9 +44,10 @@ bool BrokerFastCharging::trade(Offer& _offer) {
     }
 
     // if we have not bought anything, we first need to buy the minimal limits for ac_amp if any.
-    for (int i = 0; i < globals.schedule_length; i++) {
+    for (int i = 0; i < optimizer_context.schedule_length; i++) {
 
-        bool time_slot_is_active = time_slot_active(i, offer->import_offer);
+        // all offers share the time grid of the optimizer context, so the active slot is only calculated once per run
+        bool time_slot_is_active = optimizer_context.active_slot == i;
 
         // make this more readable
         auto& max_current_import = offer->import_offer[i].limits_to_root.ac_max_current_A;
@@ -92,9 +64,6 @@ bool BrokerFastCharging::trade(Offer& _offer) {
         const auto ac_number_of_active_phases_export =
             offer->export_offer[i].limits_to_root.ac_number_of_active_phases.value_or(3);
 
-        const auto max_phases_import = offer->import_offer[i].limits_to_root.ac_max_phase_count.value_or(3);
-        const auto min_phases_import = offer->import_offer[i].limits_to_root.ac_min_phase_count.value_or(3);
-
         // in each timeslot: do we want to import or export energy?
         if (slot_type[i] == SlotType::Undecided) {
             bool can_import = !((total_power_import.has_value() && total_power_import.value() == 0.) ||
@@ -119,81 +88,18 @@ bool BrokerFastCharging::trade(Offer& _offer) {
             if (max_current_import.has_value()) {
                 // A current limit is set
 
-                // If an additional watt limit is set check phases, else it is max_phases (typically 3)
-                // First decide if we would like to charge 1 phase or 3 phase (if switching is possible at all)
-                //   - Check if we are below e.g. 4.2kW (min_current*voltage*3) -> we have to do single phase
-                //   - Check if we are above e.g. 4.4kW (min_current*voltage*3 + watt_hysteresis) -> we want to go three
-                //   phase
-                //   - If we are in between, use what is currently active (hysteresis)
-
                 int number_of_phases = ac_number_of_active_phases_import;
-
-                const auto min_power_3ph =
-                    min_current_import.value_or(0) * max_phases_import * local_market.nominal_ac_voltage();
-
                 bool number_of_switching_cycles_reached = false;
 
                 if (first_trade[i]) {
-                    if (config.switch_1ph_3ph_mode not_eq Switch1ph3phMode::Never and total_power_import.has_value() &&
-                        min_power_3ph > 0.) {
-
-                        if (total_power_import.value() < min_power_3ph) {
-                            // We have to do single phase, it is impossible with 3ph
-                            number_of_phases = min_phases_import;
-                        } else if (config.switch_1ph_3ph_mode == Switch1ph3phMode::Both and
-                                   total_power_import.value() > min_power_3ph + config.power_hysteresis_W) {
-                            number_of_phases = max_phases_import;
-                        } else {
-                            // Keep number of phases as they are
-                            number_of_phases = ac_number_of_active_phases_import;
-                        }
-
-                        // Now we made the decision what the optimal number of phases would be (in variable
-                        // number_of_phases) We also have a time based hysteresis as well as some limits in maximum
-                        // number of switching cycles. This means we maybe cannot use the optimal number of phases just
-                        // now. Check those conditions and adjust number_of_phases accordingly.
-
-                        if (config.max_nr_of_switches_per_session > 0 and
-                            context.number_1ph3ph_cycles > config.max_nr_of_switches_per_session) {
-                            number_of_switching_cycles_reached = true;
-                            if (config.stickyness == StickyNess::SinglePhase) {
-                                number_of_phases = min_phases_import;
-                            } else if (config.stickyness == StickyNess::ThreePhase) {
-                                number_of_phases = max_phases_import;
-                            } else {
-                                number_of_phases = ac_number_of_active_phases_import;
-                            }
-                        }
-
-                        if (number_of_phases == min_phases_import and time_slot_is_active) {
-                            context.ts_1ph_optimal = date::utc_clock::now();
-                        }
-
-                        if (config.time_hysteresis_s > 0 and time_slot_is_active) {
-                            // Check time based hysteresis:
-                            // - store timestamp whenever 1ph is optimal (update continously)
-                            // Then now-timestamp is the stable time period for a 3ph condition.
-                            // This should only be done in the currently active time slot. Ignore time hysteresis in
-                            // other slots in the future or past.
-                            // Only allow an actual change to 3ph if the time exceeds the configured hysteresis limit.
-                            const auto stable_3ph = std::chrono::duration_cast<std::chrono::seconds>(
-                                                        globals.start_time - context.ts_1ph_optimal)
-                                                        .count();
-
-                            if (stable_3ph < config.time_hysteresis_s and number_of_phases == max_phases_import) {
-                                number_of_phases = min_phases_import;
-                            }
-                        }
-                    } else {
-                        number_of_phases = max_phases_import;
-                    }
+                    number_of_phases =
+                        choose_number_of_phases(config, context, offer->import_offer[i],
+                                                local_market.nominal_ac_voltage(), time_slot_is_active,
+                                                optimizer_context.start_time, number_of_switching_cycles_reached);
                 }
 
                 // store decision in context
-                if (ac_number_of_active_phases_import not_eq context.last_ac_number_of_active_phases_import) {
-                    context.number_1ph3ph_cycles++;
-                }
-                context.last_ac_number_of_active_phases_import = ac_number_of_active_phases_import;
+                count_1ph3ph_cycles(context, ac_number_of_active_phases_import);
 
                 if (first_trade[i] && min_current_import.has_value() && min_current_import.value() > 0.) {
                     num_phases[i] = number_of_phases;
@@ -217,13 +123,13 @@ bool BrokerFastCharging::trade(Offer& _offer) {
                 } else {
                     // EVLOG_info << "I: Not first trade or nor min current needed.";
                     //  try to buy a slice but allow less to be bought
-                    buy_ampere_import(i, globals.slice_ampere, true, num_phases[i]);
+                    buy_ampere_import(i, optimizer_context.slice_ampere, true, num_phases[i]);
                 }
 
             } else if (total_power_import.has_value()) {
                 // only a watt limit is available
                 // EVLOG_info << "I: Only watt limit is set." << total_power_import.value();
-                buy_watt_import(i, globals.slice_watt, true);
+                buy_watt_import(i, optimizer_context.slice_watt, true);
             }
         } else if (slot_type[i] == SlotType::Export) {
             // EVLOG_info << "We can export.";
@@ -238,12 +144,12 @@ bool BrokerFastCharging::trade(Offer& _offer) {
                 } else {
                     // EVLOG_info << "E: Not first trade or nor min current needed.";
                     //  try to buy a slice but allow less to be bought
-                    buy_ampere_export(i, globals.slice_ampere, true, 3);
+                    buy_ampere_export(i, optimizer_context.slice_ampere, true, 3);
                 }
             } else if (total_power_export.has_value()) {
                 // only a watt limit is available
                 // EVLOG_info << "E: Only watt limit is set." << total_power_export.value();
-                buy_watt_export(i, globals.slice_watt, true);
+                buy_watt_export(i, optimizer_context.slice_watt, true);
             }
         } else {
             // EVLOG_info << "We can neither import nor export.";
@@ -252,7 +158,7 @@ bool BrokerFastCharging::trade(Offer& _offer) {
 
     // if we want to buy anything:
     if (traded) {
-        if (globals.debug) {
+        if (optimizer_context.debug) {
             EVLOG_info << fmt::format("\033[1;33m                                {}A {}W \033[1;0m",
                                       (trading[0].limits_to_root.ac_max_current_A.has_value()
                                            ? std::to_string(trading[0].limits_to_root.ac_max_current_A.value())
@@ -265,7 +171,7 @@ bool BrokerFastCharging::trade(Offer& _offer) {
         local_market.trade(trading);
         return true;
     } else {
-        if (globals.debug)
+        if (optimizer_context.debug)
             EVLOG_info << fmt::format("\033[1;33m                               NO TRADE \033[1;0m");
 
         //   execute the zero trade on the market
@@ -274,6 +180,94 @@ bool BrokerFastCharging::trade(Offer& _offer) {
     }
 }
 
+int BrokerFastCharging::choose_number_of_phases(const Config& config, BrokerContext& context, const SlotReq& offer,
+                                                float nominal_ac_voltage, bool time_slot_is_active,
+                                                date::utc_clock::time_point start_time,
+                                                bool& number_of_switching_cycles_reached) {
+    const auto& min_current_import = offer.limits_to_root.ac_min_current_A;
+    const auto& total_power_import = offer.limits_to_root.total_power_W;
+
+    // If not specified, assume worst case (3ph being active)
+    const auto ac_number_of_active_phases_import = offer.limits_to_root.ac_number_of_active_phases.value_or(3);
+    const auto max_phases_import = offer.limits_to_root.ac_max_phase_count.value_or(3);
+    const auto min_phases_import = offer.limits_to_root.ac_min_phase_count.value_or(3);
+
+    // If an additional watt limit is set check phases, else it is max_phases (typically 3)
+    // First decide if we would like to charge 1 phase or 3 phase (if switching is possible at all)
+    //   - Check if we are below e.g. 4.2kW (min_current*voltage*3) -> we have to do single phase
+    //   - Check if we are above e.g. 4.4kW (min_current*voltage*3 + watt_hysteresis) -> we want to go three
+    //   phase
+    //   - If we are in between, use what is currently active (hysteresis)
+
+    int number_of_phases = ac_number_of_active_phases_import;
+
+    const auto min_power_3ph = min_current_import.value_or(0) * max_phases_import * nominal_ac_voltage;
+
+    number_of_switching_cycles_reached = false;
+
+    if (config.switch_1ph_3ph_mode not_eq Switch1ph3phMode::Never and total_power_import.has_value() &&
+        min_power_3ph > 0.) {
+
+        if (total_power_import.value() < min_power_3ph) {
+            // We have to do single phase, it is impossible with 3ph
+            number_of_phases = min_phases_import;
+        } else if (config.switch_1ph_3ph_mode == Switch1ph3phMode::Both and
+                   total_power_import.value() > min_power_3ph + config.power_hysteresis_W) {
+            number_of_phases = max_phases_import;
+        } else {
+            // Keep number of phases as they are
+            number_of_phases = ac_number_of_active_phases_import;
+        }
+
+        // Now we made the decision what the optimal number of phases would be (in variable
+        // number_of_phases) We also have a time based hysteresis as well as some limits in maximum
+        // number of switching cycles. This means we maybe cannot use the optimal number of phases just
+        // now. Check those conditions and adjust number_of_phases accordingly.
+
+        if (config.max_nr_of_switches_per_session > 0 and
+            context.number_1ph3ph_cycles > config.max_nr_of_switches_per_session) {
+            number_of_switching_cycles_reached = true;
+            if (config.stickyness == StickyNess::SinglePhase) {
+                number_of_phases = min_phases_import;
+            } else if (config.stickyness == StickyNess::ThreePhase) {
+                number_of_phases = max_phases_import;
+            } else {
+                number_of_phases = ac_number_of_active_phases_import;
+            }
+        }
+
+        if (number_of_phases == min_phases_import and time_slot_is_active) {
+            context.ts_1ph_optimal = date::utc_clock::now();
+        }
+
+        if (config.time_hysteresis_s > 0 and time_slot_is_active) {
+            // Check time based hysteresis:
+            // - store timestamp whenever 1ph is optimal (update continously)
+            // Then now-timestamp is the stable time period for a 3ph condition.
+            // This should only be done in the currently active time slot. Ignore time hysteresis in
+            // other slots in the future or past.
+            // Only allow an actual change to 3ph if the time exceeds the configured hysteresis limit.
+            const auto stable_3ph =
+                std::chrono::duration_cast<std::chrono::seconds>(start_time - context.ts_1ph_optimal).count();
+
+            if (stable_3ph < config.time_hysteresis_s and number_of_phases == max_phases_import) {
+                number_of_phases = min_phases_import;
+            }
+        }
+    } else {
+        number_of_phases = max_phases_import;
+    }
+
+    return number_of_phases;
+}
+
+void BrokerFastCharging::count_1ph3ph_cycles(BrokerContext& context, int ac_number_of_active_phases) {
+    if (ac_number_of_active_phases not_eq context.last_ac_number_of_active_phases_import) {
+        context.number_1ph3ph_cycles++;
+    }
+    context.last_ac_number_of_active_phases_import = ac_number_of_active_phases;
+}
+
 bool BrokerFastCharging::buy_ampere_import(int index, float ampere, bool allow_less, int number_of_phases) {
     return buy_ampere(offer->import_offer[index], index, ampere, allow_less, true, number_of_phases);
 }
@@ -290,7 +284,7 @@ bool BrokerFastCharging::buy_watt_export(int index, float watt, bool allow_less)
     return buy_watt(offer->export_offer[index], index, watt, allow_less, false);
 }
 
-bool BrokerFastCharging::buy_ampere(const types::energy::ScheduleReqEntry& _offer, int index, float ampere,
+bool BrokerFastCharging::buy_ampere(const SlotReq& _offer, int index, float ampere,
                                     bool allow_less, bool import, int number_of_phases) {
     // make this more readable
     auto& max_current = _offer.limits_to_root.ac_max_current_A;
@@ -366,7 +360,7 @@ bool BrokerFastCharging::buy_ampere(const types::energy::ScheduleReqEntry& _offe
     return false;
 }
 
-bool BrokerFastCharging::buy_watt(const types::energy::ScheduleReqEntry& _offer, int index, float watt, bool allow_less,
+bool BrokerFastCharging::buy_watt(const SlotReq& _offer, int index, float watt, bool allow_less,
                                   bool import) {
     // make this more readable
     auto& total_power = _offer.limits_to_root.total_power_W;
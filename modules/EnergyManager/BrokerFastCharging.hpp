@@ -33,20 +33,28 @@ public:
     explicit BrokerFastCharging(Market& market, BrokerContext& context, Config config);
     virtual bool trade(Offer& offer) override;
 
+    // Decide if the first trade in a time slot should be done with 1ph or 3ph (1ph/3ph switching with power and
+    // time based hysteresis). This is shared with the water filling optimizer.
+    static int choose_number_of_phases(const Config& config, BrokerContext& context, const SlotReq& offer,
+                                       float nominal_ac_voltage, bool time_slot_is_active,
+                                       date::utc_clock::time_point start_time,
+                                       bool& number_of_switching_cycles_reached);
+    static void count_1ph3ph_cycles(BrokerContext& context, int ac_number_of_active_phases);
+
 private:
     void buy_ampere_unchecked(int index, float ampere, int number_of_phases);
     void buy_watt_unchecked(int index, float watt);
 
     bool buy_ampere_import(int index, float ampere, bool allow_less, int number_of_phases);
     bool buy_ampere_export(int index, float ampere, bool allow_less, int number_of_phases);
-    bool buy_ampere(const types::energy::ScheduleReqEntry& _offer, int index, float ampere, bool allow_less,
+    bool buy_ampere(const SlotReq& _offer, int index, float ampere, bool allow_less,
                     bool import, int number_of_phases);
 
     bool buy_watt_import(int index, float watt, bool allow_less);
     bool buy_watt_export(int index, float watt, bool allow_less);
-    bool buy_watt(const types::energy::ScheduleReqEntry& _offer, int index, float watt, bool allow_less, bool import);
+    bool buy_watt(const SlotReq& _offer, int index, float watt, bool allow_less, bool import);
 
-    ScheduleRes trading;
+    SlotsRes trading;
     Offer* offer{nullptr};
     bool traded{false};
 
@@ -4,8 +4,12 @@
 #include "Broker.hpp"
 #include "BrokerFastCharging.hpp"
 #include "Market.hpp"
+#include "WaterFilling.hpp"
+#include <atomic>
+#include <cmath>
 #include <fmt/core.h>
 #include <optional>
+#include <thread>
 
 using namespace std::literals::chrono_literals;
 
@@ -14,15 +18,23 @@ namespace module {
 void EnergyManager::init() {
     r_energy_trunk->subscribe_energy_flow_request([this](types::energy::EnergyFlowRequest e) {
         // Received new energy object from a child.
-        std::scoped_lock lock(energy_mutex);
-        energy_flow_request = e;
+        auto snapshot = std::make_shared<const types::energy::EnergyFlowRequest>(std::move(e));
+        std::atomic_store(&energy_flow_request, snapshot);
 
-        if (is_priority_request(e)) {
+        if (is_priority_request(*snapshot)) {
             // trigger optimization now
             mainloop_sleep_condvar.notify_all();
         }
     });
 
+    r_energy_trunk->subscribe_energy_flow_request_patch([this](types::energy::EnergyFlowRequestPatch p) {
+        // Received the changed part of the tree
+        if (apply_energy_flow_request_patch(p)) {
+            EVLOG_info << "Missed an energy flow request patch of " << p.uuid << ", requesting a snapshot";
+            r_energy_trunk->call_resync_energy_flow_request();
+        }
+    });
+
     invoke_init(*p_main);
 }
 
@@ -32,9 +44,9 @@ void EnergyManager::ready() {
     // start thread to update energy optimization
     std::thread([this] {
         while (true) {
-            globals.init(date::utc_clock::now(), config.schedule_interval_duration, config.schedule_total_duration,
-                         config.slice_ampere, config.slice_watt, config.debug, energy_flow_request);
-            auto optimized_values = run_optimizer(energy_flow_request);
+            // the snapshot stays alive for the whole run even if a new request arrives in the meantime
+            const auto request = energy_flow_request_snapshot();
+            auto optimized_values = run_optimizer(*request, date::utc_clock::now());
             enforce_limits(optimized_values);
             {
                 std::unique_lock<std::mutex> lock(mainloop_sleep_mutex);
@@ -44,6 +56,43 @@ void EnergyManager::ready() {
     }).detach();
 }
 
+// Returns true if a snapshot needs to be requested from the trunk
+bool EnergyManager::apply_energy_flow_request_patch(const types::energy::EnergyFlowRequestPatch& patch) {
+    using Result = everest::staging::energy_flow::PatchSequence::Result;
+
+    std::scoped_lock lock(energy_mutex);
+    const auto result = trunk_patches.check(patch);
+    if (result != Result::Apply) {
+        return result == Result::RequestResync;
+    }
+
+    if (not everest::staging::energy_flow::apply_patch(patched_energy_flow_request, patch)) {
+        trunk_patches.resync_requested(patch.uuid);
+        return true;
+    }
+    patched_energy_flow_request_changed = true;
+
+    if (patch.node.has_value() and is_priority_request(patch.node.value())) {
+        // trigger optimization now
+        mainloop_sleep_condvar.notify_all();
+    }
+    return false;
+}
+
+// Latest complete tree. A tree that is maintained from patches is copied into a new snapshot at most once per
+// optimizer run.
+std::shared_ptr<const types::energy::EnergyFlowRequest> EnergyManager::energy_flow_request_snapshot() {
+    {
+        std::scoped_lock lock(energy_mutex);
+        if (patched_energy_flow_request_changed) {
+            std::atomic_store(&energy_flow_request,
+                              std::make_shared<const types::energy::EnergyFlowRequest>(patched_energy_flow_request));
+            patched_energy_flow_request_changed = false;
+        }
+    }
+    return std::atomic_load(&energy_flow_request);
+}
+
 // Check if any node set the priority request flag
 bool EnergyManager::is_priority_request(const types::energy::EnergyFlowRequest& e) {
     bool prio = e.priority_request.has_value() and e.priority_request.value();
@@ -63,14 +112,95 @@ bool EnergyManager::is_priority_request(const types::energy::EnergyFlowRequest&
     return false;
 }
 
-void EnergyManager::enforce_limits(const std::vector<types::energy::EnforcedLimits>& limits) {
+static bool differs(const std::optional<float>& a, const std::optional<float>& b, double tolerance) {
+    if (a.has_value() != b.has_value()) {
+        return true;
+    }
+    return a.has_value() and std::fabs(a.value() - b.value()) > tolerance;
+}
+
+static bool differs(const types::energy::LimitsRes& a, const types::energy::LimitsRes& b, double tolerance_A,
+                    double tolerance_W) {
+    return a.ac_max_phase_count != b.ac_max_phase_count or
+           differs(a.ac_max_current_A, b.ac_max_current_A, tolerance_A) or
+           differs(a.total_power_W, b.total_power_W, tolerance_W);
+}
+
+static bool differs(const types::energy::EnforcedLimits& a, const types::energy::EnforcedLimits& b, double tolerance_A,
+                    double tolerance_W) {
+    if (a.limits_root_side.has_value() != b.limits_root_side.has_value() or
+        a.schedule.has_value() != b.schedule.has_value()) {
+        return true;
+    }
+
+    if (a.limits_root_side.has_value() and
+        differs(a.limits_root_side.value(), b.limits_root_side.value(), tolerance_A, tolerance_W)) {
+        return true;
+    }
+
+    if (a.schedule.has_value()) {
+        const auto& schedule_a = a.schedule.value();
+        const auto& schedule_b = b.schedule.value();
+        if (schedule_a.size() != schedule_b.size()) {
+            return true;
+        }
+        for (std::size_t i = 0; i < schedule_a.size(); i++) {
+            if (schedule_a[i].timestamp != schedule_b[i].timestamp or
+                differs(schedule_a[i].limits_to_root, schedule_b[i].limits_to_root, tolerance_A, tolerance_W)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Returns the limits that need to be sent: limits of new evses, limits that changed more than the tolerance and
+// limits that were not sent for half of their validity (valid_until is 10 update intervals after the run).
+std::vector<types::energy::EnforcedLimits>
+EnergyManager::select_changed_limits(const std::vector<types::energy::EnforcedLimits>& limits,
+                                     std::chrono::steady_clock::time_point now) {
+    const auto refresh_interval = std::chrono::seconds(config.update_interval * 5);
+
+    std::vector<types::energy::EnforcedLimits> changed_limits;
+    std::map<std::string, SentLimits> sent;
+
+    for (const auto& l : limits) {
+        const auto last = sent_limits.find(l.uuid);
+        if (last == sent_limits.end() or now - last->second.sent_at >= refresh_interval or
+            differs(l, last->second.limits, config.enforce_limits_tolerance_A, config.enforce_limits_tolerance_W)) {
+            changed_limits.push_back(l);
+            sent[l.uuid] = {l, now};
+        } else {
+            sent[l.uuid] = last->second;
+        }
+    }
+
+    // evses that are not part of the tree anymore are forgotten
+    sent_limits = std::move(sent);
+    return changed_limits;
+}
+
+void EnergyManager::enforce_limits(const std::vector<types::energy::EnforcedLimits>& all_limits) {
+    std::vector<types::energy::EnforcedLimits> changed_limits;
+    if (config.enforce_limits_only_changed) {
+        changed_limits = select_changed_limits(all_limits, std::chrono::steady_clock::now());
+    }
+    const auto& limits = config.enforce_limits_only_changed ? changed_limits : all_limits;
+
     for (const auto& it : limits) {
-        if (globals.debug)
+        if (config.debug)
             EVLOG_info << fmt::format("\033[1;92m{} Enforce limits {}A {}W {} ph\033[1;0m", it.uuid,
                                       it.limits_root_side.value().ac_max_current_A.value_or(-9999),
                                       it.limits_root_side.value().total_power_W.value_or(-9999),
                                       it.limits_root_side.value().ac_max_phase_count.value_or(-9999));
-        r_energy_trunk->call_enforce_limits(it);
+        if (not config.enforce_limits_batched) {
+            r_energy_trunk->call_enforce_limits(it);
+        }
+    }
+
+    if (config.enforce_limits_batched and not limits.empty()) {
+        r_energy_trunk->call_enforce_limits_batch(limits);
     }
 }
 
@@ -106,40 +236,40 @@ static BrokerFastCharging::Config to_broker_fast_charging_config(const Conf& mod
     return broker_conf;
 }
 
-std::vector<types::energy::EnforcedLimits> EnergyManager::run_optimizer(types::energy::EnergyFlowRequest request) {
-
-    std::scoped_lock lock(energy_mutex);
+int EnergyManager::trade(const std::vector<Market*>& evse_markets,
+                         std::map<std::string, BrokerContext>& broker_contexts, time_probe& offer_tp,
+                         time_probe& broker_tp) {
+    if (evse_markets.empty()) {
+        return 0;
+    }
 
-    time_probe optimizer_start;
-    optimizer_start.start();
-    if (globals.debug)
-        EVLOG_info << "\033[1;44m---------------- Run energy optimizer ---------------- \033[1;0m";
+    if (config.optimizer_algorithm == "WaterFilling") {
+        // compute a max-min fair allocation for all evses in one pass instead of trading slices
+        broker_tp.start();
+        WaterFilling water_filling(evse_markets.front()->optimizer_context(), evse_markets, broker_contexts,
+                                   to_broker_fast_charging_config(config));
+        water_filling.run();
+        broker_tp.pause();
+        return 0;
+    }
 
-    time_probe market_tp;
+    if (config.parallel_split_depth > 0) {
+        return trade_parallel(evse_markets, broker_contexts, offer_tp, broker_tp);
+    }
 
-    //  create market for trading energy based on the request tree
-    market_tp.start();
-    Market market(request, config.nominal_ac_voltage);
-    market_tp.pause();
+    return trade_brokers(evse_markets, broker_contexts, offer_tp, broker_tp);
+}
 
+int EnergyManager::trade_brokers(const std::vector<Market*>& evse_markets,
+                                 std::map<std::string, BrokerContext>& broker_contexts, time_probe& offer_tp,
+                                 time_probe& broker_tp) {
     // create brokers for all evses (they buy/sell energy on behalf of EvseManagers)
     std::vector<std::shared_ptr<Broker>> brokers;
 
-    auto evse_markets = market.get_list_of_evses();
-
     for (auto m : evse_markets) {
-        // Check if we need to clear the context
-        // Note that context is created here if it does not exist implicitly by operator[] of the map
-        if (m->energy_flow_request.evse_state == types::energy::EvseState::Unplugged or
-            m->energy_flow_request.evse_state == types::energy::EvseState::Finished) {
-            contexts[m->energy_flow_request.uuid].clear();
-            contexts[m->energy_flow_request.uuid].ts_1ph_optimal =
-                globals.start_time - std::chrono::seconds(config.switch_3ph1ph_time_hysteresis_s);
-        }
-
         // FIXME: check for actual optimizer_targets and create correct broker for this evse
         // For now always create simple FastCharging broker
-        brokers.push_back(std::make_shared<BrokerFastCharging>(*m, contexts[m->energy_flow_request.uuid],
+        brokers.push_back(std::make_shared<BrokerFastCharging>(*m, broker_contexts.at(m->energy_flow_request.uuid),
                                                                to_broker_fast_charging_config(config)));
         // EVLOG_info << fmt::format("Created broker for {}", m->energy_flow_request.uuid);
     }
@@ -148,8 +278,6 @@ std::vector<types::energy::EnforcedLimits> EnergyManager::run_optimizer(types::e
     // continue until no one wants to buy/sell anything anymore.
 
     int max_number_of_trading_rounds = 100;
-    time_probe offer_tp;
-    time_probe broker_tp;
 
     while (max_number_of_trading_rounds-- > 0) {
         bool trade_happend_in_this_round = false;
@@ -175,46 +303,381 @@ std::vector<types::energy::EnforcedLimits> EnergyManager::run_optimizer(types::e
         EVLOG_error << "Trading: Maximum number of trading rounds reached.";
     }
 
-    if (globals.debug) {
+    return 100 - max_number_of_trading_rounds;
+}
+
+// Limits of the budget of a subtree in a slot: the budget only needs to limit what the nodes above the subtree root
+// limit, all other limits are applied inside of the subtree anyway.
+static void set_budget_limit(std::optional<float>& budget, const std::optional<float>& upper_limit, float sum) {
+    if (upper_limit.has_value()) {
+        budget = sum;
+    } else {
+        budget.reset();
+    }
+}
+
+static void add_missing_limits(SlotsReq& limits, const SlotsReq& other) {
+    for (std::size_t i = 0; i < limits.size() and i < other.size(); i++) {
+        auto& l = limits[i].limits_to_root;
+        if (not l.ac_max_current_A.has_value()) {
+            l.ac_max_current_A = other[i].limits_to_root.ac_max_current_A;
+        }
+        if (not l.total_power_W.has_value()) {
+            l.total_power_W = other[i].limits_to_root.total_power_W;
+        }
+    }
+}
+
+int EnergyManager::trade_parallel(const std::vector<Market*>& evse_markets,
+                                  std::map<std::string, BrokerContext>& broker_contexts, time_probe& offer_tp,
+                                  time_probe& broker_tp) {
+    // Split the tree at parallel_split_depth. Every EVSE belongs to exactly one subtree: the subtree of its ancestor
+    // at that depth or its own if it is connected above that depth.
+    std::vector<Market*> subtree_roots;
+    std::vector<std::vector<std::size_t>> subtree_evses;
+    for (std::size_t e = 0; e < evse_markets.size(); e++) {
+        std::vector<Market*> path;
+        for (Market* n = evse_markets[e]; n != nullptr; n = n->parent()) {
+            path.push_back(n);
+        }
+
+        Market* subtree_root = evse_markets[e];
+        if (path.size() > static_cast<std::size_t>(config.parallel_split_depth)) {
+            subtree_root = path[path.size() - 1 - config.parallel_split_depth];
+        }
+
+        auto it = std::find(subtree_roots.begin(), subtree_roots.end(), subtree_root);
+        if (it == subtree_roots.end()) {
+            subtree_roots.push_back(subtree_root);
+            subtree_evses.push_back({e});
+        } else {
+            subtree_evses[it - subtree_roots.begin()].push_back(e);
+        }
+    }
+
+    if (subtree_roots.size() < 2) {
+        return trade_brokers(evse_markets, broker_contexts, offer_tp, broker_tp);
+    }
+
+    // Fixed budget per subtree: the max-min fair share of all EVSEs in the subtree, so that the subtrees can be solved
+    // independently of each other without exceeding the limits above them.
+    broker_tp.start();
+    const auto& optimizer_context = evse_markets.front()->optimizer_context();
+    WaterFilling water_filling(optimizer_context, evse_markets, broker_contexts,
+                               to_broker_fast_charging_config(config));
+    water_filling.allocate();
+
+    for (std::size_t s = 0; s < subtree_roots.size(); s++) {
+        Market* subtree_root = subtree_roots[s];
+        SlotsReq budget_import = optimizer_context.empty_schedule_req;
+        SlotsReq budget_export = optimizer_context.empty_schedule_req;
+
+        if (not subtree_root->is_root()) {
+            SlotsReq upper_import = optimizer_context.empty_schedule_req;
+            SlotsReq upper_export = optimizer_context.empty_schedule_req;
+            for (Market* n = subtree_root->parent(); n != nullptr; n = n->parent()) {
+                add_missing_limits(upper_import, n->get_available_energy_import());
+                add_missing_limits(upper_export, n->get_available_energy_export());
+            }
+
+            for (std::size_t i = 0; i < budget_import.size(); i++) {
+                float import_A = 0., import_W = 0., export_A = 0., export_W = 0.;
+                for (auto e : subtree_evses[s]) {
+                    const auto& limits = water_filling.get_allocation(e)[i].limits_to_root;
+                    import_A += std::max(0.F, limits.ac_max_current_A.value_or(0.));
+                    import_W += std::max(0.F, limits.total_power_W.value_or(0.));
+                    export_A += std::max(0.F, -limits.ac_max_current_A.value_or(0.));
+                    export_W += std::max(0.F, -limits.total_power_W.value_or(0.));
+                }
+                set_budget_limit(budget_import[i].limits_to_root.ac_max_current_A,
+                                 upper_import[i].limits_to_root.ac_max_current_A, import_A);
+                set_budget_limit(budget_import[i].limits_to_root.total_power_W,
+                                 upper_import[i].limits_to_root.total_power_W, import_W);
+                set_budget_limit(budget_export[i].limits_to_root.ac_max_current_A,
+                                 upper_export[i].limits_to_root.ac_max_current_A, export_A);
+                set_budget_limit(budget_export[i].limits_to_root.total_power_W,
+                                 upper_export[i].limits_to_root.total_power_W, export_W);
+            }
+        }
+
+        subtree_root->detach(budget_import, budget_export);
+    }
+
+    // Solve the subtrees concurrently. Each worker only touches the markets of the subtree it is working on, the
+    // broker contexts of all EVSEs already exist and are only looked up.
+    std::atomic<std::size_t> next_subtree{0};
+    std::vector<int> number_of_trading_rounds(subtree_roots.size(), 0);
+
+    auto worker = [&]() {
+        time_probe worker_offer_tp;
+        time_probe worker_broker_tp;
+        for (std::size_t s = next_subtree++; s < subtree_roots.size(); s = next_subtree++) {
+            std::vector<Market*> markets;
+            for (auto e : subtree_evses[s]) {
+                markets.push_back(evse_markets[e]);
+            }
+            number_of_trading_rounds[s] = trade_brokers(markets, broker_contexts, worker_offer_tp, worker_broker_tp);
+        }
+    };
+
+    std::size_t number_of_workers =
+        std::min(static_cast<std::size_t>(std::max(config.parallel_worker_threads, 1)), subtree_roots.size());
+    std::vector<std::thread> workers;
+    for (std::size_t w = 1; w < number_of_workers; w++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    // Merge: propagate the energy sold in each subtree to the nodes above it
+    for (auto subtree_root : subtree_roots) {
+        subtree_root->attach();
+        if (not subtree_root->is_root()) {
+            subtree_root->parent()->trade(subtree_root->get_sold_energy());
+        }
+    }
+    broker_tp.pause();
+
+    if (optimizer_context.debug) {
+        EVLOG_info << fmt::format("Parallel optimization: {} subtrees on {} workers", subtree_roots.size(),
+                                  number_of_workers);
+    }
+
+    return *std::max_element(number_of_trading_rounds.begin(), number_of_trading_rounds.end());
+}
+
+static void add_request_fingerprints(const types::energy::EnergyFlowRequest& request,
+                                     std::map<std::string, std::size_t>& fingerprints) {
+    fingerprints[request.uuid] = request_fingerprint(request);
+    for (const auto& child : request.children) {
+        add_request_fingerprints(child, fingerprints);
+    }
+}
+
+// An evse needs to trade again if its own request or the request of any node on its path to the root changed
+bool EnergyManager::needs_trading(const OptimizerCache& cache, Market* evse_market,
+                                  const std::map<std::string, std::size_t>& fingerprints) {
+    if (cache.sold_energy.count(evse_market->energy_flow_request.uuid) == 0) {
+        return true;
+    }
+
+    for (Market* m = evse_market; m != nullptr; m = m->parent()) {
+        const auto& uuid = m->energy_flow_request.uuid;
+        const auto cached = cache.fingerprints.find(uuid);
+        if (cached == cache.fingerprints.end() or cached->second != fingerprints.at(uuid)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Returns true if a schedule contains less energy than before in any time slot
+static bool sold_less_energy(const SlotsRes& now, const SlotsRes& before) {
+    constexpr float epsilon = 0.01;
+
+    if (now.size() != before.size()) {
+        return true;
+    }
+
+    for (SlotsRes::size_type i = 0; i < now.size(); i++) {
+        const auto& a = now[i].limits_to_root;
+        const auto& b = before[i].limits_to_root;
+        if (std::fabs(a.ac_max_current_A.value_or(0)) + epsilon < std::fabs(b.ac_max_current_A.value_or(0)) or
+            std::fabs(a.total_power_W.value_or(0)) + epsilon < std::fabs(b.total_power_W.value_or(0))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<types::energy::EnforcedLimits>
+EnergyManager::run_optimizer(const types::energy::EnergyFlowRequest& request, date::utc_clock::time_point start_time) {
+    std::scoped_lock lock(optimizer_mutex);
+
+    const OptimizerContext optimizer_context(start_time, config.schedule_interval_duration,
+                                             config.schedule_total_duration, config.slice_ampere, config.slice_watt,
+                                             config.debug, request);
+    auto optimized_values = optimize(request, optimizer_context, contexts, &optimizer_cache);
+
+    {
+        std::scoped_lock contexts_lock(contexts_snapshot_mutex);
+        contexts_snapshot = contexts;
+    }
+
+    return optimized_values;
+}
+
+std::vector<types::energy::EnforcedLimits> EnergyManager::simulate(const types::energy::EnergyFlowRequest& request) {
+    // Runs next to the live optimization: start from the broker contexts of its last run, but never modify them and
+    // always optimize the complete tree.
+    std::map<std::string, BrokerContext> simulation_contexts;
+    {
+        std::scoped_lock contexts_lock(contexts_snapshot_mutex);
+        simulation_contexts = contexts_snapshot;
+    }
+
+    const OptimizerContext optimizer_context(date::utc_clock::now(), config.schedule_interval_duration,
+                                             config.schedule_total_duration, config.slice_ampere, config.slice_watt,
+                                             config.debug, request);
+    return optimize(request, optimizer_context, simulation_contexts, nullptr);
+}
+
+std::vector<types::energy::EnforcedLimits>
+EnergyManager::optimize(const types::energy::EnergyFlowRequest& request, const OptimizerContext& optimizer_context,
+                        std::map<std::string, BrokerContext>& broker_contexts, OptimizerCache* cache) {
+    time_probe optimizer_start;
+    optimizer_start.start();
+    if (optimizer_context.debug)
+        EVLOG_info << "\033[1;44m---------------- Run energy optimizer ---------------- \033[1;0m";
+
+    time_probe market_tp;
+
+    //  create market for trading energy based on the request tree
+    market_tp.start();
+    auto market = std::make_unique<Market>(optimizer_context, request, config.nominal_ac_voltage);
+    market_tp.pause();
+
+    auto evse_markets = market->get_list_of_evses();
+
+    for (auto m : evse_markets) {
+        // Check if we need to clear the context
+        // Note that context is created here if it does not exist implicitly by operator[] of the map. Trading only
+        // looks contexts up, so that it can run on several threads.
+        broker_contexts[m->energy_flow_request.uuid];
+        if (m->energy_flow_request.evse_state == types::energy::EvseState::Unplugged or
+            m->energy_flow_request.evse_state == types::energy::EvseState::Finished) {
+            broker_contexts[m->energy_flow_request.uuid].clear();
+            broker_contexts[m->energy_flow_request.uuid].ts_1ph_optimal =
+                optimizer_context.start_time - std::chrono::seconds(config.switch_3ph1ph_time_hysteresis_s);
+        }
+    }
+
+    int number_of_trading_rounds = 0;
+    time_probe offer_tp;
+    time_probe broker_tp;
+
+    const bool incremental_optimization_enabled = cache != nullptr and config.full_optimization_interval > 1;
+    bool full_optimization = true;
+
+    std::map<std::string, std::size_t> fingerprints;
+    if (incremental_optimization_enabled) {
+        add_request_fingerprints(request, fingerprints);
+    }
+
+    if (incremental_optimization_enabled and not cache->fingerprints.empty() and
+        cache->runs_since_full_optimization + 1 < config.full_optimization_interval and
+        cache->timestamps == optimizer_context.timestamps) {
+        // Only evses with a changed request somewhere on their path trade again. All others keep the energy they
+        // bought in the last run.
+        std::vector<Market*> dirty_evse_markets;
+        std::size_t number_of_known_evses = 0;
+
+        for (auto m : evse_markets) {
+            const auto cached = cache->sold_energy.find(m->energy_flow_request.uuid);
+            if (cached != cache->sold_energy.end()) {
+                number_of_known_evses++;
+            }
+
+            if (needs_trading(*cache, m, fingerprints)) {
+                dirty_evse_markets.push_back(m);
+            } else {
+                m->trade(cached->second);
+            }
+        }
+
+        number_of_trading_rounds = trade(dirty_evse_markets, broker_contexts, offer_tp, broker_tp);
+
+        // If energy became available (an evse was removed or bought less than before), the other evses may want to
+        // use it, so we need to optimize the complete tree.
+        full_optimization = number_of_known_evses != cache->sold_energy.size();
+        for (auto m : dirty_evse_markets) {
+            if (full_optimization) {
+                break;
+            }
+            const auto cached = cache->sold_energy.find(m->energy_flow_request.uuid);
+            if (cached != cache->sold_energy.end()) {
+                full_optimization = sold_less_energy(m->get_sold_energy(), cached->second);
+            }
+        }
+
+        if (full_optimization) {
+            market_tp.start();
+            market = std::make_unique<Market>(optimizer_context, request, config.nominal_ac_voltage);
+            market_tp.pause();
+            evse_markets = market->get_list_of_evses();
+        } else {
+            cache->runs_since_full_optimization++;
+            for (auto m : dirty_evse_markets) {
+                cache->sold_energy[m->energy_flow_request.uuid] = m->get_sold_energy();
+            }
+
+            if (optimizer_context.debug) {
+                EVLOG_info << fmt::format("Incremental optimization: {} of {} evses traded", dirty_evse_markets.size(),
+                                          evse_markets.size());
+            }
+        }
+    }
+
+    if (full_optimization) {
+        number_of_trading_rounds = trade(evse_markets, broker_contexts, offer_tp, broker_tp);
+
+        if (incremental_optimization_enabled) {
+            cache->runs_since_full_optimization = 0;
+            cache->sold_energy.clear();
+            for (auto m : evse_markets) {
+                cache->sold_energy[m->energy_flow_request.uuid] = m->get_sold_energy();
+            }
+        }
+    }
+
+    if (incremental_optimization_enabled) {
+        cache->timestamps = optimizer_context.timestamps;
+        cache->fingerprints = std::move(fingerprints);
+    }
+
+    if (optimizer_context.debug) {
         EVLOG_info << fmt::format("\033[1;44m---------------- End energy optimizer ({} rounds, offer {}ms market {}ms "
                                   "broker {}ms total {}ms) ---------------- \033[1;0m",
-                                  100 - max_number_of_trading_rounds, offer_tp.stop(), market_tp.stop(),
-                                  broker_tp.stop(), optimizer_start.stop());
+                                  number_of_trading_rounds, offer_tp.stop(), market_tp.stop(), broker_tp.stop(),
+                                  optimizer_start.stop());
     }
 
     std::vector<types::energy::EnforcedLimits> optimized_values;
-    optimized_values.reserve(brokers.size());
+    optimized_values.reserve(evse_markets.size());
 
-    for (auto& broker : brokers) {
-        auto& local_market = broker->get_local_market();
-        const auto sold_energy = local_market.get_sold_energy();
+    for (auto m : evse_markets) {
+        auto& local_market = *m;
+        const auto& sold_energy = local_market.get_sold_energy();
 
         if (sold_energy.size() > 0) {
 
             types::energy::EnforcedLimits l;
             l.uuid = local_market.energy_flow_request.uuid;
-            l.valid_until =
-                Everest::Date::to_rfc3339(globals.start_time + std::chrono::seconds(config.update_interval * 10));
+            l.valid_until = Everest::Date::to_rfc3339(optimizer_context.start_time +
+                                                      std::chrono::seconds(config.update_interval * 10));
 
-            l.schedule = sold_energy;
+            l.schedule = optimizer_context.to_schedule_res(sold_energy);
 
-            // select root limit from schedule based on globals.start_time
+            // select root limit from schedule based on the start time of this run
             l.limits_root_side = sold_energy[0].limits_to_root;
 
-            for (const auto& s : sold_energy) {
-                const auto schedule_time = Everest::Date::from_rfc3339(s.timestamp);
-                if (globals.start_time < schedule_time) {
+            for (std::size_t i = 0; i < sold_energy.size(); i++) {
+                if (optimizer_context.start_time < optimizer_context.timestamps[i]) {
                     // all further schedules will be further into the future
                     break;
                 } else {
                     // use this schedule as the starting point
-                    l.limits_root_side = s.limits_to_root;
+                    l.limits_root_side = sold_energy[i].limits_to_root;
                 }
             }
 
             optimized_values.push_back(l);
 
-            if (globals.debug && l.limits_root_side.has_value()) {
+            if (optimizer_context.debug && l.limits_root_side.has_value()) {
                 EVLOG_info << "Sending enforced limits (import) to :" << l.uuid << " " << l.limits_root_side.value();
             }
         }
@@ -23,10 +23,24 @@
 #include <date/tz.h>
 #include <utils/date.hpp>
 
+#include <everest/staging/energy_flow/patch.hpp>
+#include <memory>
 #include <mutex>
 
 #include "Broker.hpp"
 
+#if defined(BUILD_TESTING_MODULE_ENERGY_MANAGER) || defined(BUILD_BENCHMARK_MODULE_ENERGY_MANAGER)
+namespace module {
+class EnergyManager;
+}
+namespace module::test {
+// used by the tests and the benchmarks, does not need gtest
+std::vector<types::energy::EnforcedLimits> run_optimizer(EnergyManager& manager,
+                                                         const types::energy::EnergyFlowRequest& request,
+                                                         date::utc_clock::time_point start_time);
+}
+#endif
+
 #ifdef BUILD_TESTING_MODULE_ENERGY_MANAGER
 #include <gtest/gtest_prod.h>
 namespace module::test {
@@ -52,6 +66,14 @@ struct Conf {
     std::string switch_3ph1ph_switch_limit_stickyness;
     int switch_3ph1ph_power_hysteresis_W;
     int switch_3ph1ph_time_hysteresis_s;
+    std::string optimizer_algorithm;
+    int full_optimization_interval;
+    int parallel_split_depth;
+    int parallel_worker_threads;
+    bool enforce_limits_only_changed;
+    double enforce_limits_tolerance_A;
+    double enforce_limits_tolerance_W;
+    bool enforce_limits_batched;
 };
 
 class EnergyManager : public Everest::ModuleBase {
@@ -67,6 +89,9 @@ public:
 
     // ev@1fce4c5e-0ab8-41bb-90f7-14277703d2ac:v1
     // insert your public definitions here
+    // Optimizes a hypothetical request tree without enforcing the result. Can run concurrently with the live
+    // optimization.
+    std::vector<types::energy::EnforcedLimits> simulate(const types::energy::EnergyFlowRequest& request);
     // ev@1fce4c5e-0ab8-41bb-90f7-14277703d2ac:v1
 
 protected:
@@ -82,25 +107,89 @@ private:
     // ev@211cfdbe-f69a-4cd6-a4ec-f8aaa3d1b6c8:v1
     // insert your private definitions here
     bool is_priority_request(const types::energy::EnergyFlowRequest& e);
+    // serializes live optimizer runs, which share the broker contexts and the optimizer cache
+    std::mutex optimizer_mutex;
+
+    // latest complete energy tree request. Snapshots are immutable and replaced with std::atomic_store, so the
+    // optimizer can work on a snapshot without copying it or blocking the subscription.
+    std::shared_ptr<const types::energy::EnergyFlowRequest> energy_flow_request{
+        std::make_shared<const types::energy::EnergyFlowRequest>()};
+
+    // Tree maintained from energy_flow_request_patch messages if the trunk publishes patches. Patches are applied in
+    // place, a new snapshot is only copied from it when the optimizer runs.
     std::mutex energy_mutex;
+    types::energy::EnergyFlowRequest patched_energy_flow_request;
+    bool patched_energy_flow_request_changed{false};
+    everest::staging::energy_flow::PatchSequence trunk_patches;
 
-    // complete energy tree requests
-    types::energy::EnergyFlowRequest energy_flow_request;
+    bool apply_energy_flow_request_patch(const types::energy::EnergyFlowRequestPatch& patch);
+    std::shared_ptr<const types::energy::EnergyFlowRequest> energy_flow_request_snapshot();
 
     void enforce_limits(const std::vector<types::energy::EnforcedLimits>& limits);
-    std::vector<types::energy::EnforcedLimits> run_optimizer(types::energy::EnergyFlowRequest request);
+    std::vector<types::energy::EnforcedLimits>
+    select_changed_limits(const std::vector<types::energy::EnforcedLimits>& limits,
+                          std::chrono::steady_clock::time_point now);
+
+    // Limits that were sent last per evse uuid, used to only send changed limits
+    struct SentLimits {
+        types::energy::EnforcedLimits limits;
+        std::chrono::steady_clock::time_point sent_at;
+    };
+    std::map<std::string, SentLimits> sent_limits;
+    // Result of the previous optimizer run, used for incremental optimization
+    struct OptimizerCache {
+        std::vector<date::utc_clock::time_point> timestamps;
+        std::map<std::string, std::size_t> fingerprints; // request fingerprint per node uuid
+        std::map<std::string, SlotsRes> sold_energy;     // sold energy per evse uuid
+        int runs_since_full_optimization{0};
+    };
+    OptimizerCache optimizer_cache;
+
+    // live optimization
+    std::vector<types::energy::EnforcedLimits> run_optimizer(const types::energy::EnergyFlowRequest& request,
+                                                             date::utc_clock::time_point start_time);
+    // one optimizer run with its own context. Incremental optimization is only used if a cache is given.
+    std::vector<types::energy::EnforcedLimits> optimize(const types::energy::EnergyFlowRequest& request,
+                                                        const OptimizerContext& optimizer_context,
+                                                        std::map<std::string, BrokerContext>& broker_contexts,
+                                                        OptimizerCache* cache);
+    int trade(const std::vector<Market*>& evse_markets, std::map<std::string, BrokerContext>& broker_contexts,
+              time_probe& offer_tp, time_probe& broker_tp);
+    int trade_brokers(const std::vector<Market*>& evse_markets, std::map<std::string, BrokerContext>& broker_contexts,
+                      time_probe& offer_tp, time_probe& broker_tp);
+    int trade_parallel(const std::vector<Market*>& evse_markets, std::map<std::string, BrokerContext>& broker_contexts,
+                       time_probe& offer_tp, time_probe& broker_tp);
+    bool needs_trading(const OptimizerCache& cache, Market* evse_market,
+                       const std::map<std::string, std::size_t>& fingerprints);
 
     std::condition_variable mainloop_sleep_condvar;
     std::mutex mainloop_sleep_mutex;
 
     std::map<std::string, BrokerContext> contexts;
 
+    // copy of the broker contexts after the last live optimization, used as starting point for simulations
+    std::map<std::string, BrokerContext> contexts_snapshot;
+    std::mutex contexts_snapshot_mutex;
+
 #ifdef BUILD_TESTING_MODULE_ENERGY_MANAGER
     FRIEND_TEST(EnergyManagerTest, empty);
     FRIEND_TEST(EnergyManagerTest, noSchedules);
     FRIEND_TEST(EnergyManagerTest, schedules);
+    FRIEND_TEST(EnergyManagerTest, waterFillingGcp);
+    FRIEND_TEST(EnergyManagerTest, waterFillingFairShare);
+    FRIEND_TEST(EnergyManagerTest, waterFillingMinCurrent);
+    FRIEND_TEST(EnergyManagerTest, incrementalOptimization);
+    FRIEND_TEST(EnergyManagerTest, parallelOptimization);
+    FRIEND_TEST(EnergyManagerTest, simulate);
+    FRIEND_TEST(EnergyManagerTest, enforceOnlyChangedLimits);
+    FRIEND_TEST(EnergyManagerTest, energyFlowRequestPatches);
     friend void test::schedule_test(const types::energy::EnergyFlowRequest& energy_flow_request,
                                     const std::string& start_time_str, float expected_limit);
+#endif
+#if defined(BUILD_TESTING_MODULE_ENERGY_MANAGER) || defined(BUILD_BENCHMARK_MODULE_ENERGY_MANAGER)
+    friend std::vector<types::energy::EnforcedLimits>
+    test::run_optimizer(EnergyManager& manager, const types::energy::EnergyFlowRequest& request,
+                        date::utc_clock::time_point start_time);
 #endif
     // ev@211cfdbe-f69a-4cd6-a4ec-f8aaa3d1b6c8:v1
 };
@@ -0,0 +1,388 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include "LimitArrays.hpp"
+#include <everest/logging.hpp>
+
+#if defined(__x86_64__) and (defined(__GNUC__) or defined(__clang__))
+#define LIMIT_ARRAYS_AVX2
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define LIMIT_ARRAYS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace module {
+
+// All kernels work on blocks of 8 slots. Every block has one byte in the bitmask, bit j is set if slot j of the block
+// has a value. Results of the SIMD paths are identical to the scalar ones, including the handling of equal values.
+
+namespace {
+
+constexpr std::size_t block_size = 8;
+
+inline bool is_set(const std::uint8_t* valid, std::size_t i) {
+    return (valid[i / block_size] >> (i % block_size)) & 1;
+}
+
+// scalar fallback, written without branches on the data so that the compiler can vectorize it as well
+
+void min_scalar(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        const float m = b[i] < a[i] ? b[i] : a[i];
+        a[i] = is_set(vb, i) ? (is_set(va, i) ? m : b[i]) : a[i];
+    }
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        va[k] |= vb[k];
+    }
+}
+
+void max_scalar(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        const float m = b[i] > a[i] ? b[i] : a[i];
+        a[i] = is_set(vb, i) ? (is_set(va, i) ? m : b[i]) : a[i];
+    }
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        va[k] |= vb[k];
+    }
+}
+
+void add_scalar(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        const float sum = b[i] + (is_set(va, i) ? a[i] : 0.F);
+        a[i] = is_set(vb, i) ? sum : a[i];
+    }
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        va[k] |= vb[k];
+    }
+}
+
+void add_negative_part_scalar(float* a, const std::uint8_t* va, const float* b, const std::uint8_t* vb, float sign,
+                              std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        const float s = sign * (is_set(vb, i) ? b[i] : 0.F);
+        const float d = s > 0.F ? 0.F : s;
+        a[i] = is_set(va, i) ? a[i] + d : a[i];
+    }
+}
+
+#ifdef LIMIT_ARRAYS_AVX2
+
+// The module is built for the baseline x86-64 instruction set, so the AVX2 kernels are compiled for AVX2 only and
+// selected at runtime.
+bool cpu_supports_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+__attribute__((target("avx2"))) inline __m256 lane_mask(std::uint8_t bits) {
+    const __m256i bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), bit), bit));
+}
+
+__attribute__((target("avx2"))) void min_avx2(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb,
+                                              std::size_t n) {
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        const __m256 x = _mm256_loadu_ps(a + k * block_size);
+        const __m256 y = _mm256_loadu_ps(b + k * block_size);
+        // _mm256_min_ps(y, x) is y < x ? y : x
+        __m256 r = _mm256_blendv_ps(y, _mm256_min_ps(y, x), lane_mask(va[k]));
+        r = _mm256_blendv_ps(x, r, lane_mask(vb[k]));
+        _mm256_storeu_ps(a + k * block_size, r);
+        va[k] |= vb[k];
+    }
+}
+
+__attribute__((target("avx2"))) void max_avx2(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb,
+                                              std::size_t n) {
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        const __m256 x = _mm256_loadu_ps(a + k * block_size);
+        const __m256 y = _mm256_loadu_ps(b + k * block_size);
+        __m256 r = _mm256_blendv_ps(y, _mm256_max_ps(y, x), lane_mask(va[k]));
+        r = _mm256_blendv_ps(x, r, lane_mask(vb[k]));
+        _mm256_storeu_ps(a + k * block_size, r);
+        va[k] |= vb[k];
+    }
+}
+
+__attribute__((target("avx2"))) void add_avx2(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb,
+                                              std::size_t n) {
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        const __m256 x = _mm256_loadu_ps(a + k * block_size);
+        const __m256 y = _mm256_loadu_ps(b + k * block_size);
+        const __m256 r = _mm256_add_ps(y, _mm256_and_ps(x, lane_mask(va[k])));
+        _mm256_storeu_ps(a + k * block_size, _mm256_blendv_ps(x, r, lane_mask(vb[k])));
+        va[k] |= vb[k];
+    }
+}
+
+__attribute__((target("avx2"))) void add_negative_part_avx2(float* a, const std::uint8_t* va, const float* b,
+                                                            const std::uint8_t* vb, float sign, std::size_t n) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 factor = _mm256_set1_ps(sign);
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        const __m256 x = _mm256_loadu_ps(a + k * block_size);
+        const __m256 y = _mm256_loadu_ps(b + k * block_size);
+        const __m256 s = _mm256_mul_ps(factor, _mm256_and_ps(y, lane_mask(vb[k])));
+        // _mm256_min_ps(zero, s) is 0 < s ? 0 : s
+        const __m256 r = _mm256_add_ps(x, _mm256_min_ps(zero, s));
+        _mm256_storeu_ps(a + k * block_size, _mm256_blendv_ps(x, r, lane_mask(va[k])));
+    }
+}
+
+#endif
+
+#ifdef LIMIT_ARRAYS_NEON
+
+// NEON registers hold 4 floats, so every block of 8 slots is processed in two halves
+inline uint32x4_t lane_mask(std::uint8_t bits, std::size_t half) {
+    const uint32_t bit_values[4] = {1, 2, 4, 8};
+    return vtstq_u32(vdupq_n_u32(bits >> (half * 4)), vld1q_u32(bit_values));
+}
+
+void min_neon(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+    for (std::size_t i = 0; i < n; i += 4) {
+        const std::size_t k = i / block_size, half = (i % block_size) / 4;
+        const float32x4_t x = vld1q_f32(a + i);
+        const float32x4_t y = vld1q_f32(b + i);
+        const float32x4_t m = vbslq_f32(vcltq_f32(y, x), y, x);
+        const float32x4_t r = vbslq_f32(lane_mask(va[k], half), m, y);
+        vst1q_f32(a + i, vbslq_f32(lane_mask(vb[k], half), r, x));
+    }
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        va[k] |= vb[k];
+    }
+}
+
+void max_neon(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+    for (std::size_t i = 0; i < n; i += 4) {
+        const std::size_t k = i / block_size, half = (i % block_size) / 4;
+        const float32x4_t x = vld1q_f32(a + i);
+        const float32x4_t y = vld1q_f32(b + i);
+        const float32x4_t m = vbslq_f32(vcgtq_f32(y, x), y, x);
+        const float32x4_t r = vbslq_f32(lane_mask(va[k], half), m, y);
+        vst1q_f32(a + i, vbslq_f32(lane_mask(vb[k], half), r, x));
+    }
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        va[k] |= vb[k];
+    }
+}
+
+void add_neon(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+    const float32x4_t zero = vdupq_n_f32(0.F);
+    for (std::size_t i = 0; i < n; i += 4) {
+        const std::size_t k = i / block_size, half = (i % block_size) / 4;
+        const float32x4_t x = vld1q_f32(a + i);
+        const float32x4_t y = vld1q_f32(b + i);
+        const float32x4_t r = vaddq_f32(y, vbslq_f32(lane_mask(va[k], half), x, zero));
+        vst1q_f32(a + i, vbslq_f32(lane_mask(vb[k], half), r, x));
+    }
+    for (std::size_t k = 0; k < n / block_size; k++) {
+        va[k] |= vb[k];
+    }
+}
+
+void add_negative_part_neon(float* a, const std::uint8_t* va, const float* b, const std::uint8_t* vb, float sign,
+                            std::size_t n) {
+    const float32x4_t zero = vdupq_n_f32(0.F);
+    for (std::size_t i = 0; i < n; i += 4) {
+        const std::size_t k = i / block_size, half = (i % block_size) / 4;
+        const float32x4_t x = vld1q_f32(a + i);
+        const float32x4_t y = vld1q_f32(b + i);
+        const float32x4_t s = vmulq_n_f32(vbslq_f32(lane_mask(vb[k], half), y, zero), sign);
+        const float32x4_t d = vbslq_f32(vcgtq_f32(s, zero), zero, s);
+        vst1q_f32(a + i, vbslq_f32(lane_mask(va[k], half), vaddq_f32(x, d), x));
+    }
+}
+
+#endif
+
+void min_kernel(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+#if defined(LIMIT_ARRAYS_AVX2)
+    if (cpu_supports_avx2()) {
+        min_avx2(a, va, b, vb, n);
+        return;
+    }
+#elif defined(LIMIT_ARRAYS_NEON)
+    min_neon(a, va, b, vb, n);
+    return;
+#endif
+    min_scalar(a, va, b, vb, n);
+}
+
+void max_kernel(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+#if defined(LIMIT_ARRAYS_AVX2)
+    if (cpu_supports_avx2()) {
+        max_avx2(a, va, b, vb, n);
+        return;
+    }
+#elif defined(LIMIT_ARRAYS_NEON)
+    max_neon(a, va, b, vb, n);
+    return;
+#endif
+    max_scalar(a, va, b, vb, n);
+}
+
+void add_kernel(float* a, std::uint8_t* va, const float* b, const std::uint8_t* vb, std::size_t n) {
+#if defined(LIMIT_ARRAYS_AVX2)
+    if (cpu_supports_avx2()) {
+        add_avx2(a, va, b, vb, n);
+        return;
+    }
+#elif defined(LIMIT_ARRAYS_NEON)
+    add_neon(a, va, b, vb, n);
+    return;
+#endif
+    add_scalar(a, va, b, vb, n);
+}
+
+void add_negative_part_kernel(float* a, const std::uint8_t* va, const float* b, const std::uint8_t* vb, float sign,
+                              std::size_t n) {
+#if defined(LIMIT_ARRAYS_AVX2)
+    if (cpu_supports_avx2()) {
+        add_negative_part_avx2(a, va, b, vb, sign, n);
+        return;
+    }
+#elif defined(LIMIT_ARRAYS_NEON)
+    add_negative_part_neon(a, va, b, vb, sign, n);
+    return;
+#endif
+    add_negative_part_scalar(a, va, b, vb, sign, n);
+}
+
+template <typename T> std::optional<float> to_float(const std::optional<T>& v) {
+    if (v.has_value()) {
+        return static_cast<float>(v.value());
+    }
+    return std::nullopt;
+}
+
+template <typename T> std::optional<T> from_float(const std::optional<float>& v) {
+    if (v.has_value()) {
+        return static_cast<T>(v.value());
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+LimitArrays::LimitArrays(std::size_t _length) :
+    length(_length),
+    stride((_length + block_size - 1) / block_size * block_size),
+    values(NumberOfLimits * stride, 0.F),
+    valid(NumberOfLimits * stride / block_size, 0) {
+}
+
+std::size_t LimitArrays::size() const {
+    return length;
+}
+
+float* LimitArrays::values_of(Limit limit) {
+    return values.data() + limit * stride;
+}
+
+const float* LimitArrays::values_of(Limit limit) const {
+    return values.data() + limit * stride;
+}
+
+std::uint8_t* LimitArrays::valid_of(Limit limit) {
+    return valid.data() + limit * stride / block_size;
+}
+
+const std::uint8_t* LimitArrays::valid_of(Limit limit) const {
+    return valid.data() + limit * stride / block_size;
+}
+
+void LimitArrays::set(Limit limit, std::size_t i, const std::optional<float>& value) {
+    const std::uint8_t bit = 1 << (i % block_size);
+    if (value.has_value()) {
+        values_of(limit)[i] = value.value();
+        valid_of(limit)[i / block_size] |= bit;
+    } else {
+        values_of(limit)[i] = 0.F;
+        valid_of(limit)[i / block_size] &= ~bit;
+    }
+}
+
+std::optional<float> LimitArrays::get(Limit limit, std::size_t i) const {
+    if (is_set(valid_of(limit), i)) {
+        return values_of(limit)[i];
+    }
+    return std::nullopt;
+}
+
+bool LimitArrays::is_zero(Limit limit) const {
+    const float* v = values_of(limit);
+    const std::uint8_t* va = valid_of(limit);
+    for (std::size_t i = 0; i < length; i++) {
+        if (is_set(va, i) and v[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LimitArrays::set(std::size_t i, const types::energy::LimitsReq& limits) {
+    set(MaxCurrent, i, limits.ac_max_current_A);
+    set(MinCurrent, i, limits.ac_min_current_A);
+    set(TotalPower, i, limits.total_power_W);
+    set(MaxPhaseCount, i, to_float(limits.ac_max_phase_count));
+    set(MinPhaseCount, i, to_float(limits.ac_min_phase_count));
+}
+
+void LimitArrays::set(std::size_t i, const types::energy::LimitsRes& limits) {
+    set(MaxCurrent, i, limits.ac_max_current_A);
+    set(MinCurrent, i, std::nullopt);
+    set(TotalPower, i, limits.total_power_W);
+    set(MaxPhaseCount, i, to_float(limits.ac_max_phase_count));
+    set(MinPhaseCount, i, std::nullopt);
+}
+
+void LimitArrays::get(std::size_t i, types::energy::LimitsReq& limits) const {
+    limits.ac_max_current_A = get(MaxCurrent, i);
+    limits.ac_min_current_A = get(MinCurrent, i);
+    limits.total_power_W = get(TotalPower, i);
+    limits.ac_max_phase_count = from_float<int32_t>(get(MaxPhaseCount, i));
+    limits.ac_min_phase_count = from_float<int32_t>(get(MinPhaseCount, i));
+}
+
+void LimitArrays::get(std::size_t i, types::energy::LimitsRes& limits) const {
+    limits.ac_max_current_A = get(MaxCurrent, i);
+    limits.total_power_W = get(TotalPower, i);
+    limits.ac_max_phase_count = from_float<int32_t>(get(MaxPhaseCount, i));
+}
+
+bool LimitArrays::same_size(const LimitArrays& other) const {
+    if (length != other.length) {
+        EVLOG_error << "LimitArrays: schedules are not of the same size: " << length << " and " << other.length;
+        return false;
+    }
+    return true;
+}
+
+void LimitArrays::limit_min(Limit limit, const LimitArrays& other) {
+    if (same_size(other)) {
+        min_kernel(values_of(limit), valid_of(limit), other.values_of(limit), other.valid_of(limit), stride);
+    }
+}
+
+void LimitArrays::limit_max(Limit limit, const LimitArrays& other) {
+    if (same_size(other)) {
+        max_kernel(values_of(limit), valid_of(limit), other.values_of(limit), other.valid_of(limit), stride);
+    }
+}
+
+void LimitArrays::add(Limit limit, const LimitArrays& other) {
+    if (same_size(other)) {
+        add_kernel(values_of(limit), valid_of(limit), other.values_of(limit), other.valid_of(limit), stride);
+    }
+}
+
+void LimitArrays::add_negative_part(Limit limit, const LimitArrays& other, float sign) {
+    if (same_size(other)) {
+        add_negative_part_kernel(values_of(limit), valid_of(limit), other.values_of(limit), other.valid_of(limit),
+                                 sign, stride);
+    }
+}
+
+} // namespace module
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef LIMIT_ARRAYS_HPP
+#define LIMIT_ARRAYS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <generated/interfaces/energy/Interface.hpp>
+#include <optional>
+#include <vector>
+
+namespace module {
+
+// Structure of arrays representation of the root side limits of a schedule: one float array per limit and a bitmask
+// that tells which entries are set. The Market uses it in its hot loops (available energy, path limits, trades)
+// instead of the std::optional fields of the schedule entries, so that all slots can be merged with SIMD instructions
+// (AVX2 on x86-64 if supported by the CPU, NEON on ARM) without a branch per field. Phase counts are stored as floats,
+// they are converted back to integers when the entries are read.
+class LimitArrays {
+public:
+    enum Limit : std::size_t {
+        MaxCurrent,
+        MinCurrent,
+        TotalPower,
+        MaxPhaseCount,
+        MinPhaseCount,
+        NumberOfLimits
+    };
+
+    LimitArrays() = default;
+    // all limits of all slots are unset
+    explicit LimitArrays(std::size_t length);
+
+    std::size_t size() const;
+
+    void set(std::size_t i, const types::energy::LimitsReq& limits);
+    void set(std::size_t i, const types::energy::LimitsRes& limits);
+    // only overwrites the fields that are part of the arrays
+    void get(std::size_t i, types::energy::LimitsReq& limits) const;
+    void get(std::size_t i, types::energy::LimitsRes& limits) const;
+
+    std::optional<float> get(Limit limit, std::size_t i) const;
+    // true if no slot has a value other than 0
+    bool is_zero(Limit limit) const;
+
+    // Kernels working on one limit of all slots. Unset entries of other are ignored.
+    // this = min(this, other), unset entries of this are set to other
+    void limit_min(Limit limit, const LimitArrays& other);
+    // this = max(this, other), unset entries of this are set to other
+    void limit_max(Limit limit, const LimitArrays& other);
+    // this = this + other, unset entries of this are treated as 0
+    void add(Limit limit, const LimitArrays& other);
+    // this = this + min(0, sign * other) for all set entries of this, unset entries of other are treated as 0
+    void add_negative_part(Limit limit, const LimitArrays& other, float sign);
+
+private:
+    std::size_t length{0};
+    std::size_t stride{0}; // length rounded up to a full block of 8 slots (one byte of the bitmask)
+    std::vector<float> values;
+    std::vector<std::uint8_t> valid;
+
+    float* values_of(Limit limit);
+    const float* values_of(Limit limit) const;
+    std::uint8_t* valid_of(Limit limit);
+    const std::uint8_t* valid_of(Limit limit) const;
+    void set(Limit limit, std::size_t i, const std::optional<float>& value);
+    bool same_size(const LimitArrays& other) const;
+};
+
+} // namespace module
+
+#endif // LIMIT_ARRAYS_HPP
@@ -2,45 +2,52 @@
 // Copyright Pionix GmbH and Contributors to EVerest
 
 #include "Market.hpp"
+#include <algorithm>
 #include <everest/logging.hpp>
 #include <fmt/core.h>
+#include <functional>
 
 namespace module {
 
-globals_t globals;
-
-void globals_t::init(date::utc_clock::time_point _start_time, int _interval_duration, int _schedule_duration,
-                     float _slice_ampere, float _slice_watt, bool _debug,
-                     const types::energy::EnergyFlowRequest& energy_flow_request) {
-    start_time = _start_time;
-    interval_duration = std::chrono::minutes(_interval_duration);
-    schedule_length = std::chrono::hours(_schedule_duration) / interval_duration;
-    slice_ampere = _slice_ampere;
-    slice_watt = _slice_watt;
-    debug = _debug;
+OptimizerContext::OptimizerContext(date::utc_clock::time_point _start_time, int _interval_duration,
+                                   int _schedule_duration, float _slice_ampere, float _slice_watt, bool _debug,
+                                   const types::energy::EnergyFlowRequest& energy_flow_request) :
+    start_time(_start_time),
+    interval_duration(_interval_duration),
+    schedule_length(std::chrono::hours(_schedule_duration) / interval_duration),
+    slice_ampere(_slice_ampere),
+    slice_watt(_slice_watt),
+    debug(_debug) {
 
     create_timestamps(energy_flow_request);
+    active_slot = find_active_slot();
+
+    // convert the time grid to strings only once per optimizer run
+    timestamps_rfc3339.reserve(schedule_length);
+    for (const auto& t : timestamps) {
+        timestamps_rfc3339.push_back(Everest::Date::to_rfc3339(t));
+    }
 
-    zero_schedule_req = create_empty_schedule_req();
+    zero_schedule_req = SlotsReq(schedule_length);
 
     for (auto& a : zero_schedule_req) {
         a.limits_to_root.ac_max_current_A = 0.;
         a.limits_to_root.total_power_W = 0.;
     }
 
-    empty_schedule_req = create_empty_schedule_req();
+    empty_schedule_req = SlotsReq(schedule_length);
 
-    zero_schedule_res = create_empty_schedule_res();
+    zero_schedule_res = SlotsRes(schedule_length);
 
     for (auto& a : zero_schedule_res) {
         a.limits_to_root.ac_max_current_A = 0.;
         a.limits_to_root.total_power_W = 0.;
     }
 
-    empty_schedule_res = create_empty_schedule_res();
+    empty_schedule_res = SlotsRes(schedule_length);
 }
 
-void globals_t::create_timestamps(const types::energy::EnergyFlowRequest& energy_flow_request) {
+void OptimizerContext::create_timestamps(const types::energy::EnergyFlowRequest& energy_flow_request) {
 
     timestamps.clear();
     timestamps.reserve(schedule_length);
@@ -70,7 +77,7 @@ void globals_t::create_timestamps(const types::energy::EnergyFlowRequest& energy
     schedule_length = timestamps.size();
 }
 
-void globals_t::add_timestamps(const types::energy::EnergyFlowRequest& energy_flow_request) {
+void OptimizerContext::add_timestamps(const types::energy::EnergyFlowRequest& energy_flow_request) {
     // add local timestamps
     if (energy_flow_request.schedule_import.has_value()) {
         for (auto t : energy_flow_request.schedule_import.value()) {
@@ -90,30 +97,114 @@ void globals_t::add_timestamps(const types::energy::EnergyFlowRequest& energy_fl
         add_timestamps(c);
 }
 
-ScheduleReq globals_t::create_empty_schedule_req() {
-    // initialize schedule with correct size
-    types::energy::ScheduleReqEntry e;
-    ScheduleReq s(schedule_length, e);
+int OptimizerContext::find_active_slot() const {
+    if (timestamps.empty()) {
+        return 0;
+    }
 
-    for (int i = 0; i < schedule_length; i++) {
-        s[i].timestamp = Everest::Date::to_rfc3339(timestamps[i]);
+    if (start_time < timestamps.front()) {
+        // First element already in the future
+        return 0;
+    } else if (start_time > timestamps.back()) {
+        // Last element in the past
+        return timestamps.size() - 1;
     }
 
-    return s;
+    // Somewhere in between
+    for (std::size_t n = 0; n < timestamps.size() - 1; n++) {
+        if (start_time > timestamps[n] and start_time < timestamps[n + 1]) {
+            return n;
+        }
+    }
+
+    return 0;
 }
 
-ScheduleRes globals_t::create_empty_schedule_res() {
-    // initialize schedule with correct size
-    types::energy::ScheduleResEntry e;
-    ScheduleRes s(schedule_length, e);
+ScheduleRes OptimizerContext::to_schedule_res(const SlotsRes& slots) const {
+    ScheduleRes s;
+    s.reserve(slots.size());
 
-    for (int i = 0; i < schedule_length; i++) {
-        s[i].timestamp = Everest::Date::to_rfc3339(timestamps[i]);
+    for (std::size_t i = 0; i < slots.size() and i < timestamps_rfc3339.size(); i++) {
+        types::energy::ScheduleResEntry e;
+        e.timestamp = timestamps_rfc3339[i];
+        e.limits_to_root = slots[i].limits_to_root;
+        e.price_per_kwh = slots[i].price_per_kwh;
+        s.push_back(std::move(e));
     }
 
     return s;
 }
 
+template <typename T> static void hash_combine(std::size_t& seed, const T& v) {
+    seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+template <typename T> static void hash_combine(std::size_t& seed, const std::optional<T>& v) {
+    hash_combine(seed, v.has_value());
+    if (v.has_value()) {
+        hash_combine(seed, v.value());
+    }
+}
+
+static void hash_combine(std::size_t& seed, const types::energy::LimitsReq& l) {
+    hash_combine(seed, l.total_power_W);
+    hash_combine(seed, l.ac_max_current_A);
+    hash_combine(seed, l.ac_min_current_A);
+    hash_combine(seed, l.ac_max_phase_count);
+    hash_combine(seed, l.ac_min_phase_count);
+    hash_combine(seed, l.ac_supports_changing_phases_during_charging);
+    hash_combine(seed, l.ac_number_of_active_phases);
+}
+
+static void hash_combine(std::size_t& seed, const std::optional<ScheduleReq>& schedule) {
+    hash_combine(seed, schedule.has_value());
+    if (not schedule.has_value()) {
+        return;
+    }
+
+    for (const auto& e : schedule.value()) {
+        hash_combine(seed, e.timestamp);
+        hash_combine(seed, e.limits_to_root);
+        hash_combine(seed, e.limits_to_leaves);
+        hash_combine(seed, e.conversion_efficiency);
+        hash_combine(seed, e.price_per_kwh.has_value());
+        if (e.price_per_kwh.has_value()) {
+            hash_combine(seed, e.price_per_kwh.value().timestamp);
+            hash_combine(seed, e.price_per_kwh.value().value);
+        }
+    }
+}
+
+std::size_t request_fingerprint(const types::energy::EnergyFlowRequest& request) {
+    std::size_t seed = 0;
+
+    hash_combine(seed, request.uuid);
+    hash_combine(seed, static_cast<int>(request.node_type));
+    hash_combine(seed, request.evse_state.has_value());
+    if (request.evse_state.has_value()) {
+        hash_combine(seed, static_cast<int>(request.evse_state.value()));
+    }
+
+    if (request.optimizer_target.has_value()) {
+        const auto& t = request.optimizer_target.value();
+        hash_combine(seed, t.energy_amount_needed);
+        hash_combine(seed, t.charge_to_max_percent);
+        hash_combine(seed, t.car_battery_soc);
+        hash_combine(seed, t.leave_time);
+        hash_combine(seed, t.price_limit);
+        hash_combine(seed, t.full_autonomy);
+    }
+
+    hash_combine(seed, request.schedule_import);
+    hash_combine(seed, request.schedule_export);
+
+    for (const auto& child : request.children) {
+        hash_combine(seed, child.uuid);
+    }
+
+    return seed;
+}
+
 int time_probe::stop() {
     if (running)
         pause();
@@ -171,28 +262,51 @@ template <typename T> std::optional<T> max_optional(std::optional<T> a, std::opt
     return b;
 }
 
-ScheduleReq Market::get_max_available_energy(const ScheduleReq& request) {
+// Returns the index of the request entry that is valid at timepoint t. The first entry is also valid before its
+// timestamp, the last one stays valid forever.
+static std::size_t find_request_entry(const std::vector<date::utc_clock::time_point>& request_timestamps,
+                                      bool sorted, const date::utc_clock::time_point& t) {
+    if (sorted) {
+        auto it = std::upper_bound(request_timestamps.begin(), request_timestamps.end(), t);
+        if (it == request_timestamps.begin()) {
+            return 0;
+        }
+        return std::distance(request_timestamps.begin(), it) - 1;
+    }
 
-    ScheduleReq available = globals.empty_schedule_req;
+    for (std::size_t i = 0; i < request_timestamps.size(); i++) {
+        if (i + 1 == request_timestamps.size()) {
+            return i;
+        }
+        if ((t >= request_timestamps[i] && t < request_timestamps[i + 1]) || (i == 0 && t < request_timestamps[i])) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+SlotsReq Market::get_max_available_energy(const ScheduleReq& request) {
+
+    SlotsReq available = _optimizer_context.empty_schedule_req;
+
+    if (request.empty()) {
+        return available;
+    }
 
-    // First resample request to the timestamps in available and merge all limits on root sides
-    for (auto& a : available) {
+    // parse all timestamps of the request only once
+    std::vector<date::utc_clock::time_point> request_timestamps;
+    request_timestamps.reserve(request.size());
+    for (const auto& r : request) {
+        request_timestamps.push_back(Everest::Date::from_rfc3339(r.timestamp));
+    }
+    const bool sorted = std::is_sorted(request_timestamps.begin(), request_timestamps.end());
+
+    // First resample request to the time grid and merge all limits on root sides
+    for (SlotsReq::size_type i = 0; i < available.size(); i++) {
+        auto& a = available[i];
 
         // find corresponding entry in request
-        auto r = request.begin();
-        auto tp_a = Everest::Date::from_rfc3339(a.timestamp);
-        for (auto ir = request.begin(); ir != request.end(); ir++) {
-            auto tp_r_1 = Everest::Date::from_rfc3339((*ir).timestamp);
-            if ((ir + 1 == request.end())) {
-                r = ir;
-                break;
-            }
-            auto tp_r_2 = Everest::Date::from_rfc3339((*(ir + 1)).timestamp);
-            if ((tp_a >= tp_r_1 && tp_a < tp_r_2) || (ir == request.begin() && tp_a < tp_r_1)) {
-                r = ir;
-                break;
-            }
-        }
+        auto r = request.begin() + find_request_entry(request_timestamps, sorted, _optimizer_context.timestamps[i]);
 
         if (r != request.end()) {
 
@@ -227,67 +341,110 @@ ScheduleReq Market::get_max_available_energy(const ScheduleReq& request) {
     return available;
 }
 
-ScheduleReq Market::get_available_energy(const ScheduleReq& max_available, bool add_sold) {
-    ScheduleReq available = max_available;
-    for (ScheduleReq::size_type i = 0; i < available.size(); i++) {
-        // FIXME: sold_root is the sum of all energy sold, but we need to limit indivdual paths as well
-        // add config option for pure star type of cabling here as well.
+static LimitArrays to_limit_arrays(const SlotsReq& slots) {
+    LimitArrays limits(slots.size());
+    for (SlotsReq::size_type i = 0; i < slots.size(); i++) {
+        limits.set(i, slots[i].limits_to_root);
+    }
+    return limits;
+}
 
-        float sold_current = (add_sold ? 1 : -1) * sold_root[i].limits_to_root.ac_max_current_A.value_or(0);
-        if (sold_current > 0)
-            sold_current = 0;
+static LimitArrays to_limit_arrays(const SlotsRes& slots) {
+    LimitArrays limits(slots.size());
+    for (SlotsRes::size_type i = 0; i < slots.size(); i++) {
+        limits.set(i, slots[i].limits_to_root);
+    }
+    return limits;
+}
 
-        float sold_watt = (add_sold ? 1 : -1) * sold_root[i].limits_to_root.total_power_W.value_or(0);
-        if (sold_watt > 0)
-            sold_watt = 0;
+void Market::get_available_energy(const LimitArrays& max_available, const LimitArrays* budget, bool add_sold,
+                                  LimitArrays& available) {
+    available = max_available;
 
-        if (available[i].limits_to_root.ac_max_current_A.has_value())
-            available[i].limits_to_root.ac_max_current_A.value() += sold_current;
+    if (budget) {
+        available.limit_min(LimitArrays::MaxCurrent, *budget);
+        available.limit_min(LimitArrays::TotalPower, *budget);
+    }
 
-        if (available[i].limits_to_root.total_power_W.has_value())
-            available[i].limits_to_root.total_power_W.value() += sold_watt;
+    // FIXME: sold_root is the sum of all energy sold, but we need to limit indivdual paths as well
+    // add config option for pure star type of cabling here as well.
+    const float sign = add_sold ? 1 : -1;
+    available.add_negative_part(LimitArrays::MaxCurrent, sold_root, sign);
+    available.add_negative_part(LimitArrays::TotalPower, sold_root, sign);
+}
+
+// Converts limits back to slots. Everything that is not part of the limits (e.g. prices) is taken from max_available.
+SlotsReq Market::to_slots_req(const SlotsReq& max_available, const LimitArrays& limits) {
+    SlotsReq slots = max_available;
+    for (SlotsReq::size_type i = 0; i < slots.size() and i < limits.size(); i++) {
+        limits.get(i, slots[i].limits_to_root);
     }
-    return available;
+    return slots;
 }
 
-ScheduleReq Market::get_available_energy_import() {
-    return get_available_energy(import_max_available, false);
+static void apply_limits(LimitArrays& a, const LimitArrays& b) {
+    // limits to leave are already merged to the root side, so we dont use them here
+    a.limit_min(LimitArrays::MaxCurrent, b);
+    a.limit_min(LimitArrays::MaxPhaseCount, b);
+    a.limit_min(LimitArrays::TotalPower, b);
+    a.limit_max(LimitArrays::MinPhaseCount, b);
+    a.limit_max(LimitArrays::MinCurrent, b);
 }
 
-ScheduleReq Market::get_available_energy_export() {
-    return get_available_energy(export_max_available, true);
+SlotsReq Market::get_available_energy_import() {
+    LimitArrays available;
+    get_available_energy(import_max_limits, detached ? &budget_import : nullptr, false, available);
+    return to_slots_req(import_max_available, available);
 }
 
-Market::Market(types::energy::EnergyFlowRequest& _energy_flow_request, const float __nominal_ac_voltage,
+SlotsReq Market::get_available_energy_export() {
+    LimitArrays available;
+    get_available_energy(export_max_limits, detached ? &budget_export : nullptr, true, available);
+    return to_slots_req(export_max_available, available);
+}
+
+Market::Market(const OptimizerContext& __optimizer_context,
+               const types::energy::EnergyFlowRequest& _energy_flow_request, const float __nominal_ac_voltage,
                Market* __parent) :
-    energy_flow_request(_energy_flow_request), _parent(__parent), _nominal_ac_voltage(__nominal_ac_voltage) {
+    energy_flow_request(_energy_flow_request),
+    _optimizer_context(__optimizer_context),
+    _parent(__parent),
+    _root(__parent ? __parent->_root : this),
+    _nominal_ac_voltage(__nominal_ac_voltage) {
 
     // EVLOG_info << "Create market for " << _energy_flow_request.uuid;
 
-    sold_root = globals.empty_schedule_res;
+    sold_root = LimitArrays(_optimizer_context.schedule_length);
 
     if (energy_flow_request.schedule_import.has_value()) {
         import_max_available = get_max_available_energy(energy_flow_request.schedule_import.value());
     } else {
         // nothing is available as nothing was requested
-        import_max_available = globals.zero_schedule_req;
+        import_max_available = _optimizer_context.zero_schedule_req;
     }
 
     if (energy_flow_request.schedule_export.has_value()) {
         export_max_available = get_max_available_energy(energy_flow_request.schedule_export.value());
     } else {
         // nothing is available as nothing was requested
-        export_max_available = globals.zero_schedule_req;
+        export_max_available = _optimizer_context.zero_schedule_req;
     }
 
+    import_max_limits = to_limit_arrays(import_max_available);
+    export_max_limits = to_limit_arrays(export_max_available);
+
     // Recursion: create one Market for each child
     for (auto& flow_child : _energy_flow_request.children) {
-        _children.emplace_back(flow_child, _nominal_ac_voltage, this);
+        _children.emplace_back(_optimizer_context, flow_child, _nominal_ac_voltage, this);
     }
 }
 
-ScheduleRes Market::get_sold_energy() {
-    return sold_root;
+SlotsRes Market::get_sold_energy() {
+    SlotsRes sold = _optimizer_context.empty_schedule_res;
+    for (SlotsRes::size_type i = 0; i < sold.size() and i < sold_root.size(); i++) {
+        sold_root.get(i, sold[i].limits_to_root);
+    }
+    return sold;
 }
 
 Market* Market::parent() {
@@ -295,7 +452,28 @@ Market* Market::parent() {
 }
 
 bool Market::is_root() {
-    return _parent == nullptr;
+    return _parent == nullptr or detached;
+}
+
+void Market::detach(const SlotsReq& _budget_import, const SlotsReq& _budget_export) {
+    budget_import = to_limit_arrays(_budget_import);
+    budget_export = to_limit_arrays(_budget_export);
+    detached = true;
+    set_root(this);
+    trade_epoch++;
+}
+
+void Market::attach() {
+    detached = false;
+    set_root(_parent ? _parent->_root : this);
+    trade_epoch++;
+}
+
+void Market::set_root(Market* root) {
+    _root = root;
+    for (auto& child : _children) {
+        child.set_root(root);
+    }
 }
 
 void Market::get_list_of_evses(std::vector<Market*>& list) {
@@ -320,42 +498,100 @@ std::vector<Market*> Market::get_list_of_evses() {
     return list;
 }
 
-static void schedule_add(ScheduleRes& a, const ScheduleRes& b) {
-    if (a.size() != b.size()) {
-        EVLOG_critical << "schedule_add: Schedules are not of the same size: a: " << a.size() << " b: " << b.size();
+// Slots of the path: the limits of the whole path, price and number of active phases of this node
+static SlotsReq to_path_slots(const SlotsReq& max_available, const LimitArrays& limits) {
+    SlotsReq slots(limits.size());
+    for (SlotsReq::size_type i = 0; i < slots.size() and i < max_available.size(); i++) {
+        limits.get(i, slots[i].limits_to_root);
+        slots[i].price_per_kwh = max_available[i].price_per_kwh;
+        slots[i].limits_to_root.ac_number_of_active_phases = max_available[i].limits_to_root.ac_number_of_active_phases;
+    }
+    return slots;
+}
+
+void Market::trade(const SlotsRes& traded) {
+    if (traded.size() != sold_root.size()) {
+        EVLOG_critical << "Market::trade: Schedules are not of the same size: sold: " << sold_root.size()
+                       << " traded: " << traded.size();
         return;
     }
+    trade(to_limit_arrays(traded));
+}
 
-    for (ScheduleRes::size_type i = 0; i < a.size(); i++) {
-        if (b[i].limits_to_root.ac_max_current_A.has_value()) {
-            a[i].limits_to_root.ac_max_current_A =
-                b[i].limits_to_root.ac_max_current_A.value() + a[i].limits_to_root.ac_max_current_A.value_or(0);
-        }
+void Market::trade(const LimitArrays& traded) {
+    sold_root.add(LimitArrays::MaxCurrent, traded);
+    sold_root.add(LimitArrays::TotalPower, traded);
+    sold_root.limit_max(LimitArrays::MaxPhaseCount, traded);
 
-        if (b[i].limits_to_root.total_power_W.has_value()) {
-            a[i].limits_to_root.total_power_W =
-                b[i].limits_to_root.total_power_W.value() + a[i].limits_to_root.total_power_W.value_or(0);
-        }
+    // the available energy only depends on the sold current and power, zero trades of brokers that could not buy
+    // anything keep the cached paths
+    if (not traded.is_zero(LimitArrays::MaxCurrent) or not traded.is_zero(LimitArrays::TotalPower)) {
+        trade_epoch++;
+    }
 
-        if (b[i].limits_to_root.ac_max_phase_count.has_value()) {
-            if (a[i].limits_to_root.ac_max_phase_count.has_value()) {
-                if (b[i].limits_to_root.ac_max_phase_count.value() > a[i].limits_to_root.ac_max_phase_count.value()) {
-                    a[i].limits_to_root.ac_max_phase_count.value() = b[i].limits_to_root.ac_max_phase_count.value();
-                }
-            } else {
-                a[i].limits_to_root.ac_max_phase_count = b[i].limits_to_root.ac_max_phase_count.value();
-            }
-        }
+    // propagate to root
+    if (!is_root()) {
+        parent()->trade(traded);
     }
 }
 
-void Market::trade(const ScheduleRes& traded) {
-    schedule_add(sold_root, traded);
+const SlotsReq& Market::get_path_available_import() {
+    update_path_cache();
+    if (not path_cache.import_slots_valid) {
+        path_cache.import_available = to_path_slots(import_max_available, path_cache.import_limits);
+        path_cache.import_slots_valid = true;
+    }
+    return path_cache.import_available;
+}
 
-    // propagate to root
+const SlotsReq& Market::get_path_available_export() {
+    update_path_cache();
+    if (not path_cache.export_slots_valid) {
+        path_cache.export_available = to_path_slots(export_max_available, path_cache.export_limits);
+        path_cache.export_slots_valid = true;
+    }
+    return path_cache.export_available;
+}
+
+// Recursive: the path of this node is the path of the parent limited by the energy available at this node. Only
+// nodes whose cache is outdated are updated on the way to the root.
+void Market::update_path_cache() {
     if (!is_root()) {
-        parent()->trade(traded);
+        _parent->update_path_cache();
+    }
+
+    const std::uint64_t parent_version = is_root() ? 0 : _parent->path_cache.version;
+    if (path_cache.valid and path_cache.root == _root and path_cache.trade_epoch == trade_epoch and
+        path_cache.parent_version == parent_version) {
+        return;
+    }
+
+    if (!is_root()) {
+        path_cache.import_limits = _parent->path_cache.import_limits;
+        path_cache.export_limits = _parent->path_cache.export_limits;
+    } else {
+        // initialize time slots
+        path_cache.import_limits = LimitArrays(_optimizer_context.schedule_length);
+        path_cache.export_limits = LimitArrays(_optimizer_context.schedule_length);
     }
+
+    // limit path with limits at this market place
+    get_available_energy(import_max_limits, detached ? &budget_import : nullptr, false, available_scratch);
+    apply_limits(path_cache.import_limits, available_scratch);
+    get_available_energy(export_max_limits, detached ? &budget_export : nullptr, true, available_scratch);
+    apply_limits(path_cache.export_limits, available_scratch);
+
+    path_cache.valid = true;
+    path_cache.root = _root;
+    path_cache.trade_epoch = trade_epoch;
+    path_cache.parent_version = parent_version;
+    path_cache.version++;
+    path_cache.import_slots_valid = false;
+    path_cache.export_slots_valid = false;
+}
+
+const OptimizerContext& Market::optimizer_context() const {
+    return _optimizer_context;
 }
 
 float Market::nominal_ac_voltage() {
@@ -4,10 +4,15 @@
 #define MARKET_HPP
 
 // headers for required interface implementations
+#include <cstdint>
 #include <generated/interfaces/energy/Interface.hpp>
+#include <optional>
+#include <string>
 #include <utils/date.hpp>
 #include <vector>
 
+#include "LimitArrays.hpp"
+
 using namespace std::chrono_literals;
 
 namespace module {
@@ -15,29 +20,52 @@ namespace module {
 typedef std::vector<types::energy::ScheduleReqEntry> ScheduleReq;
 typedef std::vector<types::energy::ScheduleResEntry> ScheduleRes;
 
-class globals_t {
+// Optimizer internal schedule entries. They do not carry their own RFC3339 timestamp: entry i always belongs to
+// OptimizerContext::timestamps[i]. Timestamps are only parsed once when a request is resampled to the time grid and
+// only converted back to strings when the EnforcedLimits are created.
+struct SlotReq {
+    types::energy::LimitsReq limits_to_root;
+    std::optional<types::energy_price_information::PricePerkWh> price_per_kwh;
+};
+
+struct SlotRes {
+    types::energy::LimitsRes limits_to_root;
+    std::optional<types::energy_price_information::PricePerkWh> price_per_kwh;
+};
+
+typedef std::vector<SlotReq> SlotsReq;
+typedef std::vector<SlotRes> SlotsRes;
+
+// Common state of one optimizer run (time grid, slice sizes). Every run creates its own context and passes it to the
+// Market tree, so that several optimizations can run at the same time.
+class OptimizerContext {
 public:
-    void init(date::utc_clock::time_point _start_time, int _interval_duration, int _schedule_duration,
-              float _slice_ampere, float _slice_watt, bool _debug,
-              const types::energy::EnergyFlowRequest& energy_flow_request);
+    OptimizerContext(date::utc_clock::time_point _start_time, int _interval_duration, int _schedule_duration,
+                     float _slice_ampere, float _slice_watt, bool _debug,
+                     const types::energy::EnergyFlowRequest& energy_flow_request);
     date::utc_clock::time_point start_time; // common start point
     std::chrono::minutes interval_duration; // interval duration
     int schedule_length;                    // total forcast length (in counts of (non-regular) intervals)
     float slice_ampere;                     // ampere_slices for trades
     float slice_watt;                       // ampere_slices for trades
     bool debug{false};
-    ScheduleReq zero_schedule_req, empty_schedule_req;
-    ScheduleRes zero_schedule_res, empty_schedule_res;
+    SlotsReq zero_schedule_req, empty_schedule_req;
+    SlotsRes zero_schedule_res, empty_schedule_res;
+    std::vector<date::utc_clock::time_point> timestamps; // sorted time grid, one entry per slot
+    int active_slot{0};                                  // slot that is active at start_time
+
+    ScheduleRes to_schedule_res(const SlotsRes& slots) const;
 
 private:
     void create_timestamps(const types::energy::EnergyFlowRequest& energy_flow_request);
     void add_timestamps(const types::energy::EnergyFlowRequest& energy_flow_request);
-    ScheduleReq create_empty_schedule_req();
-    ScheduleRes create_empty_schedule_res();
-    std::vector<date::utc_clock::time_point> timestamps;
+    int find_active_slot() const;
+    std::vector<std::string> timestamps_rfc3339;
 };
 
-extern globals_t globals;
+// Hash over everything in the request of this node that has an influence on the optimizer result, including the
+// uuids of its children (but not their requests). Powermeter readings are not used by the optimizer and are ignored.
+std::size_t request_fingerprint(const types::energy::EnergyFlowRequest& request);
 
 class time_probe {
 public:
@@ -53,39 +81,82 @@ private:
 
 class Market {
 public:
-    Market(types::energy::EnergyFlowRequest& _energy_flow_request, const float __nominal_ac_voltage,
-           Market* __parent = nullptr);
+    Market(const OptimizerContext& _optimizer_context, const types::energy::EnergyFlowRequest& _energy_flow_request,
+           const float __nominal_ac_voltage, Market* __parent = nullptr);
 
-    void trade(const ScheduleRes& s);
+    void trade(const SlotsRes& s);
 
     bool is_root();
 
     void get_list_of_evses(std::vector<Market*>& list);
     std::vector<Market*> get_list_of_evses();
-    ScheduleReq get_available_energy_import();
-    ScheduleReq get_available_energy_export();
+    SlotsReq get_available_energy_import();
+    SlotsReq get_available_energy_export();
+
+    // Available energy along the path from the root to this node, i.e. the limits of all market places on the way.
+    // Cached per node until energy is traded on a node of the path.
+    const SlotsReq& get_path_available_import();
+    const SlotsReq& get_path_available_export();
 
-    ScheduleRes get_sold_energy();
+    SlotsRes get_sold_energy();
 
     Market* parent();
 
     float nominal_ac_voltage();
 
+    const OptimizerContext& optimizer_context() const;
+
+    // Parallel optimization: While detached, this node acts like a root node with the given budgets as additional
+    // limits. Trades in this subtree stop here and need to be propagated to the parent after attach().
+    void detach(const SlotsReq& budget_import, const SlotsReq& budget_export);
+    void attach();
+
     // local request only for this node
-    types::energy::EnergyFlowRequest& energy_flow_request;
+    const types::energy::EnergyFlowRequest& energy_flow_request;
 
 private:
+    const OptimizerContext& _optimizer_context;
     Market* _parent;
+    Market* _root; // the root of the tree or the detached node this node currently belongs to
     std::list<Market> _children;
     float _nominal_ac_voltage;
 
-    // main data structures
-    ScheduleReq import_max_available, export_max_available;
-    ScheduleRes sold_root;
-    std::vector<ScheduleRes> sold_leaves;
-
-    ScheduleReq get_max_available_energy(const ScheduleReq& request);
-    ScheduleReq get_available_energy(const ScheduleReq& available, bool add_sold);
+    // main data structures. The limits are additionally kept as LimitArrays for the hot loops, the slots keep the
+    // price and the number of active phases.
+    SlotsReq import_max_available, export_max_available;
+    LimitArrays import_max_limits, export_max_limits;
+    LimitArrays sold_root;
+
+    bool detached{false};
+    LimitArrays budget_import, budget_export;
+
+    // Incremented when energy traded on this node changes what is available below it, or when it is detached or
+    // attached.
+    std::uint64_t trade_epoch{0};
+
+    // The limits along the path are only converted to slots if they are requested for this node, not for all nodes on
+    // the way to the root. The cache is valid as long as the trade_epoch of this node and the cache of the parent are
+    // unchanged, so a trade only invalidates the paths that contain a node it was traded on.
+    struct PathCache {
+        bool valid{false};
+        Market* root{nullptr};
+        std::uint64_t trade_epoch{0};    // trade_epoch of this node the cache was built with
+        std::uint64_t parent_version{0}; // version of the parent's cache it was built from
+        std::uint64_t version{0};        // incremented on every rebuild
+        LimitArrays import_limits, export_limits;
+        bool import_slots_valid{false}, export_slots_valid{false};
+        SlotsReq import_available, export_available;
+    } path_cache;
+    LimitArrays available_scratch;
+
+    void update_path_cache();
+    void set_root(Market* root);
+    void trade(const LimitArrays& traded);
+
+    SlotsReq get_max_available_energy(const ScheduleReq& request);
+    void get_available_energy(const LimitArrays& max_available, const LimitArrays* budget, bool add_sold,
+                              LimitArrays& available);
+    SlotsReq to_slots_req(const SlotsReq& max_available, const LimitArrays& limits);
 };
 
 } // namespace module
@@ -16,10 +16,7 @@ public:
     Offer(Market& market);
 
     std::optional<types::energy::OptimizerTarget> optimizer_target;
-    ScheduleReq import_offer, export_offer;
-
-private:
-    void create_offer_for_local_market(Market& market);
+    SlotsReq import_offer, export_offer;
 };
 
 std::ostream& operator<<(std::ostream& out, const Offer& self);
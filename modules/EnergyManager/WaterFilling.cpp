@@ -0,0 +1,347 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include "WaterFilling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <everest/logging.hpp>
+#include <fmt/core.h>
+#include <limits>
+
+namespace module {
+
+static constexpr float infinity = std::numeric_limits<float>::infinity();
+
+// Tolerance for float comparisons of limits
+static constexpr float epsilon = 0.001;
+
+struct LevelItem {
+    float min_level;
+    float max_level;
+    float weight;
+};
+
+// Returns the highest water level L for which sum(weight * clamp(L, min_level, max_level)) <= budget.
+// The sum is piecewise linear in L, so we can walk along the sorted break points and solve the linear equation in the
+// segment where the budget is exceeded.
+static float saturation_level(const std::vector<LevelItem>& items, float budget) {
+    std::vector<std::pair<float, float>> slope_changes;
+    slope_changes.reserve(items.size() * 2);
+
+    float consumed = 0.;
+    for (const auto& item : items) {
+        if (item.weight <= 0.) {
+            continue;
+        }
+        consumed += item.weight * item.min_level;
+        if (item.max_level > item.min_level) {
+            slope_changes.emplace_back(item.min_level, item.weight);
+            if (item.max_level < infinity) {
+                slope_changes.emplace_back(item.max_level, -item.weight);
+            }
+        }
+    }
+
+    if (consumed > budget + epsilon) {
+        // Should not happen as only EVSEs whose minimum fits are admitted
+        return 0.;
+    }
+
+    std::sort(slope_changes.begin(), slope_changes.end());
+
+    float level = 0.;
+    float slope = 0.;
+    for (const auto& [break_point, slope_change] : slope_changes) {
+        const float consumed_at_break_point = consumed + slope * (break_point - level);
+        if (slope > 0. and consumed_at_break_point > budget) {
+            return level + (budget - consumed) / slope;
+        }
+        consumed = consumed_at_break_point;
+        level = break_point;
+        slope += slope_change;
+    }
+
+    if (slope > epsilon) {
+        return level + (budget - consumed) / slope;
+    }
+
+    // all EVSEs are saturated below the budget
+    return infinity;
+}
+
+WaterFilling::WaterFilling(const OptimizerContext& _optimizer_context, const std::vector<Market*>& evse_markets,
+                           std::map<std::string, BrokerContext>& contexts, const BrokerFastCharging::Config& _config) :
+    optimizer_context(_optimizer_context), config(_config) {
+
+    evses.reserve(evse_markets.size());
+
+    std::map<Market*, std::size_t> node_index;
+
+    for (auto m : evse_markets) {
+        evses.emplace_back(m, &contexts[m->energy_flow_request.uuid]);
+        const std::size_t evse_index = evses.size() - 1;
+        auto& evse = evses.back();
+
+        // walk up to the root and register this EVSE at all nodes on its path
+        for (Market* n = m; n != nullptr; n = n->parent()) {
+            auto it = node_index.find(n);
+            if (it == node_index.end()) {
+                nodes.push_back({n, 0, n->get_available_energy_import(), n->get_available_energy_export(), {}});
+                it = node_index.emplace(n, nodes.size() - 1).first;
+            }
+            nodes[it->second].evses.push_back(evse_index);
+            evse.path.push_back(it->second);
+        }
+
+        for (std::size_t k = 0; k < evse.path.size(); k++) {
+            nodes[evse.path[k]].depth = evse.path.size() - 1 - k;
+        }
+    }
+
+    bottom_up.resize(nodes.size());
+    for (std::size_t n = 0; n < nodes.size(); n++) {
+        bottom_up[n] = n;
+    }
+    std::stable_sort(bottom_up.begin(), bottom_up.end(),
+                     [this](std::size_t a, std::size_t b) { return nodes[a].depth > nodes[b].depth; });
+}
+
+void WaterFilling::run() {
+    allocate();
+
+    // execute the trades on the markets
+    for (auto& evse : evses) {
+        if (optimizer_context.debug) {
+            EVLOG_info << fmt::format("\033[1;33m{} WaterFilling: {}A {}W \033[1;0m",
+                                      evse.market->energy_flow_request.uuid,
+                                      evse.trading[0].limits_to_root.ac_max_current_A.value_or(-9999),
+                                      evse.trading[0].limits_to_root.total_power_W.value_or(-9999));
+        }
+        evse.market->trade(evse.trading);
+    }
+}
+
+const SlotsRes& WaterFilling::get_allocation(std::size_t i) const {
+    return evses.at(i).trading;
+}
+
+void WaterFilling::allocate() {
+    for (auto& evse : evses) {
+        const auto& import_offer = evse.offer.import_offer;
+        const auto& export_offer = evse.offer.export_offer;
+
+        // buy/sell nothing in the beginning
+        evse.trading = optimizer_context.empty_schedule_res;
+        evse.slot_type = std::vector<SlotType>(optimizer_context.schedule_length, SlotType::Undecided);
+
+        for (int i = 0; i < optimizer_context.schedule_length; i++) {
+            if (import_offer[i].limits_to_root.ac_max_current_A.has_value()) {
+                evse.trading[i].limits_to_root.ac_max_current_A = 0.;
+            }
+            if (import_offer[i].limits_to_root.total_power_W.has_value()) {
+                evse.trading[i].limits_to_root.total_power_W = 0.;
+            }
+
+            // in each timeslot: do we want to import or export energy?
+            const auto& limits_import = import_offer[i].limits_to_root;
+            const auto& limits_export = export_offer[i].limits_to_root;
+
+            bool can_import =
+                !((limits_import.total_power_W.has_value() && limits_import.total_power_W.value() == 0.) ||
+                  (limits_import.ac_max_current_A.has_value() && limits_import.ac_max_current_A.value() == 0.));
+
+            bool can_export =
+                !((limits_export.total_power_W.has_value() && limits_export.total_power_W.value() == 0.) ||
+                  (limits_export.ac_max_current_A.has_value() && limits_export.ac_max_current_A.value() == 0.));
+
+            if (can_import) {
+                evse.slot_type[i] = SlotType::Import;
+            } else if (can_export) {
+                evse.slot_type[i] = SlotType::Export;
+            }
+        }
+    }
+
+    for (int i = 0; i < optimizer_context.schedule_length; i++) {
+        fill_slot(i, true);
+        fill_slot(i, false);
+    }
+}
+
+// Decide on the minimum current and number of phases of one EVSE and reserve the minimum current on all nodes of its
+// path. EVSEs are admitted in tree order, so this behaves like the first trading round of BrokerFastCharging.
+void WaterFilling::admit(int i, bool import, std::size_t e, std::vector<Demand>& demand,
+                         std::vector<float>& remaining_A, std::vector<float>& remaining_W) {
+    auto& evse = evses[e];
+    auto& d = demand[e];
+    const float nominal_ac_voltage = evse.market->nominal_ac_voltage();
+    const auto& offer = (import ? evse.offer.import_offer[i] : evse.offer.export_offer[i]);
+    const auto& max_current = offer.limits_to_root.ac_max_current_A;
+    const auto& total_power = offer.limits_to_root.total_power_W;
+
+    if (max_current.has_value()) {
+        d.weight_A = 1.;
+        d.min_level = std::max(0.f, offer.limits_to_root.ac_min_current_A.value_or(0.));
+
+        if (import) {
+            const int ac_number_of_active_phases = offer.limits_to_root.ac_number_of_active_phases.value_or(3);
+            d.number_of_phases = ac_number_of_active_phases;
+
+            bool number_of_switching_cycles_reached = false;
+            if (d.min_level > 0.) {
+                // decide based on the power that is left over after the EVSEs before us got their minimum
+                SlotReq remaining_offer = offer;
+                if (total_power.has_value()) {
+                    for (auto n : evse.path) {
+                        remaining_offer.limits_to_root.total_power_W =
+                            std::min(remaining_offer.limits_to_root.total_power_W.value(), remaining_W[n]);
+                    }
+                }
+                d.number_of_phases = BrokerFastCharging::choose_number_of_phases(
+                    config, *evse.context, remaining_offer, nominal_ac_voltage, optimizer_context.active_slot == i,
+                    optimizer_context.start_time, number_of_switching_cycles_reached);
+            }
+            BrokerFastCharging::count_1ph3ph_cycles(*evse.context, ac_number_of_active_phases);
+
+            d.weight_W = d.number_of_phases * nominal_ac_voltage;
+
+            auto fits = [&]() {
+                return std::all_of(evse.path.begin(), evse.path.end(), [&](std::size_t n) {
+                    return d.min_level * d.weight_A <= remaining_A[n] + epsilon and
+                           d.min_level * d.weight_W <= remaining_W[n] + epsilon;
+                });
+            };
+
+            if (not fits() and config.switch_1ph_3ph_mode not_eq BrokerFastCharging::Switch1ph3phMode::Never and
+                not number_of_switching_cycles_reached) {
+                // If we cannot get the minimum amount we need, try again in single phase mode (it may be due to a
+                // watt limit only)
+                d.number_of_phases = 1;
+                d.weight_W = d.number_of_phases * nominal_ac_voltage;
+            }
+
+            if (not fits()) {
+                return;
+            }
+        } else {
+            // export is always done with 3 phases
+            d.number_of_phases = 3;
+            d.weight_W = d.number_of_phases * nominal_ac_voltage;
+            const bool fits = std::all_of(evse.path.begin(), evse.path.end(), [&](std::size_t n) {
+                return d.min_level <= remaining_A[n] + epsilon and
+                       d.min_level * d.weight_W <= remaining_W[n] + epsilon;
+            });
+            if (not fits) {
+                return;
+            }
+        }
+    } else if (total_power.has_value()) {
+        // only a watt limit is available (e.g. DC). The water level is translated to power as if it was a three
+        // phase AC EVSE, so it gets the same share of power as three phase AC EVSEs on the same node.
+        d.weight_A = 0.;
+        d.number_of_phases = offer.limits_to_root.ac_max_phase_count.value_or(1);
+        d.weight_W = 3 * nominal_ac_voltage;
+        d.min_level = 0.;
+    } else {
+        return;
+    }
+
+    d.active = true;
+    d.level = infinity;
+    for (auto n : evse.path) {
+        remaining_A[n] -= d.min_level * d.weight_A;
+        remaining_W[n] -= d.min_level * d.weight_W;
+    }
+}
+
+void WaterFilling::fill_slot(int i, bool import) {
+    const SlotType direction = (import ? SlotType::Import : SlotType::Export);
+
+    std::vector<Demand> demand(evses.size());
+    std::vector<float> budget_A(nodes.size()), budget_W(nodes.size());
+
+    for (std::size_t n = 0; n < nodes.size(); n++) {
+        const auto& limits = (import ? nodes[n].import_available[i] : nodes[n].export_available[i]).limits_to_root;
+        budget_A[n] = std::max(0.f, limits.ac_max_current_A.value_or(infinity));
+        budget_W[n] = std::max(0.f, limits.total_power_W.value_or(infinity));
+    }
+
+    // Everybody gets the minimum current first (or nothing at all if it does not fit)
+    std::vector<float> remaining_A = budget_A;
+    std::vector<float> remaining_W = budget_W;
+    bool any_active = false;
+    for (std::size_t e = 0; e < evses.size(); e++) {
+        if (evses[e].slot_type[i] == direction) {
+            admit(i, import, e, demand, remaining_A, remaining_W);
+            any_active = any_active or demand[e].active;
+        }
+    }
+
+    if (not any_active) {
+        return;
+    }
+
+    // Bottom-up: compute the highest water level each node allows given the levels of the nodes below it.
+    // The level of each EVSE is updated on the way, so after the root was processed it holds the lowest water level
+    // of its path, which is the final allocation.
+    std::vector<LevelItem> items_A, items_W;
+    for (auto n : bottom_up) {
+        const auto& node = nodes[n];
+        const bool limit_A = budget_A[n] < infinity;
+        const bool limit_W = budget_W[n] < infinity;
+        if (not limit_A and not limit_W) {
+            continue;
+        }
+
+        items_A.clear();
+        items_W.clear();
+        for (auto e : node.evses) {
+            const auto& d = demand[e];
+            if (d.active) {
+                items_A.push_back({d.min_level, d.level, d.weight_A});
+                items_W.push_back({d.min_level, d.level, d.weight_W});
+            }
+        }
+
+        float level = infinity;
+        if (limit_A) {
+            level = std::min(level, saturation_level(items_A, budget_A[n]));
+        }
+        if (limit_W) {
+            level = std::min(level, saturation_level(items_W, budget_W[n]));
+        }
+
+        for (auto e : node.evses) {
+            auto& d = demand[e];
+            if (d.active) {
+                d.level = std::max(d.min_level, std::min(d.level, level));
+            }
+        }
+    }
+
+    // Write allocation into the trading schedules
+    const float sign = (import ? 1. : -1.);
+    for (std::size_t e = 0; e < evses.size(); e++) {
+        const auto& d = demand[e];
+        if (not d.active or not std::isfinite(d.level) or d.level <= 0.) {
+            continue;
+        }
+
+        auto& evse = evses[e];
+        const auto& offer = (import ? evse.offer.import_offer[i] : evse.offer.export_offer[i]);
+        auto& trade = evse.trading[i].limits_to_root;
+
+        if (offer.limits_to_root.ac_max_current_A.has_value()) {
+            trade.ac_max_current_A = sign * d.level;
+            trade.ac_max_phase_count = d.number_of_phases;
+            if (offer.limits_to_root.total_power_W.has_value()) {
+                trade.total_power_W = sign * d.level * d.weight_W;
+            }
+        } else {
+            trade.total_power_W = sign * d.level * d.weight_W;
+            trade.ac_max_phase_count = d.number_of_phases;
+        }
+    }
+}
+
+} // namespace module
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef WATER_FILLING_HPP
+#define WATER_FILLING_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BrokerFastCharging.hpp"
+#include "Market.hpp"
+#include "Offer.hpp"
+
+namespace module {
+
+// Alternative to the slice by slice trading rounds of the brokers: Computes a hierarchical max-min fair allocation
+// (water filling over the fuse tree) for all EVSEs in one pass per time slot.
+//
+// The water level is expressed in Ampere per phase. Every node in the tree limits the sum of the currents (and the sum
+// of the power) of all EVSEs below it. In a bottom-up pass each node computes the highest water level its limits
+// allow, the allocation of an EVSE is the lowest water level on its path to the root. The min current, phase count
+// and 1ph/3ph switching constraints are the same as in BrokerFastCharging: EVSEs receive their minimum current first
+// (in tree order) or nothing at all, and the remaining capacity is shared equally.
+class WaterFilling {
+public:
+    // Allocates energy to the given EVSEs. Energy that was already sold on the markets (e.g. to EVSEs that are not
+    // part of this allocation) is not available anymore.
+    WaterFilling(const OptimizerContext& optimizer_context, const std::vector<Market*>& evse_markets,
+                 std::map<std::string, BrokerContext>& contexts, const BrokerFastCharging::Config& config);
+
+    // Computes the allocation and executes the resulting trades on the local markets of all EVSEs
+    void run();
+
+    // Only computes the allocation without trading. Allocation of EVSE i (in the order of evse_markets) is available
+    // with get_allocation(i) afterwards.
+    void allocate();
+    const SlotsRes& get_allocation(std::size_t i) const;
+
+private:
+    struct Node {
+        Market* market;
+        int depth;
+        SlotsReq import_available, export_available;
+        std::vector<std::size_t> evses; // all EVSEs in this subtree (indices into evses)
+    };
+
+    struct Evse {
+        Evse(Market* _market, BrokerContext* _context) : market(_market), context(_context), offer(*_market){};
+        Market* market;
+        BrokerContext* context;
+        Offer offer;                    // limits along the path to the root
+        std::vector<std::size_t> path;  // node indices from the EVSE up to the root
+        SlotsRes trading;
+        std::vector<SlotType> slot_type;
+    };
+
+    // per slot demand of one EVSE
+    struct Demand {
+        bool active{false};
+        float min_level{0.};  // minimum current in A, 0 if not needed
+        float level{0.};      // current water level (upper bound) in A
+        float weight_A{0.};   // Ampere consumed at a node per Ampere of water level
+        float weight_W{0.};   // Watt consumed at a node per Ampere of water level
+        int number_of_phases{3};
+    };
+
+    void fill_slot(int i, bool import);
+    void admit(int i, bool import, std::size_t e, std::vector<Demand>& demand, std::vector<float>& remaining_A,
+               std::vector<float>& remaining_W);
+
+    std::vector<Node> nodes;
+    std::vector<Evse> evses;
+    std::vector<std::size_t> bottom_up; // node indices, deepest nodes first
+    const OptimizerContext& optimizer_context;
+    BrokerFastCharging::Config config;
+};
+
+} // namespace module
+
+#endif // WATER_FILLING_HPP
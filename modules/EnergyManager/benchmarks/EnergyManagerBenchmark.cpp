@@ -0,0 +1,319 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include <benchmark/benchmark.h>
+
+#include "BrokerFastCharging.hpp"
+#include "EnergyManager.hpp"
+#include "EnergyManagerImplStub.hpp"
+#include "Market.hpp"
+#include "Offer.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Allocation counting: every benchmark reports the number of heap allocations per iteration. Only operator new is
+// replaced, the default operator delete releases the memory with free(). noinline keeps the compiler from pairing
+// the malloc() with a sized operator delete in inlined code and warning about a mismatch.
+
+namespace {
+std::atomic<std::size_t> allocation_count{0};
+} // namespace
+
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+namespace module::test {
+std::vector<types::energy::EnforcedLimits> run_optimizer(EnergyManager& manager,
+                                                         const types::energy::EnergyFlowRequest& request,
+                                                         date::utc_clock::time_point start_time) {
+    return manager.run_optimizer(request, start_time);
+}
+} // namespace module::test
+
+namespace {
+
+const ModuleInfo c_module_info{
+    "EnergyManager",
+    {},               // authors
+    "MIT",            // license
+    "energy_manager", // ID
+    {
+        // path etc
+        "",
+        // path libexec
+        "",
+        // path share
+        "",
+    },
+    false, // telemetry_enabled
+    false, // global_errors_enabled
+};
+
+// Parameters of a synthetic tree. Benchmark arguments are: depth, number of EVSEs, number of slots, schedule mix
+struct TreeParameters {
+    int depth;       // number of levels of generic nodes including the grid connection point (1 = all EVSEs at root)
+    int evses;       // total number of EVSEs
+    int slots;       // length of all schedules
+    int mix;         // 0: import only, 1: import and export, 2: import, export and prices
+    int fan_out;     // children per generic node, derived from depth and number of EVSEs
+    int interval;    // schedule interval in minutes
+    int total_hours; // schedule duration in hours
+
+    explicit TreeParameters(const benchmark::State& state) :
+        depth(state.range(0)), evses(state.range(1)), slots(state.range(2)), mix(state.range(3)) {
+        fan_out = std::max(2, static_cast<int>(std::ceil(std::pow(evses, 1. / depth))));
+        interval = slots > 24 ? 15 : 60;
+        total_hours = std::max(1, slots * interval / 60);
+    }
+};
+
+const auto c_start_time = Everest::Date::from_rfc3339("2024-03-27T12:00:00.000Z");
+
+std::vector<types::energy::ScheduleReqEntry> schedule(const TreeParameters& p, float max_current, float min_current,
+                                                      bool prices) {
+    std::vector<types::energy::ScheduleReqEntry> s;
+    s.reserve(p.slots);
+    for (int i = 0; i < p.slots; i++) {
+        types::energy::ScheduleReqEntry e;
+        e.timestamp = Everest::Date::to_rfc3339(c_start_time + std::chrono::minutes(i * p.interval));
+        // vary the limit over time so that slots are not identical
+        e.limits_to_root.ac_max_current_A = max_current * (1. - 0.25 * (i % 4) / 3.);
+        e.limits_to_root.ac_min_current_A = min_current;
+        e.limits_to_root.ac_max_phase_count = 3;
+        e.limits_to_root.ac_min_phase_count = 1;
+        e.limits_to_root.ac_supports_changing_phases_during_charging = true;
+        if (prices) {
+            e.price_per_kwh = {e.timestamp, 0.2F + 0.01F * (i % 24), "EUR"};
+        }
+        s.push_back(e);
+    }
+    return s;
+}
+
+types::energy::EnergyFlowRequest evse(const TreeParameters& p, int id) {
+    types::energy::EnergyFlowRequest r;
+    r.uuid = "evse" + std::to_string(id);
+    r.node_type = types::energy::NodeType::Evse;
+    r.evse_state = types::energy::EvseState::Charging;
+    r.schedule_import = schedule(p, 32., 6., false);
+    if (p.mix > 0) {
+        r.schedule_export = schedule(p, 16., 6., false);
+    }
+    return r;
+}
+
+// Recursive: creates generic nodes down to depth, EVSEs are distributed evenly over the lowest generic nodes
+types::energy::EnergyFlowRequest node(const TreeParameters& p, int level, int first_evse, int evses) {
+    types::energy::EnergyFlowRequest r;
+    r.uuid = level == 0 ? "grid_connection_point" : "node_" + std::to_string(level) + "_" + std::to_string(first_evse);
+    r.node_type = types::energy::NodeType::Generic;
+    // fuses are sized for less than all EVSEs at full power so that the optimizer needs to share
+    const float max_current = 16. * evses;
+    r.schedule_import = schedule(p, max_current, 0., level == 0 and p.mix > 1);
+    if (p.mix > 0) {
+        r.schedule_export = schedule(p, max_current, 0., false);
+    }
+
+    if (level + 1 >= p.depth) {
+        for (int i = 0; i < evses; i++) {
+            r.children.push_back(evse(p, first_evse + i));
+        }
+    } else {
+        const int per_child = (evses + p.fan_out - 1) / p.fan_out;
+        for (int first = 0; first < evses; first += per_child) {
+            r.children.push_back(node(p, level + 1, first_evse + first, std::min(per_child, evses - first)));
+        }
+    }
+    return r;
+}
+
+types::energy::EnergyFlowRequest tree(const TreeParameters& p) {
+    return node(p, 0, 0, p.evses);
+}
+
+module::Conf config(const TreeParameters& p, const std::string& optimizer_algorithm) {
+    return {
+        230.0,               // nominal_ac_voltage
+        1,                   // update_interval
+        p.interval,          // schedule_interval_duration
+        p.total_hours,       // schedule_total_duration
+        0.5,                 // slice_ampere
+        500,                 // slice_watt
+        false,               // debug
+        "Never",             // switch_3ph1ph_while_charging_mode
+        0,                   // switch_3ph1ph_max_nr_of_switches_per_session
+        "DontChange",        // switch_3ph1ph_switch_limit_stickyness
+        200,                 // switch_3ph1ph_power_hysteresis_W
+        600,                 // switch_3ph1ph_time_hysteresis_s
+        optimizer_algorithm, // optimizer_algorithm
+        1,                   // full_optimization_interval
+        0,                   // parallel_split_depth
+        4,                   // parallel_worker_threads
+        false,               // enforce_limits_only_changed
+        0.1,                 // enforce_limits_tolerance_A
+        50,                  // enforce_limits_tolerance_W
+        false,               // enforce_limits_batched
+    };
+}
+
+module::OptimizerContext optimizer_context(const TreeParameters& p, const types::energy::EnergyFlowRequest& request) {
+    return {c_start_time, p.interval, p.total_hours, 0.5, 500, false, request};
+}
+
+void report(benchmark::State& state, const TreeParameters& p, std::size_t slots, std::size_t allocations) {
+    state.counters["evses"] = p.evses;
+    state.counters["fan_out"] = p.fan_out;
+    state.counters["slots"] = slots;
+    state.counters["allocs_per_run"] =
+        benchmark::Counter(allocations, benchmark::Counter::kAvgIterations, benchmark::Counter::kIs1000);
+}
+
+void market_construction(benchmark::State& state) {
+    const TreeParameters p(state);
+    auto request = tree(p);
+    const auto context = optimizer_context(p, request);
+
+    const auto allocations_start = allocation_count.load();
+    for (auto _ : state) {
+        module::Market market(context, request, 230.);
+        benchmark::DoNotOptimize(market);
+    }
+    report(state, p, context.timestamps.size(), allocation_count.load() - allocations_start);
+}
+
+void offer_creation(benchmark::State& state) {
+    const TreeParameters p(state);
+    auto request = tree(p);
+    const auto context = optimizer_context(p, request);
+    module::Market market(context, request, 230.);
+    auto evse_markets = market.get_list_of_evses();
+
+    // a trade on the first evse invalidates the paths through the root, i.e. all of them, so this measures offers as
+    // created in the first trading round. Zero trades would keep the cached paths. The trades are not measured.
+    auto buy = context.zero_schedule_res;
+    buy[0].limits_to_root.ac_max_current_A = 1.;
+    auto sell = context.zero_schedule_res;
+    sell[0].limits_to_root.ac_max_current_A = -1.;
+    bool buying = true;
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        for (auto m : evse_markets) {
+            state.PauseTiming();
+            evse_markets.front()->trade(buying ? buy : sell);
+            buying = not buying;
+            state.ResumeTiming();
+
+            const auto allocations_start = allocation_count.load();
+            module::Offer offer(*m);
+            benchmark::DoNotOptimize(offer);
+            allocations += allocation_count.load() - allocations_start;
+        }
+    }
+    report(state, p, context.timestamps.size(), allocations);
+    state.SetItemsProcessed(state.iterations() * evse_markets.size());
+}
+
+void broker_trading(benchmark::State& state) {
+    const TreeParameters p(state);
+    auto request = tree(p);
+    const auto context = optimizer_context(p, request);
+    // same as config(): no 1ph/3ph switching
+    const module::BrokerFastCharging::Config broker_config;
+
+    // only the trading rounds are counted, not the construction and destruction of the market and the brokers
+    std::size_t allocations = 0;
+    int rounds = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto market = std::make_unique<module::Market>(context, request, 230.);
+        auto evse_markets = market->get_list_of_evses();
+        std::map<std::string, module::BrokerContext> contexts;
+        std::vector<std::unique_ptr<module::Broker>> brokers;
+        for (auto m : evse_markets) {
+            brokers.push_back(std::make_unique<module::BrokerFastCharging>(*m, contexts[m->energy_flow_request.uuid],
+                                                                           broker_config));
+        }
+        state.ResumeTiming();
+
+        const auto allocations_start = allocation_count.load();
+        for (rounds = 0; rounds < 100; rounds++) {
+            bool traded = false;
+            for (auto& broker : brokers) {
+                module::Offer offer(broker->get_local_market());
+                traded |= broker->trade(offer);
+            }
+            if (not traded) {
+                break;
+            }
+        }
+        allocations += allocation_count.load() - allocations_start;
+
+        state.PauseTiming();
+        market.reset();
+        brokers.clear();
+        state.ResumeTiming();
+    }
+    report(state, p, context.timestamps.size(), allocations);
+    state.counters["trading_rounds"] = rounds;
+}
+
+void run_optimizer(benchmark::State& state, const std::string& optimizer_algorithm) {
+    const TreeParameters p(state);
+    const auto request = tree(p);
+    auto conf = config(p, optimizer_algorithm);
+
+    std::unique_ptr<energyIntf> energy;
+    auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+    module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy), conf);
+
+    const auto allocations_start = allocation_count.load();
+    for (auto _ : state) {
+        auto optimized_values = module::test::run_optimizer(manager, request, c_start_time);
+        benchmark::DoNotOptimize(optimized_values);
+    }
+    report(state, p, optimizer_context(p, request).timestamps.size(), allocation_count.load() - allocations_start);
+}
+
+// depth 1-5 at a medium depot size, EVSE count 10-2000 at depth 3, schedule length 1-192, schedule mix
+void tree_arguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"depth", "evses", "slots", "mix"});
+    for (int depth = 1; depth <= 5; depth++) {
+        b->Args({depth, 100, 24, 1});
+    }
+    for (int evses : {10, 50, 200, 500, 2000}) {
+        b->Args({3, evses, 24, 1});
+    }
+    for (int slots : {1, 96, 192}) {
+        b->Args({3, 100, slots, 1});
+    }
+    for (int mix : {0, 2}) {
+        b->Args({3, 100, 24, mix});
+    }
+}
+
+} // namespace
+
+BENCHMARK(market_construction)->Apply(tree_arguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK(offer_creation)->Apply(tree_arguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK(broker_trading)->Apply(tree_arguments)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(run_optimizer, TradingRounds, std::string("TradingRounds"))
+    ->Apply(tree_arguments)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(run_optimizer, WaterFilling, std::string("WaterFilling"))
+    ->Apply(tree_arguments)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -12,5 +12,10 @@ void energy_managerImpl::init() {
 void energy_managerImpl::ready() {
 }
 
+std::vector<types::energy::EnforcedLimits>
+energy_managerImpl::handle_simulate(types::energy::EnergyFlowRequest& request) {
+    return mod->simulate(request);
+}
+
 } // namespace main
 } // namespace module
@@ -16,6 +16,9 @@ struct energy_managerImplStub : public energy_managerImplBase {
     }
     virtual void ready() {
     }
+    virtual std::vector<types::energy::EnforcedLimits> handle_simulate(types::energy::EnergyFlowRequest& request) {
+        return {};
+    }
 };
 
 } // namespace module::stub
@@ -2,11 +2,15 @@
 // Copyright Pionix GmbH and Contributors to EVerest
 #include "EnergyManager.hpp"
 #include "EnergyManagerImplStub.hpp"
+#include "LimitArrays.hpp"
 #include "Market.hpp"
+#include "Offer.hpp"
 #include <gtest/gtest.h>
 #include <utils/date.hpp>
 
 #include <optional>
+#include <random>
+#include <thread>
 #include <utility>
 
 /*
@@ -640,9 +644,7 @@ void schedule_test(const types::energy::EnergyFlowRequest& energy_flow_request,
     module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy), config);
 
     const auto start_time = Everest::Date::from_rfc3339(start_time_str);
-    module::globals.init(start_time, config.schedule_interval_duration, config.schedule_total_duration,
-                         config.slice_ampere, config.slice_watt, config.debug, energy_flow_request);
-    auto optimized_values = manager.run_optimizer(energy_flow_request);
+    auto optimized_values = manager.run_optimizer(energy_flow_request, start_time);
 
     // check result
     // std::cout << optimized_values << std::endl;
@@ -733,9 +735,7 @@ TEST(EnergyManagerTest, empty) {
     module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy), config);
 
     types::energy::EnergyFlowRequest energy_flow_request;
-    module::globals.init(date::utc_clock::now(), config.schedule_interval_duration, config.schedule_total_duration,
-                         config.slice_ampere, config.slice_watt, config.debug, energy_flow_request);
-    auto optimized_values = manager.run_optimizer(energy_flow_request);
+    auto optimized_values = manager.run_optimizer(energy_flow_request, date::utc_clock::now());
     std::cout << optimized_values << std::endl;
     EXPECT_EQ(optimized_values.size(), 0);
 }
@@ -770,9 +770,7 @@ TEST(EnergyManagerTest, noSchedules) {
 
     // use a fixed time for repeatable tests
     const auto start_time = Everest::Date::from_rfc3339("2024-01-01T12:00:00.000Z");
-    module::globals.init(start_time, config.schedule_interval_duration, config.schedule_total_duration,
-                         config.slice_ampere, config.slice_watt, config.debug, energy_flow_request);
-    auto optimized_values = manager.run_optimizer(energy_flow_request);
+    auto optimized_values = manager.run_optimizer(energy_flow_request, start_time);
 
     // check result
     // std::cout << optimized_values << std::endl;
@@ -840,9 +838,7 @@ TEST(EnergyManagerTest, schedules) {
 
     // start a little ahead of the 1st schedule
     const auto start_time = Everest::Date::from_rfc3339("2024-03-27T12:40:40.000Z");
-    module::globals.init(start_time, config.schedule_interval_duration, config.schedule_total_duration,
-                         config.slice_ampere, config.slice_watt, config.debug, energy_flow_request);
-    auto optimized_values = manager.run_optimizer(energy_flow_request);
+    auto optimized_values = manager.run_optimizer(energy_flow_request, start_time);
 
     // check result
     // std::cout << optimized_values << std::endl;
@@ -884,6 +880,447 @@ TEST(EnergyManagerTest, schedules) {
     }
 }
 
+types::energy::EnergyFlowRequest evse_request(const std::string& uuid, float max_current, float min_current) {
+    types::energy::EnergyFlowRequest r;
+    r.uuid = uuid;
+    r.node_type = types::energy::NodeType::Evse;
+    r.schedule_import = {{"2024-03-27T12:00:00.000Z", limit(max_current, min_current), limit(max_current)}};
+    r.schedule_export = {{"2024-03-27T12:00:00.000Z", limit_zero(), limit()}};
+    return r;
+}
+
+types::energy::EnergyFlowRequest node_request(const std::string& uuid, float max_current,
+                                              std::vector<types::energy::EnergyFlowRequest> evses) {
+    types::energy::EnergyFlowRequest r;
+    r.uuid = uuid;
+    r.node_type = types::energy::NodeType::Generic;
+    r.children = std::move(evses);
+    r.schedule_import = {{"2024-03-27T12:00:00.000Z", limit(max_current), limit_no_phase(max_current)}};
+    r.schedule_export = {{"2024-03-27T12:00:00.000Z", limit_zero(), limit()}};
+    return r;
+}
+
+types::energy::EnergyFlowRequest grid_request(float max_current, std::vector<types::energy::EnergyFlowRequest> evses) {
+    return node_request("grid_connection_point", max_current, std::move(evses));
+}
+
+struct module::Conf water_filling_config {
+    230.0,              // nominal_ac_voltage
+        1,              // update_interval
+        60,             // schedule_interval_duration
+        1,              // schedule_total_duration
+        0.5,            // slice_ampere
+        500,            // slice_watt
+        false,          // debug
+        "Never",        // switch_3ph1ph_while_charging_mode
+        0,              // switch_3ph1ph_max_nr_of_switches_per_session
+        "DontChange",   // switch_3ph1ph_switch_limit_stickyness
+        200,            // switch_3ph1ph_power_hysteresis_W
+        600,            // switch_3ph1ph_time_hysteresis_s
+        "WaterFilling", // optimizer_algorithm
+};
+
+TEST(EnergyManagerTest, waterFillingGcp) {
+    std::unique_ptr<energyIntf> energy;
+    auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+    module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy),
+                                  water_filling_config);
+
+    const auto& request = grid_connection_point::c_efr_grid_connection_point;
+    const auto start_time = Everest::Date::from_rfc3339("2024-03-28T14:20:13.000Z");
+    auto optimized_values = manager.run_optimizer(request, start_time);
+
+    // same result as the trading rounds
+    ASSERT_EQ(optimized_values.size(), 1);
+    EXPECT_EQ(optimized_values[0].uuid, "evse_manager");
+    ASSERT_TRUE(optimized_values[0].limits_root_side.has_value());
+    ASSERT_TRUE(optimized_values[0].limits_root_side.value().ac_max_current_A.has_value());
+    EXPECT_FLOAT_EQ(optimized_values[0].limits_root_side.value().ac_max_current_A.value(), 24.0);
+    EXPECT_EQ(optimized_values[0].limits_root_side.value().ac_max_phase_count, 3);
+}
+
+TEST(EnergyManagerTest, waterFillingFairShare) {
+    std::unique_ptr<energyIntf> energy;
+    auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+    module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy),
+                                  water_filling_config);
+
+    // one EVSE is limited below the fair share, the others share the rest equally
+    const auto request =
+        grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 8.0, 6.0),
+                            evse_request("evse3", 32.0, 6.0)});
+    const auto start_time = Everest::Date::from_rfc3339("2024-03-27T12:10:00.000Z");
+    auto optimized_values = manager.run_optimizer(request, start_time);
+
+    ASSERT_EQ(optimized_values.size(), 3);
+    const std::vector<float> expected{12.0, 8.0, 12.0};
+    for (std::size_t i = 0; i < optimized_values.size(); i++) {
+        SCOPED_TRACE(optimized_values[i].uuid);
+        ASSERT_TRUE(optimized_values[i].limits_root_side.has_value());
+        ASSERT_TRUE(optimized_values[i].limits_root_side.value().ac_max_current_A.has_value());
+        EXPECT_NEAR(optimized_values[i].limits_root_side.value().ac_max_current_A.value(), expected[i], 0.01);
+    }
+}
+
+TEST(EnergyManagerTest, waterFillingMinCurrent) {
+    std::unique_ptr<energyIntf> energy;
+    auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+    module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy),
+                                  water_filling_config);
+
+    // only two EVSEs can get their minimum current, the third one gets nothing
+    const auto request =
+        grid_request(16.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 32.0, 6.0),
+                            evse_request("evse3", 32.0, 6.0)});
+    const auto start_time = Everest::Date::from_rfc3339("2024-03-27T12:10:00.000Z");
+    auto optimized_values = manager.run_optimizer(request, start_time);
+
+    ASSERT_EQ(optimized_values.size(), 3);
+    const std::vector<float> expected{8.0, 8.0, 0.0};
+    for (std::size_t i = 0; i < optimized_values.size(); i++) {
+        SCOPED_TRACE(optimized_values[i].uuid);
+        ASSERT_TRUE(optimized_values[i].limits_root_side.has_value());
+        ASSERT_TRUE(optimized_values[i].limits_root_side.value().ac_max_current_A.has_value());
+        EXPECT_NEAR(optimized_values[i].limits_root_side.value().ac_max_current_A.value(), expected[i], 0.01);
+    }
+}
+
+TEST(EnergyManagerTest, incrementalOptimization) {
+    auto config = water_filling_config;
+    config.optimizer_algorithm = "TradingRounds";
+    config.full_optimization_interval = 10;
+
+    std::unique_ptr<energyIntf> energy;
+    auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+    module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy), config);
+
+    const auto start_time = Everest::Date::from_rfc3339("2024-03-27T12:10:00.000Z");
+    auto run = [&](const types::energy::EnergyFlowRequest& request, std::vector<float> expected) {
+        auto optimized_values = manager.run_optimizer(request, start_time);
+        ASSERT_EQ(optimized_values.size(), expected.size());
+        for (std::size_t i = 0; i < optimized_values.size(); i++) {
+            SCOPED_TRACE(optimized_values[i].uuid);
+            ASSERT_TRUE(optimized_values[i].limits_root_side.has_value());
+            ASSERT_TRUE(optimized_values[i].limits_root_side.value().ac_max_current_A.has_value());
+            EXPECT_NEAR(optimized_values[i].limits_root_side.value().ac_max_current_A.value(), expected[i], 0.01);
+        }
+    };
+
+    // first run optimizes the complete tree
+    run(grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 32.0, 6.0)}), {16.0, 16.0});
+    EXPECT_EQ(manager.optimizer_cache.runs_since_full_optimization, 0);
+
+    // nothing changed: allocation is reused
+    run(grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 32.0, 6.0)}), {16.0, 16.0});
+    EXPECT_EQ(manager.optimizer_cache.runs_since_full_optimization, 1);
+
+    // evse2 needs less: this frees energy for evse1, so the complete tree is optimized again
+    run(grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 10.0, 6.0)}), {22.0, 10.0});
+    EXPECT_EQ(manager.optimizer_cache.runs_since_full_optimization, 0);
+
+    // evse2 changes but does not free any energy: only evse2 trades again
+    run(grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 12.0, 6.0)}), {22.0, 10.0});
+    EXPECT_EQ(manager.optimizer_cache.runs_since_full_optimization, 1);
+
+    // limit of the root changed: all evses trade again
+    run(grid_request(40.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 12.0, 6.0)}), {28.0, 12.0});
+    EXPECT_EQ(manager.optimizer_cache.runs_since_full_optimization, 2);
+}
+
+TEST(EnergyManagerTest, parallelOptimization) {
+    auto sequential_config = water_filling_config;
+    sequential_config.optimizer_algorithm = "TradingRounds";
+    auto parallel_config = sequential_config;
+    parallel_config.parallel_split_depth = 1;
+    parallel_config.parallel_worker_threads = 2;
+
+    const auto start_time = Everest::Date::from_rfc3339("2024-03-27T12:10:00.000Z");
+    auto run = [&](module::Conf& config, const types::energy::EnergyFlowRequest& request) {
+        std::unique_ptr<energyIntf> energy;
+        auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+        module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy), config);
+        std::vector<float> currents;
+        for (const auto& v : manager.run_optimizer(request, start_time)) {
+            EXPECT_TRUE(v.limits_root_side.has_value() and v.limits_root_side.value().ac_max_current_A.has_value());
+            currents.push_back(v.limits_root_side.value_or(types::energy::LimitsRes{}).ac_max_current_A.value_or(0.));
+        }
+        return currents;
+    };
+
+    // subtrees of different size share the grid connection fairly, same result as without splitting the tree
+    const auto request = grid_request(40.0, {node_request("sub1", 100.0, {evse_request("evse1", 32.0, 6.0)}),
+                                             node_request("sub2", 100.0,
+                                                          {evse_request("evse2", 32.0, 6.0),
+                                                           evse_request("evse3", 32.0, 6.0),
+                                                           evse_request("evse4", 32.0, 6.0)})});
+    const auto sequential = run(sequential_config, request);
+    const auto parallel = run(parallel_config, request);
+    ASSERT_EQ(parallel.size(), 4);
+    ASSERT_EQ(parallel.size(), sequential.size());
+    for (std::size_t i = 0; i < parallel.size(); i++) {
+        EXPECT_NEAR(parallel[i], 10.0, 0.01);
+        EXPECT_NEAR(parallel[i], sequential[i], 0.01);
+    }
+
+    // one subtree is limited on its own, the other subtree gets the rest. The limits above the subtrees hold.
+    const auto limited_request =
+        grid_request(40.0, {node_request("sub1", 6.0, {evse_request("evse1", 32.0, 6.0)}),
+                            node_request("sub2", 100.0,
+                                         {evse_request("evse2", 32.0, 6.0), evse_request("evse3", 32.0, 6.0),
+                                          evse_request("evse4", 32.0, 6.0)})});
+    const auto limited = run(parallel_config, limited_request);
+    ASSERT_EQ(limited.size(), 4);
+    EXPECT_NEAR(limited[0], 6.0, 0.01);
+    float total = 0.;
+    for (std::size_t i = 1; i < limited.size(); i++) {
+        EXPECT_NEAR(limited[i], 34.0 / 3, 0.5);
+        total += limited[i];
+    }
+    EXPECT_LE(total, 34.0 + 0.01);
+}
+
+TEST(EnergyManagerTest, simulate) {
+    auto config = water_filling_config;
+    config.optimizer_algorithm = "TradingRounds";
+    config.full_optimization_interval = 10;
+
+    std::unique_ptr<energyIntf> energy;
+    auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+    module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy), config);
+
+    const auto start_time = Everest::Date::from_rfc3339("2024-03-27T12:10:00.000Z");
+    const auto live_request =
+        grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 32.0, 6.0)});
+    const auto what_if_request = grid_request(
+        48.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 32.0, 6.0), evse_request("evse3", 32.0, 6.0)});
+
+    auto expect_currents = [](const std::vector<types::energy::EnforcedLimits>& optimized_values, std::size_t size,
+                              float expected) {
+        ASSERT_EQ(optimized_values.size(), size);
+        for (const auto& v : optimized_values) {
+            SCOPED_TRACE(v.uuid);
+            ASSERT_TRUE(v.limits_root_side.has_value());
+            ASSERT_TRUE(v.limits_root_side.value().ac_max_current_A.has_value());
+            EXPECT_NEAR(v.limits_root_side.value().ac_max_current_A.value(), expected, 0.01);
+        }
+    };
+
+    expect_currents(manager.run_optimizer(live_request, start_time), 2, 16.0);
+    manager.run_optimizer(live_request, start_time);
+    EXPECT_EQ(manager.optimizer_cache.runs_since_full_optimization, 1);
+
+    // a simulation does not change the state of the live optimization
+    expect_currents(manager.simulate(what_if_request), 3, 16.0);
+    EXPECT_EQ(manager.optimizer_cache.runs_since_full_optimization, 1);
+    EXPECT_EQ(manager.contexts.count("evse3"), 0);
+
+    // simulations can run while the live optimization runs
+    std::thread simulation([&]() {
+        for (int i = 0; i < 20; i++) {
+            expect_currents(manager.simulate(what_if_request), 3, 16.0);
+        }
+    });
+    for (int i = 0; i < 20; i++) {
+        expect_currents(manager.run_optimizer(live_request, start_time), 2, 16.0);
+    }
+    simulation.join();
+}
+
+TEST(EnergyManagerTest, limitArraysKernels) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> value(-50., 50.);
+    auto random_optional = [&]() -> std::optional<float> {
+        if (rng() % 3 == 0) {
+            return std::nullopt;
+        }
+        return value(rng);
+    };
+
+    auto min_reference = [](std::optional<float> a, std::optional<float> b) -> std::optional<float> {
+        if (not b.has_value()) {
+            return a;
+        }
+        return a.has_value() and not(b.value() < a.value()) ? a : b;
+    };
+    auto max_reference = [](std::optional<float> a, std::optional<float> b) -> std::optional<float> {
+        if (not b.has_value()) {
+            return a;
+        }
+        return a.has_value() and not(b.value() > a.value()) ? a : b;
+    };
+    auto add_reference = [](std::optional<float> a, std::optional<float> b) -> std::optional<float> {
+        if (not b.has_value()) {
+            return a;
+        }
+        return b.value() + a.value_or(0);
+    };
+    auto add_negative_part_reference = [](std::optional<float> a, std::optional<float> b,
+                                          float sign) -> std::optional<float> {
+        if (not a.has_value()) {
+            return a;
+        }
+        return a.value() + std::min(0.F, sign * b.value_or(0));
+    };
+
+    // lengths that do and do not fill complete blocks of 8 slots
+    for (std::size_t length : {1, 8, 13, 96}) {
+        std::vector<std::optional<float>> a(length), b(length);
+        module::LimitArrays x(length), y(length);
+        for (std::size_t i = 0; i < length; i++) {
+            a[i] = random_optional();
+            b[i] = random_optional();
+            if (i % 5 == 0 and a[i].has_value()) {
+                b[i] = a[i]; // equal values
+            }
+            types::energy::LimitsReq la, lb;
+            la.ac_max_current_A = la.ac_min_current_A = la.total_power_W = a[i];
+            lb.ac_max_current_A = lb.ac_min_current_A = lb.total_power_W = b[i];
+            x.set(i, la);
+            y.set(i, lb);
+        }
+
+        x.limit_min(module::LimitArrays::MaxCurrent, y);
+        x.limit_max(module::LimitArrays::MinCurrent, y);
+        x.add(module::LimitArrays::TotalPower, y);
+        for (std::size_t i = 0; i < length; i++) {
+            EXPECT_EQ(x.get(module::LimitArrays::MaxCurrent, i), min_reference(a[i], b[i])) << length << " " << i;
+            EXPECT_EQ(x.get(module::LimitArrays::MinCurrent, i), max_reference(a[i], b[i])) << length << " " << i;
+            EXPECT_EQ(x.get(module::LimitArrays::TotalPower, i), add_reference(a[i], b[i])) << length << " " << i;
+        }
+
+        for (float sign : {1.F, -1.F}) {
+            module::LimitArrays z(length);
+            for (std::size_t i = 0; i < length; i++) {
+                types::energy::LimitsReq la;
+                la.ac_max_current_A = a[i];
+                z.set(i, la);
+            }
+            z.add_negative_part(module::LimitArrays::MaxCurrent, y, sign);
+            for (std::size_t i = 0; i < length; i++) {
+                EXPECT_EQ(z.get(module::LimitArrays::MaxCurrent, i), add_negative_part_reference(a[i], b[i], sign))
+                    << length << " " << i;
+            }
+        }
+    }
+}
+
+TEST(EnergyManagerTest, pathOfferCache) {
+    auto request = grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 32.0, 6.0)});
+    const auto start_time = Everest::Date::from_rfc3339("2024-03-27T12:10:00.000Z");
+    const module::OptimizerContext optimizer_context(
+        start_time, water_filling_config.schedule_interval_duration, water_filling_config.schedule_total_duration,
+        water_filling_config.slice_ampere, water_filling_config.slice_watt, water_filling_config.debug, request);
+    module::Market market(optimizer_context, request, water_filling_config.nominal_ac_voltage);
+    auto evse_markets = market.get_list_of_evses();
+    ASSERT_EQ(evse_markets.size(), 2);
+
+    auto offer = module::Offer(*evse_markets[0]);
+    ASSERT_TRUE(offer.import_offer[0].limits_to_root.ac_max_current_A.has_value());
+    EXPECT_FLOAT_EQ(offer.import_offer[0].limits_to_root.ac_max_current_A.value(), 32.0);
+
+    // a trade of the sibling changes the energy available at the root and invalidates the cached path
+    auto traded = optimizer_context.zero_schedule_res;
+    traded[0].limits_to_root.ac_max_current_A = 10.0;
+    evse_markets[1]->trade(traded);
+
+    offer = module::Offer(*evse_markets[0]);
+    EXPECT_FLOAT_EQ(offer.import_offer[0].limits_to_root.ac_max_current_A.value(), 22.0);
+    offer = module::Offer(*evse_markets[1]);
+    EXPECT_FLOAT_EQ(offer.import_offer[0].limits_to_root.ac_max_current_A.value(), 22.0);
+}
+
+TEST(EnergyManagerTest, enforceOnlyChangedLimits) {
+    auto config = water_filling_config;
+    config.enforce_limits_only_changed = true;
+    config.enforce_limits_tolerance_A = 0.1;
+    config.enforce_limits_tolerance_W = 50;
+
+    std::unique_ptr<energyIntf> energy;
+    auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+    module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy), config);
+
+    auto request = grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 32.0, 6.0)});
+    const auto start_time = Everest::Date::from_rfc3339("2024-03-27T12:10:00.000Z");
+    auto limits = manager.run_optimizer(request, start_time);
+    ASSERT_EQ(limits.size(), 2);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    auto set_current = [&](float current) {
+        limits[0].limits_root_side.value().ac_max_current_A = current;
+        limits[0].schedule.value()[0].limits_to_root.ac_max_current_A = current;
+    };
+
+    // all limits are sent initially, unchanged limits are not sent again
+    EXPECT_EQ(manager.select_changed_limits(limits, t0).size(), 2);
+    EXPECT_EQ(manager.select_changed_limits(limits, t0 + std::chrono::seconds(1)).size(), 0);
+
+    // changes within the tolerance are ignored
+    set_current(16.05);
+    EXPECT_EQ(manager.select_changed_limits(limits, t0 + std::chrono::seconds(2)).size(), 0);
+
+    set_current(12.0);
+    auto changed = manager.select_changed_limits(limits, t0 + std::chrono::seconds(3));
+    ASSERT_EQ(changed.size(), 1);
+    EXPECT_EQ(changed[0].uuid, "evse1");
+
+    // unchanged limits are refreshed after 5 update intervals, before they expire
+    changed = manager.select_changed_limits(limits, t0 + std::chrono::seconds(5));
+    ASSERT_EQ(changed.size(), 1);
+    EXPECT_EQ(changed[0].uuid, "evse2");
+    EXPECT_EQ(manager.select_changed_limits(limits, t0 + std::chrono::seconds(7)).size(), 0);
+    EXPECT_EQ(manager.select_changed_limits(limits, t0 + std::chrono::seconds(8)).size(), 1);
+}
+
+TEST(EnergyManagerTest, energyFlowRequestPatches) {
+    std::unique_ptr<energyIntf> energy;
+    auto energy_managerImpl = std::make_unique<module::stub::energy_managerImplStub>();
+    module::EnergyManager manager(c_module_info, std::move(energy_managerImpl), std::move(energy),
+                                  water_filling_config);
+
+    auto patch = [](int version, std::vector<std::string> path) {
+        types::energy::EnergyFlowRequestPatch p;
+        p.uuid = "grid_connection_point";
+        p.version = version;
+        p.path = std::move(path);
+        return p;
+    };
+
+    // patches before the first snapshot request a snapshot
+    auto p = patch(1, {"evse1"});
+    p.node = evse_request("evse1", 16.0, 6.0);
+    EXPECT_TRUE(manager.apply_energy_flow_request_patch(p));
+
+    p = patch(2, {});
+    p.node = grid_request(32.0, {evse_request("evse1", 32.0, 6.0), evse_request("evse2", 32.0, 6.0)});
+    EXPECT_FALSE(manager.apply_energy_flow_request_patch(p));
+    auto snapshot = manager.energy_flow_request_snapshot();
+    ASSERT_EQ(snapshot->children.size(), 2);
+
+    // no copy if nothing changed
+    EXPECT_EQ(manager.energy_flow_request_snapshot(), snapshot);
+
+    p = patch(3, {"evse2"});
+    p.node = evse_request("evse2", 8.0, 6.0);
+    EXPECT_FALSE(manager.apply_energy_flow_request_patch(p));
+    auto patched = manager.energy_flow_request_snapshot();
+    EXPECT_NE(patched, snapshot);
+    EXPECT_FLOAT_EQ(patched->children[1].schedule_import.value()[0].limits_to_root.ac_max_current_A.value(), 8.0);
+    // the old snapshot is immutable
+    EXPECT_FLOAT_EQ(snapshot->children[1].schedule_import.value()[0].limits_to_root.ac_max_current_A.value(), 32.0);
+
+    auto limits = manager.run_optimizer(*patched, Everest::Date::from_rfc3339("2024-03-27T12:10:00.000Z"));
+    ASSERT_EQ(limits.size(), 2);
+    EXPECT_FLOAT_EQ(limits[1].limits_root_side.value().ac_max_current_A.value(), 8.0);
+
+    // a missing version requests a snapshot, patches are ignored until it arrives
+    p = patch(5, {"evse1"});
+    p.energy_usage_root.emplace();
+    EXPECT_TRUE(manager.apply_energy_flow_request_patch(p));
+    p.version = 6;
+    EXPECT_FALSE(manager.apply_energy_flow_request_patch(p));
+    EXPECT_EQ(manager.energy_flow_request_snapshot(), patched);
+}
+
 TEST(EnergyManagerTest, before) {
     test::schedule_test(energy_flow_request, "2024-03-27T12:40:00.000Z", 24.0);
 }
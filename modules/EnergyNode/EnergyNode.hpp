@@ -29,6 +29,8 @@ namespace module {
 struct Conf {
     double fuse_limit_A;
     int phase_count;
+    bool publish_patches;
+    int publish_coalescing_window_ms;
 };
 
 class EnergyNode : public Everest::ModuleBase {
@@ -2,9 +2,11 @@
 // Copyright 2022 - 2022 Pionix GmbH and Contributors to EVerest
 
 #include "energyImpl.hpp"
+#include <algorithm>
 #include <chrono>
 #include <date/date.h>
 #include <date/tz.h>
+#include <thread>
 #include <utils/date.hpp>
 
 namespace module {
@@ -21,24 +23,27 @@ void energyImpl::init() {
     energy_flow_request.schedule_import.emplace(std::vector<types::energy::ScheduleReqEntry>({local_schedule}));
     energy_flow_request.schedule_export.emplace(std::vector<types::energy::ScheduleReqEntry>({local_schedule}));
 
-    for (auto& entry : mod->r_energy_consumer) {
-        entry->subscribe_energy_flow_request([this](types::energy::EnergyFlowRequest e) {
+    for (std::size_t consumer = 0; consumer < mod->r_energy_consumer.size(); consumer++) {
+        auto& entry = mod->r_energy_consumer[consumer];
+        entry->subscribe_energy_flow_request([this, consumer](types::energy::EnergyFlowRequest e) {
             // Received new energy_flow_request object from a child. Update in the cached object and republish.
             std::scoped_lock lock(energy_mutex);
+            update_child(e, consumer);
+        });
 
-            bool child_found = false;
-            for (auto& child : energy_flow_request.children) {
-                if (child.uuid == e.uuid) {
-                    child = e;
-                    child_found = true;
-                }
+        // Children that publish patches only send the part of their tree that changed
+        auto& child = *entry;
+        entry->subscribe_energy_flow_request_patch([this, &child, consumer](types::energy::EnergyFlowRequestPatch p) {
+            bool resync_needed = false;
+            {
+                std::scoped_lock lock(energy_mutex);
+                resync_needed = update_child(p, consumer);
             }
 
-            if (!child_found) {
-                energy_flow_request.children.push_back(e);
+            if (resync_needed) {
+                EVLOG_info << "Missed an energy flow request patch of " << p.uuid << ", requesting a snapshot";
+                child.call_resync_energy_flow_request();
             }
-
-            publish_complete_energy_object();
         });
     }
 
@@ -47,7 +52,9 @@ void energyImpl::init() {
             EVLOG_debug << "Incoming powermeter readings: " << p;
             std::scoped_lock lock(energy_mutex);
             energy_flow_request.energy_usage_root = p;
-            publish_complete_energy_object();
+            types::energy::EnergyFlowRequestPatch patch;
+            patch.energy_usage_root = p;
+            publish_change(patch, false);
         });
     }
 
@@ -57,11 +64,76 @@ void energyImpl::init() {
                 EVLOG_debug << "Incoming price schedule: " << p;
                 std::scoped_lock lock(energy_mutex);
                 energy_pricing = p;
-                publish_complete_energy_object();
+                if (mod->config.publish_patches) {
+                    publish_schedules();
+                } else {
+                    publish_change(std::nullopt, false);
+                }
             });
     }
 }
 
+types::energy::EnergyFlowRequest* energyImpl::find_child(const std::string& uuid) {
+    const auto it = child_index.find(uuid);
+    if (it == child_index.end()) {
+        return nullptr;
+    }
+    return &energy_flow_request.children[it->second];
+}
+
+// Remembers that node and all nodes below it are reached through r_energy_consumer[consumer]. Nodes that are
+// removed keep their entry, limits for them are not sent anyway.
+void energyImpl::index_subtree(const types::energy::EnergyFlowRequest& node, std::size_t consumer) {
+    route_index[node.uuid] = consumer;
+    for (const auto& child : node.children) {
+        index_subtree(child, consumer);
+    }
+}
+
+void energyImpl::update_child(const types::energy::EnergyFlowRequest& e, std::size_t consumer) {
+    index_subtree(e, consumer);
+
+    auto child = find_child(e.uuid);
+    if (child != nullptr) {
+        *child = e;
+    } else {
+        child_index[e.uuid] = energy_flow_request.children.size();
+        energy_flow_request.children.push_back(e);
+    }
+
+    publish_change(everest::staging::energy_flow::child_patch(e, energy_flow_request.uuid),
+                   everest::staging::energy_flow::is_priority_request(e));
+}
+
+// Returns true if a snapshot needs to be requested from the child
+bool energyImpl::update_child(const types::energy::EnergyFlowRequestPatch& p, std::size_t consumer) {
+    using Result = everest::staging::energy_flow::PatchSequence::Result;
+
+    const auto result = child_patches.check(p);
+    if (result != Result::Apply) {
+        return result == Result::RequestResync;
+    }
+
+    auto child = find_child(p.uuid);
+    if (child == nullptr and everest::staging::energy_flow::is_snapshot(p)) {
+        child_index[p.uuid] = energy_flow_request.children.size();
+        energy_flow_request.children.push_back(p.node.value());
+    } else if (child == nullptr or not everest::staging::energy_flow::apply_patch(*child, p)) {
+        // our copy of the tree of the child is outdated
+        child_patches.resync_requested(p.uuid);
+        return true;
+    }
+
+    // only patches with a node change the structure of the tree
+    if (p.node.has_value()) {
+        index_subtree(p.node.value(), consumer);
+    }
+
+    const bool priority = p.node.has_value() and everest::staging::energy_flow::is_priority_request(p.node.value());
+    publish_change(everest::staging::energy_flow::forward_patch(p, energy_flow_request.uuid), priority);
+    return false;
+}
+
 types::energy::ScheduleReqEntry energyImpl::get_local_schedule() {
     // local schedule of this module
     types::energy::ScheduleReqEntry local_schedule;
@@ -121,21 +193,84 @@ void energyImpl::set_external_limits(types::energy::ExternalLimits& l) {
             energy_flow_request.schedule_export.emplace(std::vector<types::energy::ScheduleReqEntry>({local_schedule}));
         }
     }
+
+    // Complete objects only pick up the new schedules with the next update, patches need to send them explicitly
+    if (mod->config.publish_patches) {
+        publish_schedules();
+    }
 }
 
-void energyImpl::publish_complete_energy_object() {
+void energyImpl::merge_prices(std::optional<std::vector<types::energy::ScheduleReqEntry>>& schedule_import,
+                              std::optional<std::vector<types::energy::ScheduleReqEntry>>& schedule_export) {
     // join the different schedules to the complete array (with resampling)
+    if (schedule_import.has_value() && energy_pricing.schedule_import.has_value()) {
+        merge_price_into_schedule(schedule_import.value(), energy_pricing.schedule_import.value());
+    }
+
+    if (schedule_export.has_value() && energy_pricing.schedule_export.has_value()) {
+        merge_price_into_schedule(schedule_export.value(), energy_pricing.schedule_export.value());
+    }
+}
+
+void energyImpl::publish_complete_energy_object() {
     types::energy::EnergyFlowRequest energy_complete = energy_flow_request;
+    merge_prices(energy_complete.schedule_import, energy_complete.schedule_export);
+
+    if (mod->config.publish_patches) {
+        // a snapshot: empty path and the complete node
+        types::energy::EnergyFlowRequestPatch patch;
+        patch.node = std::move(energy_complete);
+        publish_patch(patch);
+    } else {
+        publish_energy_flow_request(energy_complete);
+    }
+}
 
-    if (energy_flow_request.schedule_import.has_value() && energy_pricing.schedule_import.has_value()) {
-        merge_price_into_schedule(energy_complete.schedule_import.value(), energy_pricing.schedule_import.value());
+void energyImpl::publish_schedules() {
+    types::energy::EnergyFlowRequestPatch patch;
+    patch.schedule_import = energy_flow_request.schedule_import;
+    patch.schedule_export = energy_flow_request.schedule_export;
+    merge_prices(patch.schedule_import, patch.schedule_export);
+    publish_change(patch, false);
+}
+
+// Publishes a change now or at the end of the coalescing window. In patch mode, patch describes the change, otherwise
+// the complete object is published. Must be called with energy_mutex held.
+void energyImpl::publish_change(std::optional<types::energy::EnergyFlowRequestPatch> patch, bool priority) {
+    if (mod->config.publish_patches and patch.has_value()) {
+        everest::staging::energy_flow::merge_patch(pending_patches, std::move(patch.value()));
     }
+    publish_pending = true;
 
-    if (energy_flow_request.schedule_export.has_value() && energy_pricing.schedule_export.has_value()) {
-        merge_price_into_schedule(energy_complete.schedule_export.value(), energy_pricing.schedule_export.value());
+    // priority requests are not delayed
+    if (priority or mod->config.publish_coalescing_window_ms <= 0) {
+        flush_pending();
+    } else {
+        publish_condvar.notify_one();
     }
+}
 
-    publish_energy_flow_request(energy_complete);
+// Must be called with energy_mutex held
+void energyImpl::flush_pending() {
+    if (not publish_pending) {
+        return;
+    }
+    publish_pending = false;
+
+    if (mod->config.publish_patches) {
+        for (auto& patch : pending_patches) {
+            publish_patch(patch);
+        }
+        pending_patches.clear();
+    } else {
+        publish_complete_energy_object();
+    }
+}
+
+void energyImpl::publish_patch(types::energy::EnergyFlowRequestPatch& patch) {
+    patch.uuid = energy_flow_request.uuid;
+    patch.version = static_cast<int32_t>(++patch_version);
+    publish_energy_flow_request_patch(patch);
 }
 
 void energyImpl::merge_price_into_schedule(std::vector<types::energy::ScheduleReqEntry>& schedule,
@@ -185,7 +320,26 @@ void energyImpl::merge_price_into_schedule(std::vector<types::energy::ScheduleRe
 
 void energyImpl::ready() {
     // publish own limits at least once
-    publish_energy_flow_request(energy_flow_request);
+    {
+        std::scoped_lock lock(energy_mutex);
+        publish_complete_energy_object();
+    }
+
+    if (mod->config.publish_coalescing_window_ms > 0) {
+        // publishes all changes that arrived within one window at its end
+        std::thread([this] {
+            const auto window = std::chrono::milliseconds(mod->config.publish_coalescing_window_ms);
+            while (true) {
+                std::unique_lock<std::mutex> lock(energy_mutex);
+                publish_condvar.wait(lock, [this] { return publish_pending; });
+                lock.unlock();
+                std::this_thread::sleep_for(window);
+                lock.lock();
+                flush_pending();
+            }
+        }).detach();
+    }
+
     mod->signalExternalLimit.connect([this](types::energy::ExternalLimits& l) { set_external_limits(l); });
 }
 
@@ -195,15 +349,69 @@ void energyImpl::handle_enforce_limits(types::energy::EnforcedLimits& value) {
     if (value.uuid == energy_flow_request.uuid) {
         // as a generic node we cannot do much about limits, we just publish it for e.g. OCPP module.
         mod->p_external_limits->publish_enforced_limits(value);
+        return;
     }
-    // if not, route to children
-    // FIXME: this sends it to all children, we could do a lookup on which branch it actually is
-    else {
+
+    // if not, route to the child that has the node in its subtree
+    std::optional<std::size_t> consumer;
+    {
+        std::scoped_lock lock(energy_mutex);
+        const auto it = route_index.find(value.uuid);
+        if (it != route_index.end()) {
+            consumer = it->second;
+        }
+    }
+
+    if (consumer.has_value()) {
+        mod->r_energy_consumer[consumer.value()]->call_enforce_limits(value);
+    } else {
+        // the child did not publish the node yet
         for (auto& entry : mod->r_energy_consumer) {
             entry->call_enforce_limits(value);
         }
     }
 };
 
+void energyImpl::handle_resync_energy_flow_request() {
+    std::scoped_lock lock(energy_mutex);
+    // the snapshot contains all pending changes
+    publish_pending = false;
+    pending_patches.clear();
+    publish_complete_energy_object();
+}
+
+void energyImpl::handle_enforce_limits_batch(std::vector<types::energy::EnforcedLimits>& value) {
+    // entries for each child, entries for nodes the children did not publish yet go to all of them
+    std::vector<std::vector<types::energy::EnforcedLimits>> limits_for_children(mod->r_energy_consumer.size());
+    std::vector<types::energy::EnforcedLimits> limits_for_unknown;
+
+    {
+        std::scoped_lock lock(energy_mutex);
+        for (auto& limits : value) {
+            // is it for me?
+            if (limits.uuid == energy_flow_request.uuid) {
+                mod->p_external_limits->publish_enforced_limits(limits);
+                continue;
+            }
+
+            const auto it = route_index.find(limits.uuid);
+            if (it != route_index.end()) {
+                limits_for_children[it->second].push_back(std::move(limits));
+            } else {
+                limits_for_unknown.push_back(std::move(limits));
+            }
+        }
+    }
+
+    // route the rest to the children in one message each
+    for (std::size_t consumer = 0; consumer < limits_for_children.size(); consumer++) {
+        auto& limits = limits_for_children[consumer];
+        limits.insert(limits.end(), limits_for_unknown.begin(), limits_for_unknown.end());
+        if (not limits.empty()) {
+            mod->r_energy_consumer[consumer]->call_enforce_limits_batch(limits);
+        }
+    }
+}
+
 } // namespace energy_grid
 } // namespace module
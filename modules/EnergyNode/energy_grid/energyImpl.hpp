@@ -14,7 +14,11 @@
 
 // ev@75ac1216-19eb-4182-a85c-820f1fc2c091:v1
 // insert your custom include headers here
+#include <condition_variable>
 #include <mutex>
+#include <unordered_map>
+
+#include <everest/staging/energy_flow/patch.hpp>
 // ev@75ac1216-19eb-4182-a85c-820f1fc2c091:v1
 
 namespace module {
@@ -35,6 +39,8 @@ public:
 protected:
     // command handler functions (virtual)
     virtual void handle_enforce_limits(types::energy::EnforcedLimits& value) override;
+    virtual void handle_enforce_limits_batch(std::vector<types::energy::EnforcedLimits>& value) override;
+    virtual void handle_resync_energy_flow_request() override;
 
     // ev@d2d1847a-7b88-41dd-ad07-92785f06f5c4:v1
     // insert your protected definitions here
@@ -51,12 +57,35 @@ private:
     std::mutex energy_mutex;
     // subtree including children
     types::energy::EnergyFlowRequest energy_flow_request;
+    // index of each child in energy_flow_request.children by uuid, children are never removed
+    std::unordered_map<std::string, std::size_t> child_index;
+    // index of the r_energy_consumer entry whose subtree contains a node, by uuid of the node
+    std::unordered_map<std::string, std::size_t> route_index;
 
     // contains only the pricing informations last update
     types::energy_price_information::EnergyPriceSchedule energy_pricing;
 
+    // versions of the patches received from the children and of the patches published by this node
+    everest::staging::energy_flow::PatchSequence child_patches;
+    std::uint32_t patch_version{0};
+
+    // changes collected during the coalescing window
+    bool publish_pending{false};
+    std::vector<types::energy::EnergyFlowRequestPatch> pending_patches;
+    std::condition_variable publish_condvar;
+
     types::energy::ScheduleReqEntry get_local_schedule();
     void publish_complete_energy_object();
+    void publish_change(std::optional<types::energy::EnergyFlowRequestPatch> patch, bool priority);
+    void flush_pending();
+    types::energy::EnergyFlowRequest* find_child(const std::string& uuid);
+    void publish_patch(types::energy::EnergyFlowRequestPatch& patch);
+    void publish_schedules();
+    void update_child(const types::energy::EnergyFlowRequest& child, std::size_t consumer);
+    bool update_child(const types::energy::EnergyFlowRequestPatch& patch, std::size_t consumer);
+    void index_subtree(const types::energy::EnergyFlowRequest& node, std::size_t consumer);
+    void merge_prices(std::optional<std::vector<types::energy::ScheduleReqEntry>>& schedule_import,
+                      std::optional<std::vector<types::energy::ScheduleReqEntry>>& schedule_export);
     void set_external_limits(types::energy::ExternalLimits& l);
     void merge_price_into_schedule(std::vector<types::energy::ScheduleReqEntry>& schedule,
                                    const std::vector<types::energy_price_information::PricePerkWh>& price);
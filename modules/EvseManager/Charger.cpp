@@ -65,7 +65,7 @@ Charger::Charger(const std::unique_ptr<IECStateMachine>& bsp, const std::unique_
     hlc_use_5percent_current_session = false;
 
     // create thread for processing errors/error clearings
-    std::thread error_thread([this]() {
+    error_thread = std::thread([this]() {
         for (;;) {
             auto events = this->error_handling_event_queue.wait();
             if (!events.empty()) {
@@ -81,16 +81,18 @@ Charger::Charger(const std::unique_ptr<IECStateMachine>& bsp, const std::unique_
                     case ErrorHandlingEvents::AllErrorCleared:
                         shared_context.error_prevent_charging_flag = false;
                         break;
+                    case ErrorHandlingEvents::StopThread:
+                        return;
                     default:
                         EVLOG_error << "ErrorHandlingEvents invalid value: "
                                     << static_cast<std::underlying_type_t<ErrorHandlingEvents>>(event);
                         break;
                     }
                 }
+                wakeup_mainloop();
             }
         }
     });
-    error_thread.detach();
 
     // Register callbacks for errors/error clearings
     error_handling->signal_error.connect([this](const bool prevent_charging) {
@@ -110,35 +112,124 @@ Charger::Charger(const std::unique_ptr<IECStateMachine>& bsp, const std::unique_
 }
 
 Charger::~Charger() {
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    TimerService::Id timer;
+    {
+        std::scoped_lock lock(mainloop_mutex);
+        mainloop_on_timer_service = false;
+        timer = mainloop_timer;
+    }
+    TimerService::instance().cancel_and_wait(timer);
+#endif
     pwm_F();
+
+    error_handling_event_queue.push(ErrorHandlingEvents::StopThread);
+    error_thread.join();
 }
 
 void Charger::main_thread() {
+    start_mainloop();
+
+    while (true) {
+        if (main_thread_handle.shouldExit()) {
+            break;
+        }
+
+        {
+            // sleep until woken up by an event or until the next timeout of the state machine is due
+            std::unique_lock<std::mutex> lock(mainloop_mutex);
+            while (not mainloop_wakeup and TimerService::instance().now() < next_mainloop_run) {
+                mainloop_condvar.wait_until(lock, next_mainloop_run);
+            }
+            mainloop_wakeup = false;
+            // the state machine schedules its next run while it is running
+            next_mainloop_run = TimerService::instance().now() + MAINLOOP_MAX_SLEEP;
+        }
+
+        run_mainloop_once();
+    }
+}
 
+void Charger::start_mainloop() {
     // Enable CP output
     bsp->enable(true);
 
     // publish initial values
     signal_max_current(get_max_current_internal());
     signal_state(shared_context.current_state);
+}
 
-    while (true) {
-        if (main_thread_handle.shouldExit()) {
-            break;
+void Charger::run_mainloop_once() {
+    Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_mainloop);
+    // update power limits
+    power_available();
+    // Run our own state machine update (i.e. run everything that needs
+    // to be done on regular intervals independent from events)
+    run_state_machine();
+}
+
+// Wakes up the main loop, e.g. after an external event changed the shared context. May be called before the change
+// while state_machine_mutex is held, the main loop waits for the mutex before it runs the state machine.
+void Charger::wakeup_mainloop() {
+    {
+        std::scoped_lock lock(mainloop_mutex);
+        mainloop_wakeup = true;
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+        if (mainloop_on_timer_service) {
+            schedule_mainloop_timer(TimerService::instance().now());
+            return;
         }
+#endif
+    }
+    mainloop_condvar.notify_one();
+}
+
+// Makes sure the main loop runs the state machine again after t, e.g. when a timeout of the current state expires
+void Charger::run_mainloop_in(std::chrono::milliseconds t) {
+    if (t <= std::chrono::milliseconds(0)) {
+        // already handled in the current run
+        return;
+    }
 
-        std::this_thread::sleep_for(MAINLOOP_UPDATE_RATE);
+    const auto run_at = TimerService::instance().now() + t;
+    std::scoped_lock lock(mainloop_mutex);
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    if (mainloop_on_timer_service) {
+        schedule_mainloop_timer(run_at);
+        return;
+    }
+#endif
+    if (run_at < next_mainloop_run) {
+        next_mainloop_run = run_at;
+        mainloop_condvar.notify_one();
+    }
+}
 
-        {
-            Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_mainloop);
-            // update power limits
-            power_available();
-            // Run our own state machine update (i.e. run everything that needs
-            // to be done on regular intervals independent from events)
-            run_state_machine();
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+void Charger::schedule_mainloop_timer(std::chrono::time_point<std::chrono::steady_clock> run_at) {
+    if (not mainloop_started or (mainloop_timer not_eq 0 and run_at >= next_mainloop_run)) {
+        return;
+    }
+    auto& timers = TimerService::instance();
+    timers.cancel(mainloop_timer);
+    next_mainloop_run = run_at;
+    mainloop_timer = timers.schedule(run_at - timers.now(), [this]() { mainloop_timer_fired(); });
+}
+
+void Charger::mainloop_timer_fired() {
+    {
+        std::scoped_lock lock(mainloop_mutex);
+        if (not mainloop_on_timer_service) {
+            return;
         }
+        mainloop_wakeup = false;
+        mainloop_timer = 0;
+        // the state machine schedules an earlier run while it is running
+        schedule_mainloop_timer(TimerService::instance().now() + MAINLOOP_MAX_SLEEP);
     }
+    run_mainloop_once();
 }
+#endif
 
 void Charger::run_state_machine() {
 
@@ -163,13 +254,21 @@ void Charger::run_state_machine() {
         internal_context.last_state_detect_state_change = shared_context.current_state;
         internal_context.last_error_prevent_charging_flag = shared_context.error_prevent_charging_flag;
 
-        auto now = std::chrono::system_clock::now();
+        auto now = TimerService::instance().now();
 
-        if (shared_context.ac_with_soc_timeout and (shared_context.ac_with_soc_timer -= 50) < 0) {
-            shared_context.ac_with_soc_timeout = false;
-            shared_context.ac_with_soc_timer = 3600000;
-            signal_ac_with_soc_timeout();
-            return;
+        if (shared_context.ac_with_soc_timeout) {
+            shared_context.ac_with_soc_timer -= std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                    now - internal_context.ac_with_soc_timer_last_update)
+                                                    .count();
+            internal_context.ac_with_soc_timer_last_update = now;
+
+            if (shared_context.ac_with_soc_timer < 0) {
+                shared_context.ac_with_soc_timeout = false;
+                shared_context.ac_with_soc_timer = 3600000;
+                signal_ac_with_soc_timeout();
+                return;
+            }
+            run_mainloop_in(std::chrono::milliseconds(shared_context.ac_with_soc_timer + 1));
         }
 
         if (initialize_state) {
@@ -263,7 +362,7 @@ void Charger::run_state_machine() {
                 if (hlc_use_5percent_current_session) {
                     // FIXME: wait for SLAC to be ready. Teslas are really fast with sending the first slac packet after
                     // enabling PWM.
-                    std::this_thread::sleep_for(SLEEP_BEFORE_ENABLING_PWM_HLC_MODE);
+                    TimerService::instance().sleep_for(SLEEP_BEFORE_ENABLING_PWM_HLC_MODE);
                     update_pwm_now(PWM_5_PERCENT);
                     stopwatch.mark("HLC_PWM_5%_ON");
                 }
@@ -279,6 +378,7 @@ void Charger::run_state_machine() {
                         EVLOG_warning << "PP ampacity is zero, still retrying to read PP ampacity...";
                         internal_context.pp_warning_printed = true;
                     }
+                    run_mainloop_in(MAINLOOP_UPDATE_RATE);
                     break;
                 }
             }
@@ -453,6 +553,9 @@ void Charger::run_state_machine() {
                 bsp->switch_three_phases_while_charging(shared_context.switch_3ph1ph_threephase);
                 shared_context.switch_3ph1ph_threephase_ongoing = false;
                 shared_context.current_state = internal_context.switching_phases_return_state;
+            } else {
+                run_mainloop_in(
+                    std::chrono::milliseconds(config_context.switch_3ph1ph_delay_s * 1000 - time_in_current_state));
             }
             break;
 
@@ -477,6 +580,13 @@ void Charger::run_state_machine() {
                 session_log.evse(false, "Pause in X1 for EV READY regulations");
                 pwm_off();
             }
+
+            if (internal_context.t_step_ef_x1_pause) {
+                run_mainloop_in(
+                    std::chrono::milliseconds(T_STEP_EF + STAY_IN_X1_AFTER_TSTEP_EF_MS - time_in_current_state));
+            } else {
+                run_mainloop_in(std::chrono::milliseconds(T_STEP_EF - time_in_current_state));
+            }
             break;
 
         case EvseState::T_step_X1:
@@ -493,6 +603,8 @@ void Charger::run_state_machine() {
                     internal_context.pwm_set_last_ampere = internal_context.t_step_EF_return_ampere;
                 }
                 shared_context.current_state = internal_context.t_step_X1_return_state;
+            } else {
+                run_mainloop_in(std::chrono::milliseconds(T_STEP_X1 - time_in_current_state));
             }
             break;
 
@@ -555,6 +667,10 @@ void Charger::run_state_machine() {
                             // We are still here after the wakeup plus some extra delay, so probably the EV really does
                             // not want to charge. Switch to ChargingPausedEV state.
                             shared_context.current_state = EvseState::ChargingPausedEV;
+                        } else if (not shared_context.hlc_charging_active) {
+                            const auto timeout = shared_context.legacy_wakeup_done ? PREPARING_TIMEOUT_PAUSED_BY_EV
+                                                                                   : LEGACY_WAKEUP_TIMEOUT;
+                            run_mainloop_in(std::chrono::milliseconds(timeout - time_in_current_state + 1));
                         }
                     }
                 }
@@ -595,6 +711,9 @@ void Charger::run_state_machine() {
                 if (internal_context.pwm_F_active and
                     time_in_fatal_error_state_ms() > config_context.state_F_after_fault_ms) {
                     pwm_off();
+                } else if (internal_context.pwm_F_active) {
+                    run_mainloop_in(std::chrono::milliseconds(config_context.state_F_after_fault_ms -
+                                                              time_in_fatal_error_state_ms() + 1));
                 }
             }
 
@@ -951,12 +1070,14 @@ void Charger::process_cp_events_independent(CPEvent cp_event) {
 void Charger::update_pwm_max_every_5seconds_ampere(float ampere) {
     float dc = ampere_to_duty_cycle(ampere);
     if (dc not_eq internal_context.update_pwm_last_dc) {
-        auto now = std::chrono::steady_clock::now();
+        auto now = TimerService::instance().now();
         auto time_since_last_update =
             std::chrono::duration_cast<std::chrono::milliseconds>(now - internal_context.last_pwm_update).count();
         if (time_since_last_update >= IEC_PWM_MAX_UPDATE_INTERVAL) {
             update_pwm_now(dc);
             internal_context.pwm_set_last_ampere = ampere;
+        } else {
+            run_mainloop_in(std::chrono::milliseconds(IEC_PWM_MAX_UPDATE_INTERVAL - time_since_last_update));
         }
     }
 }
@@ -971,7 +1092,7 @@ void Charger::update_pwm_now(float dc) {
         fmt::format(
             "Set PWM On ({}%) took {} ms", dc * 100.,
             (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)).count()));
-    internal_context.last_pwm_update = std::chrono::steady_clock::now();
+    internal_context.last_pwm_update = TimerService::instance().now();
     internal_context.pwm_F_active = false;
     bsp->set_pwm(dc);
 }
@@ -1009,6 +1130,16 @@ void Charger::pwm_F() {
 }
 
 void Charger::run() {
+    record("charger_run");
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    if (mainloop_on_timer_service) {
+        start_mainloop();
+        std::scoped_lock lock(mainloop_mutex);
+        mainloop_started = true;
+        schedule_mainloop_timer(TimerService::instance().now());
+        return;
+    }
+#endif
     // spawn new thread and return
     main_thread_handle = std::thread(&Charger::main_thread, this);
 }
@@ -1039,15 +1170,22 @@ float Charger::ampere_to_duty_cycle(float ampere) {
 }
 
 bool Charger::set_max_current(float c, std::chrono::time_point<date::utc_clock> validUntil) {
+    const auto valid_for = validUntil - date::utc_clock::now();
+    record("charger_set_max_current",
+           fmt::format("{} {}", c, std::chrono::duration_cast<std::chrono::milliseconds>(valid_for).count()));
     if (c >= 0.0 and c <= CHARGER_ABSOLUTE_MAX_CURRENT) {
 
         // is it still valid?
-        if (validUntil > date::utc_clock::now()) {
+        if (valid_for > valid_for.zero()) {
             {
                 Everest::scoped_lock_timeout lock(state_machine_mutex,
                                                   Everest::MutexDescription::Charger_pause_charging);
+                wakeup_mainloop();
                 shared_context.max_current = c;
                 shared_context.max_current_valid_until = validUntil;
+                shared_context.max_current_expiry =
+                    TimerService::instance().now() +
+                    std::chrono::duration_cast<TimerService::Clock::duration>(valid_for);
             }
             bsp->set_overcurrent_limit(c);
             signal_max_current(c);
@@ -1059,7 +1197,9 @@ bool Charger::set_max_current(float c, std::chrono::time_point<date::utc_clock>
 
 // pause if currently charging, else do nothing.
 bool Charger::pause_charging() {
+    record("charger_pause_charging");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_pause_charging);
+    wakeup_mainloop();
     if (shared_context.current_state == EvseState::Charging) {
         shared_context.legacy_wakeup_done = false;
         shared_context.current_state = EvseState::ChargingPausedEVSE;
@@ -1069,7 +1209,9 @@ bool Charger::pause_charging() {
 }
 
 bool Charger::resume_charging() {
+    record("charger_resume_charging");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_resume_charging);
+    wakeup_mainloop();
 
     if (shared_context.hlc_charging_active and shared_context.transaction_active and
         shared_context.current_state == EvseState::ChargingPausedEVSE) {
@@ -1087,7 +1229,9 @@ bool Charger::resume_charging() {
 
 // pause charging since no power is available at the moment
 bool Charger::pause_charging_wait_for_power() {
+    record("charger_pause_charging_wait_for_power");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_waiting_for_power);
+    wakeup_mainloop();
     return pause_charging_wait_for_power_internal();
 }
 
@@ -1103,7 +1247,9 @@ bool Charger::pause_charging_wait_for_power_internal() {
 
 // resume charging since power became available. Does not resume if user paused charging.
 bool Charger::resume_charging_power_available() {
+    record("charger_resume_charging_power_available");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_resume_power_available);
+    wakeup_mainloop();
 
     if (shared_context.transaction_active and shared_context.current_state == EvseState::WaitingForEnergy and
         power_available()) {
@@ -1115,6 +1261,7 @@ bool Charger::resume_charging_power_available() {
 
 // pause charging since we run through replug sequence
 bool Charger::evse_replug() {
+    record("charger_evse_replug");
     // call BSP to start the replug sequence. It BSP actually does it,
     // it will emit a EvseReplugStarted event which will then modify our state.
     // If BSP never executes the replug, we also never change state and nothing happens.
@@ -1126,7 +1273,9 @@ bool Charger::evse_replug() {
 
 // Cancel transaction/charging from external EvseManager interface (e.g. via OCPP)
 bool Charger::cancel_transaction(const types::evse_manager::StopTransactionRequest& request) {
+    record("charger_cancel_transaction", nlohmann::json(request).dump());
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_cancel_transaction);
+    wakeup_mainloop();
 
     if (shared_context.transaction_active) {
         if (shared_context.hlc_charging_active) {
@@ -1296,6 +1445,7 @@ std::optional<types::units_signed::SignedMeterValue> Charger::get_start_signed_m
 }
 
 bool Charger::switch_three_phases_while_charging(bool n) {
+    record("charger_switch_three_phases_while_charging", n ? "true" : "false");
     if (shared_context.hlc_charging_active) {
         return false;
     }
@@ -1317,6 +1467,7 @@ bool Charger::switch_three_phases_while_charging(bool n) {
         // In all other states we can tell the bsp directly.
         bsp->switch_three_phases_while_charging(n);
     }
+    wakeup_mainloop();
     return true;
 }
 
@@ -1325,10 +1476,24 @@ void Charger::setup(bool has_ventilation, const ChargeMode _charge_mode, bool _a
                     float _soft_over_current_tolerance_percent, float _soft_over_current_measurement_noise_A,
                     const int _switch_3ph1ph_delay_s, const std::string _switch_3ph1ph_cp_state,
                     const int _soft_over_current_timeout_ms, const int _state_F_after_fault_ms) {
+    const nlohmann::json arguments = {{"has_ventilation", has_ventilation},
+                                      {"charge_mode", _charge_mode == ChargeMode::DC ? "DC" : "AC"},
+                                      {"ac_hlc_enabled", _ac_hlc_enabled},
+                                      {"ac_hlc_use_5percent", _ac_hlc_use_5percent},
+                                      {"ac_enforce_hlc", _ac_enforce_hlc},
+                                      {"ac_with_soc_timeout", _ac_with_soc_timeout},
+                                      {"soft_over_current_tolerance_percent", _soft_over_current_tolerance_percent},
+                                      {"soft_over_current_measurement_noise_A", _soft_over_current_measurement_noise_A},
+                                      {"switch_3ph1ph_delay_s", _switch_3ph1ph_delay_s},
+                                      {"switch_3ph1ph_cp_state", _switch_3ph1ph_cp_state},
+                                      {"soft_over_current_timeout_ms", _soft_over_current_timeout_ms},
+                                      {"state_F_after_fault_ms", _state_F_after_fault_ms}};
+    record("charger_setup", arguments.dump());
     // set up board support package
     bsp->setup(has_ventilation);
 
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_setup);
+    wakeup_mainloop();
     // cache our config variables
     config_context.charge_mode = _charge_mode;
     ac_hlc_enabled_current_session = config_context.ac_hlc_enabled = _ac_hlc_enabled;
@@ -1337,6 +1502,7 @@ void Charger::setup(bool has_ventilation, const ChargeMode _charge_mode, bool _a
     config_context.soft_over_current_timeout_ms = _soft_over_current_timeout_ms;
     shared_context.ac_with_soc_timeout = _ac_with_soc_timeout;
     shared_context.ac_with_soc_timer = 3600000;
+    internal_context.ac_with_soc_timer_last_update = TimerService::instance().now();
     soft_over_current_tolerance_percent = _soft_over_current_tolerance_percent;
     soft_over_current_measurement_noise_A = _soft_over_current_measurement_noise_A;
 
@@ -1393,7 +1559,9 @@ std::string Charger::get_session_id() const {
 }
 
 void Charger::authorize(bool a, const types::authorization::ProvidedIdToken& token) {
+    record("charger_authorize", fmt::format("{} {}", a, nlohmann::json(token).dump()));
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_authorize);
+    wakeup_mainloop();
     if (a) {
         shared_context.id_token = token;
         // First user interaction was auth? Then start session already here and not at plug in
@@ -1413,7 +1581,9 @@ void Charger::authorize(bool a, const types::authorization::ProvidedIdToken& tok
 }
 
 bool Charger::deauthorize() {
+    record("charger_deauthorize");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_deauthorize);
+    wakeup_mainloop();
     return deauthorize_internal();
 }
 
@@ -1438,7 +1608,9 @@ bool Charger::deauthorize_internal() {
 }
 
 bool Charger::enable_disable(int connector_id, const types::evse_manager::EnableDisableSource& source) {
+    record("charger_enable_disable", fmt::format("{} {}", connector_id, nlohmann::json(source).dump()));
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_disable);
+    wakeup_mainloop();
 
     // insert the new request into the table
     bool replaced = false;
@@ -1565,7 +1737,9 @@ bool Charger::parse_enable_disable_source_table() {
 }
 
 void Charger::set_faulted() {
+    record("charger_set_faulted");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_set_faulted);
+    wakeup_mainloop();
     shared_context.error_prevent_charging_flag = true;
 }
 
@@ -1644,8 +1818,10 @@ float Charger::get_max_current_signalled_to_ev_internal() {
 }
 
 void Charger::set_current_drawn_by_vehicle(float l1, float l2, float l3) {
+    record("charger_set_current_drawn_by_vehicle", fmt::format("{} {} {}", l1, l2, l3));
     Everest::scoped_lock_timeout lock(state_machine_mutex,
                                       Everest::MutexDescription::Charger_set_current_drawn_by_vehicle);
+    wakeup_mainloop();
     shared_context.current_drawn_by_vehicle[0] = l1;
     shared_context.current_drawn_by_vehicle[1] = l2;
     shared_context.current_drawn_by_vehicle[2] = l3;
@@ -1662,7 +1838,7 @@ void Charger::check_soft_over_current() {
         if (not internal_context.over_current) {
             internal_context.over_current = true;
             // timestamp when over current happend first
-            internal_context.last_over_current_event = std::chrono::steady_clock::now();
+            internal_context.last_over_current_event = TimerService::instance().now();
             session_log.evse(false,
                              fmt::format("Soft overcurrent event (L1:{}, L2:{}, L3:{}, limit {}), starting timer.",
                                          shared_context.current_drawn_by_vehicle[0],
@@ -1672,7 +1848,7 @@ void Charger::check_soft_over_current() {
     } else {
         internal_context.over_current = false;
     }
-    auto now = std::chrono::steady_clock::now();
+    auto now = TimerService::instance().now();
     auto time_since_over_current_started =
         std::chrono::duration_cast<std::chrono::milliseconds>(now - internal_context.last_over_current_event).count();
     if (internal_context.over_current and
@@ -1684,13 +1860,17 @@ void Charger::check_soft_over_current() {
         session_log.evse(false, errstr);
         // raise the OC error
         error_handling->raise_overcurrent_error(errstr);
+    } else if (internal_context.over_current) {
+        run_mainloop_in(
+            std::chrono::milliseconds(config_context.soft_over_current_timeout_ms - time_since_over_current_started));
     }
 }
 
 // returns whether power is actually available from EnergyManager
 // i.e. max_current is in valid range
 bool Charger::power_available() {
-    if (shared_context.max_current_valid_until < date::utc_clock::now()) {
+    const auto now = TimerService::instance().now();
+    if (shared_context.max_current_expiry < now) {
         EVLOG_warning << "Power budget expired, falling back to 0. Last update: "
                       << Everest::Date::to_rfc3339(shared_context.max_current_valid_until)
                       << " Now:" << Everest::Date::to_rfc3339(date::utc_clock::now());
@@ -1698,12 +1878,18 @@ bool Charger::power_available() {
             shared_context.max_current = 0.;
             signal_max_current(shared_context.max_current);
         }
+    } else {
+        // run again when the budget expires
+        run_mainloop_in(std::chrono::duration_cast<std::chrono::milliseconds>(shared_context.max_current_expiry - now) +
+                        std::chrono::milliseconds(1));
     }
     return (get_max_current_internal() > 5.9);
 }
 
 void Charger::request_error_sequence() {
+    record("charger_request_error_sequence");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_request_error_sequence);
+    wakeup_mainloop();
     if (shared_context.current_state == EvseState::WaitingForAuthentication or
         shared_context.current_state == EvseState::PrepareCharging) {
         internal_context.t_step_EF_return_state = shared_context.current_state;
@@ -1719,13 +1905,17 @@ void Charger::request_error_sequence() {
 }
 
 void Charger::set_matching_started(bool m) {
+    record("charger_set_matching_started", m ? "true" : "false");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_set_matching_started);
+    wakeup_mainloop();
     shared_context.matching_started = m;
 }
 
 void Charger::notify_currentdemand_started() {
+    record("charger_notify_currentdemand_started");
     Everest::scoped_lock_timeout lock(state_machine_mutex,
                                       Everest::MutexDescription::Charger_notify_currentdemand_started);
+    wakeup_mainloop();
     if (shared_context.current_state == EvseState::PrepareCharging) {
         signal_simple_event(types::evse_manager::SessionEventEnum::ChargingStarted);
         shared_context.current_state = EvseState::Charging;
@@ -1734,8 +1924,10 @@ void Charger::notify_currentdemand_started() {
 
 void Charger::inform_new_evse_max_hlc_limits(
     const types::iso15118_charger::DcEvseMaximumLimits& _currentEvseMaxLimits) {
+    record("charger_inform_new_evse_max_hlc_limits", nlohmann::json(_currentEvseMaxLimits).dump());
     Everest::scoped_lock_timeout lock(state_machine_mutex,
                                       Everest::MutexDescription::Charger_inform_new_evse_max_hlc_limits);
+    wakeup_mainloop();
     shared_context.current_evse_max_limits = _currentEvseMaxLimits;
 }
 
@@ -1746,7 +1938,9 @@ types::iso15118_charger::DcEvseMaximumLimits Charger::get_evse_max_hlc_limits()
 
 // HLC stack signalled a pause request for the lower layers.
 void Charger::dlink_pause() {
+    record("charger_dlink_pause");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_dlink_pause);
+    wakeup_mainloop();
     shared_context.hlc_allow_close_contactor = false;
     pwm_off();
     shared_context.hlc_charging_terminate_pause = HlcTerminatePause::Pause;
@@ -1754,14 +1948,18 @@ void Charger::dlink_pause() {
 
 // HLC requested end of charging session, so we can stop the 5% PWM
 void Charger::dlink_terminate() {
+    record("charger_dlink_terminate");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_dlink_terminate);
+    wakeup_mainloop();
     shared_context.hlc_allow_close_contactor = false;
     pwm_off();
     shared_context.hlc_charging_terminate_pause = HlcTerminatePause::Terminate;
 }
 
 void Charger::dlink_error() {
+    record("charger_dlink_error");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_dlink_error);
+    wakeup_mainloop();
 
     shared_context.hlc_allow_close_contactor = false;
 
@@ -1809,18 +2007,24 @@ void Charger::dlink_error() {
 }
 
 void Charger::set_hlc_charging_active() {
+    record("charger_set_hlc_charging_active");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_set_hlc_charging_active);
+    wakeup_mainloop();
     shared_context.hlc_charging_active = true;
 }
 
 void Charger::set_hlc_allow_close_contactor(bool on) {
+    record("charger_set_hlc_allow_close_contactor", on ? "true" : "false");
     Everest::scoped_lock_timeout lock(state_machine_mutex,
                                       Everest::MutexDescription::Charger_set_hlc_allow_close_contactor);
+    wakeup_mainloop();
     shared_context.hlc_allow_close_contactor = on;
 }
 
 void Charger::set_hlc_error() {
+    record("charger_set_hlc_error");
     Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::Charger_set_hlc_error);
+    wakeup_mainloop();
     shared_context.error_prevent_charging_flag = true;
 }
 
@@ -1834,10 +2038,10 @@ void Charger::bcb_toggle_reset() {
 void Charger::bcb_toggle_detect_start_pulse() {
     // For HLC charging, PWM already off: This is probably a BCB Toggle to wake us up from sleep mode.
     // Remember start of BCB toggle.
-    internal_context.hlc_ev_pause_start_of_bcb = std::chrono::steady_clock::now();
+    internal_context.hlc_ev_pause_start_of_bcb = TimerService::instance().now();
     if (internal_context.hlc_ev_pause_bcb_count == 0) {
         // remember sequence start
-        internal_context.hlc_ev_pause_start_of_bcb_sequence = std::chrono::steady_clock::now();
+        internal_context.hlc_ev_pause_start_of_bcb_sequence = TimerService::instance().now();
         internal_context.hlc_bcb_sequence_started = true;
     }
 }
@@ -1849,7 +2053,7 @@ void Charger::bcb_toggle_detect_stop_pulse() {
     }
 
     // This is probably and end of BCB toggle, verify it was not too long or too short
-    auto pulse_length = std::chrono::steady_clock::now() - internal_context.hlc_ev_pause_start_of_bcb;
+    auto pulse_length = TimerService::instance().now() - internal_context.hlc_ev_pause_start_of_bcb;
 
     if (pulse_length > TP_EV_VALD_STATE_DURATION_MIN and pulse_length < TP_EV_VALD_STATE_DURATION_MAX) {
 
@@ -1871,13 +2075,18 @@ void Charger::bcb_toggle_detect_stop_pulse() {
 // Query if a BCB sequence (of 1-3 pulses) was detected and is finished. If that is true, PWM can be enabled again
 // etc
 bool Charger::bcb_toggle_detected() {
-    auto sequence_length = std::chrono::steady_clock::now() - internal_context.hlc_ev_pause_start_of_bcb_sequence;
+    auto sequence_length = TimerService::instance().now() - internal_context.hlc_ev_pause_start_of_bcb_sequence;
     if (internal_context.hlc_bcb_sequence_started and
         (sequence_length > TT_EVSE_VALD_TOGGLE or internal_context.hlc_ev_pause_bcb_count >= 3)) {
         // no need to wait for further BCB toggles
         internal_context.hlc_ev_pause_bcb_count = 0;
         return true;
     }
+
+    if (internal_context.hlc_bcb_sequence_started) {
+        run_mainloop_in(std::chrono::duration_cast<std::chrono::milliseconds>(TT_EVSE_VALD_TOGGLE - sequence_length) +
+                        std::chrono::milliseconds(1));
+    }
     return false;
 }
 
@@ -1894,7 +2103,7 @@ int Charger::time_in_fatal_error_state_ms() {
     if (not internal_context.fatal_error_timer_running) {
         return 0;
     } else {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+        return std::chrono::duration_cast<std::chrono::milliseconds>(TimerService::instance().now() -
                                                                      internal_context.fatal_error_became_active)
             .count();
     }
@@ -1904,7 +2113,7 @@ bool Charger::stop_charging_on_fatal_error_internal() {
     bool err = false;
     if (shared_context.error_prevent_charging_flag) {
         if (not shared_context.last_error_prevent_charging_flag) {
-            internal_context.fatal_error_became_active = std::chrono::steady_clock::now();
+            internal_context.fatal_error_became_active = TimerService::instance().now();
 
             graceful_stop_charging();
         }
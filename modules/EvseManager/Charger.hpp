@@ -27,6 +27,7 @@
 #include "ld-ev.hpp"
 #include "utils/thread.hpp"
 #include <chrono>
+#include <condition_variable>
 #include <date/date.h>
 #include <date/tz.h>
 #include <generated/interfaces/ISO15118_charger/Interface.hpp>
@@ -40,12 +41,15 @@
 #include <queue>
 #include <sigslot/signal.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "ErrorHandling.hpp"
 #include "EventQueue.hpp"
 #include "IECStateMachine.hpp"
 #include "PersistentStore.hpp"
+#include "StateMachineRecorder.hpp"
+#include "TimerService.hpp"
 #include "scoped_lock_timeout.hpp"
 #include "utils.hpp"
 
@@ -215,11 +219,25 @@ public:
     }
 
     void set_connector_type(types::evse_board_support::Connector_type t) {
+        record("charger_set_connector_type", types::evse_board_support::connector_type_to_string(t));
         connector_type = t;
     }
 
     void cleanup_transactions_on_startup();
 
+    // Records all external inputs from now on, set before setup()
+    void set_recorder(StateMachineRecorder* r) {
+        recorder = r;
+    }
+
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    // Runs the main loop on TimerService timers instead of its own thread, so it follows the virtual clock in replays.
+    // Set before run().
+    void set_mainloop_on_timer_service(bool m) {
+        mainloop_on_timer_service = m;
+    }
+#endif
+
 private:
     utils::Stopwatch stopwatch;
 
@@ -251,6 +269,10 @@ private:
     void run_state_machine();
 
     void main_thread();
+    void start_mainloop();
+    void run_mainloop_once();
+    void wakeup_mainloop();
+    void run_mainloop_in(std::chrono::milliseconds t);
 
     void graceful_stop_charging();
 
@@ -288,6 +310,8 @@ private:
         bool matching_started;
         float max_current;
         std::chrono::time_point<date::utc_clock> max_current_valid_until;
+        // max_current_valid_until on the TimerService clock
+        std::chrono::time_point<std::chrono::steady_clock> max_current_expiry;
         float max_current_cable{0.};
         bool transaction_active;
         bool session_active;
@@ -359,7 +383,7 @@ private:
         bool over_current{false};
 
         bool last_error_prevent_charging_flag{false};
-        std::chrono::system_clock::time_point current_state_started;
+        std::chrono::steady_clock::time_point current_state_started;
         EvseState last_state_detect_state_change;
         EvseState last_state;
 
@@ -371,11 +395,29 @@ private:
 
         std::chrono::time_point<std::chrono::steady_clock> fatal_error_became_active;
         bool fatal_error_timer_running{false};
+
+        std::chrono::time_point<std::chrono::steady_clock> ac_with_soc_timer_last_update;
     } internal_context;
 
     // main Charger thread
     Everest::Thread main_thread_handle;
 
+    // The main loop sleeps until an event needs to be processed or the next timeout of the state machine is due
+    std::mutex mainloop_mutex;
+    std::condition_variable mainloop_condvar;
+    bool mainloop_wakeup{false};
+    std::chrono::time_point<std::chrono::steady_clock> next_mainloop_run;
+
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    bool mainloop_on_timer_service{false};
+    bool mainloop_started{false};
+    TimerService::Id mainloop_timer{0};
+    // (re)schedules the main loop timer if run_at is earlier than the next run and run() was called, mainloop_mutex
+    // must be held
+    void schedule_mainloop_timer(std::chrono::time_point<std::chrono::steady_clock> run_at);
+    void mainloop_timer_fired();
+#endif
+
     const std::unique_ptr<IECStateMachine>& bsp;
     const std::unique_ptr<ErrorHandling>& error_handling;
     const std::vector<std::unique_ptr<powermeterIntf>>& r_powermeter_billing;
@@ -388,10 +430,19 @@ private:
     enum class ErrorHandlingEvents : std::uint8_t {
         PreventCharging,
         AllErrorsPreventingChargingCleared,
-        AllErrorCleared
+        AllErrorCleared,
+        StopThread
     };
 
-    EventQueue<ErrorHandlingEvents> error_handling_event_queue;
+    MPSCEventQueue<ErrorHandlingEvents> error_handling_event_queue;
+    std::thread error_thread;
+
+    StateMachineRecorder* recorder{nullptr};
+    void record(const std::string& name, const std::string& arguments = "") {
+        if (recorder not_eq nullptr) {
+            recorder->record(name, arguments);
+        }
+    }
 
     // constants
     static constexpr float CHARGER_ABSOLUTE_MAX_CURRENT{1000.};
@@ -406,7 +457,10 @@ private:
     static constexpr auto TT_EVSE_VALD_TOGGLE =
         std::chrono::milliseconds(3500 + 200); // We give 200 msecs tolerance to the norm values (table 3 ISO15118-3)
     static constexpr auto SLEEP_BEFORE_ENABLING_PWM_HLC_MODE = std::chrono::seconds(1);
+    // retry interval for values that are polled from the BSP, e.g. the PP ampacity
     static constexpr auto MAINLOOP_UPDATE_RATE = std::chrono::milliseconds(100);
+    // the main loop runs at least once in this interval even if no event or timeout occurs
+    static constexpr auto MAINLOOP_MAX_SLEEP = std::chrono::seconds(1);
     static constexpr float PWM_5_PERCENT = 0.05;
     static constexpr int T_REPLUG_MS = 4000;
     // 3 seconds according to IEC61851-1
@@ -3,9 +3,12 @@
 #ifndef EVENTQUEUE_HPP
 #define EVENTQUEUE_HPP
 
+#include <array>
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <mutex>
+#include <utility>
 #include <vector>
 
 namespace module {
@@ -45,5 +48,180 @@ public:
     }
 };
 
+/// \brief Bounded lock-free multi-producer single-consumer variant of EventQueue with the same API
+///
+/// push() does not allocate and only takes a lock to wake up a sleeping consumer or to wait while the queue is full.
+/// The consumer drains all pending events at once. wait() and get_events() must only be called from a single consumer
+/// thread, which must not push itself while the queue may be full.
+template <typename E, std::size_t Capacity = 256> class MPSCEventQueue {
+    static_assert(Capacity >= 2 and (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    using events_t = std::vector<E>;
+
+private:
+    static constexpr std::size_t mask = Capacity - 1;
+
+    // A slot can be written by the producer that claimed position pos when sequence == pos and read by the consumer
+    // when sequence == pos + 1.
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        E event;
+    };
+
+    std::array<Slot, Capacity> slots;
+    alignas(64) std::atomic<std::size_t> enqueue_pos{0};
+    alignas(64) std::size_t dequeue_pos{0}; // only used by the consumer
+
+    // Only used to sleep while the queue is empty (consumer) or full (producers). The flags are checked after a
+    // seq_cst fence on both sides, so either the sleeping side sees the change or the other side sees the flag.
+    std::atomic_bool consumer_waiting{false};
+    std::atomic<int> producers_waiting{0};
+    std::mutex mux;
+    std::condition_variable not_empty_cv;
+    std::condition_variable not_full_cv;
+
+    bool empty() const {
+        return slots[dequeue_pos & mask].sequence.load(std::memory_order_acquire) != dequeue_pos + 1;
+    }
+
+    // event is only moved from if it was added
+    template <typename T> bool enqueue(T&& event) {
+        auto pos = enqueue_pos.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        while (true) {
+            slot = &slots[pos & mask];
+            const auto seq = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // the consumer did not free this slot yet
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->event = std::forward<T>(event);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    void notify_consumer() {
+        // only the first producer after the consumer went to sleep needs to wake it up
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumer_waiting.load(std::memory_order_relaxed) and
+            consumer_waiting.exchange(false, std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mux);
+            not_empty_cv.notify_one();
+        }
+    }
+
+    void drain(events_t& active) {
+        if (empty()) {
+            return;
+        }
+
+        do {
+            auto& slot = slots[dequeue_pos & mask];
+            active.push_back(std::move(slot.event));
+            slot.sequence.store(dequeue_pos + Capacity, std::memory_order_release);
+            dequeue_pos++;
+        } while (not empty());
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producers_waiting.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(mux);
+            not_full_cv.notify_all();
+        }
+    }
+
+    template <typename T> bool try_push_impl(T&& event) {
+        if (not enqueue(std::forward<T>(event))) {
+            return false;
+        }
+        notify_consumer();
+        return true;
+    }
+
+    template <typename T> void push_impl(T&& event) {
+        if (not enqueue(std::forward<T>(event))) {
+            std::unique_lock<std::mutex> ul(mux);
+            while (true) {
+                producers_waiting.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (enqueue(std::forward<T>(event))) {
+                    producers_waiting.fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                not_full_cv.wait(ul);
+                producers_waiting.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        notify_consumer();
+    }
+
+public:
+    MPSCEventQueue() {
+        for (std::size_t i = 0; i < Capacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /// \brief Adds \p event to the queue
+    /// \returns false if the queue is full
+    bool try_push(const E& event) {
+        return try_push_impl(event);
+    }
+
+    /// \brief Moves \p event into the queue, \p event is left untouched if the queue is full
+    /// \returns false if the queue is full
+    bool try_push(E&& event) {
+        return try_push_impl(std::move(event));
+    }
+
+    /// \brief Adds \p event to the queue, waits for the consumer while the queue is full
+    void push(const E& event) {
+        push_impl(event);
+    }
+
+    void push(E&& event) {
+        push_impl(std::move(event));
+    }
+
+    events_t get_events() {
+        events_t active;
+        drain(active);
+        return active;
+    }
+
+    events_t wait() {
+        events_t active;
+        drain(active);
+        if (not active.empty()) {
+            return active;
+        }
+
+        {
+            std::unique_lock<std::mutex> ul(mux);
+            while (empty()) {
+                consumer_waiting.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (not empty()) {
+                    break;
+                }
+                not_empty_cv.wait(ul);
+            }
+            consumer_waiting.store(false, std::memory_order_relaxed);
+        }
+
+        drain(active);
+        return active;
+    }
+};
+
 } // namespace module
 #endif
@@ -2,12 +2,14 @@
 // Copyright Pionix GmbH and Contributors to EVerest
 #include "EvseManager.hpp"
 
+#include <filesystem>
 #include <fmt/color.h>
 #include <fmt/core.h>
 
 #include "IECStateMachine.hpp"
 #include "SessionLog.hpp"
 #include "Timeout.hpp"
+#include "lock_profiler.hpp"
 #include "scoped_lock_timeout.hpp"
 
 using namespace std::literals::chrono_literals;
@@ -45,6 +47,18 @@ void EvseManager::init() {
 
     store = std::unique_ptr<PersistentStore>(new PersistentStore(r_store, info.id));
 
+    telemetry_aggregator = std::make_unique<TelemetryAggregator>(
+        std::chrono::seconds(config.telemetry_aggregation_window_s),
+        [this](const Everest::TelemetryMap& record) { telemetry.publish("livedata", "power_meter", record); });
+
+    if (config.lock_profiling) {
+#ifdef EVEREST_LOCK_PROFILING
+        Everest::LockProfiler::enable(true);
+#else
+        EVLOG_warning << "lock_profiling is ignored, EvseManager was built without EVSEMANAGER_LOCK_PROFILING";
+#endif
+    }
+
     random_delay_enabled = config.uk_smartcharging_random_delay_enable;
     random_delay_max_duration = std::chrono::seconds(config.uk_smartcharging_random_delay_max_duration);
     if (random_delay_enabled) {
@@ -61,6 +75,18 @@ void EvseManager::init() {
         session_log.enable();
     }
     session_log.xmlOutput(config.session_logging_xml);
+    if (config.session_logging_format == "binary") {
+        session_log.setFormat(SessionLog::Format::Binary);
+    }
+    if (config.session_logging_async) {
+        if (config.session_logging_fsync == "batch") {
+            session_log.enableAsync(SessionLog::FsyncPolicy::Batch);
+        } else if (config.session_logging_fsync == "session_end") {
+            session_log.enableAsync(SessionLog::FsyncPolicy::SessionEnd);
+        } else {
+            session_log.enableAsync(SessionLog::FsyncPolicy::Never);
+        }
+    }
 
     invoke_init(*p_evse);
     invoke_init(*p_energy_grid);
@@ -157,6 +183,18 @@ void EvseManager::init() {
 void EvseManager::ready() {
     bsp = std::unique_ptr<IECStateMachine>(new IECStateMachine(r_bsp, config.lock_connector_in_state_b));
 
+    if (config.cp_state_machine_recording) {
+        std::filesystem::create_directories(config.session_logging_path);
+        const auto path = fmt::format("{}/{}-cp_state_machine.rec", config.session_logging_path,
+                                      Everest::Date::to_rfc3339(date::utc_clock::now()));
+        if (cp_state_machine_recorder.open(path)) {
+            bsp->set_recorder(&cp_state_machine_recorder);
+            EVLOG_info << "Recording CP state machine inputs to " << path;
+        } else {
+            EVLOG_error << "Could not open CP state machine recording " << path;
+        }
+    }
+
     if (config.hack_simplified_mode_limit_10A) {
         bsp->set_ev_simplified_mode_evse_limit(true);
     }
@@ -170,6 +208,10 @@ void EvseManager::ready() {
 
     charger = std::make_unique<Charger>(bsp, error_handling, r_powermeter_billing(), store,
                                         hw_capabilities.connector_type, config.evse_id);
+    if (config.cp_state_machine_recording) {
+        // records nothing if the file could not be opened
+        charger->set_recorder(&cp_state_machine_recorder);
+    }
 
     // Now incoming hardware capabilties can be processed
     hw_caps_mutex.unlock();
@@ -392,7 +434,7 @@ void EvseManager::ready() {
                                                           Everest::MutexDescription::EVSE_publish_ev_info);
                         ev_info.target_voltage = latest_target_voltage;
                         ev_info.target_current = latest_target_current;
-                        p_evse->publish_ev_info(ev_info);
+                        ev_info_changed();
                     }
                 }
             });
@@ -434,7 +476,7 @@ void EvseManager::ready() {
                                                               Everest::MutexDescription::EVSE_publish_ev_info);
                             ev_info.target_voltage = latest_target_voltage;
                             ev_info.target_current = latest_target_current;
-                            p_evse->publish_ev_info(ev_info);
+                            ev_info_changed();
                         }
                     }
                 });
@@ -458,97 +500,91 @@ void EvseManager::ready() {
 
             r_hlc[0]->subscribe_dc_ev_maximum_limits([this](types::iso15118_charger::DcEvMaximumLimits l) {
                 EVLOG_info << "Received EV maximum limits: " << l;
-                Everest::scoped_lock_timeout lock(ev_info_mutex,
-                                                  Everest::MutexDescription::EVSE_subscribe_dc_ev_maximum_limits);
-                ev_info.maximum_current_limit = l.dc_ev_maximum_current_limit;
-                ev_info.maximum_power_limit = l.dc_ev_maximum_power_limit;
-                ev_info.maximum_voltage_limit = l.dc_ev_maximum_voltage_limit;
-                p_evse->publish_ev_info(ev_info);
+                {
+                    Everest::scoped_lock_timeout lock(ev_info_mutex,
+                                                      Everest::MutexDescription::EVSE_subscribe_dc_ev_maximum_limits);
+                    ev_info.maximum_current_limit = l.dc_ev_maximum_current_limit;
+                    ev_info.maximum_power_limit = l.dc_ev_maximum_power_limit;
+                    ev_info.maximum_voltage_limit = l.dc_ev_maximum_voltage_limit;
+                    ev_info_changed();
+                }
+                // cable check may be waiting for the maximum voltage
+                notify_cable_check();
             });
 
             r_hlc[0]->subscribe_departure_time([this](const std::string& t) {
                 Everest::scoped_lock_timeout lock(ev_info_mutex,
                                                   Everest::MutexDescription::EVSE_subscribe_departure_time);
                 ev_info.departure_time = t;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_ac_eamount([this](double e) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex, Everest::MutexDescription::EVSE_subscribe_ac_eamount);
                 ev_info.remaining_energy_needed = e;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_ac_ev_max_voltage([this](double v) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex,
                                                   Everest::MutexDescription::EVSE_subscribe_ac_ev_max_voltage);
                 ev_info.maximum_voltage_limit = v;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_ac_ev_max_current([this](double c) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex,
                                                   Everest::MutexDescription::EVSE_subscribe_ac_ev_max_current);
                 ev_info.maximum_current_limit = c;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_ac_ev_min_current([this](double c) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex,
                                                   Everest::MutexDescription::EVSE_subscribe_ac_ev_min_current);
                 ev_info.minimum_current_limit = c;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_dc_ev_energy_capacity([this](double c) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex,
                                                   Everest::MutexDescription::EVSE_subscribe_dc_ev_energy_capacity);
                 ev_info.battery_capacity = c;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_dc_ev_energy_request([this](double c) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex,
                                                   Everest::MutexDescription::EVSE_subscribe_dc_ev_energy_request);
                 ev_info.remaining_energy_needed = c;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_dc_full_soc([this](double c) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex, Everest::MutexDescription::EVSE_subscribe_dc_full_soc);
                 ev_info.battery_full_soc = c;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_dc_bulk_soc([this](double c) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex, Everest::MutexDescription::EVSE_subscribe_dc_bulk_soc);
                 ev_info.battery_bulk_soc = c;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_dc_ev_remaining_time([this](types::iso15118_charger::DcEvRemainingTime t) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex,
                                                   Everest::MutexDescription::EVSE_subscribe_dc_ev_remaining_time);
                 ev_info.estimated_time_full = t.ev_remaining_time_to_full_soc;
                 ev_info.estimated_time_bulk = t.ev_remaining_time_to_full_bulk_soc;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             r_hlc[0]->subscribe_dc_ev_status([this](types::iso15118_charger::DcEvStatus s) {
-                // FIXME send only on change / throttle messages
                 Everest::scoped_lock_timeout lock(ev_info_mutex,
                                                   Everest::MutexDescription::EVSE_subscribe_dc_ev_status);
                 ev_info.soc = s.dc_ev_ress_soc;
-                p_evse->publish_ev_info(ev_info);
+                ev_info_changed();
             });
 
             // SAE J2847/2 Bidi
@@ -627,7 +663,7 @@ void EvseManager::ready() {
                 {
                     Everest::scoped_lock_timeout lock(ev_info_mutex, Everest::MutexDescription::EVSE_subscribe_evcc_id);
                     ev_info.evcc_id = token;
-                    p_evse->publish_ev_info(ev_info);
+                    ev_info_changed();
                 }
             });
         }
@@ -732,11 +768,13 @@ void EvseManager::ready() {
 
             if (event == CPEvent::PowerOn) {
                 contactor_open = false;
+                notify_cable_check();
                 r_hlc[0]->call_ac_contactor_closed(true);
             }
 
             if (event == CPEvent::PowerOff) {
                 contactor_open = true;
+                notify_cable_check();
                 latest_target_voltage = 0;
                 latest_target_current = 0;
                 r_hlc[0]->call_ac_contactor_closed(false);
@@ -764,6 +802,7 @@ void EvseManager::ready() {
                 Everest::scoped_lock_timeout lock(power_mutex, Everest::MutexDescription::EVSE_subscribe_powermeter);
                 latest_powermeter_data_billing = p;
             }
+            add_powermeter_telemetry(p);
 
             {
                 std::scoped_lock<std::mutex> lk(powermeter_mutex);
@@ -821,7 +860,11 @@ void EvseManager::ready() {
         });
     }
 
+    // Cable check is cancelled when the charger leaves PrepareCharging
+    charger->signal_state.connect([this](Charger::EvseState) { notify_cable_check(); });
+
     charger->signal_max_current.connect([this](float ampere) {
+        telemetry_aggregator->gauge("max_current_A", ampere);
         // The charger changed the max current setting. Forward to HLC
         if (get_hlc_enabled()) {
             r_hlc[0]->call_update_ac_max_current(ampere);
@@ -838,7 +881,9 @@ void EvseManager::ready() {
         }
         if (s == types::evse_manager::SessionEventEnum::SessionFinished) {
             // Reset EV information on Session start and end
+            Everest::scoped_lock_timeout lock(ev_info_mutex, Everest::MutexDescription::EVSE_publish_ev_info);
             ev_info = types::evse_manager::EVInfo();
+            ev_info_dirty = false;
             p_evse->publish_ev_info(ev_info);
         }
 
@@ -864,8 +909,12 @@ void EvseManager::ready() {
         [this](types::evse_manager::StartSessionReason start_reason,
                const std::optional<types::authorization::ProvidedIdToken>& provided_id_token) {
             // Reset EV information on Session start and end
-            ev_info = types::evse_manager::EVInfo();
-            p_evse->publish_ev_info(ev_info);
+            {
+                Everest::scoped_lock_timeout lock(ev_info_mutex, Everest::MutexDescription::EVSE_publish_ev_info);
+                ev_info = types::evse_manager::EVInfo();
+                ev_info_dirty = false;
+                p_evse->publish_ev_info(ev_info);
+            }
 
             std::vector<types::iso15118_charger::PaymentOption> payment_options;
 
@@ -891,108 +940,29 @@ void EvseManager::ready() {
                        config.state_F_after_fault_ms);
     }
 
-    telemetryThreadHandle = std::thread([this]() {
-        while (not telemetryThreadHandle.shouldExit()) {
-            sleep(10);
-            auto p = get_latest_powermeter_data_billing();
-            Everest::TelemetryMap telemetry_data{{"timestamp", p.timestamp},
-                                                 {"type", "power_meter"},
-                                                 {"meter_id", p.meter_id.value_or("N/A")},
-                                                 {"energy_import_total_Wh", p.energy_Wh_import.total}};
-
-            if (p.energy_Wh_import.L1) {
-                telemetry_data["energy_import_L1_Wh"] = p.energy_Wh_import.L1.value();
-            }
-            if (p.energy_Wh_import.L2) {
-                telemetry_data["energy_import_L2_Wh"] = p.energy_Wh_import.L2.value();
-            }
-            if (p.energy_Wh_import.L3) {
-                telemetry_data["energy_import_L3_Wh"] = p.energy_Wh_import.L3.value();
-            }
-
-            if (p.energy_Wh_export) {
-                telemetry_data["energy_export_total_Wh"] = p.energy_Wh_export.value().total;
-            }
-            if (p.energy_Wh_export and p.energy_Wh_export.value().L1) {
-                telemetry_data["energy_export_L1_Wh"] = p.energy_Wh_export.value().L1.value();
-            }
-            if (p.energy_Wh_export and p.energy_Wh_export.value().L2) {
-                telemetry_data["energy_export_L2_Wh"] = p.energy_Wh_export.value().L2.value();
-            }
-            if (p.energy_Wh_export and p.energy_Wh_export.value().L3) {
-                telemetry_data["energy_export_L3_Wh"] = p.energy_Wh_export.value().L3.value();
-            }
-
-            if (p.power_W) {
-                telemetry_data["power_total_W"] = p.power_W.value().total;
-            }
-            if (p.power_W and p.power_W.value().L1) {
-                telemetry_data["power_L1_W"] = p.power_W.value().L1.value();
-            }
-            if (p.power_W and p.power_W.value().L2) {
-                telemetry_data["power_L3_W"] = p.power_W.value().L2.value();
-            }
-            if (p.power_W and p.power_W.value().L3) {
-                telemetry_data["power_L3_W"] = p.power_W.value().L3.value();
-            }
-
-            if (p.VAR) {
-                telemetry_data["var_total"] = p.VAR.value().total;
-            }
-            if (p.VAR and p.VAR.value().L1) {
-                telemetry_data["var_L1"] = p.VAR.value().L1.value();
-            }
-            if (p.VAR and p.VAR.value().L2) {
-                telemetry_data["var_L1"] = p.VAR.value().L2.value();
-            }
-            if (p.VAR and p.VAR.value().L3) {
-                telemetry_data["var_L1"] = p.VAR.value().L3.value();
-            }
-
-            if (p.voltage_V and p.voltage_V.value().L1) {
-                telemetry_data["voltage_L1_V"] = p.voltage_V.value().L1.value();
-            }
-            if (p.voltage_V and p.voltage_V.value().L2) {
-                telemetry_data["voltage_L2_V"] = p.voltage_V.value().L2.value();
-            }
-            if (p.voltage_V and p.voltage_V.value().L3) {
-                telemetry_data["voltage_L3_V"] = p.voltage_V.value().L3.value();
-            }
-            if (p.voltage_V and p.voltage_V.value().DC) {
-                telemetry_data["voltage_DC_V"] = p.voltage_V.value().DC.value();
-            }
-
-            if (p.current_A and p.current_A.value().L1) {
-                telemetry_data["current_L1_A"] = p.current_A.value().L1.value();
-            }
-            if (p.current_A and p.current_A.value().L2) {
-                telemetry_data["current_L2_A"] = p.current_A.value().L2.value();
-            }
-            if (p.current_A and p.current_A.value().L3) {
-                telemetry_data["current_L3_A"] = p.current_A.value().L3.value();
-            }
-            if (p.current_A and p.current_A.value().DC) {
-                telemetry_data["current_DC_A"] = p.current_A.value().DC.value();
-            }
-
-            if (p.frequency_Hz) {
-                telemetry_data["frequency_L1_Hz"] = p.frequency_Hz.value().L1;
-            }
-            if (p.frequency_Hz and p.frequency_Hz.value().L2) {
-                telemetry_data["frequency_L2_Hz"] = p.frequency_Hz.value().L2.value();
-            }
-            if (p.frequency_Hz and p.frequency_Hz.value().L3) {
-                telemetry_data["frequency_L3_Hz"] = p.frequency_Hz.value().L3.value();
-            }
+    if (config.ev_info_publish_interval_ms > 0) {
+        evInfoPublishThreadHandle = std::thread([this]() {
+            const auto interval = std::chrono::milliseconds(config.ev_info_publish_interval_ms);
+            while (not evInfoPublishThreadHandle.shouldExit()) {
+                {
+                    std::unique_lock<std::mutex> lock(ev_info_publish_mutex);
+                    if (not ev_info_publish_cv.wait_for(lock, std::chrono::seconds(1),
+                                                        [this] { return ev_info_publish_pending; })) {
+                        continue;
+                    }
+                    ev_info_publish_pending = false;
+                }
 
-            if (p.phase_seq_error) {
-                telemetry_data["phase_seq_error"] = p.phase_seq_error.value();
+                // collect all changes that arrive within the interval
+                std::this_thread::sleep_for(interval);
+                Everest::scoped_lock_timeout lock(ev_info_mutex, Everest::MutexDescription::EVSE_publish_ev_info);
+                if (ev_info_dirty) {
+                    ev_info_dirty = false;
+                    p_evse->publish_ev_info(ev_info);
+                }
             }
-
-            // Publish as external telemetry data
-            telemetry.publish("livedata", "power_meter", telemetry_data);
-        }
-    });
+        });
+    }
 
     {
         // wait for first powermeter value
@@ -1392,6 +1362,42 @@ bool EvseManager::cable_check_should_exit() {
     return charger->get_current_state() not_eq Charger::EvseState::PrepareCharging;
 }
 
+void EvseManager::notify_cable_check() {
+    {
+        std::scoped_lock lock(cable_check_mutex);
+        cable_check_generation++;
+    }
+    cable_check_cv.notify_all();
+    // the measurement waits need to check cable_check_should_exit() again
+    isolation_measurement.interrupt();
+    powersupply_measurement.interrupt();
+    selftest_result.interrupt();
+}
+
+bool EvseManager::wait_for_cable_check(std::chrono::milliseconds timeout, const std::function<bool()>& condition) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        std::uint64_t generation;
+        {
+            std::scoped_lock lock(cable_check_mutex);
+            generation = cable_check_generation;
+        }
+
+        // Evaluated without holding cable_check_mutex: the notifications are sent while the charger or ev_info
+        // mutexes are locked.
+        if (condition() or cable_check_should_exit()) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(cable_check_mutex);
+        if (not cable_check_cv.wait_until(lock, deadline,
+                                          [this, generation] { return cable_check_generation != generation; })) {
+            break;
+        }
+    }
+    return condition();
+}
+
 bool EvseManager::check_isolation_resistance_in_range(double resistance) {
     if (resistance < CABLECHECK_INSULATION_FAULT_RESISTANCE_OHM) {
         session_log.evse(false, fmt::format("Isolation measurement FAULT R_F {}.", resistance));
@@ -1435,15 +1441,7 @@ void EvseManager::cable_check() {
         session_log.car(true, "DC HLC Close contactor (in CableCheck)");
         charger->set_hlc_allow_close_contactor(true);
 
-        Timeout timeout;
-        timeout.start(CABLECHECK_CONTACTORS_CLOSE_TIMEOUT);
-
-        while (not timeout.reached() and not cable_check_should_exit()) {
-            if (not contactor_open) {
-                break;
-            }
-            std::this_thread::sleep_for(100ms);
-        }
+        wait_for_cable_check(CABLECHECK_CONTACTORS_CLOSE_TIMEOUT, [this] { return not contactor_open; });
 
         // If relais are still open after timeout, give up
         if (contactor_open) {
@@ -1455,13 +1453,11 @@ void EvseManager::cable_check() {
         charger->get_stopwatch().mark("Relay On");
 
         // Get correct voltage used to test the isolation
-        for (int retry_ev_info = 0; retry_ev_info < 10; retry_ev_info++) {
-            auto ev_info = get_ev_info();
-            if (ev_info.maximum_voltage_limit.has_value()) {
-                break;
-            }
-            std::this_thread::sleep_for(100ms);
-        }
+        types::evse_manager::EVInfo ev_info;
+        wait_for_cable_check(1s, [this, &ev_info] {
+            ev_info = get_ev_info();
+            return ev_info.maximum_voltage_limit.has_value();
+        });
 
         float ev_max_voltage = 500.;
 
@@ -1519,18 +1515,14 @@ void EvseManager::cable_check() {
 
             // Wait for the result of the self test
             bool result{false};
-            bool result_received{false};
+            const bool result_received =
+                selftest_result.wait_for(result, std::chrono::seconds(CABLECHECK_SELFTEST_TIMEOUT),
+                                         [this] { return cable_check_should_exit(); });
 
-            for (int wait_seconds = 0; wait_seconds < CABLECHECK_SELFTEST_TIMEOUT; wait_seconds++) {
-                if (cable_check_should_exit()) {
-                    EVLOG_warning << "Cancel cable check";
-                    fail_cable_check();
-                    return;
-                }
-                if (selftest_result.wait_for(result, 1s)) {
-                    result_received = true;
-                    break;
-                }
+            if (not result_received and cable_check_should_exit()) {
+                EVLOG_warning << "Cancel cable check";
+                fail_cable_check();
+                return;
             }
 
             if (not result_received) {
@@ -1559,7 +1551,7 @@ void EvseManager::cable_check() {
                        << " isolation measurement sample(s)";
             // Wait for N isolation measurement values
             for (int i = 0; i < config.cable_check_wait_number_of_imd_measurements; i++) {
-                if (not isolation_measurement.wait_for(m, 5s) or cable_check_should_exit()) {
+                if (not isolation_measurement.wait_for(m, 5s, [this] { return cable_check_should_exit(); })) {
                     EVLOG_info << "Did not receive isolation measurement from IMD within 5 seconds.";
                     imd_stop();
                     fail_cable_check();
@@ -1592,11 +1584,18 @@ void EvseManager::cable_check() {
 
         // Sleep before submitting result to spend more time in cable check. This is needed for some solar inverters
         // used as DC chargers for them to warm up. Don't use it.
-        std::this_thread::sleep_for(std::chrono::seconds(config.hack_sleep_in_cable_check));
+        auto hack_sleep = std::chrono::seconds(config.hack_sleep_in_cable_check);
         if (car_manufacturer == types::evse_manager::CarManufacturer::VolkswagenGroup) {
-            std::this_thread::sleep_for(std::chrono::seconds(config.hack_sleep_in_cable_check_volkswagen));
+            hack_sleep += std::chrono::seconds(config.hack_sleep_in_cable_check_volkswagen);
         }
-        if (config.hack_sleep_in_cable_check > 0 or config.hack_sleep_in_cable_check_volkswagen > 0) {
+        if (hack_sleep > 0s) {
+            wait_for_cable_check(hack_sleep, [] { return false; });
+            if (cable_check_should_exit()) {
+                EVLOG_warning << "Cancel cable check";
+                imd_stop();
+                fail_cable_check();
+                return;
+            }
             charger->get_stopwatch().mark("Sleep");
         }
 
@@ -1617,7 +1616,7 @@ void EvseManager::cable_check() {
 
         // Report CableCheck Finished with success to EV
         r_hlc[0]->call_cable_check_finished(true);
-        charger->get_stopwatch().report_phase();
+        session_log.evse(true, charger->get_stopwatch().report_phase());
         charger->get_stopwatch().mark_phase("PrepareCharging");
     });
     // Detach thread and exit command handler right away
@@ -1755,12 +1754,12 @@ bool EvseManager::wait_powersupply_DC_voltage_reached(double target_voltage) {
             break;
         }
         types::power_supply_DC::VoltageCurrent m;
-        if (powersupply_measurement.wait_for(m, 2000ms)) {
+        if (powersupply_measurement.wait_for(m, 2000ms, [this] { return cable_check_should_exit(); })) {
             if (fabs(m.voltage_V - target_voltage) < 10) {
                 voltage_ok = true;
                 break;
             }
-        } else {
+        } else if (not cable_check_should_exit()) {
             EVLOG_info << "Did not receive voltage measurement from power supply within 2 seconds.";
             power_supply_DC_charging_phase = types::power_supply_DC::ChargingPhase::Other;
             powersupply_DC_off();
@@ -1786,12 +1785,12 @@ bool EvseManager::wait_powersupply_DC_below_voltage(double target_voltage) {
             break;
         }
         types::power_supply_DC::VoltageCurrent m;
-        if (powersupply_measurement.wait_for(m, 2000ms)) {
+        if (powersupply_measurement.wait_for(m, 2000ms, [this] { return cable_check_should_exit(); })) {
             if (m.voltage_V < target_voltage) {
                 voltage_ok = true;
                 break;
             }
-        } else {
+        } else if (not cable_check_should_exit()) {
             EVLOG_info << "Did not receive voltage measurement from power supply within 2 seconds.";
             power_supply_DC_charging_phase = types::power_supply_DC::ChargingPhase::Other;
             powersupply_DC_off();
@@ -1846,6 +1845,7 @@ types::energy::ExternalLimits EvseManager::get_local_energy_limits() {
 }
 
 void EvseManager::fail_cable_check() {
+    charger->get_stopwatch().mark("Failed");
     if (config.charge_mode == "DC") {
         power_supply_DC_charging_phase = types::power_supply_DC::ChargingPhase::Other;
         powersupply_DC_off();
@@ -1859,15 +1859,165 @@ void EvseManager::fail_cable_check() {
     r_hlc[0]->call_send_error(types::iso15118_charger::EvseError::Error_EmergencyShutdown);
 }
 
+void EvseManager::add_powermeter_telemetry(const types::powermeter::Powermeter& p) {
+    auto& t = *telemetry_aggregator;
+    t.info("timestamp", p.timestamp);
+    t.info("type", "power_meter");
+    t.info("meter_id", p.meter_id.value_or("N/A"));
+    if (p.phase_seq_error) {
+        t.info("phase_seq_error", p.phase_seq_error.value());
+    }
+
+    t.counter("energy_import_total_Wh", p.energy_Wh_import.total);
+    if (p.energy_Wh_import.L1) {
+        t.counter("energy_import_L1_Wh", p.energy_Wh_import.L1.value());
+    }
+    if (p.energy_Wh_import.L2) {
+        t.counter("energy_import_L2_Wh", p.energy_Wh_import.L2.value());
+    }
+    if (p.energy_Wh_import.L3) {
+        t.counter("energy_import_L3_Wh", p.energy_Wh_import.L3.value());
+    }
+    if (p.energy_Wh_export) {
+        const auto& e = p.energy_Wh_export.value();
+        t.counter("energy_export_total_Wh", e.total);
+        if (e.L1) {
+            t.counter("energy_export_L1_Wh", e.L1.value());
+        }
+        if (e.L2) {
+            t.counter("energy_export_L2_Wh", e.L2.value());
+        }
+        if (e.L3) {
+            t.counter("energy_export_L3_Wh", e.L3.value());
+        }
+    }
+
+    if (p.power_W) {
+        const auto& w = p.power_W.value();
+        t.gauge("power_total_W", w.total);
+        if (w.L1) {
+            t.gauge("power_L1_W", w.L1.value());
+        }
+        if (w.L2) {
+            t.gauge("power_L2_W", w.L2.value());
+        }
+        if (w.L3) {
+            t.gauge("power_L3_W", w.L3.value());
+        }
+    }
+
+    if (p.VAR) {
+        const auto& var = p.VAR.value();
+        t.gauge("var_total", var.total);
+        if (var.L1) {
+            t.gauge("var_L1", var.L1.value());
+        }
+        if (var.L2) {
+            t.gauge("var_L2", var.L2.value());
+        }
+        if (var.L3) {
+            t.gauge("var_L3", var.L3.value());
+        }
+    }
+
+    if (p.voltage_V) {
+        const auto& v = p.voltage_V.value();
+        if (v.L1) {
+            t.gauge("voltage_L1_V", v.L1.value());
+        }
+        if (v.L2) {
+            t.gauge("voltage_L2_V", v.L2.value());
+        }
+        if (v.L3) {
+            t.gauge("voltage_L3_V", v.L3.value());
+        }
+        if (v.DC) {
+            t.gauge("voltage_DC_V", v.DC.value());
+        }
+    }
+
+    if (p.current_A) {
+        const auto& c = p.current_A.value();
+        if (c.L1) {
+            t.gauge("current_L1_A", c.L1.value());
+        }
+        if (c.L2) {
+            t.gauge("current_L2_A", c.L2.value());
+        }
+        if (c.L3) {
+            t.gauge("current_L3_A", c.L3.value());
+        }
+        if (c.DC) {
+            t.gauge("current_DC_A", c.DC.value());
+        }
+    }
+
+    if (p.frequency_Hz) {
+        const auto& f = p.frequency_Hz.value();
+        t.gauge("frequency_L1_Hz", f.L1);
+        if (f.L2) {
+            t.gauge("frequency_L2_Hz", f.L2.value());
+        }
+        if (f.L3) {
+            t.gauge("frequency_L3_Hz", f.L3.value());
+        }
+    }
+}
+
 types::evse_manager::EVInfo EvseManager::get_ev_info() {
     Everest::scoped_lock_timeout l(ev_info_mutex, Everest::MutexDescription::EVSE_get_ev_info);
     return ev_info;
 }
 
+// Publishes ev_info now or, with ev_info_publish_interval_ms configured, at the end of the current interval together
+// with all other changes. Must be called with ev_info_mutex held.
+void EvseManager::ev_info_changed() {
+    if (config.ev_info_publish_interval_ms <= 0) {
+        p_evse->publish_ev_info(ev_info);
+        return;
+    }
+
+    if (not ev_info_dirty) {
+        ev_info_dirty = true;
+        {
+            std::scoped_lock lock(ev_info_publish_mutex);
+            ev_info_publish_pending = true;
+        }
+        ev_info_publish_cv.notify_one();
+    }
+}
+
 void EvseManager::apply_new_target_voltage_current() {
     if (latest_target_voltage > 0) {
         powersupply_DC_set(latest_target_voltage, latest_target_current);
     }
 }
 
+// Publishes the lock wait/hold histograms on everest_external/nodered/<id>/lock_profile
+void EvseManager::publish_lock_profile(bool reset) {
+    const auto histogram = [](const Everest::LockProfiler::Histogram& h) {
+        return json{{"count", h.count},
+                    {"total_ms", h.total_us / 1000.},
+                    {"p50_us", h.percentile_us(0.5)},
+                    {"p99_us", h.percentile_us(0.99)},
+                    {"max_us", h.max_us}};
+    };
+
+    json sites = json::array();
+    for (const auto& site : Everest::LockProfiler::top(LOCK_PROFILE_NR_OF_SITES)) {
+        sites.push_back({{"site", Everest::to_string(static_cast<Everest::MutexDescription>(site.description))},
+                         {"wait", histogram(site.wait)},
+                         {"hold", histogram(site.hold)}});
+    }
+
+    json profile;
+    profile["enabled"] = Everest::LockProfiler::enabled();
+    profile["sites"] = sites;
+    mqtt.publish(fmt::format("everest_external/nodered/{}/lock_profile", config.connector_id), profile.dump());
+
+    if (reset) {
+        Everest::LockProfiler::reset();
+    }
+}
+
 } // namespace module
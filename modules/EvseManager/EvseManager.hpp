@@ -44,6 +44,8 @@
 #include "ErrorHandling.hpp"
 #include "PersistentStore.hpp"
 #include "SessionLog.hpp"
+#include "StateMachineRecorder.hpp"
+#include "TelemetryAggregator.hpp"
 #include "VarContainer.hpp"
 #include "scoped_lock_timeout.hpp"
 // ev@4bf81b14-a215-475c-a1d3-0a484ae48918:v1
@@ -62,6 +64,9 @@ struct Conf {
     bool session_logging;
     std::string session_logging_path;
     bool session_logging_xml;
+    bool session_logging_async;
+    std::string session_logging_fsync;
+    std::string session_logging_format;
     bool has_ventilation;
     double max_current_import_A;
     double max_current_export_A;
@@ -102,6 +107,10 @@ struct Conf {
     int soft_over_current_timeout_ms;
     bool lock_connector_in_state_b;
     int state_F_after_fault_ms;
+    int ev_info_publish_interval_ms;
+    int telemetry_aggregation_window_s;
+    bool lock_profiling;
+    bool cp_state_machine_recording;
 };
 
 class EvseManager : public Everest::ModuleBase {
@@ -171,6 +180,7 @@ public:
     bool update_local_energy_limit(types::energy::ExternalLimits l);
     void nodered_set_current_limit(float max_current);
     void nodered_set_watt_limit(float max_watt);
+    void publish_lock_profile(bool reset);
     types::energy::ExternalLimits get_local_energy_limits();
 
     void cancel_reservation(bool signal_event);
@@ -258,6 +268,7 @@ public:
         }
     }
     std::atomic_int ac_nr_phases_active{0};
+    std::unique_ptr<TelemetryAggregator> telemetry_aggregator;
     // ev@1fce4c5e-0ab8-41bb-90f7-14277703d2ac:v1
 
 protected:
@@ -329,14 +340,29 @@ private:
 
     bool cable_check_should_exit();
 
+    // Wakes up the cable check when the contactors, the charger state or the EV limits changed
+    void notify_cable_check();
+    // Waits until condition() is true, the cable check should exit or the timeout expired. Returns condition().
+    bool wait_for_cable_check(std::chrono::milliseconds timeout, const std::function<bool()>& condition);
+    std::mutex cable_check_mutex;
+    std::condition_variable cable_check_cv;
+    std::uint64_t cable_check_generation{0};
+
     // EV information
     Everest::timed_mutex_traceable ev_info_mutex;
     types::evse_manager::EVInfo ev_info;
+    // ev_info changed but was not published yet, guarded by ev_info_mutex
+    bool ev_info_dirty{false};
+    void ev_info_changed();
+    std::mutex ev_info_publish_mutex;
+    std::condition_variable ev_info_publish_cv;
+    bool ev_info_publish_pending{false};
+    Everest::Thread evInfoPublishThreadHandle;
     types::evse_manager::CarManufacturer car_manufacturer{types::evse_manager::CarManufacturer::Unknown};
 
     void imd_stop();
     void imd_start();
-    Everest::Thread telemetryThreadHandle;
+    void add_powermeter_telemetry(const types::powermeter::Powermeter& p);
 
     void fail_cable_check();
 
@@ -351,6 +377,10 @@ private:
     static constexpr double CABLECHECK_SAFE_VOLTAGE{60.};
     static constexpr int CABLECHECK_SELFTEST_TIMEOUT{30};
 
+    static constexpr std::size_t LOCK_PROFILE_NR_OF_SITES{10};
+
+    StateMachineRecorder cp_state_machine_recorder;
+
     std::atomic_bool current_demand_active{false};
     std::atomic_bool slac_unmatched{false};
     std::mutex powermeter_mutex;
@@ -5,6 +5,7 @@
 #include "everest/logging.hpp"
 
 #include <cstdint>
+#include <fmt/core.h>
 #include <math.h>
 #include <string.h>
 
@@ -98,6 +99,7 @@ IECStateMachine::IECStateMachine(const std::unique_ptr<evse_board_supportIntf>&
 }
 
 void IECStateMachine::process_bsp_event(const types::board_support_common::BspEvent bsp_event) {
+    record("bsp_event", types::board_support_common::event_to_string(bsp_event.event));
     auto event = from_bsp_event(bsp_event.event);
     std::visit(overloaded{[this](RawCPState& raw_state) {
                               // If it is a raw CP state, run it through the state machine
@@ -124,6 +126,12 @@ void IECStateMachine::process_bsp_event(const types::board_support_common::BspEv
 }
 
 void IECStateMachine::feed_state_machine() {
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    if (feed_in_caller_thread) {
+        feed_state_machine_no_thread();
+        return;
+    }
+#endif
     std::thread feed([this]() { feed_state_machine_no_thread(); });
     feed.detach();
 }
@@ -364,6 +372,7 @@ std::queue<CPEvent> IECStateMachine::state_machine() {
 
 // High level state machine sets PWM duty cycle
 void IECStateMachine::set_pwm(double value) {
+    record("set_pwm", fmt::format("{}", value));
     {
         Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::IEC_set_pwm);
         if (value > 0 && value < 1) {
@@ -386,6 +395,7 @@ void IECStateMachine::set_pwm(double value) {
 
 // High level state machine sets state X1
 void IECStateMachine::set_pwm_off() {
+    record("set_pwm_off");
     {
         Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::IEC_set_pwm_off);
         pwm_running = false;
@@ -397,6 +407,7 @@ void IECStateMachine::set_pwm_off() {
 
 // High level state machine sets state F
 void IECStateMachine::set_pwm_F() {
+    record("set_pwm_F");
     {
         Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::IEC_set_pwm_F);
         pwm_running = false;
@@ -408,6 +419,7 @@ void IECStateMachine::set_pwm_F() {
 
 // The higher level state machine in Charger.cpp calls this to indicate it allows contactors to be switched on
 void IECStateMachine::allow_power_on(bool value, types::evse_board_support::Reason reason) {
+    record("allow_power_on", fmt::format("{} {}", value, types::evse_board_support::reason_to_string(reason)));
     {
         Everest::scoped_lock_timeout lock(state_machine_mutex, Everest::MutexDescription::IEC_allow_power_on);
         // Only set the flags here in case of power on.
@@ -469,11 +481,13 @@ void IECStateMachine::switch_three_phases_while_charging(bool n) {
 
 // Forwards config parameters from EvseManager module config to BSP
 void IECStateMachine::setup(bool has_ventilation) {
+    record("setup", has_ventilation ? "true" : "false");
     this->has_ventilation = has_ventilation;
 }
 
 // enable/disable the charging port and CP signal
 void IECStateMachine::enable(bool en) {
+    record("enable", en ? "true" : "false");
     enabled = en;
     r_bsp->call_enable(en);
 }
@@ -498,6 +512,7 @@ void IECStateMachine::connector_unlock() {
 }
 
 void IECStateMachine::connector_force_unlock() {
+    record("connector_force_unlock");
     RawCPState cp;
 
     {
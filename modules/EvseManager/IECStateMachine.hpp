@@ -29,6 +29,7 @@
 #include <generated/interfaces/evse_board_support/Interface.hpp>
 #include <sigslot/signal.hpp>
 
+#include "StateMachineRecorder.hpp"
 #include "Timeout.hpp"
 #include "utils/thread.hpp"
 
@@ -86,6 +87,7 @@ public:
     void set_pwm_F();
 
     void set_three_phases(bool t) {
+        record("set_three_phases", t ? "true" : "false");
         three_phases = t;
     }
 
@@ -94,9 +96,22 @@ public:
     void connector_force_unlock();
 
     void set_ev_simplified_mode_evse_limit(bool l) {
+        record("set_ev_simplified_mode_evse_limit", l ? "true" : "false");
         ev_simplified_mode_evse_limit = l;
     }
 
+    // Records all inputs from now on, set before enable()
+    void set_recorder(StateMachineRecorder* r) {
+        recorder = r;
+    }
+
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    // Runs the state machine in the thread of the input instead of a new one, for deterministic replays
+    void set_feed_in_caller_thread(bool f) {
+        feed_in_caller_thread = f;
+    }
+#endif
+
     // Signal for internal events type
     sigslot::signal<CPEvent> signal_event;
     sigslot::signal<> signal_lock;
@@ -145,6 +160,17 @@ private:
 
     static constexpr std::chrono::seconds power_off_under_load_in_c1_timeout{6};
     static constexpr std::chrono::seconds unlock_in_state_f_timeout{5};
+
+    StateMachineRecorder* recorder{nullptr};
+    void record(const std::string& name, const std::string& arguments = "") {
+        if (recorder not_eq nullptr) {
+            recorder->record(name, arguments);
+        }
+    }
+
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    bool feed_in_caller_thread{false};
+#endif
 };
 
 } // namespace module
@@ -6,10 +6,11 @@
 #include <chrono>
 #include <date/date.h>
 #include <date/tz.h>
+#include <fcntl.h>
 #include <filesystem>
+#include <unistd.h>
 #include <utils/date.hpp>
 
-#include <boost/algorithm/string.hpp>
 #include <fmt/core.h>
 
 namespace module {
@@ -23,9 +24,19 @@ SessionLog::SessionLog() {
 }
 
 SessionLog::~SessionLog() {
+    if (writer.joinable()) {
+        Record exit;
+        exit.type = Record::Type::Exit;
+        queue->push(std::move(exit));
+        writer.join();
+    }
+
     if (logfile_csv.is_open()) {
         logfile_csv.close();
     }
+    if (logfile_bin.is_open()) {
+        logfile_bin.close();
+    }
 }
 
 void SessionLog::setPath(const std::string& path) {
@@ -40,6 +51,101 @@ void SessionLog::enable() {
     enabled = true;
 }
 
+void SessionLog::setFormat(Format f) {
+    format = f;
+}
+
+void SessionLog::enableAsync(FsyncPolicy policy) {
+    if (writer.joinable()) {
+        return;
+    }
+    fsync_policy = policy;
+    queue = std::make_unique<MPSCEventQueue<Record, ASYNC_QUEUE_SIZE>>();
+    writer = std::thread(&SessionLog::writer_thread, this);
+}
+
+void SessionLog::writer_thread() {
+    while (true) {
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+        {
+            std::scoped_lock hold(writer_hold);
+        }
+#endif
+        bool exit = false;
+        for (const auto& record : queue->wait()) {
+            switch (record.type) {
+            case Record::Type::Entry:
+                write_record(record);
+                break;
+            case Record::Type::Start:
+                open_files(record.entry.xml, record.entry.msg);
+                break;
+            case Record::Type::Stop:
+                // records dropped before the stop belong to this session
+                write_dropped_note();
+                close_files();
+                break;
+            case Record::Type::Exit:
+                exit = true;
+                break;
+            }
+        }
+
+        write_dropped_note();
+        flush_files();
+        if (exit) {
+            return;
+        }
+    }
+}
+
+void SessionLog::write_dropped_note() {
+    const auto dropped = dropped_records.exchange(0);
+    if (dropped > 0) {
+        EVLOG_warning << "Session log queue full, dropped " << dropped << " records";
+        Record note;
+        note.entry.typ = 2;
+        note.entry.timestamp_ms = session_log_format::now_ms();
+        note.entry.msg = fmt::format("Dropped {} records", dropped);
+        write_record(note);
+    }
+}
+
+// syncs a file that was written through a stream to the storage
+static void fsync_file(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+void SessionLog::flush_files() {
+    if (logfile_bin.is_open() and not bin_buffer.empty()) {
+        logfile_bin.write(bin_buffer.data(), bin_buffer.size());
+        logfile_bin.flush();
+        bin_buffer.clear();
+    }
+    if (logfile_csv.is_open()) {
+        logfile_csv.flush();
+    }
+    if (logfile_html.is_open()) {
+        logfile_html.flush();
+    }
+
+    if (queue and fsync_policy == FsyncPolicy::Batch) {
+        if (logfile_bin.is_open()) {
+            fsync_file(fn);
+        }
+        if (logfile_csv.is_open()) {
+            fsync_file(fn);
+        }
+        if (logfile_html.is_open()) {
+            fsync_file(fnhtml);
+        }
+    }
+}
+
 std::optional<std::string> SessionLog::startSession(const std::string& suffix_string) {
     if (enabled) {
         if (session_active) {
@@ -57,45 +163,18 @@ std::optional<std::string> SessionLog::startSession(const std::string& suffix_st
         if (!std::filesystem::exists(logpath))
             std::filesystem::create_directories(logpath);
 
-        // open new file
-        fn = fmt::format("{}/incomplete-eventlog.csv", logpath);
-        fnhtml = fmt::format("{}/incomplete-eventlog.html", logpath);
-        fn_complete = fmt::format("{}/eventlog.csv", logpath);
-        fnhtml_complete = fmt::format("{}/eventlog.html", logpath);
-
-        try {
-            logfile_csv.open(fn);
-            logfile_html.open(fnhtml);
+        if (queue) {
+            // the files are opened by the writer thread
+            Record start;
+            start.type = Record::Type::Start;
+            start.entry.msg = suffix_string;
+            start.entry.xml = logpath;
+            queue->push(std::move(start));
             session_active = true;
-        } catch (const std::ofstream::failure& e) {
-            EVLOG_error << fmt::format("Cannot open {} of {} for writing", fn, fnhtml);
-            session_active = false;
+        } else {
+            session_active = open_files(logpath, suffix_string);
         }
-        logfile_html << fmt::format("<html><head><title>EVerest log session {}</title>\n", suffix_string);
-        logfile_html << "<style>"
-                        ".log {"
-                        "  font-family: Arial, Helvetica, sans-serif;"
-                        "  border-collapse: collapse;"
-                        "  width: 100%;"
-                        "}"
-                        ".log td, .log th {"
-                        "  border: 1px solid #ddd;"
-                        "  padding: 8px;"
-                        "  vertical-align: top;"
-                        "}"
-                        ".log tr.CAR{background-color: #E4E6F2;}"
-                        ".log tr.EVSE{background-color: #F2F0E4;}"
-                        ".log tr.SYS{background-color: white;}"
-                        ".log th {"
-                        "  padding-top: 12px;"
-                        "  padding-bottom: 12px;"
-                        "  text-align: left;"
-                        "  vertical-align: top;"
-                        "  background-color: #04AA6D;"
-                        "  color: white;"
-                        "}"
-                        "</style>";
-        logfile_html << "</head><body><table class=\"log\">\n";
+
         sys("Session logging started.");
         return logpath;
     }
@@ -103,33 +182,93 @@ std::optional<std::string> SessionLog::startSession(const std::string& suffix_st
     return std::string();
 }
 
+bool SessionLog::open_files(const std::string& path, const std::string& suffix_string) {
+    if (format == Format::Binary) {
+        fn = fmt::format("{}/incomplete-eventlog.bin", path);
+        fn_complete = fmt::format("{}/eventlog.bin", path);
+        fnhtml.clear();
+        fnhtml_complete.clear();
+
+        logfile_bin.open(fn, std::ios::binary);
+        if (!logfile_bin.is_open()) {
+            EVLOG_error << fmt::format("Cannot open {} for writing", fn);
+            return false;
+        }
+        bin_buffer = session_log_format::binary_header(suffix_string);
+        return true;
+    }
+
+    // open new file
+    fn = fmt::format("{}/incomplete-eventlog.csv", path);
+    fnhtml = fmt::format("{}/incomplete-eventlog.html", path);
+    fn_complete = fmt::format("{}/eventlog.csv", path);
+    fnhtml_complete = fmt::format("{}/eventlog.html", path);
+
+    bool opened = true;
+    try {
+        logfile_csv.open(fn);
+        logfile_html.open(fnhtml);
+    } catch (const std::ofstream::failure& e) {
+        EVLOG_error << fmt::format("Cannot open {} of {} for writing", fn, fnhtml);
+        opened = false;
+    }
+    logfile_html << session_log_format::html_header(suffix_string);
+    return opened;
+}
+
 void SessionLog::stopSession() {
     if (enabled) {
         sys("Session logging stopped.");
 
-        logfile_html << "</table></body></html>\n";
-
-        if (logfile_csv.is_open()) {
-            logfile_csv.close();
-        }
-        if (logfile_html.is_open()) {
-            logfile_html.close();
+        if (queue) {
+            Record stop;
+            stop.type = Record::Type::Stop;
+            queue->push(std::move(stop));
+        } else {
+            close_files();
         }
 
-        // rename files to indicate they are finished now
-        try {
-            std::filesystem::rename(fn, fn_complete);
-        } catch (const std::filesystem::filesystem_error& fs_err) {
-            EVLOG_error << "Could not rename " << fn << ": " << fs_err.what();
-        }
+        session_active = false;
+    }
+}
+
+void SessionLog::close_files() {
+    if (logfile_html.is_open()) {
+        logfile_html << session_log_format::html_footer();
+    }
+    flush_files();
+
+    if (logfile_bin.is_open()) {
+        logfile_bin.close();
+    }
+    if (logfile_csv.is_open()) {
+        logfile_csv.close();
+    }
+    if (logfile_html.is_open()) {
+        logfile_html.close();
+    }
 
-        try {
-            std::filesystem::rename(fnhtml, fnhtml_complete);
-        } catch (const std::filesystem::filesystem_error& fs_err) {
-            EVLOG_error << "Could not rename " << fnhtml << ": " << fs_err.what();
+    if (queue and fsync_policy != FsyncPolicy::Never) {
+        fsync_file(fn);
+        if (!fnhtml.empty()) {
+            fsync_file(fnhtml);
         }
+    }
 
-        session_active = false;
+    // rename files to indicate they are finished now
+    try {
+        std::filesystem::rename(fn, fn_complete);
+    } catch (const std::filesystem::filesystem_error& fs_err) {
+        EVLOG_error << "Could not rename " << fn << ": " << fs_err.what();
+    }
+
+    if (fnhtml.empty()) {
+        return;
+    }
+    try {
+        std::filesystem::rename(fnhtml, fnhtml_complete);
+    } catch (const std::filesystem::filesystem_error& fs_err) {
+        EVLOG_error << "Could not rename " << fnhtml << ": " << fs_err.what();
     }
 }
 
@@ -154,59 +293,76 @@ void SessionLog::car(bool iso15118, const std::string& msg, const std::string& x
 void SessionLog::output(unsigned int typ, bool iso15118, const std::string& msg, const std::string& xml,
                         const std::string& xml_hex, const std::string& xml_base64, const std::string& json_str) {
     if (enabled && session_active) {
-        std::string ts = Everest::Date::to_rfc3339(date::utc_clock::now());
+        Record record;
+        auto& entry = record.entry;
+        entry.typ = typ;
+        entry.iso15118 = iso15118;
+        entry.timestamp_ms = session_log_format::now_ms();
+        entry.msg = msg;
+        entry.xml = xml;
+        entry.exi_hex = xml_hex;
+        entry.exi_base64 = xml_base64;
+        entry.json_str = json_str;
+
+        if (not queue) {
+            write_record(record);
+            flush_files();
+        } else if (not queue->try_push(std::move(record))) {
+            dropped_records++;
+        }
+
+        // output to api
+        nlohmann::json data;
+        data["origin"] = session_log_format::origin(typ);
+        data["target"] = session_log_format::target(typ);
+        data["iso15118"] = iso15118;
+        data["msg"] = msg;
+        this->mqtt(data);
+    }
+}
+
+void SessionLog::write_record(const Record& r) {
+    const auto& e = r.entry;
 
-        std::string xml_pretty;
+    // the binary log stores the messages as they are, they are only pretty printed when it is exported
+    std::string xml_pretty;
+    if (format == Format::Text or xmloutput) {
         v2g_message v2g;
-        if (!xml.empty()) {
-            v2g.from_xml(xml);
+        if (!e.xml.empty()) {
+            v2g.from_xml(e.xml);
             xml_pretty = v2g.to_xml();
-        } else if (!json_str.empty()) {
-            v2g.from_json(json_str);
+        } else if (!e.json_str.empty()) {
+            v2g.from_json(e.json_str);
             xml_pretty = v2g.to_json();
         }
+    }
 
-        // output to EVerest log
-        std::string log = msg;
-        std::string origin, target;
-        if (xmloutput) {
-            log += xml_pretty;
-        }
-        if (typ == 0) {
-            origin = "EVSE";
-            target = "CAR";
-            EVLOG_info << "\033[1;34mEVSE " << (iso15118 ? "ISO" : "IEC") << " " << log << "\033[1;0m";
-        } else if (typ == 1) {
-            origin = "CAR";
-            target = "EVSE";
-            EVLOG_info << "                                    \033[1;33mCAR " << (iso15118 ? "ISO" : "IEC") << " "
-                       << log << "\033[1;0m";
-        } else {
-            origin = "SYS";
-            target = "";
-            EVLOG_info << "SYS  " << msg;
-        }
+    // output to EVerest log
+    std::string log = e.msg;
+    if (xmloutput) {
+        log += xml_pretty;
+    }
+    if (e.typ == 0) {
+        EVLOG_info << "\033[1;34mEVSE " << (e.iso15118 ? "ISO" : "IEC") << " " << log << "\033[1;0m";
+    } else if (e.typ == 1) {
+        EVLOG_info << "                                    \033[1;33mCAR " << (e.iso15118 ? "ISO" : "IEC") << " "
+                   << log << "\033[1;0m";
+    } else {
+        EVLOG_info << "SYS  " << e.msg;
+    }
 
-        // output to session log file
-        logfile_csv << fmt::format("\"{}\",\"{}\",\"{}\",\"{}\"\n", ts, origin, msg, xml_pretty);
-        logfile_csv.flush();
+    if (format == Format::Binary) {
+        if (logfile_bin.is_open()) {
+            session_log_format::append_binary(e, bin_buffer);
+        }
+        return;
+    }
 
-        // output to session html file
-        logfile_html << fmt::format("<tr class=\"{}\"> <td>{}</td> <td>{}</td> <td><b>{}</b></td><td><b>{}</b></td> "
-                                    "<td><pre lang=\"xml\">{}</pre></td> <td><pre lang=\"xml\">{}</pre></td> <td><pre "
-                                    "lang=\"xml\">{}</pre></td> </tr>\n",
-                                    origin, ts, origin + "&gt;" + target, (typ == 0 || typ == 2 ? msg : ""),
-                                    (typ == 1 ? msg : ""), html_encode(xml_pretty), xml_hex, xml_base64);
-        logfile_html.flush();
+    // output to session log file
+    logfile_csv << session_log_format::csv_line(e, xml_pretty);
 
-        // output to api
-        nlohmann::json data;
-        data["origin"] = origin;
-        data["target"] = target;
-        data["iso15118"] = iso15118;
-        data["msg"] = msg;
-        this->mqtt(data);
-    }
+    // output to session html file
+    logfile_html << session_log_format::html_row(e, xml_pretty);
 }
 
 void SessionLog::xmlOutput(bool e) {
@@ -217,11 +373,4 @@ void SessionLog::sys(const std::string& msg) {
     output(2, false, msg, "", "", "", "");
 }
 
-std::string SessionLog::html_encode(const std::string& msg) {
-    std::string out = msg;
-    boost::replace_all(out, "<", "&lt;");
-    boost::replace_all(out, ">", "&gt;");
-    return out;
-}
-
 } // namespace module
@@ -3,11 +3,18 @@
 #ifndef SESSION_LOG_HPP
 #define SESSION_LOG_HPP
 
+#include <atomic>
 #include <fstream>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json_fwd.hpp>
 #include <optional>
 #include <string>
+#include <thread>
+
+#include "EventQueue.hpp"
+#include "SessionLogFormat.hpp"
 
 namespace module {
 /*
@@ -16,12 +23,29 @@ namespace module {
 
 class SessionLog {
 public:
+    // When the log files are synced to the storage in async mode
+    enum class FsyncPolicy {
+        Never,      // only flushed to the OS
+        Batch,      // after every written batch
+        SessionEnd, // when the session log is closed
+    };
+
+    // Format of the session log files
+    enum class Format {
+        Text,   // eventlog.csv and eventlog.html
+        Binary, // eventlog.bin, converted to CSV/HTML/JSON offline with session_log_export
+    };
+
     SessionLog();
     ~SessionLog();
 
     void setPath(const std::string& path);
     void setMqtt(const std::function<void(nlohmann::json data)>& mqtt_provider);
     void enable();
+    void setFormat(Format format);
+    // Formats and writes the log files from a background thread in batches. Logging only queues the record, if the
+    // queue is full the record is dropped and counted instead of blocking the caller.
+    void enableAsync(FsyncPolicy fsync_policy);
     std::optional<std::string> startSession(const std::string& suffix_string);
     void stopSession();
 
@@ -37,10 +61,34 @@ public:
 
     void sys(const std::string& msg);
 
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    // The writer thread does not start its next batch while the returned lock is held, to fill the queue in tests
+    std::unique_lock<std::mutex> hold_writer() {
+        return std::unique_lock<std::mutex>(writer_hold);
+    }
+#endif
+
 private:
+    struct Record {
+        enum class Type {
+            Entry,
+            Start, // msg is the suffix, xml the session log path
+            Stop,
+            Exit,
+        };
+        Type type{Type::Entry};
+        session_log_format::Entry entry;
+    };
+    static constexpr std::size_t ASYNC_QUEUE_SIZE = 1024;
+
     void output(unsigned int evse, bool iso15118, const std::string& msg, const std::string& xml,
                 const std::string& xml_hex, const std::string& xml_base64, const std::string& json_str);
-    std::string html_encode(const std::string& msg);
+    bool open_files(const std::string& path, const std::string& suffix_string);
+    void close_files();
+    void write_record(const Record& record);
+    void flush_files();
+    void writer_thread();
+    void write_dropped_note();
     bool xmloutput;
     bool session_active;
     bool enabled;
@@ -50,7 +98,19 @@ private:
 
     std::ofstream logfile_csv;
     std::ofstream logfile_html;
+    std::ofstream logfile_bin;
+    Format format{Format::Text};
+    std::string bin_buffer; // binary records not written yet
     std::function<void(nlohmann::json data)> mqtt;
+
+    // async mode
+    FsyncPolicy fsync_policy{FsyncPolicy::Never};
+    std::unique_ptr<MPSCEventQueue<Record, ASYNC_QUEUE_SIZE>> queue;
+    std::thread writer;
+    std::atomic<std::size_t> dropped_records{0};
+#ifdef BUILD_TESTING_MODULE_EVSE_MANAGER
+    std::mutex writer_hold;
+#endif
 };
 
 extern SessionLog session_log;
@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "SessionLogFormat.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <stdexcept>
+
+#include <boost/algorithm/string.hpp>
+#include <fmt/core.h>
+
+namespace module {
+namespace session_log_format {
+
+static constexpr char MAGIC[8] = {'E', 'V', 'S', 'E', 'S', 'L', 'O', 'G'};
+static constexpr std::uint32_t VERSION = 1;
+static constexpr std::uint8_t FLAG_ISO15118 = 0x01;
+
+std::int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string format_timestamp(std::int64_t timestamp_ms) {
+    auto seconds = static_cast<std::time_t>(timestamp_ms / 1000);
+    auto ms = timestamp_ms % 1000;
+    if (ms < 0) {
+        seconds--;
+        ms += 1000;
+    }
+    std::tm tm{};
+    gmtime_r(&seconds, &tm);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    return fmt::format("{}.{:03}Z", buf, ms);
+}
+
+std::string origin(unsigned int typ) {
+    return typ == 0 ? "EVSE" : (typ == 1 ? "CAR" : "SYS");
+}
+
+std::string target(unsigned int typ) {
+    return typ == 0 ? "CAR" : (typ == 1 ? "EVSE" : "");
+}
+
+std::string html_encode(const std::string& msg) {
+    std::string out = msg;
+    boost::replace_all(out, "<", "&lt;");
+    boost::replace_all(out, ">", "&gt;");
+    return out;
+}
+
+std::string csv_line(const Entry& entry, const std::string& xml_pretty) {
+    return fmt::format("\"{}\",\"{}\",\"{}\",\"{}\"\n", format_timestamp(entry.timestamp_ms), origin(entry.typ),
+                       entry.msg, xml_pretty);
+}
+
+std::string html_header(const std::string& session_name) {
+    return fmt::format("<html><head><title>EVerest log session {}</title>\n", session_name) +
+           "<style>"
+           ".log {"
+           "  font-family: Arial, Helvetica, sans-serif;"
+           "  border-collapse: collapse;"
+           "  width: 100%;"
+           "}"
+           ".log td, .log th {"
+           "  border: 1px solid #ddd;"
+           "  padding: 8px;"
+           "  vertical-align: top;"
+           "}"
+           ".log tr.CAR{background-color: #E4E6F2;}"
+           ".log tr.EVSE{background-color: #F2F0E4;}"
+           ".log tr.SYS{background-color: white;}"
+           ".log th {"
+           "  padding-top: 12px;"
+           "  padding-bottom: 12px;"
+           "  text-align: left;"
+           "  vertical-align: top;"
+           "  background-color: #04AA6D;"
+           "  color: white;"
+           "}"
+           "</style>"
+           "</head><body><table class=\"log\">\n";
+}
+
+std::string html_row(const Entry& entry, const std::string& xml_pretty) {
+    const auto o = origin(entry.typ);
+    return fmt::format("<tr class=\"{}\"> <td>{}</td> <td>{}</td> <td><b>{}</b></td><td><b>{}</b></td> "
+                       "<td><pre lang=\"xml\">{}</pre></td> <td><pre lang=\"xml\">{}</pre></td> <td><pre "
+                       "lang=\"xml\">{}</pre></td> </tr>\n",
+                       o, format_timestamp(entry.timestamp_ms), o + "&gt;" + target(entry.typ),
+                       (entry.typ == 0 || entry.typ == 2 ? entry.msg : ""), (entry.typ == 1 ? entry.msg : ""),
+                       html_encode(xml_pretty), entry.exi_hex, entry.exi_base64);
+}
+
+std::string html_footer() {
+    return "</table></body></html>\n";
+}
+
+nlohmann::json to_json(const Entry& entry) {
+    nlohmann::json data;
+    data["timestamp"] = format_timestamp(entry.timestamp_ms);
+    data["origin"] = origin(entry.typ);
+    data["target"] = target(entry.typ);
+    data["iso15118"] = entry.iso15118;
+    data["msg"] = entry.msg;
+    if (!entry.xml.empty()) {
+        data["xml"] = entry.xml;
+    }
+    if (!entry.json_str.empty()) {
+        data["v2g_json"] = entry.json_str;
+    }
+    if (!entry.exi_hex.empty()) {
+        data["exi"] = entry.exi_hex;
+        data["exi_base64"] = entry.exi_base64;
+    }
+    return data;
+}
+
+std::string to_hex(const std::string& bytes) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(bytes.size() * 2);
+    for (const auto c : bytes) {
+        const auto b = static_cast<std::uint8_t>(c);
+        hex += digits[b >> 4];
+        hex += digits[b & 0x0f];
+    }
+    return hex;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+std::string from_hex(const std::string& hex) {
+    std::string bytes;
+    bytes.reserve(hex.size() / 2);
+    for (std::size_t i = 0; i + 1 < hex.size(); i += 2) {
+        const auto hi = hex_digit(hex[i]);
+        const auto lo = hex_digit(hex[i + 1]);
+        if (hi < 0 || lo < 0) {
+            break;
+        }
+        bytes += static_cast<char>((hi << 4) | lo);
+    }
+    return bytes;
+}
+
+static constexpr char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string to_base64(const std::string& bytes) {
+    std::string out;
+    out.reserve((bytes.size() + 2) / 3 * 4);
+    std::size_t i = 0;
+    for (; i + 2 < bytes.size(); i += 3) {
+        const std::uint32_t v = static_cast<std::uint8_t>(bytes[i]) << 16 |
+                                static_cast<std::uint8_t>(bytes[i + 1]) << 8 | static_cast<std::uint8_t>(bytes[i + 2]);
+        out += BASE64_CHARS[(v >> 18) & 0x3f];
+        out += BASE64_CHARS[(v >> 12) & 0x3f];
+        out += BASE64_CHARS[(v >> 6) & 0x3f];
+        out += BASE64_CHARS[v & 0x3f];
+    }
+    if (i + 1 == bytes.size()) {
+        const std::uint32_t v = static_cast<std::uint8_t>(bytes[i]) << 16;
+        out += BASE64_CHARS[(v >> 18) & 0x3f];
+        out += BASE64_CHARS[(v >> 12) & 0x3f];
+        out += "==";
+    } else if (i + 2 == bytes.size()) {
+        const std::uint32_t v =
+            static_cast<std::uint8_t>(bytes[i]) << 16 | static_cast<std::uint8_t>(bytes[i + 1]) << 8;
+        out += BASE64_CHARS[(v >> 18) & 0x3f];
+        out += BASE64_CHARS[(v >> 12) & 0x3f];
+        out += BASE64_CHARS[(v >> 6) & 0x3f];
+        out += '=';
+    }
+    return out;
+}
+
+std::string from_base64(const std::string& base64) {
+    std::string bytes;
+    bytes.reserve(base64.size() / 4 * 3);
+    std::uint32_t v = 0;
+    int bits = 0;
+    for (const auto c : base64) {
+        const char* p = std::char_traits<char>::find(BASE64_CHARS, 64, c);
+        if (p == nullptr) {
+            // padding or whitespace
+            continue;
+        }
+        v = (v << 6) | static_cast<std::uint32_t>(p - BASE64_CHARS);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            bytes += static_cast<char>((v >> bits) & 0xff);
+        }
+    }
+    return bytes;
+}
+
+static void append_u32(std::string& buffer, std::uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        buffer += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+static void append_i64(std::string& buffer, std::int64_t value) {
+    const auto v = static_cast<std::uint64_t>(value);
+    for (int i = 0; i < 8; i++) {
+        buffer += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+static void append_string(std::string& buffer, const std::string& s) {
+    append_u32(buffer, static_cast<std::uint32_t>(s.size()));
+    buffer += s;
+}
+
+std::string binary_header(const std::string& session_name) {
+    std::string header(MAGIC, sizeof(MAGIC));
+    append_u32(header, VERSION);
+    append_string(header, session_name);
+    return header;
+}
+
+void append_binary(const Entry& entry, std::string& buffer) {
+    const auto exi = entry.exi_hex.empty() ? from_base64(entry.exi_base64) : from_hex(entry.exi_hex);
+
+    const auto start = buffer.size();
+    append_u32(buffer, 0); // length, filled in below
+    buffer += static_cast<char>(entry.typ);
+    buffer += static_cast<char>(entry.iso15118 ? FLAG_ISO15118 : 0);
+    append_i64(buffer, entry.timestamp_ms);
+    append_string(buffer, entry.msg);
+    append_string(buffer, entry.xml);
+    append_string(buffer, entry.json_str);
+    append_string(buffer, exi);
+
+    const auto length = static_cast<std::uint32_t>(buffer.size() - start - 4);
+    for (int i = 0; i < 4; i++) {
+        buffer[start + i] = static_cast<char>((length >> (8 * i)) & 0xff);
+    }
+}
+
+// reads from a record that was read completely, returns false if it is shorter than its content claims
+class RecordParser {
+public:
+    explicit RecordParser(const std::string& record) : record(record) {
+    }
+
+    bool u8(std::uint8_t& v) {
+        if (pos + 1 > record.size()) {
+            return false;
+        }
+        v = static_cast<std::uint8_t>(record[pos++]);
+        return true;
+    }
+
+    bool u32(std::uint32_t& v) {
+        if (pos + 4 > record.size()) {
+            return false;
+        }
+        v = 0;
+        for (int i = 0; i < 4; i++) {
+            v |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(record[pos++])) << (8 * i);
+        }
+        return true;
+    }
+
+    bool i64(std::int64_t& value) {
+        if (pos + 8 > record.size()) {
+            return false;
+        }
+        std::uint64_t v = 0;
+        for (int i = 0; i < 8; i++) {
+            v |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(record[pos++])) << (8 * i);
+        }
+        value = static_cast<std::int64_t>(v);
+        return true;
+    }
+
+    bool string(std::string& s) {
+        std::uint32_t length{0};
+        if (not u32(length) or pos + length > record.size()) {
+            return false;
+        }
+        s.assign(record, pos, length);
+        pos += length;
+        return true;
+    }
+
+private:
+    const std::string& record;
+    std::size_t pos{0};
+};
+
+static bool read_u32(std::istream& in, std::uint32_t& v) {
+    std::uint8_t b[4];
+    if (not in.read(reinterpret_cast<char*>(b), sizeof(b))) {
+        return false;
+    }
+    v = b[0] | b[1] << 8 | b[2] << 16 | static_cast<std::uint32_t>(b[3]) << 24;
+    return true;
+}
+
+BinaryReader::BinaryReader(std::istream& in) : in(in) {
+    char magic[sizeof(MAGIC)];
+    std::uint32_t version{0};
+    std::uint32_t length{0};
+    if (not in.read(magic, sizeof(magic)) or not std::equal(magic, magic + sizeof(magic), MAGIC)) {
+        throw std::runtime_error("Not a binary session log");
+    }
+    if (not read_u32(in, version) or version != VERSION) {
+        throw std::runtime_error(fmt::format("Unsupported binary session log version {}", version));
+    }
+    if (not read_u32(in, length)) {
+        throw std::runtime_error("Incomplete binary session log header");
+    }
+    name.resize(length);
+    if (not in.read(name.data(), length)) {
+        throw std::runtime_error("Incomplete binary session log header");
+    }
+}
+
+const std::string& BinaryReader::session_name() const {
+    return name;
+}
+
+bool BinaryReader::next(Entry& entry) {
+    std::uint32_t length{0};
+    if (incomplete or not read_u32(in, length)) {
+        // a partially written length is an incomplete record as well
+        incomplete = incomplete or in.gcount() != 0;
+        return false;
+    }
+
+    std::string record(length, '\0');
+    if (not in.read(record.data(), length)) {
+        incomplete = true;
+        return false;
+    }
+
+    RecordParser parser(record);
+    std::uint8_t typ{0};
+    std::uint8_t flags{0};
+    std::string exi;
+    if (not(parser.u8(typ) and parser.u8(flags) and parser.i64(entry.timestamp_ms) and parser.string(entry.msg) and
+            parser.string(entry.xml) and parser.string(entry.json_str) and parser.string(exi))) {
+        incomplete = true;
+        return false;
+    }
+    entry.typ = typ;
+    entry.iso15118 = flags & FLAG_ISO15118;
+    entry.exi_hex = to_hex(exi);
+    entry.exi_base64 = to_base64(exi);
+    return true;
+}
+
+bool BinaryReader::truncated() const {
+    return incomplete;
+}
+
+} // namespace session_log_format
+} // namespace module
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef SESSION_LOG_FORMAT_HPP
+#define SESSION_LOG_FORMAT_HPP
+
+#include <cstdint>
+#include <istream>
+#include <nlohmann/json.hpp>
+#include <string>
+
+namespace module {
+namespace session_log_format {
+/*
+ Views of session log entries that are shared between the SessionLog and the session_log_export tool.
+
+ Binary format (all integers little endian):
+   file header: magic "EVSESLOG", u32 version, string session name
+   record:      u32 length of the rest of the record, u8 typ, u8 flags (bit 0: iso15118), i64 timestamp in ms since
+                the epoch (UTC), string msg, string xml, string json, string raw EXI stream
+   string:      u32 length, bytes
+ The EXI stream is stored once as raw bytes, its hex and base64 representation is recreated when it is read.
+*/
+
+struct Entry {
+    std::int64_t timestamp_ms{0};
+    unsigned int typ{0}; // 0: EVSE, 1: CAR, 2: SYS
+    bool iso15118{false};
+    std::string msg;
+    std::string xml;
+    std::string json_str;
+    std::string exi_hex;
+    std::string exi_base64;
+};
+
+std::int64_t now_ms();
+// Formats like Everest::Date::to_rfc3339, e.g. 2024-03-27T12:00:00.000Z
+std::string format_timestamp(std::int64_t timestamp_ms);
+
+std::string origin(unsigned int typ);
+std::string target(unsigned int typ);
+
+std::string html_encode(const std::string& msg);
+std::string csv_line(const Entry& entry, const std::string& xml_pretty);
+std::string html_header(const std::string& session_name);
+std::string html_row(const Entry& entry, const std::string& xml_pretty);
+std::string html_footer();
+nlohmann::json to_json(const Entry& entry);
+
+std::string to_hex(const std::string& bytes);
+std::string from_hex(const std::string& hex);
+std::string to_base64(const std::string& bytes);
+std::string from_base64(const std::string& base64);
+
+std::string binary_header(const std::string& session_name);
+// Appends the binary record of entry to buffer. The EXI stream is taken from exi_hex or, if that is empty, from
+// exi_base64.
+void append_binary(const Entry& entry, std::string& buffer);
+
+class BinaryReader {
+public:
+    // Reads the file header, throws std::runtime_error if the stream is not a binary session log
+    explicit BinaryReader(std::istream& in);
+
+    const std::string& session_name() const;
+    // Reads the next record, returns false at the end of the file or if the last record is incomplete
+    bool next(Entry& entry);
+    // true if the file ended in the middle of a record, e.g. after a power loss
+    bool truncated() const;
+
+private:
+    std::istream& in;
+    std::string name;
+    bool incomplete{false};
+};
+
+} // namespace session_log_format
+} // namespace module
+
+#endif // SESSION_LOG_FORMAT_HPP
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "StateMachineRecorder.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace module {
+
+bool StateMachineRecorder::open(const std::string& path) {
+    std::scoped_lock lock(mutex);
+    file.open(path, std::ios::out | std::ios::trunc);
+    start = std::chrono::steady_clock::now();
+    return file.is_open();
+}
+
+void StateMachineRecorder::record(const std::string& name, const std::string& arguments) {
+    const auto time_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::scoped_lock lock(mutex);
+    if (not file.is_open()) {
+        return;
+    }
+    file << time_ms << ' ' << name;
+    if (not arguments.empty()) {
+        file << ' ' << arguments;
+    }
+    // flushed per line so the recording survives a crash, the inputs arrive a few times per second at most
+    file << std::endl;
+}
+
+std::vector<StateMachineRecorder::Input> StateMachineRecorder::parse(std::istream& in) {
+    std::vector<Input> inputs;
+    std::string line;
+    int line_nr = 0;
+    while (std::getline(in, line)) {
+        line_nr++;
+        if (line.empty() or line[0] == '#') {
+            continue;
+        }
+        std::istringstream l(line);
+        Input input;
+        if (not(l >> input.time_ms >> input.name)) {
+            throw std::runtime_error("Malformed state machine recording in line " + std::to_string(line_nr));
+        }
+        std::getline(l >> std::ws, input.arguments);
+        inputs.push_back(input);
+    }
+    return inputs;
+}
+
+} // namespace module
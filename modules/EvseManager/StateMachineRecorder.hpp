@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef STATE_MACHINE_RECORDER_HPP
+#define STATE_MACHINE_RECORDER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace module {
+/*
+ Records the inputs of the IECStateMachine (BSP events and the calls from the Charger) and of the Charger (prefixed
+ with charger_, e.g. authorization, HLC callbacks and limits) with the time they arrived, so field sessions can be
+ replayed against the state machines in virtual time (see tests/IECStateMachineReplay.hpp and tests/ChargerReplay.hpp).
+ One line per input:
+
+   <ms since start> <input> [<arguments>]
+*/
+
+class StateMachineRecorder {
+public:
+    struct Input {
+        std::int64_t time_ms{0};
+        std::string name;
+        std::string arguments;
+    };
+
+    bool open(const std::string& path);
+    void record(const std::string& name, const std::string& arguments = "");
+
+    // Reads a recording, throws std::runtime_error on malformed lines
+    static std::vector<Input> parse(std::istream& in);
+
+private:
+    std::mutex mutex;
+    std::ofstream file;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace module
+
+#endif // STATE_MACHINE_RECORDER_HPP
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "TelemetryAggregator.hpp"
+
+#include <algorithm>
+
+namespace module {
+
+TelemetryAggregator::TelemetryAggregator(std::chrono::milliseconds window, const Publisher& publisher) :
+    window(window), publisher(publisher) {
+    timer_id = TimerService::instance().schedule_periodic(window, [this]() { flush(); });
+}
+
+TelemetryAggregator::~TelemetryAggregator() {
+    // waits for a flush that is running right now
+    TimerService::instance().cancel_and_wait(timer_id);
+}
+
+std::chrono::milliseconds TelemetryAggregator::get_window() const {
+    return window;
+}
+
+TelemetryAggregator::Channel* TelemetryAggregator::channel(const std::string& name, bool is_counter) {
+    for (std::size_t i = 0; i < nr_of_channels; i++) {
+        if (channels[i].name == name) {
+            return &channels[i];
+        }
+    }
+    if (nr_of_channels == MAX_CHANNELS) {
+        return nullptr;
+    }
+    auto& c = channels[nr_of_channels++];
+    c.name = name;
+    c.is_counter = is_counter;
+    return &c;
+}
+
+void TelemetryAggregator::gauge(const std::string& name, double value) {
+    std::scoped_lock lock(mutex);
+    auto c = channel(name, false);
+    if (c == nullptr) {
+        return;
+    }
+    if (c->count == 0) {
+        c->min = value;
+        c->max = value;
+        c->sum = 0.;
+    }
+    c->min = std::min(c->min, value);
+    c->max = std::max(c->max, value);
+    c->sum += value;
+    c->count++;
+    c->last = value;
+    c->has_value = true;
+}
+
+void TelemetryAggregator::counter(const std::string& name, double value) {
+    std::scoped_lock lock(mutex);
+    auto c = channel(name, true);
+    if (c == nullptr) {
+        return;
+    }
+    if (not c->has_value or value < c->window_start) {
+        // first reading or the counter was reset
+        c->window_start = value;
+    }
+    c->last = value;
+    c->has_value = true;
+}
+
+void TelemetryAggregator::info(const std::string& name, const Everest::TelemetryMap::mapped_type& value) {
+    std::scoped_lock lock(mutex);
+    info_values[name] = value;
+}
+
+void TelemetryAggregator::flush() {
+    Everest::TelemetryMap record;
+    {
+        std::scoped_lock lock(mutex);
+        if (nr_of_channels == 0 and info_values.empty()) {
+            return;
+        }
+
+        record = info_values;
+        record["window_s"] = std::chrono::duration<double>(window).count();
+        for (std::size_t i = 0; i < nr_of_channels; i++) {
+            auto& c = channels[i];
+            if (not c.has_value) {
+                continue;
+            }
+            record[c.name] = c.last;
+            if (c.is_counter) {
+                record[c.name + "_delta"] = c.last - c.window_start;
+                c.window_start = c.last;
+            } else if (c.count > 0) {
+                record[c.name + "_min"] = c.min;
+                record[c.name + "_max"] = c.max;
+                record[c.name + "_mean"] = c.sum / c.count;
+                c.count = 0;
+            }
+        }
+    }
+
+    publisher(record);
+}
+
+} // namespace module
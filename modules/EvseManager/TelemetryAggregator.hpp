@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef TELEMETRY_AGGREGATOR_HPP
+#define TELEMETRY_AGGREGATOR_HPP
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include <utils/types.hpp>
+
+#include "TimerService.hpp"
+
+namespace module {
+/*
+ Collects telemetry values as they arrive and publishes one record per window that contains the min/max/mean of
+ gauges (power, temperature, limits) and the increase of counters (energy), so short peaks between two records are
+ not lost. The aggregators are flushed by the shared TimerService.
+*/
+
+class TelemetryAggregator {
+public:
+    using Publisher = std::function<void(const Everest::TelemetryMap& record)>;
+
+    TelemetryAggregator(std::chrono::milliseconds window, const Publisher& publisher);
+    ~TelemetryAggregator();
+    TelemetryAggregator(const TelemetryAggregator&) = delete;
+    TelemetryAggregator& operator=(const TelemetryAggregator&) = delete;
+
+    // Adds a sample of a value like power or temperature. The record contains its last value as name and the
+    // statistics of the window as name_min, name_max and name_mean.
+    void gauge(const std::string& name, double value);
+    // Adds a reading of an increasing counter like an energy register. The record contains its last value as name
+    // and the increase within the window as name_delta.
+    void counter(const std::string& name, double value);
+    // Sets a value that is published as it is, e.g. the meter id
+    void info(const std::string& name, const Everest::TelemetryMap::mapped_type& value);
+
+    // Publishes the record of the current window and starts the next one. Nothing is published before the first
+    // value was added. Called by the TimerService at the end of every window.
+    void flush();
+
+    std::chrono::milliseconds get_window() const;
+
+private:
+    static constexpr std::size_t MAX_CHANNELS = 48;
+
+    struct Channel {
+        std::string name;
+        bool is_counter{false};
+        bool has_value{false};
+        double last{0.};
+        // gauge statistics of the current window
+        std::size_t count{0};
+        double min{0.};
+        double max{0.};
+        double sum{0.};
+        // counter value at the start of the current window
+        double window_start{0.};
+    };
+
+    Channel* channel(const std::string& name, bool is_counter);
+
+    const std::chrono::milliseconds window;
+    const Publisher publisher;
+    TimerService::Id timer_id;
+
+    std::mutex mutex;
+    std::array<Channel, MAX_CHANNELS> channels;
+    std::size_t nr_of_channels{0};
+    Everest::TelemetryMap info_values;
+};
+
+} // namespace module
+
+#endif // TELEMETRY_AGGREGATOR_HPP
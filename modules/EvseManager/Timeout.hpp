@@ -4,9 +4,11 @@
 #define TIMEOUT_HPP
 
 #include <chrono>
+#include <cstdint>
+#include <mutex>
 #include <sigslot/signal.hpp>
 
-#include "utils/thread.hpp"
+#include "TimerService.hpp"
 
 using namespace std::chrono;
 
@@ -47,43 +49,40 @@ private:
     bool running{false};
 };
 
-/* Simple helper class for a timeout with internal thread */
+/* Simple helper class for a timeout that signals when it is reached. Runs on the shared TimerService. */
 class AsyncTimeout {
 public:
+    ~AsyncTimeout() {
+        module::TimerService::Id id;
+        {
+            std::scoped_lock lock(mutex);
+            running = false;
+            id = timer_id;
+        }
+        // the callback uses this object
+        module::TimerService::instance().cancel_and_wait(id);
+    }
+
     void start(milliseconds _t) {
         std::scoped_lock lock(mutex);
 
         if (running) {
-            wait_thread.stop();
+            module::TimerService::instance().cancel(timer_id);
             running = false;
         }
 
         t = _t;
-        start_time = steady_clock::now();
+        start_time = module::TimerService::instance().now();
+        generation++;
 
-        // start waiting thread
-        wait_thread = std::thread([this]() {
-            while (not wait_thread.shouldExit()) {
-                std::this_thread::sleep_for(resolution);
-                if (reached_nolock()) {
-                    // Note the order is important here.
-                    // We first signal reached which will call all callbacks.
-                    // The timer is still running in this in those callbacks, so they can also call reached() and
-                    // get a true as return value.
-                    signal_reached();
-                    // After all signal handlers are called, we stop the timer.
-                    break;
-                }
-            }
-        });
+        timer_id = module::TimerService::instance().schedule(t, [this, g = generation]() { fire(g); });
         running = true;
     }
 
-    // Note that stopping the timer may take up to "resolution" amount of time to return
     void stop() {
         std::scoped_lock lock(mutex);
         if (running) {
-            wait_thread.stop();
+            module::TimerService::instance().cancel(timer_id);
             running = false;
         }
     }
@@ -101,22 +100,35 @@ public:
     sigslot::signal<> signal_reached;
 
 private:
+    void fire(std::uint64_t g) {
+        {
+            std::scoped_lock lock(mutex);
+            // restarted or stopped after this timer was due
+            if (not running or g not_eq generation) {
+                return;
+            }
+        }
+        // The timer is still running in the callbacks, so they can also call reached() and get a true as return
+        // value. It stays reached until it is stopped or started again.
+        signal_reached();
+    }
+
     bool reached_nolock() {
         if (!running) {
             return false;
-        } else if ((steady_clock::now() - start_time) > t) {
+        } else if ((module::TimerService::instance().now() - start_time) >= t) {
             return true;
         } else {
             return false;
         }
     }
 
-    constexpr static auto resolution = 500ms;
     milliseconds t;
     time_point<steady_clock> start_time;
     bool running{false};
+    std::uint64_t generation{0};
+    module::TimerService::Id timer_id{0};
     std::mutex mutex;
-    Everest::Thread wait_thread;
 };
 
 #endif
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "TimerService.hpp"
+
+#include <algorithm>
+
+#include <everest/logging.hpp>
+
+namespace module {
+
+TimerService& TimerService::instance() {
+    // never destroyed, timers may still be cancelled during static destruction
+    static auto* service = new TimerService();
+    return *service;
+}
+
+TimerService::Id TimerService::schedule(Clock::duration delay, const Callback& callback) {
+    return add(delay, Clock::duration::zero(), callback);
+}
+
+TimerService::Id TimerService::schedule_periodic(Clock::duration period, const Callback& callback) {
+    return add(period, period, callback);
+}
+
+TimerService::Id TimerService::add(Clock::duration delay, Clock::duration period, const Callback& callback) {
+    Id id;
+    {
+        std::scoped_lock lock(mutex);
+        if (not workers_started) {
+            workers_started = true;
+            for (std::size_t i = 0; i < NR_OF_WORKERS; i++) {
+                std::thread(&TimerService::worker, this).detach();
+            }
+        }
+        id = next_id++;
+        const auto due = now_nolock() + delay;
+        timers.emplace(std::make_pair(due, id), Timer{period, callback});
+        due_times.emplace(id, due);
+    }
+    timers_changed.notify_all();
+    return id;
+}
+
+void TimerService::cancel(Id id) {
+    std::scoped_lock lock(mutex);
+    const auto due = due_times.find(id);
+    if (due != due_times.end()) {
+        timers.erase(std::make_pair(due->second, id));
+        due_times.erase(due);
+    }
+    for (auto& r : running) {
+        if (r.id == id) {
+            // do not start a periodic timer again
+            r.cancelled = true;
+        }
+    }
+}
+
+void TimerService::cancel_and_wait(Id id) {
+    cancel(id);
+    const auto self = std::this_thread::get_id();
+    std::unique_lock<std::mutex> lock(mutex);
+    callback_done.wait(lock, [this, id, self] {
+        return std::none_of(running.begin(), running.end(),
+                            [id, self](const Running& r) { return r.id == id and r.thread != self; });
+    });
+}
+
+TimerService::Clock::time_point TimerService::now() {
+    // AsyncTimeout::reached() polls this, do not serialize it on the timer mutex in normal operation
+    if (not virtual_time) {
+        return Clock::now();
+    }
+    std::scoped_lock lock(mutex);
+    return now_nolock();
+}
+
+void TimerService::sleep_for(Clock::duration duration) {
+    {
+        std::scoped_lock lock(mutex);
+        if (virtual_time) {
+            virtual_now += duration;
+            return;
+        }
+    }
+    std::this_thread::sleep_for(duration);
+}
+
+TimerService::Clock::time_point TimerService::now_nolock() {
+    return virtual_time ? virtual_now : Clock::now();
+}
+
+void TimerService::use_virtual_time(bool enable) {
+    {
+        std::scoped_lock lock(mutex);
+        if (enable and not virtual_time) {
+            virtual_now = Clock::now();
+        }
+        virtual_time = enable;
+    }
+    timers_changed.notify_all();
+}
+
+std::size_t TimerService::advance(Clock::duration duration) {
+    std::unique_lock<std::mutex> lock(mutex);
+    const auto target = virtual_now + duration;
+    std::size_t runs = 0;
+    while (virtual_time and not timers.empty() and timers.begin()->first.first <= target) {
+        virtual_now = std::max(virtual_now, timers.begin()->first.first);
+        run_first(lock);
+        runs++;
+    }
+    // a callback may have slept beyond the target
+    virtual_now = std::max(virtual_now, target);
+    return runs;
+}
+
+std::optional<TimerService::Clock::time_point> TimerService::next_due() {
+    std::scoped_lock lock(mutex);
+    if (timers.empty()) {
+        return std::nullopt;
+    }
+    return timers.begin()->first.first;
+}
+
+void TimerService::run_first(std::unique_lock<std::mutex>& lock) {
+    const auto [due, id] = timers.begin()->first;
+    auto timer = std::move(timers.begin()->second);
+    timers.erase(timers.begin());
+    due_times.erase(id);
+    running.push_back({id, std::this_thread::get_id(), false});
+
+    lock.unlock();
+    try {
+        timer.callback();
+    } catch (const std::exception& e) {
+        EVLOG_error << "Timer callback failed: " << e.what();
+    }
+    lock.lock();
+
+    const auto r = std::find_if(running.begin(), running.end(), [id = id](const Running& r) { return r.id == id; });
+    const bool cancelled = r->cancelled;
+    running.erase(r);
+    callback_done.notify_all();
+
+    if (timer.period > Clock::duration::zero() and not cancelled) {
+        auto next = due + timer.period;
+        const auto now = now_nolock();
+        if (next <= now) {
+            next = now + timer.period;
+        }
+        timers.emplace(std::make_pair(next, id), std::move(timer));
+        due_times.emplace(id, next);
+    }
+}
+
+void TimerService::worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (virtual_time or timers.empty()) {
+            // virtual timers only run in advance()
+            timers_changed.wait(lock);
+            continue;
+        }
+
+        const auto due = timers.begin()->first.first;
+        if (due > Clock::now()) {
+            timers_changed.wait_until(lock, due);
+            continue;
+        }
+
+        run_first(lock);
+    }
+}
+
+} // namespace module
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef TIMER_SERVICE_HPP
+#define TIMER_SERVICE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace module {
+/*
+ Process wide timer service. Timers are kept ordered by their due time and the callbacks run on a small fixed pool
+ of worker threads that sleep until the next timer is due, so no thread is created per timer.
+
+ For replays the service can run on a virtual clock instead: time only moves in advance() and the callbacks run in
+ the thread that calls it.
+*/
+
+class TimerService {
+public:
+    using Callback = std::function<void()>;
+    using Id = std::uint64_t;
+    using Clock = std::chrono::steady_clock;
+
+    static TimerService& instance();
+
+    // Runs callback once after delay
+    Id schedule(Clock::duration delay, const Callback& callback);
+    // Runs callback every period. If the callback is late, the missed runs are skipped.
+    Id schedule_periodic(Clock::duration period, const Callback& callback);
+
+    // Removes the timer. A callback that is running right now is not waited for. Unknown ids are ignored.
+    void cancel(Id id);
+    // Like cancel, but waits until a callback of this timer that is running on another thread returned.
+    // Must not be called while holding a lock that the callback needs.
+    void cancel_and_wait(Id id);
+
+    // Time base of the timers, use this instead of Clock::now() when comparing against them. Does not lock unless the
+    // virtual clock is used.
+    Clock::time_point now();
+    // Blocks the calling thread for duration. On the virtual clock it only moves the time, the timers that get due on
+    // the way run in the next advance().
+    void sleep_for(Clock::duration duration);
+
+    // Switches between the steady clock and a virtual clock that starts at the current time
+    void use_virtual_time(bool enable);
+    // Moves the virtual clock forward and runs the timers that get due on the way in the calling thread.
+    // Returns the number of callbacks that were run.
+    std::size_t advance(Clock::duration duration);
+    // Due time of the next timer, if there is one
+    std::optional<Clock::time_point> next_due();
+
+    TimerService(const TimerService&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+
+    static constexpr std::size_t NR_OF_WORKERS = 2;
+
+private:
+    TimerService() = default;
+
+    struct Timer {
+        Clock::duration period;
+        Callback callback;
+    };
+
+    struct Running {
+        Id id;
+        std::thread::id thread;
+        bool cancelled;
+    };
+
+    Id add(Clock::duration delay, Clock::duration period, const Callback& callback);
+    Clock::time_point now_nolock();
+    // runs the first timer, the lock is released during the callback
+    void run_first(std::unique_lock<std::mutex>& lock);
+    void worker();
+
+    std::mutex mutex;
+    std::condition_variable timers_changed;
+    std::condition_variable callback_done;
+    // ordered by due time, the id keeps timers with the same due time apart
+    std::map<std::pair<Clock::time_point, Id>, Timer> timers;
+    std::unordered_map<Id, Clock::time_point> due_times;
+    std::vector<Running> running;
+    Id next_id{1};
+    bool workers_started{false};
+    std::atomic_bool virtual_time{false};
+    Clock::time_point virtual_now;
+};
+
+} // namespace module
+
+#endif // TIMER_SERVICE_HPP
@@ -5,6 +5,7 @@
 
 #include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 
 /*
@@ -42,11 +43,48 @@ public:
         }
     };
 
+    // Like wait_for, but returns false as soon as cancel() returns true. cancel is evaluated without holding the lock,
+    // at the start and again after every call to interrupt().
+    bool wait_for(T& d, std::chrono::milliseconds timeout, const std::function<bool()>& cancel) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::unique_lock<std::mutex> lock(data_mutex);
+        while (true) {
+            if (unread_data) {
+                unread_data = false;
+                d = data;
+                return true;
+            }
+
+            const auto seen_interrupts = interrupts;
+            lock.unlock();
+            if (cancel()) {
+                return false;
+            }
+            lock.lock();
+
+            const auto woken = [this, seen_interrupts] { return unread_data or interrupts != seen_interrupts; };
+            if (not condvar.wait_until(lock, deadline, woken)) {
+                // Timeout occured in wait_for
+                return false;
+            }
+        }
+    };
+
+    // Wakes up a waiting wait_for to evaluate its cancel condition again
+    void interrupt() {
+        {
+            std::scoped_lock lock(data_mutex);
+            interrupts++;
+        }
+        condvar.notify_all();
+    };
+
 private:
     T data;
     std::condition_variable condvar;
     std::mutex data_mutex;
     bool unread_data{false};
+    unsigned int interrupts{0};
 };
 
 #endif
@@ -594,5 +594,20 @@ void energyImpl::handle_enforce_limits(types::energy::EnforcedLimits& value) {
     }
 }
 
+void energyImpl::handle_resync_energy_flow_request() {
+    // the EVSE always publishes its complete request, so a snapshot is just the next request
+    request_energy_from_energy_manager(false);
+}
+
+void energyImpl::handle_enforce_limits_batch(std::vector<types::energy::EnforcedLimits>& value) {
+    // leaf of the tree: only the entry for this EVSE is of interest
+    for (auto& limits : value) {
+        if (limits.uuid == energy_flow_request.uuid) {
+            handle_enforce_limits(limits);
+            return;
+        }
+    }
+}
+
 } // namespace energy_grid
 } // namespace module
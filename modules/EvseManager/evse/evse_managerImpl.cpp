@@ -58,6 +58,9 @@ void evse_managerImpl::init() {
     mod->mqtt.subscribe(fmt::format("everest_external/nodered/{}/cmd/faulted", mod->config.connector_id),
                         [&charger = mod->charger](const std::string& data) { charger->set_faulted(); });
 
+    mod->mqtt.subscribe(fmt::format("everest_external/nodered/{}/cmd/lock_profile", mod->config.connector_id),
+                        [this](const std::string& data) { mod->publish_lock_profile(data == "reset"); });
+
     mod->mqtt.subscribe(
         fmt::format("everest_external/nodered/{}/cmd/switch_three_phases_while_charging", mod->config.connector_id),
         [&charger = mod->charger](const std::string& data) {
@@ -133,6 +136,11 @@ void evse_managerImpl::ready() {
         mod->mqtt.publish(fmt::format("everest_external/nodered/{}/state/temperature", mod->config.connector_id),
                           telemetry.evse_temperature_C);
         // /external Nodered interface
+        mod->telemetry_aggregator->gauge("evse_temperature_C", telemetry.evse_temperature_C);
+        if (telemetry.plug_temperature_C) {
+            mod->telemetry_aggregator->gauge("plug_temperature_C", telemetry.plug_temperature_C.value());
+        }
+        mod->telemetry_aggregator->gauge("fan_rpm", telemetry.fan_rpm);
         publish_telemetry(telemetry);
     });
 
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "lock_profiler.hpp"
+
+#include <algorithm>
+
+namespace Everest {
+
+std::atomic_bool LockProfiler::is_enabled{false};
+std::array<LockProfiler::AtomicSite, LockProfiler::MAX_SITES> LockProfiler::sites;
+
+namespace {
+std::size_t bucket(std::uint64_t us) {
+    std::size_t b = 0;
+    while (b < LockProfiler::NR_OF_BUCKETS - 1 and us >= (std::uint64_t{1} << b)) {
+        b++;
+    }
+    return b;
+}
+} // namespace
+
+std::uint64_t LockProfiler::Histogram::percentile_us(double p) const {
+    if (count == 0) {
+        return 0;
+    }
+    const auto rank = static_cast<std::uint64_t>(p * count);
+    std::uint64_t seen = 0;
+    for (std::size_t b = 0; b < NR_OF_BUCKETS - 1; b++) {
+        seen += buckets[b];
+        if (seen > rank) {
+            return std::min(std::uint64_t{1} << b, max_us);
+        }
+    }
+    return max_us;
+}
+
+void LockProfiler::AtomicHistogram::add(std::uint64_t us) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    total_us.fetch_add(us, std::memory_order_relaxed);
+    buckets[bucket(us)].fetch_add(1, std::memory_order_relaxed);
+    auto m = max_us.load(std::memory_order_relaxed);
+    while (us > m and not max_us.compare_exchange_weak(m, us, std::memory_order_relaxed)) {
+    }
+}
+
+LockProfiler::Histogram LockProfiler::AtomicHistogram::load() const {
+    Histogram h;
+    h.count = count.load(std::memory_order_relaxed);
+    h.total_us = total_us.load(std::memory_order_relaxed);
+    h.max_us = max_us.load(std::memory_order_relaxed);
+    for (std::size_t b = 0; b < NR_OF_BUCKETS; b++) {
+        h.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+    }
+    return h;
+}
+
+void LockProfiler::AtomicHistogram::clear() {
+    count.store(0, std::memory_order_relaxed);
+    total_us.store(0, std::memory_order_relaxed);
+    max_us.store(0, std::memory_order_relaxed);
+    for (auto& b : buckets) {
+        b.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LockProfiler::enable(bool e) {
+    is_enabled.store(e, std::memory_order_relaxed);
+}
+
+void LockProfiler::record(std::size_t description, std::chrono::steady_clock::duration wait,
+                          std::chrono::steady_clock::duration hold) {
+    if (description >= MAX_SITES) {
+        return;
+    }
+    auto& site = sites[description];
+    site.wait.add(std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+    site.hold.add(std::chrono::duration_cast<std::chrono::microseconds>(hold).count());
+}
+
+std::vector<LockProfiler::Site> LockProfiler::top(std::size_t n) {
+    std::vector<Site> result;
+    for (std::size_t i = 0; i < MAX_SITES; i++) {
+        Site s{i, sites[i].wait.load(), sites[i].hold.load()};
+        if (s.wait.count > 0) {
+            result.push_back(s);
+        }
+    }
+    std::sort(result.begin(), result.end(),
+              [](const Site& a, const Site& b) { return a.wait.total_us > b.wait.total_us; });
+    if (result.size() > n) {
+        result.resize(n);
+    }
+    return result;
+}
+
+void LockProfiler::reset() {
+    for (auto& s : sites) {
+        s.wait.clear();
+        s.hold.clear();
+    }
+}
+
+} // namespace Everest
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef EVEREST_LOCK_PROFILER
+#define EVEREST_LOCK_PROFILER
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/*
+ Lock contention profiler for scoped_lock_timeout
+
+ Records the time spent waiting for and holding the lock per MutexDescription into fixed log2 histograms of
+ atomic counters, so recording never allocates or locks. The hooks in scoped_lock_timeout are only compiled in
+ with EVEREST_LOCK_PROFILING defined (CMake option EVSEMANAGER_LOCK_PROFILING), without it the locks have no
+ overhead at all. With it compiled in, recording is still off until enable(true) is called.
+*/
+namespace Everest {
+
+class LockProfiler {
+public:
+    // bucket i counts durations below 2^i microseconds, the last one everything above
+    static constexpr std::size_t NR_OF_BUCKETS = 25;
+
+    struct Histogram {
+        std::uint64_t count{0};
+        std::uint64_t total_us{0};
+        std::uint64_t max_us{0};
+        std::array<std::uint64_t, NR_OF_BUCKETS> buckets{};
+
+        // upper bound of the bucket that contains the given percentile (0..1)
+        std::uint64_t percentile_us(double p) const;
+    };
+
+    struct Site {
+        std::size_t description;
+        Histogram wait;
+        Histogram hold;
+    };
+
+    static void enable(bool e);
+    static bool enabled() {
+        return is_enabled.load(std::memory_order_relaxed);
+    }
+
+    static void record(std::size_t description, std::chrono::steady_clock::duration wait,
+                       std::chrono::steady_clock::duration hold);
+
+    // Sites with at least one recorded lock, sorted by total wait time (most contended first)
+    static std::vector<Site> top(std::size_t n);
+    static void reset();
+
+    static constexpr std::size_t MAX_SITES = 128;
+
+private:
+    struct AtomicHistogram {
+        std::atomic<std::uint64_t> count{0};
+        std::atomic<std::uint64_t> total_us{0};
+        std::atomic<std::uint64_t> max_us{0};
+        std::array<std::atomic<std::uint64_t>, NR_OF_BUCKETS> buckets{};
+
+        void add(std::uint64_t us);
+        Histogram load() const;
+        void clear();
+    };
+
+    struct AtomicSite {
+        AtomicHistogram wait;
+        AtomicHistogram hold;
+    };
+
+    static std::atomic_bool is_enabled;
+    static std::array<AtomicSite, MAX_SITES> sites;
+};
+
+} // namespace Everest
+
+#endif
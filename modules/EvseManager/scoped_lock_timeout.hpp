@@ -7,8 +7,12 @@
 #include "everest/logging.hpp"
 #include <mutex>
 #include <signal.h>
+#include <thread>
 
 #include "backtrace.hpp"
+#ifdef EVEREST_LOCK_PROFILING
+#include "lock_profiler.hpp"
+#endif
 
 /*
  Simple helper class for scoped lock with timeout
@@ -257,6 +261,12 @@ public:
 template <typename mutex_type> class scoped_lock_timeout {
 public:
     explicit scoped_lock_timeout(mutex_type& __m, MutexDescription description) : mutex(__m) {
+#ifdef EVEREST_LOCK_PROFILING
+        this->description = description;
+        if (LockProfiler::enabled()) {
+            wait_start = std::chrono::steady_clock::now();
+        }
+#endif
         if (not mutex.try_lock_for(deadlock_timeout)) {
 #ifdef EVEREST_USE_BACKTRACES
             request_backtrace(pthread_self());
@@ -276,6 +286,11 @@ public:
 #endif
         } else {
             locked = true;
+#ifdef EVEREST_LOCK_PROFILING
+            if (wait_start.time_since_epoch().count() not_eq 0) {
+                locked_at = std::chrono::steady_clock::now();
+            }
+#endif
 #ifdef EVEREST_USE_BACKTRACES
             mutex.description = description;
             mutex.p_id = pthread_self();
@@ -285,6 +300,14 @@ public:
 
     ~scoped_lock_timeout() {
         if (locked) {
+#ifdef EVEREST_LOCK_PROFILING
+            if (locked_at.time_since_epoch().count() not_eq 0) {
+                const auto now = std::chrono::steady_clock::now();
+                mutex.unlock();
+                LockProfiler::record(static_cast<std::size_t>(description), locked_at - wait_start, now - locked_at);
+                return;
+            }
+#endif
             mutex.unlock();
         }
     }
@@ -295,6 +318,11 @@ public:
 private:
     bool locked{false};
     mutex_type& mutex;
+#ifdef EVEREST_LOCK_PROFILING
+    MutexDescription description;
+    std::chrono::steady_clock::time_point wait_start;
+    std::chrono::steady_clock::time_point locked_at;
+#endif
 
     // This should be lower then command timeouts from framework (by default 300s)
     static constexpr auto deadlock_timeout = std::chrono::seconds(120);
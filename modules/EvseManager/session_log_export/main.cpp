@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "SessionLogFormat.hpp"
+#include "v2gMessage.hpp"
+
+using namespace module;
+
+static void help() {
+    std::cerr << "\nUsage: ./session_log_export csv|html|json eventlog.bin [output file]\n\n"
+                 "Converts a binary session log of the EvseManager into the CSV, HTML or JSON view. The output is\n"
+                 "written to stdout if no output file is given.\n";
+}
+
+static std::string pretty_print(const session_log_format::Entry& entry) {
+    v2g_message v2g;
+    if (!entry.xml.empty()) {
+        v2g.from_xml(entry.xml);
+        return v2g.to_xml();
+    } else if (!entry.json_str.empty()) {
+        v2g.from_json(entry.json_str);
+        return v2g.to_json();
+    }
+    return {};
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 or argc > 4) {
+        help();
+        return 1;
+    }
+    const std::string view = argv[1];
+    if (view != "csv" and view != "html" and view != "json") {
+        help();
+        return 1;
+    }
+
+    std::ifstream in(argv[2], std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Cannot open " << argv[2] << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::ofstream file;
+    if (argc == 4) {
+        file.open(argv[3]);
+        if (!file.is_open()) {
+            std::cerr << "Cannot open " << argv[3] << " for writing: " << std::strerror(errno) << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = file.is_open() ? file : std::cout;
+
+    try {
+        session_log_format::BinaryReader reader(in);
+        session_log_format::Entry entry;
+        auto json = nlohmann::json::array();
+
+        if (view == "html") {
+            out << session_log_format::html_header(reader.session_name());
+        }
+        while (reader.next(entry)) {
+            if (view == "csv") {
+                out << session_log_format::csv_line(entry, pretty_print(entry));
+            } else if (view == "html") {
+                out << session_log_format::html_row(entry, pretty_print(entry));
+            } else {
+                json.push_back(session_log_format::to_json(entry));
+            }
+        }
+        if (view == "html") {
+            out << session_log_format::html_footer();
+        } else if (view == "json") {
+            out << json.dump(2) << "\n";
+        }
+
+        if (reader.truncated()) {
+            std::cerr << "Warning: the last record of " << argv[2] << " is incomplete and was skipped\n";
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << argv[2] << ": " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
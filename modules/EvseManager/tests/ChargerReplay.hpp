@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+/*
+ Replays recordings of the Charger inputs (the charger_* inputs of a cp_state_machine_recording) together with the BSP
+ events against the real Charger and IECStateMachine. The main loop of the Charger and all its timeouts run on the
+ virtual clock of the TimerService, so a session of hours replays in milliseconds.
+
+ The trace contains the inputs and everything the Charger did in response: BSP calls, CP events, session events,
+ signals and the state transitions with the virtual time spent in the previous state. Runs of the main loop that did
+ nothing are left out. The latency of a state transition (e.g. "state Idle->WaitingForAuthentication") is the
+ processing time from the start of the input or main loop run that caused it.
+
+ The IECStateMachine inputs that the Charger generates itself (enable, setup, set_pwm*, allow_power_on) are skipped,
+ the replay produces them again. Not replayed are errors of other modules, the billing powermeter and the persistent
+ store. Unless charger_set_connector_type was recorded, the connector is a cable.
+*/
+
+#ifndef CHARGER_REPLAY_HPP
+#define CHARGER_REPLAY_HPP
+
+#include "EvseManagerStub.hpp"
+#include "IECStateMachineReplay.hpp"
+#include <Charger.hpp>
+
+#include <sstream>
+
+namespace module::replay {
+
+class ChargerReplay {
+public:
+    static ReplayResult run(const std::vector<StateMachineRecorder::Input>& inputs,
+                            types::evse_board_support::Connector_type connector_type =
+                                types::evse_board_support::Connector_type::IEC62196Type2Cable) {
+        auto& timers = TimerService::instance();
+        // destroyed last, the Charger cancels its main loop timer on destruction
+        const VirtualTime virtual_time(timers);
+        const auto start = timers.now();
+
+        Setup s(connector_type);
+        auto& bsp = s.bsp;
+        auto& charger = *s.charger;
+
+        ReplayResult result;
+        std::map<std::string, std::vector<double>> samples;
+        auto t0 = std::chrono::steady_clock::now();
+        auto state = charger.get_current_state();
+        auto state_entered = timers.now();
+
+        s.state_machine->signal_event.connect([&bsp, &charger](CPEvent e) {
+            bsp.outputs.push_back("event " + cpevent_to_string(e));
+            charger.process_event(e);
+        });
+        s.state_machine->signal_lock.connect([&bsp]() { bsp.outputs.push_back("lock"); });
+        s.state_machine->signal_unlock.connect([&bsp]() { bsp.outputs.push_back("unlock"); });
+
+        charger.signal_state.connect([&](Charger::EvseState next) {
+            if (next == state) {
+                return;
+            }
+            const auto transition = charger.evse_state_to_string(state) + "->" + charger.evse_state_to_string(next);
+            samples["state " + transition].push_back(
+                std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+            bsp.outputs.push_back(fmt::format(
+                "state {} (after {} ms)", transition,
+                std::chrono::duration_cast<std::chrono::milliseconds>(timers.now() - state_entered).count()));
+            state = next;
+            state_entered = timers.now();
+        });
+        charger.signal_simple_event.connect([&bsp](types::evse_manager::SessionEventEnum e) {
+            bsp.outputs.push_back("session_event " + types::evse_manager::session_event_enum_to_string(e));
+        });
+        charger.signal_max_current.connect(
+            [&bsp](float c) { bsp.outputs.push_back(fmt::format("max_current {:.1f}", c)); });
+        charger.signal_session_started_event.connect(
+            [&bsp](types::evse_manager::StartSessionReason r, std::optional<types::authorization::ProvidedIdToken>) {
+                bsp.outputs.push_back("session_started " + types::evse_manager::start_session_reason_to_string(r));
+            });
+        charger.signal_session_resumed_event.connect(
+            [&bsp](const std::string&) { bsp.outputs.push_back("session_resumed"); });
+        charger.signal_transaction_started_event.connect([&bsp](types::authorization::ProvidedIdToken token) {
+            bsp.outputs.push_back("transaction_started " + token.id_token.value);
+        });
+        charger.signal_transaction_finished_event.connect(
+            [&bsp](types::evse_manager::StopTransactionReason r, std::optional<types::authorization::ProvidedIdToken>) {
+                bsp.outputs.push_back("transaction_finished " +
+                                      types::evse_manager::stop_transaction_reason_to_string(r));
+            });
+        charger.signal_ac_with_soc_timeout.connect([&bsp]() { bsp.outputs.push_back("ac_with_soc_timeout"); });
+        charger.signal_dc_supply_off.connect([&bsp]() { bsp.outputs.push_back("dc_supply_off"); });
+        charger.signal_slac_reset.connect([&bsp]() { bsp.outputs.push_back("slac_reset"); });
+        charger.signal_slac_start.connect([&bsp]() { bsp.outputs.push_back("slac_start"); });
+        charger.signal_hlc_stop_charging.connect([&bsp]() { bsp.outputs.push_back("hlc_stop_charging"); });
+
+        const auto step = [&](const std::string& label, const std::string& line, const auto& apply) {
+            bsp.outputs.clear();
+            t0 = std::chrono::steady_clock::now();
+            const bool ran = apply();
+            const auto t1 = std::chrono::steady_clock::now();
+            if (not ran) {
+                return;
+            }
+            samples[label].push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+            if (label == "timer" and bsp.outputs.empty()) {
+                return;
+            }
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(timers.now() - start).count();
+            result.trace.push_back(fmt::format("{} {}", ms, line));
+            for (const auto& output : bsp.outputs) {
+                result.trace.push_back(fmt::format("{}   -> {}", ms, output));
+            }
+        };
+
+        const auto run_timers_until = [&](TimerService::Clock::time_point t) {
+            for (auto due = timers.next_due(); due.has_value() and due.value() <= t; due = timers.next_due()) {
+                step("timer", "timer", [&timers, &due]() {
+                    return timers.advance(std::max(due.value() - timers.now(), TimerService::Clock::duration::zero())) >
+                           0;
+                });
+            }
+            if (t > timers.now()) {
+                timers.advance(t - timers.now());
+            }
+        };
+
+        for (const auto& input : inputs) {
+            run_timers_until(start + std::chrono::milliseconds(input.time_ms));
+
+            const auto label = input.name == "bsp_event" ? input.name + " " + input.arguments : input.name;
+            const auto line = input.arguments.empty() ? input.name : input.name + " " + input.arguments;
+            step(label, line, [&]() { return apply(input, s); });
+        }
+        // let the last input settle, e.g. a pending timeout of the state machine
+        run_timers_until(timers.now() + SETTLE_TIME);
+
+        result.latency = summarize(samples);
+        return result;
+    }
+
+    static constexpr auto SETTLE_TIME = std::chrono::seconds(10);
+
+private:
+    // Everything the Charger needs, destroyed in reverse order
+    struct Setup {
+        explicit Setup(types::evse_board_support::Connector_type connector_type) {
+            state_machine->set_feed_in_caller_thread(true);
+            charger = std::make_unique<Charger>(state_machine, error_handling, r_powermeter_billing, store,
+                                                connector_type, "DE*PNX*E12345*1");
+            charger->set_mainloop_on_timer_service(true);
+        }
+        ~Setup() {
+            // the Charger switches the PWM to F on destruction, its events must not reach it anymore
+            state_machine->signal_event.disconnect_all();
+        }
+
+        ReplayBsp bsp;
+        std::unique_ptr<evse_board_supportIntf> r_bsp{std::make_unique<stub::evse_board_supportIntfStub>(bsp)};
+        std::unique_ptr<IECStateMachine> state_machine{std::make_unique<IECStateMachine>(r_bsp, true)};
+        std::unique_ptr<evse_managerImplBase> p_evse{std::make_unique<stub::evse_managerImplStub>(&bsp)};
+        std::vector<std::unique_ptr<ISO15118_chargerIntf>> r_hlc;
+        std::vector<std::unique_ptr<connector_lockIntf>> r_connector_lock;
+        std::vector<std::unique_ptr<ac_rcdIntf>> r_ac_rcd;
+        std::vector<std::unique_ptr<isolation_monitorIntf>> r_imd;
+        std::vector<std::unique_ptr<power_supply_DCIntf>> r_powersupply;
+        std::unique_ptr<ErrorHandling> error_handling{std::make_unique<ErrorHandling>(
+            r_bsp, r_hlc, r_connector_lock, r_ac_rcd, p_evse, r_imd, r_powersupply)};
+        std::vector<std::unique_ptr<powermeterIntf>> r_powermeter_billing;
+        std::vector<std::unique_ptr<kvsIntf>> r_store;
+        std::unique_ptr<PersistentStore> store{std::make_unique<PersistentStore>(r_store, "replay")};
+        std::unique_ptr<Charger> charger;
+    };
+
+    // splits "<first> <rest>"
+    static std::pair<std::string, std::string> split(const std::string& a) {
+        const auto space = a.find(' ');
+        if (space == std::string::npos) {
+            return {a, ""};
+        }
+        return {a.substr(0, space), a.substr(space + 1)};
+    }
+
+    static void setup(Charger& charger, const std::string& a) {
+        const auto j = nlohmann::json::parse(a);
+        const auto charge_mode = j.at("charge_mode").get<std::string>() == "DC" ? Charger::ChargeMode::DC
+                                                                                 : Charger::ChargeMode::AC;
+        charger.setup(j.at("has_ventilation").get<bool>(), charge_mode,
+                      j.at("ac_hlc_enabled").get<bool>(), j.at("ac_hlc_use_5percent").get<bool>(),
+                      j.at("ac_enforce_hlc").get<bool>(), j.at("ac_with_soc_timeout").get<bool>(),
+                      j.at("soft_over_current_tolerance_percent").get<float>(),
+                      j.at("soft_over_current_measurement_noise_A").get<float>(),
+                      j.at("switch_3ph1ph_delay_s").get<int>(), j.at("switch_3ph1ph_cp_state").get<std::string>(),
+                      j.at("soft_over_current_timeout_ms").get<int>(), j.at("state_F_after_fault_ms").get<int>());
+    }
+
+    // returns false for inputs that are not replayed
+    static bool apply(const StateMachineRecorder::Input& input, Setup& s) {
+        auto& charger = *s.charger;
+        const auto& n = input.name;
+        const auto& a = input.arguments;
+        if (n == "bsp_event") {
+            s.bsp.raise_event(types::board_support_common::string_to_event(a));
+        } else if (n == "enable" or n == "setup" or n == "set_pwm" or n == "set_pwm_off" or n == "set_pwm_F" or
+                   n == "allow_power_on") {
+            // generated by the Charger
+            return false;
+        } else if (n == "connector_force_unlock") {
+            s.state_machine->connector_force_unlock();
+        } else if (n == "set_three_phases") {
+            s.state_machine->set_three_phases(a == "true");
+        } else if (n == "set_ev_simplified_mode_evse_limit") {
+            s.state_machine->set_ev_simplified_mode_evse_limit(a == "true");
+        } else if (n == "charger_set_connector_type") {
+            charger.set_connector_type(types::evse_board_support::string_to_connector_type(a));
+        } else if (n == "charger_setup") {
+            setup(charger, a);
+        } else if (n == "charger_run") {
+            charger.run();
+        } else if (n == "charger_set_max_current") {
+            const auto [current, valid_for_ms] = split(a);
+            charger.set_max_current(std::stof(current),
+                                    date::utc_clock::now() + std::chrono::milliseconds(std::stoll(valid_for_ms)));
+        } else if (n == "charger_authorize") {
+            const auto [authorized, token] = split(a);
+            charger.authorize(authorized == "true",
+                              nlohmann::json::parse(token).get<types::authorization::ProvidedIdToken>());
+        } else if (n == "charger_deauthorize") {
+            charger.deauthorize();
+        } else if (n == "charger_enable_disable") {
+            const auto [connector_id, source] = split(a);
+            charger.enable_disable(std::stoi(connector_id),
+                                   nlohmann::json::parse(source).get<types::evse_manager::EnableDisableSource>());
+        } else if (n == "charger_set_faulted") {
+            charger.set_faulted();
+        } else if (n == "charger_pause_charging") {
+            charger.pause_charging();
+        } else if (n == "charger_resume_charging") {
+            charger.resume_charging();
+        } else if (n == "charger_pause_charging_wait_for_power") {
+            charger.pause_charging_wait_for_power();
+        } else if (n == "charger_resume_charging_power_available") {
+            charger.resume_charging_power_available();
+        } else if (n == "charger_evse_replug") {
+            charger.evse_replug();
+        } else if (n == "charger_cancel_transaction") {
+            charger.cancel_transaction(
+                nlohmann::json::parse(a).get<types::evse_manager::StopTransactionRequest>());
+        } else if (n == "charger_switch_three_phases_while_charging") {
+            charger.switch_three_phases_while_charging(a == "true");
+        } else if (n == "charger_set_current_drawn_by_vehicle") {
+            std::istringstream currents(a);
+            float l1{0.}, l2{0.}, l3{0.};
+            currents >> l1 >> l2 >> l3;
+            charger.set_current_drawn_by_vehicle(l1, l2, l3);
+        } else if (n == "charger_request_error_sequence") {
+            charger.request_error_sequence();
+        } else if (n == "charger_set_matching_started") {
+            charger.set_matching_started(a == "true");
+        } else if (n == "charger_notify_currentdemand_started") {
+            charger.notify_currentdemand_started();
+        } else if (n == "charger_inform_new_evse_max_hlc_limits") {
+            charger.inform_new_evse_max_hlc_limits(
+                nlohmann::json::parse(a).get<types::iso15118_charger::DcEvseMaximumLimits>());
+        } else if (n == "charger_dlink_pause") {
+            charger.dlink_pause();
+        } else if (n == "charger_dlink_terminate") {
+            charger.dlink_terminate();
+        } else if (n == "charger_dlink_error") {
+            charger.dlink_error();
+        } else if (n == "charger_set_hlc_charging_active") {
+            charger.set_hlc_charging_active();
+        } else if (n == "charger_set_hlc_allow_close_contactor") {
+            charger.set_hlc_allow_close_contactor(a == "true");
+        } else if (n == "charger_set_hlc_error") {
+            charger.set_hlc_error();
+        } else {
+            throw std::runtime_error("Unknown input in charger recording: " + n);
+        }
+        return true;
+    }
+};
+
+} // namespace module::replay
+
+#endif // CHARGER_REPLAY_HPP
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "ChargerReplay.hpp"
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+using module::StateMachineRecorder;
+using module::replay::ChargerReplay;
+using module::replay::ReplayResult;
+
+const std::string setup_ac =
+    "0 charger_setup {\"ac_enforce_hlc\":false,\"ac_hlc_enabled\":false,\"ac_hlc_use_5percent\":false,"
+    "\"ac_with_soc_timeout\":false,\"charge_mode\":\"AC\",\"has_ventilation\":false,"
+    "\"soft_over_current_measurement_noise_A\":0.5,\"soft_over_current_timeout_ms\":7000,"
+    "\"soft_over_current_tolerance_percent\":10.0,\"state_F_after_fault_ms\":300,\"switch_3ph1ph_cp_state\":\"X1\","
+    "\"switch_3ph1ph_delay_s\":10}\n"
+    "0 charger_set_max_current 0 120000\n"
+    "0 charger_run\n";
+
+const std::string authorize_rfid = "charger_authorize true {\"authorization_type\":\"RFID\","
+                                   "\"id_token\":{\"type\":\"ISO14443\",\"value\":\"DEADBEEF\"}}\n";
+
+std::vector<StateMachineRecorder::Input> parse(const std::string& recording) {
+    std::istringstream in(recording);
+    return StateMachineRecorder::parse(in);
+}
+
+// virtual time of the first trace line from time from on that contains text, -1 if there is none
+std::int64_t time_of(const ReplayResult& result, const std::string& text, std::int64_t from = 0) {
+    for (const auto& line : result.trace) {
+        if (std::stoll(line) >= from and line.find(text) != std::string::npos) {
+            return std::stoll(line);
+        }
+    }
+    return -1;
+}
+
+void print(const std::string& name, const ReplayResult& result) {
+    std::cout << "Charger replay of " << name << ":" << std::endl;
+    for (const auto& [label, stats] : result.latency) {
+        std::cout << "  " << label << ": n=" << stats.count << " mean=" << stats.mean_us << "us p99=" << stats.p99_us
+                  << "us max=" << stats.max_us << "us" << std::endl;
+    }
+}
+
+TEST(ChargerReplay, ac_session_eim) {
+    const auto result = ChargerReplay::run(parse(setup_ac + "100 bsp_event A\n"
+                                                            "1000 charger_set_max_current 16 7200000\n"
+                                                            "2000 bsp_event B\n"
+                                                            "5000 " +
+                                                 authorize_rfid +
+                                                 "7000 bsp_event C\n"
+                                                 "7100 bsp_event PowerOn\n"
+                                                 "3600000 bsp_event B\n"
+                                                 "3600050 bsp_event PowerOff\n"
+                                                 "3610000 bsp_event A\n"));
+    print("ac_session_eim", result);
+
+    EXPECT_EQ(time_of(result, "state Idle->Wait for Auth"), 2000);
+    EXPECT_EQ(time_of(result, "session_started EVConnected"), 2000);
+    EXPECT_EQ(time_of(result, "transaction_started DEADBEEF"), 5000);
+    // 16 A in the PWM duty cycle
+    EXPECT_EQ(time_of(result, "bsp pwm_on 26.7"), 5000);
+    EXPECT_EQ(time_of(result, "bsp allow_power_on true"), 7000);
+    EXPECT_EQ(time_of(result, "->Charging"), 7000);
+    EXPECT_EQ(time_of(result, "transaction_finished EVDisconnected"), 3610000);
+    EXPECT_EQ(time_of(result, "state Finished->Idle"), 3610000);
+
+    // transitions are measured from the input that caused them
+    ASSERT_EQ(result.latency.count("state Idle->Wait for Auth"), 1);
+    EXPECT_LE(result.latency.at("state Idle->Wait for Auth").max_us, result.latency.at("bsp_event B").max_us);
+}
+
+TEST(ChargerReplay, power_budget_expires_on_virtual_clock) {
+    const auto result = ChargerReplay::run(parse(setup_ac + "100 bsp_event A\n"
+                                                            "1000 charger_set_max_current 16 60500\n"
+                                                            "2000 bsp_event B\n"
+                                                            "3000 " +
+                                                 authorize_rfid +
+                                                 "4000 bsp_event C\n"
+                                                 "4100 bsp_event PowerOn\n"
+                                                 "120000 bsp_event B\n"));
+
+    EXPECT_EQ(time_of(result, "->Charging"), 4000);
+    // the main loop runs when the budget expires, not only once per second
+    EXPECT_EQ(time_of(result, "max_current 0.0", 4000), 61500);
+    EXPECT_EQ(time_of(result, "state Charging->Wait for energy (after 57500 ms)"), 61500);
+    EXPECT_EQ(time_of(result, "bsp pwm_off", 4000), 61500);
+    // the EV stays in C, the IECStateMachine switches off under load after its 6 s timeout
+    EXPECT_EQ(time_of(result, "bsp allow_power_on false", 4000), 67500);
+}
+
+TEST(ChargerReplay, unknown_input) {
+    EXPECT_THROW(ChargerReplay::run(parse(setup_ac + "10 charger_reboot\n")), std::runtime_error);
+}
+
+// Replays all recordings (*.rec) in tests/recordings/charger and in $EVSE_MANAGER_REPLAY_DIR. If a
+// <name>.charger.trace file exists next to a recording, the trace must match it. Set EVSE_MANAGER_REPLAY_UPDATE to
+// (re)write the trace files.
+TEST(ChargerReplay, recordings) {
+    std::vector<std::filesystem::path> dirs{CHARGER_REPLAY_RECORDINGS_DIR};
+    if (const auto* dir = std::getenv("EVSE_MANAGER_REPLAY_DIR")) {
+        dirs.emplace_back(dir);
+    }
+    const bool update = std::getenv("EVSE_MANAGER_REPLAY_UPDATE") != nullptr;
+
+    for (const auto& dir : dirs) {
+        if (not std::filesystem::is_directory(dir)) {
+            continue;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.path().extension() != ".rec") {
+                continue;
+            }
+            SCOPED_TRACE(entry.path().string());
+            std::ifstream in(entry.path());
+            const auto result = ChargerReplay::run(StateMachineRecorder::parse(in));
+            print(entry.path().filename().string(), result);
+
+            auto trace_path = entry.path();
+            trace_path.replace_extension(".charger.trace");
+            if (update) {
+                std::ofstream out(trace_path);
+                for (const auto& line : result.trace) {
+                    out << line << "\n";
+                }
+            } else if (std::filesystem::exists(trace_path)) {
+                std::ifstream expected_in(trace_path);
+                std::vector<std::string> expected;
+                for (std::string line; std::getline(expected_in, line);) {
+                    expected.push_back(line);
+                }
+                EXPECT_EQ(result.trace, expected);
+            }
+        }
+    }
+}
+
+} // namespace
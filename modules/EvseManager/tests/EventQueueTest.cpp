@@ -3,9 +3,12 @@
 #include <EventQueue.hpp>
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <condition_variable>
+#include <iostream>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace {
 
@@ -91,4 +94,105 @@ TEST(EventQueue, wait) {
     wait_thread.join();
 }
 
+TEST(MPSCEventQueue, one) {
+    module::MPSCEventQueue<ErrorHandlingEvents> queue;
+    auto events = queue.get_events();
+    EXPECT_EQ(events.size(), 0);
+
+    queue.push(ErrorHandlingEvents::PreventCharging);
+    events = queue.get_events();
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0], ErrorHandlingEvents::PreventCharging);
+
+    events = queue.get_events();
+    EXPECT_EQ(events.size(), 0);
+}
+
+TEST(MPSCEventQueue, full) {
+    module::MPSCEventQueue<int, 4> queue;
+
+    // wraps around several times
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++) {
+            EXPECT_TRUE(queue.try_push(round * 4 + i));
+        }
+        EXPECT_FALSE(queue.try_push(-1));
+
+        auto events = queue.get_events();
+        ASSERT_EQ(events.size(), 4);
+        for (int i = 0; i < 4; i++) {
+            EXPECT_EQ(events[i], round * 4 + i);
+        }
+    }
+}
+
+TEST(MPSCEventQueue, wait) {
+    module::MPSCEventQueue<ErrorHandlingEvents> queue;
+
+    std::thread push_thread([&queue]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        queue.push(ErrorHandlingEvents::PreventCharging);
+    });
+
+    auto events = queue.wait();
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0], ErrorHandlingEvents::PreventCharging);
+
+    push_thread.join();
+}
+
+struct ProducerEvent {
+    int producer{0};
+    int sequence{0};
+};
+
+// Several producers push bursts of events while one consumer drains them. Checks that no event is lost or
+// reordered per producer and reports the time needed.
+template <typename Queue> void contention_benchmark(const char* name) {
+    constexpr int producers = 4;
+    constexpr int events_per_producer = 50000;
+
+    Queue queue;
+    std::vector<int> next_sequence(producers, 0);
+    int received = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread consumer([&]() {
+        while (received < producers * events_per_producer) {
+            for (const auto& event : queue.wait()) {
+                EXPECT_EQ(event.sequence, next_sequence[event.producer]);
+                next_sequence[event.producer] = event.sequence + 1;
+                received++;
+            }
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 0; i < events_per_producer; i++) {
+                queue.push({p, i});
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    consumer.join();
+
+    const auto duration =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << name << ": " << producers << " producers, " << producers * events_per_producer << " events in "
+              << duration.count() << " us" << std::endl;
+
+    EXPECT_EQ(received, producers * events_per_producer);
+}
+
+TEST(EventQueue, contention_benchmark) {
+    contention_benchmark<module::EventQueue<ProducerEvent>>("EventQueue");
+    contention_benchmark<module::MPSCEventQueue<ProducerEvent>>("MPSCEventQueue");
+}
+
 } // namespace
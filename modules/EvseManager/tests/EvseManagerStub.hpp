@@ -11,7 +11,9 @@
 namespace module::stub {
 
 struct evse_managerImplStub : public evse_managerImplBase {
-    evse_managerImplStub() : evse_managerImplBase(nullptr, "manager") {
+    // with an adapter the error manager, state monitor and factory of the implementation are available
+    explicit evse_managerImplStub(Everest::ModuleAdapter* adapter = nullptr) :
+        evse_managerImplBase(adapter, "manager") {
     }
     virtual void init() {
     }
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+/*
+ Replays recordings of the CP state machine inputs (see StateMachineRecorder.hpp and the config option
+ cp_state_machine_recording) against the real IECStateMachine. The timers run on the virtual clock of the
+ TimerService and the state machine is fed in the thread of the input, so a replay is deterministic and a session of
+ hours takes milliseconds.
+
+ The result is a trace of the inputs and everything the state machine did in response (BSP calls, CP events, connector
+ lock) with their virtual time, plus the processing time per input type. The inputs of the Charger (charger_*) in a
+ recording are skipped, tests/ChargerReplay.hpp replays them.
+*/
+
+#ifndef IEC_STATE_MACHINE_REPLAY_HPP
+#define IEC_STATE_MACHINE_REPLAY_HPP
+
+#include "evse_board_supportIntfStub.hpp"
+#include <IECStateMachine.hpp>
+#include <StateMachineRecorder.hpp>
+#include <TimerService.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace module::replay {
+
+struct LatencyStats {
+    std::size_t count{0};
+    double mean_us{0.};
+    double p99_us{0.};
+    double max_us{0.};
+};
+
+struct ReplayResult {
+    std::vector<std::string> trace;
+    // processing time of the state machine per input type, e.g. "bsp_event C" or "timer"
+    std::map<std::string, LatencyStats> latency;
+};
+
+// Switches the TimerService to the virtual clock, and back to the steady clock also when a replay throws
+struct VirtualTime {
+    explicit VirtualTime(TimerService& timers_) : timers(timers_) {
+        timers.use_virtual_time(true);
+    }
+    ~VirtualTime() {
+        timers.use_virtual_time(false);
+    }
+    TimerService& timers;
+};
+
+// processing times in us per label
+inline std::map<std::string, LatencyStats> summarize(std::map<std::string, std::vector<double>>& samples) {
+    std::map<std::string, LatencyStats> latency;
+    for (auto& [label, s] : samples) {
+        std::sort(s.begin(), s.end());
+        LatencyStats stats;
+        stats.count = s.size();
+        for (const auto v : s) {
+            stats.mean_us += v;
+        }
+        stats.mean_us /= s.size();
+        stats.p99_us = s[std::min(s.size() - 1, static_cast<std::size_t>(s.size() * 0.99))];
+        stats.max_us = s.back();
+        latency[label] = stats;
+    }
+    return latency;
+}
+
+// BSP that writes the calls of the state machine into the trace
+struct ReplayBsp : public stub::ModuleAdapterStub {
+    ValueCallback event_cb;
+    std::vector<std::string> outputs;
+
+    void raise_event(types::board_support_common::Event event) {
+        if (event_cb != nullptr) {
+            types::board_support_common::BspEvent bsp_event;
+            bsp_event.event = event;
+            event_cb(bsp_event);
+        }
+    }
+
+    virtual void subscribe_fn(const Requirement&, const std::string& fn, ValueCallback cb) override {
+        if (fn == "event") {
+            event_cb = cb;
+        }
+    }
+
+    virtual Result call_fn(const Requirement&, const std::string& fn, Parameters p) override {
+        std::string call = "bsp " + fn;
+        if (p.contains("value")) {
+            const auto& value = p.at("value");
+            if (fn == "pwm_on") {
+                call += fmt::format(" {:.1f}", value.get<double>());
+            } else if (fn == "allow_power_on") {
+                call += value.at("allow_power_on").get<bool>() ? " true" : " false";
+            } else if (value.is_boolean()) {
+                call += value.get<bool>() ? " true" : " false";
+            }
+        }
+        outputs.push_back(call);
+        return std::nullopt;
+    }
+};
+
+class IECStateMachineReplay {
+public:
+    static ReplayResult run(const std::vector<StateMachineRecorder::Input>& inputs,
+                            bool lock_connector_in_state_b = true) {
+        auto& timers = TimerService::instance();
+        const VirtualTime virtual_time(timers);
+        const auto start = timers.now();
+
+        ReplayBsp bsp;
+        std::unique_ptr<evse_board_supportIntf> bsp_if = std::make_unique<stub::evse_board_supportIntfStub>(bsp);
+        IECStateMachine state_machine(bsp_if, lock_connector_in_state_b);
+        state_machine.set_feed_in_caller_thread(true);
+        state_machine.signal_event.connect(
+            [&bsp](CPEvent e) { bsp.outputs.push_back("event " + cpevent_to_string(e)); });
+        state_machine.signal_lock.connect([&bsp]() { bsp.outputs.push_back("lock"); });
+        state_machine.signal_unlock.connect([&bsp]() { bsp.outputs.push_back("unlock"); });
+
+        ReplayResult result;
+        std::map<std::string, std::vector<double>> samples;
+
+        const auto step = [&](const std::string& label, const std::string& line, const auto& apply) {
+            bsp.outputs.clear();
+            const auto t0 = std::chrono::steady_clock::now();
+            const bool ran = apply();
+            const auto t1 = std::chrono::steady_clock::now();
+            if (not ran) {
+                return;
+            }
+            samples[label].push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(timers.now() - start).count();
+            result.trace.push_back(fmt::format("{} {}", ms, line));
+            for (const auto& output : bsp.outputs) {
+                result.trace.push_back(fmt::format("{}   -> {}", ms, output));
+            }
+        };
+
+        for (const auto& input : inputs) {
+            if (input.name.rfind("charger_", 0) == 0) {
+                // inputs of the Charger, see ChargerReplay.hpp
+                continue;
+            }
+            // run the timers that expire before this input one at a time, so each gets its own trace entry
+            const auto input_time = start + std::chrono::milliseconds(input.time_ms);
+            for (auto due = timers.next_due(); due.has_value() and due.value() <= input_time; due = timers.next_due()) {
+                step("timer", "timer", [&timers, &due]() {
+                    return timers.advance(std::max(due.value() - timers.now(), TimerService::Clock::duration::zero())) >
+                           0;
+                });
+            }
+            if (input_time > timers.now()) {
+                timers.advance(input_time - timers.now());
+            }
+
+            const auto label = input.name == "bsp_event" ? input.name + " " + input.arguments : input.name;
+            const auto line = input.arguments.empty() ? input.name : input.name + " " + input.arguments;
+            step(label, line, [&]() {
+                apply(input, state_machine, bsp);
+                return true;
+            });
+        }
+
+        result.latency = summarize(samples);
+        return result;
+    }
+
+private:
+    static void apply(const StateMachineRecorder::Input& input, IECStateMachine& state_machine, ReplayBsp& bsp) {
+        const auto& a = input.arguments;
+        if (input.name == "bsp_event") {
+            bsp.raise_event(types::board_support_common::string_to_event(a));
+        } else if (input.name == "enable") {
+            state_machine.enable(a == "true");
+        } else if (input.name == "setup") {
+            state_machine.setup(a == "true");
+        } else if (input.name == "set_pwm") {
+            state_machine.set_pwm(std::stod(a));
+        } else if (input.name == "set_pwm_off") {
+            state_machine.set_pwm_off();
+        } else if (input.name == "set_pwm_F") {
+            state_machine.set_pwm_F();
+        } else if (input.name == "allow_power_on") {
+            const auto space = a.find(' ');
+            state_machine.allow_power_on(a.substr(0, space) == "true",
+                                         types::evse_board_support::string_to_reason(a.substr(space + 1)));
+        } else if (input.name == "connector_force_unlock") {
+            state_machine.connector_force_unlock();
+        } else if (input.name == "set_three_phases") {
+            state_machine.set_three_phases(a == "true");
+        } else if (input.name == "set_ev_simplified_mode_evse_limit") {
+            state_machine.set_ev_simplified_mode_evse_limit(a == "true");
+        } else {
+            throw std::runtime_error("Unknown input in state machine recording: " + input.name);
+        }
+    }
+};
+
+} // namespace module::replay
+
+#endif // IEC_STATE_MACHINE_REPLAY_HPP
@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "IECStateMachineReplay.hpp"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+using module::StateMachineRecorder;
+using module::replay::IECStateMachineReplay;
+using module::replay::ReplayResult;
+
+std::vector<StateMachineRecorder::Input> parse(const std::string& recording) {
+    std::istringstream in(recording);
+    return StateMachineRecorder::parse(in);
+}
+
+// virtual time of the first trace line that contains text, -1 if there is none
+std::int64_t time_of(const ReplayResult& result, const std::string& text) {
+    for (const auto& line : result.trace) {
+        if (line.find(text) != std::string::npos) {
+            return std::stoll(line);
+        }
+    }
+    return -1;
+}
+
+void print(const std::string& name, const ReplayResult& result) {
+    std::cout << "Replay of " << name << ":" << std::endl;
+    for (const auto& [label, stats] : result.latency) {
+        std::cout << "  " << label << ": n=" << stats.count << " mean=" << stats.mean_us << "us p99=" << stats.p99_us
+                  << "us max=" << stats.max_us << "us" << std::endl;
+    }
+}
+
+TEST(IECStateMachineReplay, recorder_round_trip) {
+    const auto path = std::filesystem::temp_directory_path() / "IECStateMachineReplayTest.rec";
+    {
+        StateMachineRecorder recorder;
+        ASSERT_TRUE(recorder.open(path.string()));
+        recorder.record("enable", "true");
+        recorder.record("bsp_event", "A");
+        recorder.record("set_pwm_off");
+    }
+
+    std::ifstream in(path);
+    const auto inputs = StateMachineRecorder::parse(in);
+    std::filesystem::remove(path);
+
+    ASSERT_EQ(inputs.size(), 3);
+    EXPECT_EQ(inputs[0].name, "enable");
+    EXPECT_EQ(inputs[0].arguments, "true");
+    EXPECT_EQ(inputs[1].name, "bsp_event");
+    EXPECT_EQ(inputs[1].arguments, "A");
+    EXPECT_EQ(inputs[2].name, "set_pwm_off");
+    EXPECT_EQ(inputs[2].arguments, "");
+    EXPECT_LE(inputs[0].time_ms, inputs[2].time_ms);
+
+    EXPECT_THROW(parse("# comment\n\nnot_a_time enable true\n"), std::runtime_error);
+}
+
+TEST(IECStateMachineReplay, power_off_under_load_in_c1) {
+    // EV stays in state C after the PWM was switched off
+    const auto result = IECStateMachineReplay::run(parse("0 enable true\n"
+                                                         "100 bsp_event A\n"
+                                                         "2000 bsp_event B\n"
+                                                         "3000 set_pwm 0.5\n"
+                                                         "3000 allow_power_on true FullPowerCharging\n"
+                                                         "5000 bsp_event C\n"
+                                                         "60000 set_pwm_off\n"
+                                                         "120000 bsp_event B\n"));
+
+    EXPECT_EQ(time_of(result, "event CarPluggedIn"), 2000);
+    EXPECT_EQ(time_of(result, "bsp allow_power_on true"), 5000);
+    // the 6 s timeout runs on the virtual clock
+    const auto it = std::find(result.trace.begin(), result.trace.end(), "66000 timer");
+    ASSERT_NE(it, result.trace.end());
+    ASSERT_NE(std::next(it), result.trace.end());
+    EXPECT_EQ(*std::next(it), "66000   -> bsp allow_power_on false");
+    EXPECT_EQ(result.latency.at("timer").count, 1);
+}
+
+TEST(IECStateMachineReplay, unlock_in_state_F) {
+    const auto result = IECStateMachineReplay::run(parse("0 enable true\n"
+                                                         "100 bsp_event A\n"
+                                                         "1000 bsp_event B\n"
+                                                         "2000 bsp_event F\n"
+                                                         "30000 bsp_event A\n"));
+
+    EXPECT_EQ(time_of(result, "-> lock"), 1000);
+    EXPECT_EQ(time_of(result, "-> unlock"), 7000);
+}
+
+TEST(IECStateMachineReplay, skips_charger_inputs) {
+    const auto result = IECStateMachineReplay::run(parse("0 charger_run\n"
+                                                         "0 enable true\n"
+                                                         "100 bsp_event A\n"
+                                                         "200 charger_deauthorize\n"));
+
+    EXPECT_EQ(time_of(result, "charger_"), -1);
+    EXPECT_EQ(time_of(result, "bsp_event A"), 100);
+}
+
+TEST(IECStateMachineReplay, unknown_input) {
+    EXPECT_THROW(IECStateMachineReplay::run(parse("0 enable true\n10 reboot\n")), std::runtime_error);
+}
+
+// Replays all recordings (*.rec) in tests/recordings and in $EVSE_MANAGER_REPLAY_DIR. If a <name>.trace file exists
+// next to a recording, the trace must match it. Set EVSE_MANAGER_REPLAY_UPDATE to (re)write the trace files.
+TEST(IECStateMachineReplay, recordings) {
+    std::vector<std::filesystem::path> dirs{IEC_REPLAY_RECORDINGS_DIR};
+    if (const auto* dir = std::getenv("EVSE_MANAGER_REPLAY_DIR")) {
+        dirs.emplace_back(dir);
+    }
+    const bool update = std::getenv("EVSE_MANAGER_REPLAY_UPDATE") != nullptr;
+
+    for (const auto& dir : dirs) {
+        if (not std::filesystem::is_directory(dir)) {
+            continue;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.path().extension() != ".rec") {
+                continue;
+            }
+            SCOPED_TRACE(entry.path().string());
+            std::ifstream in(entry.path());
+            const auto result = IECStateMachineReplay::run(StateMachineRecorder::parse(in));
+            print(entry.path().filename().string(), result);
+
+            auto trace_path = entry.path();
+            trace_path.replace_extension(".trace");
+            if (update) {
+                std::ofstream out(trace_path);
+                for (const auto& line : result.trace) {
+                    out << line << "\n";
+                }
+            } else if (std::filesystem::exists(trace_path)) {
+                std::ifstream expected_in(trace_path);
+                std::vector<std::string> expected;
+                for (std::string line; std::getline(expected_in, line);) {
+                    expected.push_back(line);
+                }
+                EXPECT_EQ(result.trace, expected);
+            }
+        }
+    }
+}
+
+} // namespace
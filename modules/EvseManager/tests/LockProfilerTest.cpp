@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include <gtest/gtest.h>
+#include <lock_profiler.hpp>
+#include <scoped_lock_timeout.hpp>
+
+#include <thread>
+
+namespace {
+
+using namespace std::chrono_literals;
+using Everest::LockProfiler;
+
+TEST(LockProfiler, histogram_percentiles) {
+    LockProfiler::Histogram h;
+    h.count = 100;
+    h.max_us = 300000;
+    h.buckets[3] = 98; // below 8 us
+    h.buckets[18] = 2; // below 262 ms
+    EXPECT_EQ(h.percentile_us(0.5), 8);
+    EXPECT_EQ(h.percentile_us(0.99), 262144);
+    EXPECT_EQ(LockProfiler::Histogram{}.percentile_us(0.99), 0);
+}
+
+TEST(LockProfiler, records_contended_sites) {
+    LockProfiler::reset();
+    LockProfiler::enable(true);
+
+    Everest::timed_mutex_traceable mutex;
+    std::thread holder([&mutex] {
+        Everest::scoped_lock_timeout lock(mutex, Everest::MutexDescription::Charger_mainloop);
+        std::this_thread::sleep_for(50ms);
+    });
+    std::this_thread::sleep_for(10ms);
+    {
+        Everest::scoped_lock_timeout lock(mutex, Everest::MutexDescription::Charger_get_current_state);
+    }
+    holder.join();
+
+    LockProfiler::enable(false);
+    {
+        // not recorded while disabled
+        Everest::scoped_lock_timeout lock(mutex, Everest::MutexDescription::Charger_get_current_state);
+    }
+
+    const auto top = LockProfiler::top(10);
+    ASSERT_EQ(top.size(), 2);
+    EXPECT_EQ(top[0].description, static_cast<std::size_t>(Everest::MutexDescription::Charger_get_current_state));
+    EXPECT_EQ(top[0].wait.count, 1);
+    EXPECT_GE(top[0].wait.max_us, 20000);
+    EXPECT_EQ(top[1].description, static_cast<std::size_t>(Everest::MutexDescription::Charger_mainloop));
+    EXPECT_GE(top[1].hold.max_us, 50000);
+
+    LockProfiler::reset();
+    EXPECT_TRUE(LockProfiler::top(10).empty());
+}
+
+} // namespace
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include <SessionLogFormat.hpp>
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+namespace {
+
+using namespace module::session_log_format;
+
+Entry v2g_entry() {
+    Entry e;
+    e.timestamp_ms = 1711540800123; // 2024-03-27T12:00:00.123Z
+    e.typ = 1;
+    e.iso15118 = true;
+    e.msg = "V2G CurrentDemandReq";
+    e.exi_hex = "01fe8001000000";
+    e.exi_base64 = to_base64(from_hex(e.exi_hex));
+    return e;
+}
+
+TEST(SessionLogFormat, encodings) {
+    EXPECT_EQ(format_timestamp(1711540800123), "2024-03-27T12:00:00.123Z");
+    EXPECT_EQ(to_hex(from_hex("00ff10AB")), "00ff10ab");
+    EXPECT_EQ(to_base64("a"), "YQ==");
+    EXPECT_EQ(to_base64("ab"), "YWI=");
+    EXPECT_EQ(to_base64("abc"), "YWJj");
+    EXPECT_EQ(from_base64("YWJjZA=="), "abcd");
+}
+
+TEST(SessionLogFormat, binary_roundtrip) {
+    std::string buffer = binary_header("session");
+    auto car = v2g_entry();
+    append_binary(car, buffer);
+    Entry sys;
+    sys.typ = 2;
+    sys.msg = "Session logging stopped.";
+    append_binary(sys, buffer);
+
+    std::istringstream in(buffer);
+    BinaryReader reader(in);
+    EXPECT_EQ(reader.session_name(), "session");
+
+    Entry e;
+    ASSERT_TRUE(reader.next(e));
+    EXPECT_EQ(e.timestamp_ms, car.timestamp_ms);
+    EXPECT_EQ(e.typ, 1);
+    EXPECT_TRUE(e.iso15118);
+    EXPECT_EQ(e.msg, car.msg);
+    EXPECT_EQ(e.exi_hex, car.exi_hex);
+    EXPECT_EQ(e.exi_base64, car.exi_base64);
+    EXPECT_EQ(html_row(e, ""), html_row(car, ""));
+    EXPECT_EQ(csv_line(e, ""), csv_line(car, ""));
+
+    ASSERT_TRUE(reader.next(e));
+    EXPECT_EQ(e.msg, sys.msg);
+    EXPECT_TRUE(e.exi_hex.empty());
+    EXPECT_FALSE(reader.next(e));
+    EXPECT_FALSE(reader.truncated());
+}
+
+TEST(SessionLogFormat, truncated) {
+    std::string buffer = binary_header("session");
+    append_binary(v2g_entry(), buffer);
+    const auto complete = buffer.size();
+    append_binary(v2g_entry(), buffer);
+    buffer.resize(complete + 7);
+
+    std::istringstream in(buffer);
+    BinaryReader reader(in);
+    Entry e;
+    EXPECT_TRUE(reader.next(e));
+    EXPECT_FALSE(reader.next(e));
+    EXPECT_TRUE(reader.truncated());
+
+    std::istringstream csv("\"2024-03-27T12:00:00.123Z\",\"SYS\"");
+    EXPECT_THROW(BinaryReader{csv}, std::runtime_error);
+}
+
+} // namespace
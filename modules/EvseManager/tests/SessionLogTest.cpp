@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include <SessionLog.hpp>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using FsyncPolicy = module::SessionLog::FsyncPolicy;
+
+class SessionLogTest : public testing::TestWithParam<FsyncPolicy> {
+protected:
+    std::filesystem::path root;
+
+    void SetUp() override {
+        root = std::filesystem::temp_directory_path() /
+               ("session_log_test_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()) + "_" +
+                std::to_string(static_cast<int>(GetParam())));
+        std::filesystem::remove_all(root);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(root);
+    }
+
+    std::unique_ptr<module::SessionLog> make_log() {
+        auto log = std::make_unique<module::SessionLog>();
+        log->setPath(root.string());
+        log->setMqtt([](nlohmann::json) {});
+        log->xmlOutput(false);
+        log->enable();
+        log->enableAsync(GetParam());
+        return log;
+    }
+
+    static std::string read_file(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    static std::size_t count(const std::string& haystack, const std::string& needle) {
+        std::size_t n = 0;
+        for (auto pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1)) {
+            n++;
+        }
+        return n;
+    }
+};
+
+TEST_P(SessionLogTest, async_multiple_threads) {
+    constexpr int nr_of_threads = 4;
+    constexpr int messages_per_thread = 200;
+
+    auto log = make_log();
+    const auto path = log->startSession("async");
+    ASSERT_TRUE(path.has_value());
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nr_of_threads; t++) {
+        threads.emplace_back([&log, t]() {
+            for (int i = 0; i < messages_per_thread; i++) {
+                const auto msg = "thread " + std::to_string(t) + " message " + std::to_string(i) + ";";
+                if (i % 2) {
+                    log->car(false, msg);
+                } else {
+                    log->evse(true, msg);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    log->stopSession();
+    // joins the writer thread after everything queued before is written
+    log.reset();
+
+    const std::filesystem::path dir(path.value());
+    EXPECT_FALSE(std::filesystem::exists(dir / "incomplete-eventlog.csv"));
+    EXPECT_FALSE(std::filesystem::exists(dir / "incomplete-eventlog.html"));
+    const auto csv = read_file(dir / "eventlog.csv");
+    const auto html = read_file(dir / "eventlog.html");
+
+    // less threads than the queue size, nothing is dropped
+    EXPECT_EQ(count(csv, "Dropped"), 0);
+    for (int t = 0; t < nr_of_threads; t++) {
+        std::size_t last = 0;
+        for (int i = 0; i < messages_per_thread; i++) {
+            const auto msg = "thread " + std::to_string(t) + " message " + std::to_string(i) + ";";
+            ASSERT_EQ(count(csv, msg), 1) << msg;
+            EXPECT_EQ(count(html, msg), 1) << msg;
+            // the records of a thread stay in order
+            const auto pos = csv.find(msg);
+            EXPECT_GT(pos, last) << msg;
+            last = pos;
+        }
+    }
+
+    EXPECT_LT(csv.find("Session logging started."), csv.find("thread 0 message 0;"));
+    EXPECT_NE(csv.find("Session logging stopped."), std::string::npos);
+    EXPECT_NE(html.find("</html>"), std::string::npos);
+}
+
+TEST_P(SessionLogTest, full_queue_counts_drops) {
+    constexpr int nr_of_messages = 3000;
+
+    auto log = make_log();
+    const auto path = log->startSession("full");
+    ASSERT_TRUE(path.has_value());
+
+    {
+        // the writer takes at most one more batch, the rest fills the queue
+        const auto hold = log->hold_writer();
+        for (int i = 0; i < nr_of_messages; i++) {
+            log->evse(false, "message " + std::to_string(i) + ";");
+        }
+    }
+
+    log->stopSession();
+    log.reset();
+
+    const auto csv = read_file(std::filesystem::path(path.value()) / "eventlog.csv");
+
+    // the stop message is logged while the queue may still be full
+    std::size_t written = count(csv, "Session logging stopped.");
+    for (int i = 0; i < nr_of_messages; i++) {
+        written += count(csv, "\"message " + std::to_string(i) + ";\"");
+    }
+
+    // each batch notes the records dropped since the last one
+    std::size_t dropped = 0;
+    const std::regex dropped_note("Dropped ([0-9]+) records");
+    for (std::sregex_iterator it(csv.begin(), csv.end(), dropped_note), end; it != end; ++it) {
+        dropped += std::stoul((*it)[1]);
+    }
+    EXPECT_GT(dropped, 0);
+    EXPECT_EQ(written + dropped, nr_of_messages + 1);
+}
+
+INSTANTIATE_TEST_SUITE_P(FsyncPolicies, SessionLogTest,
+                         testing::Values(FsyncPolicy::Never, FsyncPolicy::Batch, FsyncPolicy::SessionEnd));
+
+} // namespace
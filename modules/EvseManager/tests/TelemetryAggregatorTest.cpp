@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include <TelemetryAggregator.hpp>
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+double get(const Everest::TelemetryMap& record, const std::string& key) {
+    return std::get<double>(record.at(key));
+}
+
+TEST(TelemetryAggregator, window_statistics) {
+    std::vector<Everest::TelemetryMap> records;
+    module::TelemetryAggregator aggregator(1h, [&records](const Everest::TelemetryMap& r) { records.push_back(r); });
+
+    // nothing to publish yet
+    aggregator.flush();
+    EXPECT_EQ(records.size(), 0);
+
+    aggregator.info("meter_id", std::string("meter"));
+    aggregator.counter("energy_import_total_Wh", 1000.);
+    aggregator.gauge("power_total_W", 11000.);
+    aggregator.gauge("power_total_W", 22000.); // short peak
+    aggregator.gauge("power_total_W", 3000.);
+    aggregator.counter("energy_import_total_Wh", 1010.);
+    aggregator.flush();
+
+    ASSERT_EQ(records.size(), 1);
+    EXPECT_EQ(std::get<std::string>(records[0].at("meter_id")), "meter");
+    EXPECT_EQ(get(records[0], "window_s"), 3600.);
+    EXPECT_EQ(get(records[0], "power_total_W"), 3000.);
+    EXPECT_EQ(get(records[0], "power_total_W_min"), 3000.);
+    EXPECT_EQ(get(records[0], "power_total_W_max"), 22000.);
+    EXPECT_EQ(get(records[0], "power_total_W_mean"), 12000.);
+    EXPECT_EQ(get(records[0], "energy_import_total_Wh"), 1010.);
+    EXPECT_EQ(get(records[0], "energy_import_total_Wh_delta"), 10.);
+
+    // the next window starts where the last one ended
+    aggregator.gauge("power_total_W", 5000.);
+    aggregator.counter("energy_import_total_Wh", 1015.);
+    aggregator.flush();
+    ASSERT_EQ(records.size(), 2);
+    EXPECT_EQ(get(records[1], "power_total_W_min"), 5000.);
+    EXPECT_EQ(get(records[1], "power_total_W_max"), 5000.);
+    EXPECT_EQ(get(records[1], "energy_import_total_Wh_delta"), 5.);
+
+    // windows without samples only contain the last values
+    aggregator.flush();
+    ASSERT_EQ(records.size(), 3);
+    EXPECT_EQ(get(records[2], "power_total_W"), 5000.);
+    EXPECT_EQ(records[2].count("power_total_W_mean"), 0);
+    EXPECT_EQ(get(records[2], "energy_import_total_Wh_delta"), 0.);
+}
+
+TEST(TelemetryAggregator, shared_timer) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int published_a{0};
+    int published_b{0};
+
+    {
+        module::TelemetryAggregator a(20ms, [&](const Everest::TelemetryMap&) {
+            std::scoped_lock lock(mutex);
+            published_a++;
+            cv.notify_all();
+        });
+        module::TelemetryAggregator b(50ms, [&](const Everest::TelemetryMap&) {
+            std::scoped_lock lock(mutex);
+            published_b++;
+            cv.notify_all();
+        });
+        a.gauge("x", 1.);
+        b.gauge("x", 1.);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(cv.wait_for(lock, 2s, [&] { return published_a >= 3 and published_b >= 1; }));
+    }
+
+    // no flushes after the aggregators are gone
+    std::unique_lock<std::mutex> lock(mutex);
+    const auto a = published_a;
+    EXPECT_FALSE(cv.wait_for(lock, 100ms, [&] { return published_a != a; }));
+}
+
+} // namespace
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include <Timeout.hpp>
+#include <TimerService.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+using module::TimerService;
+
+TEST(TimerService, order_and_cancel) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<int> fired;
+    const auto record = [&](int n) {
+        std::scoped_lock lock(mutex);
+        fired.push_back(n);
+        cv.notify_all();
+    };
+
+    auto& service = TimerService::instance();
+    service.schedule(60ms, [&] { record(3); });
+    service.schedule(20ms, [&] { record(1); });
+    const auto cancelled = service.schedule(30ms, [&] { record(2); });
+    service.cancel(cancelled);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(cv.wait_for(lock, 2s, [&] { return fired.size() == 2; }));
+    EXPECT_EQ(fired, (std::vector<int>{1, 3}));
+}
+
+TEST(TimerService, periodic) {
+    std::atomic_int runs{0};
+    auto& service = TimerService::instance();
+    const auto id = service.schedule_periodic(10ms, [&] {
+        runs++;
+        std::this_thread::sleep_for(5ms);
+    });
+    std::this_thread::sleep_for(100ms);
+    service.cancel_and_wait(id);
+
+    const int after_cancel = runs;
+    EXPECT_GE(after_cancel, 3);
+    std::this_thread::sleep_for(50ms);
+    EXPECT_EQ(runs, after_cancel);
+}
+
+TEST(TimerService, async_timeout) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int signalled{0};
+
+    AsyncTimeout timeout;
+    timeout.signal_reached.connect([&] {
+        EXPECT_TRUE(timeout.reached());
+        std::scoped_lock lock(mutex);
+        signalled++;
+        cv.notify_all();
+    });
+
+    // a restarted timeout only signals once
+    timeout.start(20ms);
+    timeout.start(40ms);
+    EXPECT_FALSE(timeout.reached());
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(cv.wait_for(lock, 2s, [&] { return signalled == 1; }));
+        EXPECT_FALSE(cv.wait_for(lock, 60ms, [&] { return signalled > 1; }));
+    }
+    EXPECT_TRUE(timeout.reached());
+    timeout.stop();
+    EXPECT_FALSE(timeout.reached());
+
+    // a stopped timeout does not signal
+    timeout.start(20ms);
+    timeout.stop();
+    std::unique_lock<std::mutex> lock(mutex);
+    EXPECT_FALSE(cv.wait_for(lock, 60ms, [&] { return signalled > 1; }));
+}
+
+TEST(TimerService, virtual_sleep) {
+    auto& service = TimerService::instance();
+    service.use_virtual_time(true);
+    const auto start = service.now();
+
+    std::vector<TimerService::Clock::duration> fired;
+    service.schedule(100ms, [&] {
+        fired.push_back(service.now() - start);
+        // blocks the callback thread for a second of virtual time, the second timer is late
+        service.sleep_for(1s);
+    });
+    service.schedule(200ms, [&] { fired.push_back(service.now() - start); });
+
+    EXPECT_EQ(service.advance(150ms), 1);
+    EXPECT_EQ(service.now() - start, 1100ms);
+    EXPECT_EQ(service.advance(0ms), 1);
+    EXPECT_EQ(fired, (std::vector<TimerService::Clock::duration>{100ms, 1100ms}));
+
+    service.use_virtual_time(false);
+}
+
+} // namespace
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include <benchmark/benchmark.h>
+
+#include <exi_pool.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+//-----------------------------------------------------------------------------
+// Clearing the EXI documents between two messages: the reset of the header and the body member used by the message
+// against a memset of the whole document. Every benchmark reports the size of the document it clears.
+
+namespace {
+
+void set_counters(benchmark::State& state, std::size_t document_size) {
+    state.counters["document_bytes"] = static_cast<double>(document_size);
+}
+
+std::unique_ptr<struct exi_documents, void (*)(struct exi_documents*)> make_documents() {
+    return {static_cast<struct exi_documents*>(calloc(1, sizeof(struct exi_documents))),
+            [](struct exi_documents* documents) { free(documents); }};
+}
+
+void iso2_current_demand_req_reset(benchmark::State& state) {
+    auto documents = make_documents();
+    auto* doc = &documents->in.iso2;
+
+    for (auto _ : state) {
+        doc->V2G_Message.Header.SessionID.bytesLen = 8;
+        doc->V2G_Message.Body.CurrentDemandReq_isUsed = 1;
+        doc->V2G_Message.Body.CurrentDemandReq.EVTargetCurrent.Value = 1250;
+        iso2_exi_document_reset(doc);
+        benchmark::ClobberMemory();
+    }
+
+    set_counters(state, sizeof(*doc));
+}
+
+void iso2_certificate_installation_res_reset(benchmark::State& state) {
+    auto documents = make_documents();
+    auto* doc = &documents->out.iso2;
+
+    for (auto _ : state) {
+        doc->V2G_Message.Header.SessionID.bytesLen = 8;
+        doc->V2G_Message.Body.CertificateInstallationRes_isUsed = 1;
+        doc->V2G_Message.Body.CertificateInstallationRes.ResponseCode = iso2_responseCodeType_OK;
+        iso2_exi_document_reset(doc);
+        benchmark::ClobberMemory();
+    }
+
+    set_counters(state, sizeof(*doc));
+}
+
+void iso2_memset(benchmark::State& state) {
+    auto documents = make_documents();
+    auto* doc = &documents->in.iso2;
+
+    for (auto _ : state) {
+        doc->V2G_Message.Header.SessionID.bytesLen = 8;
+        doc->V2G_Message.Body.CurrentDemandReq_isUsed = 1;
+        doc->V2G_Message.Body.CurrentDemandReq.EVTargetCurrent.Value = 1250;
+        memset(doc, 0, sizeof(*doc));
+        benchmark::ClobberMemory();
+    }
+
+    set_counters(state, sizeof(*doc));
+}
+
+void din_current_demand_req_reset(benchmark::State& state) {
+    auto documents = make_documents();
+    auto* doc = &documents->in.din;
+
+    for (auto _ : state) {
+        doc->V2G_Message.Header.SessionID.bytesLen = 8;
+        doc->V2G_Message.Body.CurrentDemandReq_isUsed = 1;
+        doc->V2G_Message.Body.CurrentDemandReq.EVTargetCurrent.Value = 1250;
+        din_exi_document_reset(doc);
+        benchmark::ClobberMemory();
+    }
+
+    set_counters(state, sizeof(*doc));
+}
+
+void din_memset(benchmark::State& state) {
+    auto documents = make_documents();
+    auto* doc = &documents->in.din;
+
+    for (auto _ : state) {
+        doc->V2G_Message.Header.SessionID.bytesLen = 8;
+        doc->V2G_Message.Body.CurrentDemandReq_isUsed = 1;
+        doc->V2G_Message.Body.CurrentDemandReq.EVTargetCurrent.Value = 1250;
+        memset(doc, 0, sizeof(*doc));
+        benchmark::ClobberMemory();
+    }
+
+    set_counters(state, sizeof(*doc));
+}
+
+} // namespace
+
+BENCHMARK(iso2_current_demand_req_reset);
+BENCHMARK(iso2_certificate_installation_res_reset);
+BENCHMARK(iso2_memset);
+BENCHMARK(din_current_demand_req_reset);
+BENCHMARK(din_memset);
+
+BENCHMARK_MAIN();
@@ -2,6 +2,7 @@
 // Copyright (C) 2022-2023 chargebyte GmbH
 // Copyright (C) 2022-2023 Contributors to EVerest
 #include "ISO15118_chargerImpl.hpp"
+#include "connection.hpp"
 #include "log.hpp"
 #include "v2g_ctx.hpp"
 
@@ -254,7 +255,7 @@ void ISO15118_chargerImpl::handle_dlink_ready(bool& value) {
     // FIXME: dlink_ready(true) is ignored for now
     // If dlink becomes not ready (false), stop TCP connection in the read thread
     if (!value) {
-        v2g_ctx->is_connection_terminated = true;
+        connection_terminate(v2g_ctx);
     }
 }
 
@@ -4,27 +4,39 @@
 
 #include "connection.hpp"
 #include "log.hpp"
+#include "reactor.hpp"
 #include "tls_connection.hpp"
 #include "tools.hpp"
 #include "v2g_server.hpp"
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fstream>
 #include <inttypes.h>
 #include <iostream>
+#include <mutex>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <set>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
+#include <vector>
+
+#include <cbv2g/exi_v2gtp.h>
 
 #ifdef EVEREST_MBED_TLS
 #include <mbedtls/debug.h>
@@ -38,6 +50,7 @@
 #define DEFAULT_TCP_PORT              61341
 #define DEFAULT_TLS_PORT              64109
 #define ERROR_SESSION_ALREADY_STARTED 2
+#define TCP_RECEIVE_CHUNK_SIZE        2048
 
 #ifdef EVEREST_MBED_TLS
 #define MBEDTLS_DEBUG_LEVEL_VERBOSE  4
@@ -73,6 +86,164 @@ static const int v2g_ssl_allowed_hashes[] = {
     MBEDTLS_MD_SHA1,   MBEDTLS_MD_NONE};
 #endif // EVEREST_MBED_TLS
 
+/*
+ * Receiving side of a TCP connection. The reactor thread reads the socket whenever data is available and frames the
+ * V2GTP messages incrementally, connection_read() in the connection thread only takes complete messages from the
+ * inbox. So the connection thread sleeps until a request is complete (or the sequence timeout is reached) instead of
+ * polling the socket.
+ */
+struct tcp_stream {
+    explicit tcp_stream(struct v2g_context* ctx_) : ctx(ctx_) {
+    }
+
+    struct v2g_context* ctx;
+
+    std::mutex mutex;
+    std::condition_variable received;
+    std::vector<uint8_t> message; /* V2GTP message that is received right now */
+    uint32_t payload_len{0};      /* valid once the header of message is complete */
+    std::vector<uint8_t> inbox;   /* complete V2GTP messages */
+    bool closed{false};           /* peer closed the connection or reading failed */
+};
+
+/* streams of all open TCP connections, so connection_terminate() can wake up their readers */
+static std::mutex tcp_streams_mutex;
+static std::set<struct tcp_stream*> tcp_streams;
+
+/*!
+ * \brief tcp_stream_feed This function adds received bytes to the message that is received right now and moves
+ * complete messages to the inbox. Must be called with the stream mutex locked.
+ * \param stream is the TCP stream
+ * \param data is the received data
+ * \param len is the number of received bytes
+ * \return Returns \c false if a message is too long for the V2G buffer, otherwise \c true
+ */
+static bool tcp_stream_feed(struct tcp_stream* stream, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        const size_t expected = (stream->message.size() < V2GTP_HEADER_LENGTH)
+                                    ? V2GTP_HEADER_LENGTH
+                                    : V2GTP_HEADER_LENGTH + static_cast<size_t>(stream->payload_len);
+        const size_t take = std::min(expected - stream->message.size(), len);
+
+        stream->message.insert(stream->message.end(), data, data + take);
+        data += take;
+        len -= take;
+
+        if (stream->message.size() < V2GTP_HEADER_LENGTH) {
+            break;
+        }
+
+        if (stream->message.size() == V2GTP_HEADER_LENGTH) {
+            /* the header is validated in the connection thread, here we only need the payload length */
+            stream->payload_len = (static_cast<uint32_t>(stream->message[4]) << 24) |
+                                  (static_cast<uint32_t>(stream->message[5]) << 16) |
+                                  (static_cast<uint32_t>(stream->message[6]) << 8) |
+                                  static_cast<uint32_t>(stream->message[7]);
+
+            if (stream->payload_len > DEFAULT_BUFFER_SIZE - V2GTP_HEADER_LENGTH) {
+                /* pass the header on, so the connection thread reports the message length and closes the
+                 * connection */
+                stream->inbox.insert(stream->inbox.end(), stream->message.begin(), stream->message.end());
+                stream->message.clear();
+                return false;
+            }
+        }
+
+        if (stream->message.size() == V2GTP_HEADER_LENGTH + static_cast<size_t>(stream->payload_len)) {
+            stream->inbox.insert(stream->inbox.end(), stream->message.begin(), stream->message.end());
+            stream->message.clear();
+            stream->received.notify_all();
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief connection_receive This function is called by the reactor when a TCP connection is readable. It reads all
+ * available data without blocking.
+ * \param conn is the V2G connection context
+ */
+static void connection_receive(struct v2g_connection* conn) {
+    struct tcp_stream* stream = conn->tcp_stream;
+    uint8_t chunk[TCP_RECEIVE_CHUNK_SIZE];
+
+    while (true) {
+        const ssize_t num_of_bytes = read(conn->conn.socket_fd, chunk, sizeof(chunk));
+
+        if (num_of_bytes == -1) {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                return;
+
+            dlog(DLOG_LEVEL_ERROR, "read() failed: %s", strerror(errno));
+        }
+
+        std::scoped_lock lock(stream->mutex);
+        if ((num_of_bytes <= 0) || (tcp_stream_feed(stream, chunk, static_cast<size_t>(num_of_bytes)) == false)) {
+            /* peer closed the connection or we cannot continue reading, stop watching the socket */
+            stream->closed = true;
+            stream->received.notify_all();
+            reactor_remove_fd(conn->ctx->reactor, conn->conn.socket_fd);
+            return;
+        }
+    }
+}
+
+/*!
+ * \brief connection_read_stream This function waits until the requested bytes were received, the connection was
+ * closed or the sequence timeout is reached
+ * \param conn is the v2g connection context
+ * \param buf is the buffer to store the v2g message
+ * \param count is the number of bytes to read
+ * \return Returns the number of read bytes, \c -2 if the connection was terminated
+ */
+static ssize_t connection_read_stream(struct v2g_connection* conn, unsigned char* buf, size_t count) {
+    struct tcp_stream* stream = conn->tcp_stream;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(V2G_SEQUENCE_TIMEOUT_60S);
+
+    std::unique_lock<std::mutex> lock(stream->mutex);
+    /* DIN [V2G-DC-432], [V2G2-536] */
+    const bool complete = stream->received.wait_until(lock, deadline, [conn, stream, count] {
+        return (stream->inbox.size() >= count) || stream->closed || conn->ctx->is_connection_terminated;
+    });
+
+    if (conn->ctx->is_connection_terminated == true) {
+        dlog(DLOG_LEVEL_ERROR, "Reading from tcp-socket aborted");
+        return -2;
+    }
+
+    if (!complete) {
+        dlog(DLOG_LEVEL_ERROR, "Sequence timeout has occured (message: %s)",
+             v2g_msg_type[conn->ctx->current_v2g_msg]);
+    }
+
+    // [V2G2-537] read bytes are currupted if reading from socket was interrupted (V2G_SECC_Sequence_Timeout)
+    const size_t num_of_bytes = std::min(count, stream->inbox.size());
+    std::copy_n(stream->inbox.begin(), num_of_bytes, buf);
+    stream->inbox.erase(stream->inbox.begin(), stream->inbox.begin() + num_of_bytes);
+
+    return static_cast<ssize_t>(num_of_bytes);
+}
+
+/*!
+ * \brief connection_close_stream This function stops receiving on a TCP connection, must be called before the
+ * socket is closed
+ * \param conn is the V2G connection context
+ */
+static void connection_close_stream(struct v2g_connection* conn) {
+    reactor_remove_fd(conn->ctx->reactor, conn->conn.socket_fd);
+
+    {
+        std::scoped_lock lock(tcp_streams_mutex);
+        tcp_streams.erase(conn->tcp_stream);
+    }
+
+    delete conn->tcp_stream;
+    conn->tcp_stream = nullptr;
+}
+
 /*!
  * \brief connection_create_socket This function creates a tcp/tls socket
  * \param sockaddr to bind the socket to an interface
@@ -337,7 +508,7 @@ bool is_sequence_timeout(struct timespec ts_start, struct v2g_context* ctx) {
 
 /*!
  * \brief connection_read This function reads from socket until requested bytes are received or sequence
- * timeout is reached
+ * timeout is reached. TCP connections are read by the reactor, then this only waits for the received bytes.
  * \param conn is the v2g connection context
  * \param buf is the buffer to store the v2g message
  * \param count is the number of bytes to read
@@ -347,6 +518,11 @@ ssize_t connection_read(struct v2g_connection* conn, unsigned char* buf, size_t
     struct timespec ts_start;
     int bytes_read = 0;
 
+    /* TCP connections are received by the reactor */
+    if (conn->tcp_stream != nullptr) {
+        return connection_read_stream(conn, buf, count);
+    }
+
     if (clock_gettime(CLOCK_MONOTONIC, &ts_start) == -1) {
         dlog(DLOG_LEVEL_ERROR, "clock_gettime(ts_start) failed: %s", strerror(errno));
         return -1;
@@ -358,62 +534,27 @@ ssize_t connection_read(struct v2g_connection* conn, unsigned char* buf, size_t
 
         int num_of_bytes;
 
-        if (conn->is_tls_connection) {
 #ifdef EVEREST_MBED_TLS
-            num_of_bytes = mbedtls_ssl_read(&conn->conn.ssl.ssl_context, &buf[bytes_read], count - bytes_read);
+        num_of_bytes = mbedtls_ssl_read(&conn->conn.ssl.ssl_context, &buf[bytes_read], count - bytes_read);
 
-            if (num_of_bytes == MBEDTLS_ERR_SSL_WANT_READ || num_of_bytes == MBEDTLS_ERR_SSL_WANT_WRITE ||
-                num_of_bytes == MBEDTLS_ERR_SSL_TIMEOUT)
-                continue;
+        if (num_of_bytes == MBEDTLS_ERR_SSL_WANT_READ || num_of_bytes == MBEDTLS_ERR_SSL_WANT_WRITE ||
+            num_of_bytes == MBEDTLS_ERR_SSL_TIMEOUT)
+            continue;
 
-            if (num_of_bytes == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || num_of_bytes == MBEDTLS_ERR_SSL_CONN_EOF)
-                return bytes_read;
+        if (num_of_bytes == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || num_of_bytes == MBEDTLS_ERR_SSL_CONN_EOF)
+            return bytes_read;
 
-            if (num_of_bytes < 0) {
-                char error_buf[100];
-                mbedtls_strerror(num_of_bytes, error_buf, sizeof(error_buf));
-                dlog(DLOG_LEVEL_ERROR, "mbedtls_ssl_read() error: %s", error_buf);
+        if (num_of_bytes < 0) {
+            char error_buf[100];
+            mbedtls_strerror(num_of_bytes, error_buf, sizeof(error_buf));
+            dlog(DLOG_LEVEL_ERROR, "mbedtls_ssl_read() error: %s", error_buf);
 
-                return -1;
-            }
-#else
-            dlog(DLOG_LEVEL_ERROR, "mbedtls_ssl_read() not configured");
             return -1;
-#endif // EVEREST_MBED_TLS
-        } else {
-            /* use select for timeout handling */
-            struct timeval tv;
-            fd_set read_fds;
-
-            FD_ZERO(&read_fds);
-            FD_SET(conn->conn.socket_fd, &read_fds);
-
-            tv.tv_sec = conn->ctx->network_read_timeout / 1000;
-            tv.tv_usec = (conn->ctx->network_read_timeout % 1000) * 1000;
-
-            num_of_bytes = select(conn->conn.socket_fd + 1, &read_fds, nullptr, nullptr, &tv);
-
-            if (num_of_bytes == -1) {
-                if (errno == EINTR)
-                    continue;
-
-                return -1;
-            }
-
-            /* Zero fds ready means we timed out, so let upper loop check our sequence timeout */
-            if (num_of_bytes == 0) {
-                continue;
-            }
-
-            num_of_bytes = (int)read(conn->conn.socket_fd, &buf[bytes_read], count - bytes_read);
-
-            if (num_of_bytes == -1) {
-                if (errno == EINTR)
-                    continue;
-
-                return -1;
-            }
         }
+#else
+        dlog(DLOG_LEVEL_ERROR, "mbedtls_ssl_read() not configured");
+        return -1;
+#endif // EVEREST_MBED_TLS
 
         /* return when peer closed connection */
         if (num_of_bytes == 0)
@@ -465,6 +606,14 @@ ssize_t connection_write(struct v2g_connection* conn, unsigned char* buf, size_t
                 if (errno == EINTR)
                     continue;
 
+                /* the socket is non-blocking since the reactor reads it, wait until it can take more data */
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                    struct pollfd pollfd = {conn->conn.socket_fd, POLLOUT, 0};
+                    const int rv = poll(&pollfd, 1, conn->ctx->network_read_timeout);
+                    if ((rv > 0) || ((rv == -1) && (errno == EINTR)))
+                        continue;
+                }
+
                 return -1;
             }
         }
@@ -728,6 +877,9 @@ static void* connection_handle_tcp(void* data) {
     /* tear down connection gracefully */
     dlog(DLOG_LEVEL_INFO, "Closing TCP connection");
 
+    /* stop receiving in the reactor, nobody reads the connection anymore */
+    connection_close_stream(conn);
+
     std::this_thread::sleep_for(std::chrono::seconds(2));
 
     if (shutdown(conn->conn.socket_fd, SHUT_RDWR) == -1) {
@@ -752,11 +904,11 @@ static void* connection_handle_tcp(void* data) {
     return nullptr;
 }
 
+#ifdef EVEREST_MBED_TLS
 /**
  * This is the 'main' function of a thread, which handles a TLS connection.
  */
 static void* connection_handle_tls(void* data) {
-#ifdef EVEREST_MBED_TLS
     struct v2g_connection* conn = static_cast<v2g_connection*>(data);
     struct v2g_context* v2g_ctx = conn->ctx;
     mbedtls_ssl_config* ssl_config = conn->conn.ssl.ssl_config;
@@ -862,7 +1014,7 @@ static void* connection_handle_tls(void* data) {
             if (rv != 0) {
                 if (((rv != MBEDTLS_ERR_SSL_WANT_READ) && (rv != MBEDTLS_ERR_SSL_WANT_WRITE) &&
                      (rv != MBEDTLS_ERR_SSL_TIMEOUT)) ||
-                    (NULL == conn->ctx->com_setup_timeout)) {
+                    (0 == conn->ctx->com_setup_timeout)) {
                     dlog(DLOG_LEVEL_ERROR, "mbedtls_ssl_handshake returned -0x%04x", -rv);
                     goto thread_exit;
                 }
@@ -936,7 +1088,6 @@ thread_exit:
     connection_teardown(conn);
 
     free(conn);
-#endif // EVEREST_MBED_TLS
 
     return nullptr;
 }
@@ -969,40 +1120,22 @@ static void* connection_server(void* data) {
             break;
         }
 
-        /* setup common stuff */
+        /* setup common stuff, TCP connections are accepted by the reactor */
         conn->ctx = ctx;
         conn->read = &connection_read;
         conn->write = &connection_write;
-
-        /* if this thread is the TLS thread, then connections are TLS secured;
-         * return code is non-zero if equal so align it
-         */
-#ifdef EVEREST_MBED_TLS
-        conn->is_tls_connection = !!pthread_equal(pthread_self(), ctx->tls_thread);
-#else
-        conn->is_tls_connection = false;
-#endif // EVEREST_MBED_TLS
+        conn->is_tls_connection = true;
 
         /* wait for an incoming connection */
-        if (conn->is_tls_connection) {
-#ifdef EVEREST_MBED_TLS
-            conn->conn.ssl.ssl_config = &ctx->ssl_config;
+        conn->conn.ssl.ssl_config = &ctx->ssl_config;
 
-            /* at the moment, this is simply resetting the fd to -1; kept for upwards compatibility */
-            mbedtls_net_init(&conn->conn.ssl.tls_client_fd);
+        /* at the moment, this is simply resetting the fd to -1; kept for upwards compatibility */
+        mbedtls_net_init(&conn->conn.ssl.tls_client_fd);
 
-            conn->conn.ssl.tls_client_fd.fd = accept(ctx->tls_socket.fd, (struct sockaddr*)&addr, &addrlen);
-            if (conn->conn.ssl.tls_client_fd.fd == -1) {
-                dlog(DLOG_LEVEL_ERROR, "Accept(tls) failed: %s", strerror(errno));
-                continue;
-            }
-#endif // EVEREST_MBED_TLS
-        } else {
-            conn->conn.socket_fd = accept(ctx->tcp_socket, (struct sockaddr*)&addr, &addrlen);
-            if (conn->conn.socket_fd == -1) {
-                dlog(DLOG_LEVEL_ERROR, "Accept(tcp) failed: %s", strerror(errno));
-                continue;
-            }
+        conn->conn.ssl.tls_client_fd.fd = accept(ctx->tls_socket.fd, (struct sockaddr*)&addr, &addrlen);
+        if (conn->conn.ssl.tls_client_fd.fd == -1) {
+            dlog(DLOG_LEVEL_ERROR, "Accept(tls) failed: %s", strerror(errno));
+            continue;
         }
 
         if (inet_ntop(AF_INET6, &addr, client_addr, sizeof(client_addr)) != NULL) {
@@ -1016,8 +1149,7 @@ static void* connection_server(void* data) {
         // store the port to create a udp socket
         conn->ctx->udp_port = ntohs(addr.sin6_port);
 
-        if (pthread_create(&conn->thread_id, &attr,
-                           conn->is_tls_connection ? connection_handle_tls : connection_handle_tcp, conn) != 0) {
+        if (pthread_create(&conn->thread_id, &attr, connection_handle_tls, conn) != 0) {
             dlog(DLOG_LEVEL_ERROR, "pthread_create() failed: %s", strerror(errno));
             continue;
         }
@@ -1036,14 +1168,104 @@ thread_exit:
 
     return NULL;
 }
+#endif // EVEREST_MBED_TLS
+
+/*!
+ * \brief connection_accept_tcp This function is called by the reactor when the TCP listen socket is readable. It
+ * accepts all pending connections and starts a connection thread for each. The received data of the connections is
+ * read by the reactor, see connection_receive().
+ * \param ctx is the V2G context
+ */
+static void connection_accept_tcp(struct v2g_context* ctx) {
+    pthread_attr_t attr;
+
+    /* create the thread in detached state so we don't need to join every single one */
+    if ((pthread_attr_init(&attr) != 0) || (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) != 0)) {
+        dlog(DLOG_LEVEL_ERROR, "pthread_attr_init failed: %s", strerror(errno));
+        return;
+    }
+
+    while (1) {
+        char client_addr[INET6_ADDRSTRLEN];
+        struct sockaddr_in6 addr;
+        socklen_t addrlen = sizeof(addr);
+
+        const int fd = accept4(ctx->tcp_socket, (struct sockaddr*)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                dlog(DLOG_LEVEL_ERROR, "Accept(tcp) failed: %s", strerror(errno));
+            break;
+        }
+
+        struct v2g_connection* conn = static_cast<v2g_connection*>(calloc(1, sizeof(*conn)));
+        if (!conn) {
+            dlog(DLOG_LEVEL_ERROR, "Calloc failed: %s", strerror(errno));
+            close(fd);
+            break;
+        }
+
+        /* setup common stuff */
+        conn->ctx = ctx;
+        conn->read = &connection_read;
+        conn->write = &connection_write;
+        conn->is_tls_connection = false;
+        conn->conn.socket_fd = fd;
+
+        if (inet_ntop(AF_INET6, &addr, client_addr, sizeof(client_addr)) != NULL) {
+            dlog(DLOG_LEVEL_INFO, "Incoming connection on %s from [%s]:%" PRIu16, ctx->if_name, client_addr,
+                 ntohs(addr.sin6_port));
+        } else {
+            dlog(DLOG_LEVEL_ERROR, "Incoming connection on %s, but inet_ntop failed: %s", ctx->if_name,
+                 strerror(errno));
+        }
+
+        // store the port to create a udp socket
+        conn->ctx->udp_port = ntohs(addr.sin6_port);
+
+        conn->tcp_stream = new tcp_stream(ctx);
+        {
+            std::scoped_lock lock(tcp_streams_mutex);
+            tcp_streams.insert(conn->tcp_stream);
+        }
+
+        if (reactor_add_fd(ctx->reactor, fd, EPOLLIN | EPOLLRDHUP, [conn](uint32_t) { connection_receive(conn); }) !=
+            0) {
+            connection_close_stream(conn);
+            close(fd);
+            free(conn);
+            continue;
+        }
+
+        if (pthread_create(&conn->thread_id, &attr, connection_handle_tcp, conn) != 0) {
+            dlog(DLOG_LEVEL_ERROR, "pthread_create() failed: %s", strerror(errno));
+            connection_close_stream(conn);
+            close(fd);
+            free(conn);
+            continue;
+        }
+
+        /* is up to the thread to cleanup conn */
+    }
+
+    if (pthread_attr_destroy(&attr) != 0) {
+        dlog(DLOG_LEVEL_ERROR, "pthread_attr_destroy failed: %s", strerror(errno));
+    }
+}
 
 int connection_start_servers(struct v2g_context* ctx) {
     int rv, tcp_started = 0;
 
     if (ctx->tcp_socket != -1) {
-        rv = pthread_create(&ctx->tcp_thread, NULL, connection_server, ctx);
+        /* the reactor accepts all pending connections at once, so accept() must not block */
+        if (fcntl(ctx->tcp_socket, F_SETFL, fcntl(ctx->tcp_socket, F_GETFL) | O_NONBLOCK) == -1) {
+            dlog(DLOG_LEVEL_ERROR, "fcntl(O_NONBLOCK) failed: %s", strerror(errno));
+            return -1;
+        }
+        rv = reactor_add_fd(ctx->reactor, ctx->tcp_socket, EPOLLIN, [ctx](uint32_t) { connection_accept_tcp(ctx); });
         if (rv != 0) {
-            dlog(DLOG_LEVEL_ERROR, "pthread_create(tcp) failed: %s", strerror(errno));
+            dlog(DLOG_LEVEL_ERROR, "Failed to add the tcp server to the reactor");
             return -1;
         }
         tcp_started = 1;
@@ -1057,8 +1279,7 @@ int connection_start_servers(struct v2g_context* ctx) {
 #endif // EVEREST_MBED_TLS
         if (rv != 0) {
             if (tcp_started) {
-                pthread_cancel(ctx->tcp_thread);
-                pthread_join(ctx->tcp_thread, NULL);
+                reactor_remove_fd(ctx->reactor, ctx->tcp_socket);
             }
             dlog(DLOG_LEVEL_ERROR, "pthread_create(tls) failed: %s", strerror(errno));
             return -1;
@@ -1068,6 +1289,19 @@ int connection_start_servers(struct v2g_context* ctx) {
     return 0;
 }
 
+void connection_terminate(struct v2g_context* ctx) {
+    ctx->is_connection_terminated = true;
+
+    /* wake up the connection threads waiting in connection_read() */
+    std::scoped_lock lock(tcp_streams_mutex);
+    for (auto* stream : tcp_streams) {
+        if (stream->ctx == ctx) {
+            std::scoped_lock stream_lock(stream->mutex);
+            stream->received.notify_all();
+        }
+    }
+}
+
 int create_udp_socket(const uint16_t udp_port, const char* interface_name) {
     constexpr auto LINK_LOCAL_MULTICAST = "ff02::1";
 
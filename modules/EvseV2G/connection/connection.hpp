@@ -33,6 +33,12 @@ int create_udp_socket(const uint16_t udp_port, const char* interface_name);
  */
 bool is_sequence_timeout(struct timespec ts_start, struct v2g_context* ctx);
 
+/*!
+ * \brief terminate the running V2G connection, a connection_read() waiting for data returns -2
+ * \param ctx the V2G context
+ */
+void connection_terminate(struct v2g_context* ctx);
+
 /*!
  * \brief actions to take on connection close
  * \param conn v2g connection context
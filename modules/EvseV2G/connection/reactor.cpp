@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include "reactor.hpp"
+#include "log.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+#define REACTOR_MAX_EVENTS 16
+
+typedef std::chrono::steady_clock reactor_clock;
+
+struct v2g_reactor {
+    int epoll_fd{-1};
+    int wakeup_fd{-1};
+
+    std::mutex mutex;
+    std::condition_variable handler_done;
+    std::unordered_map<int, reactor_fd_handler> handlers;
+    int running_fd{-1}; /* fd whose handler runs right now */
+    std::thread::id loop_thread;
+
+    /* ordered by due time, the id keeps timers with the same due time apart */
+    std::map<std::pair<reactor_clock::time_point, uint64_t>, reactor_timer_callback> timers;
+    std::unordered_map<uint64_t, reactor_clock::time_point> timer_due;
+    uint64_t next_timer_id{1};
+};
+
+struct v2g_reactor* reactor_create() {
+    auto* reactor = new v2g_reactor;
+
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd == -1) {
+        dlog(DLOG_LEVEL_ERROR, "epoll_create1() failed: %s", strerror(errno));
+        reactor_free(reactor);
+        return nullptr;
+    }
+
+    reactor->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wakeup_fd == -1) {
+        dlog(DLOG_LEVEL_ERROR, "eventfd() failed: %s", strerror(errno));
+        reactor_free(reactor);
+        return nullptr;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = reactor->wakeup_fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wakeup_fd, &event) == -1) {
+        dlog(DLOG_LEVEL_ERROR, "epoll_ctl(wakeup) failed: %s", strerror(errno));
+        reactor_free(reactor);
+        return nullptr;
+    }
+
+    return reactor;
+}
+
+void reactor_free(struct v2g_reactor* reactor) {
+    if (reactor == nullptr) {
+        return;
+    }
+    if (reactor->wakeup_fd != -1) {
+        close(reactor->wakeup_fd);
+    }
+    if (reactor->epoll_fd != -1) {
+        close(reactor->epoll_fd);
+    }
+    delete reactor;
+}
+
+int reactor_add_fd(struct v2g_reactor* reactor, int fd, uint32_t events, const reactor_fd_handler& handler) {
+    std::scoped_lock lock(reactor->mutex);
+
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        dlog(DLOG_LEVEL_ERROR, "epoll_ctl(add) failed: %s", strerror(errno));
+        return -1;
+    }
+    reactor->handlers[fd] = handler;
+
+    return 0;
+}
+
+void reactor_remove_fd(struct v2g_reactor* reactor, int fd) {
+    std::unique_lock<std::mutex> lock(reactor->mutex);
+
+    if ((reactor->handlers.erase(fd) != 0) && (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1)) {
+        dlog(DLOG_LEVEL_ERROR, "epoll_ctl(del) failed: %s", strerror(errno));
+    }
+
+    /* also when fd was already removed, e.g. by its own handler that did not return yet */
+    if (std::this_thread::get_id() != reactor->loop_thread) {
+        reactor->handler_done.wait(lock, [reactor, fd] { return reactor->running_fd != fd; });
+    }
+}
+
+uint64_t reactor_add_timer(struct v2g_reactor* reactor, uint32_t timeout_ms, const reactor_timer_callback& callback) {
+    uint64_t id;
+    bool is_first;
+    {
+        std::scoped_lock lock(reactor->mutex);
+        id = reactor->next_timer_id++;
+        const auto due = reactor_clock::now() + std::chrono::milliseconds(timeout_ms);
+        const auto timer = reactor->timers.emplace(std::make_pair(due, id), callback).first;
+        reactor->timer_due.emplace(id, due);
+        is_first = (timer == reactor->timers.begin());
+    }
+
+    /* the reactor only needs to recalculate its epoll_wait() timeout if this is the next timer */
+    if (is_first) {
+        reactor_wakeup(reactor);
+    }
+
+    return id;
+}
+
+void reactor_cancel_timer(struct v2g_reactor* reactor, uint64_t id) {
+    std::scoped_lock lock(reactor->mutex);
+
+    const auto due = reactor->timer_due.find(id);
+    if (due != reactor->timer_due.end()) {
+        reactor->timers.erase(std::make_pair(due->second, id));
+        reactor->timer_due.erase(due);
+    }
+}
+
+void reactor_wakeup(struct v2g_reactor* reactor) {
+    const uint64_t one = 1;
+    if (write(reactor->wakeup_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        dlog(DLOG_LEVEL_ERROR, "write(wakeup) failed: %s", strerror(errno));
+    }
+}
+
+/*!
+ * \brief reactor_run_timers runs all due timers
+ * \return timeout for epoll_wait() until the next timer is due, -1 if there is none
+ */
+static int reactor_run_timers(struct v2g_reactor* reactor) {
+    std::unique_lock<std::mutex> lock(reactor->mutex);
+
+    while (!reactor->timers.empty()) {
+        const auto timer = reactor->timers.begin();
+        const auto now = reactor_clock::now();
+
+        if (timer->first.first > now) {
+            /* round up, so we do not wake up a bit too early and spin */
+            const auto timeout = std::chrono::ceil<std::chrono::milliseconds>(timer->first.first - now);
+            return static_cast<int>(timeout.count());
+        }
+
+        const auto callback = std::move(timer->second);
+        reactor->timer_due.erase(timer->first.second);
+        reactor->timers.erase(timer);
+
+        lock.unlock();
+        callback();
+        lock.lock();
+    }
+
+    return -1;
+}
+
+int reactor_run(struct v2g_reactor* reactor, const std::atomic_bool& shutdown) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    {
+        std::scoped_lock lock(reactor->mutex);
+        reactor->loop_thread = std::this_thread::get_id();
+    }
+
+    while (!shutdown) {
+        const int timeout = reactor_run_timers(reactor);
+        const int num_of_events = epoll_wait(reactor->epoll_fd, events, REACTOR_MAX_EVENTS, timeout);
+
+        if (num_of_events == -1) {
+            if (errno == EINTR)
+                continue;
+
+            dlog(DLOG_LEVEL_ERROR, "epoll_wait() failed: %s", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < num_of_events; i++) {
+            const int fd = events[i].data.fd;
+
+            if (fd == reactor->wakeup_fd) {
+                uint64_t count;
+                if (read(reactor->wakeup_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                    dlog(DLOG_LEVEL_ERROR, "read(wakeup) failed: %s", strerror(errno));
+                }
+                continue;
+            }
+
+            reactor_fd_handler handler;
+            {
+                std::scoped_lock lock(reactor->mutex);
+                /* the fd may have been removed by a handler or another thread in the meantime */
+                const auto it = reactor->handlers.find(fd);
+                if (it == reactor->handlers.end()) {
+                    continue;
+                }
+                handler = it->second;
+                reactor->running_fd = fd;
+            }
+
+            handler(events[i].events);
+
+            {
+                std::scoped_lock lock(reactor->mutex);
+                reactor->running_fd = -1;
+            }
+            reactor->handler_done.notify_all();
+        }
+    }
+
+    return 0;
+}
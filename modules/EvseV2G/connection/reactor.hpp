@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#ifndef REACTOR_HPP_
+#define REACTOR_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+/*
+ * epoll based event loop of the V2G stack. It runs in a single thread (see reactor_run()) and owns the SDP socket,
+ * the TCP listen socket, the receiving side of all TCP V2G connections and the V2G timers. Handlers and timer
+ * callbacks run in the reactor thread and must not block.
+ *
+ * File descriptors and timers can be added and removed from any thread.
+ */
+
+struct v2g_reactor;
+
+typedef std::function<void(uint32_t events)> reactor_fd_handler;
+typedef std::function<void()> reactor_timer_callback;
+
+/*!
+ * \brief reactor_create creates the epoll instance
+ * \return the reactor, nullptr on error
+ */
+struct v2g_reactor* reactor_create();
+
+/*!
+ * \brief reactor_free frees the reactor, reactor_run() must have returned
+ * \param reactor the reactor, may be nullptr
+ */
+void reactor_free(struct v2g_reactor* reactor);
+
+/*!
+ * \brief reactor_add_fd watches a file descriptor, fd is not owned by the reactor
+ * \param reactor the reactor
+ * \param fd file descriptor, should be non-blocking
+ * \param events epoll events, e.g. EPOLLIN (level triggered)
+ * \param handler called with the ready events
+ * \return 0 on success, -1 on error
+ */
+int reactor_add_fd(struct v2g_reactor* reactor, int fd, uint32_t events, const reactor_fd_handler& handler);
+
+/*!
+ * \brief reactor_remove_fd stops watching a file descriptor. When called from another thread, this waits until a
+ * running handler of fd returned, so fd can be closed and the handler data freed afterwards.
+ * \param reactor the reactor
+ * \param fd file descriptor, unknown ones are ignored
+ */
+void reactor_remove_fd(struct v2g_reactor* reactor, int fd);
+
+/*!
+ * \brief reactor_add_timer runs a callback once in the reactor thread
+ * \param reactor the reactor
+ * \param timeout_ms timeout in milli seconds
+ * \param callback the callback
+ * \return timer id, never 0
+ */
+uint64_t reactor_add_timer(struct v2g_reactor* reactor, uint32_t timeout_ms, const reactor_timer_callback& callback);
+
+/*!
+ * \brief reactor_cancel_timer cancels a timer, a callback that is running right now is not waited for
+ * \param reactor the reactor
+ * \param id timer id, unknown ids (and 0) are ignored
+ */
+void reactor_cancel_timer(struct v2g_reactor* reactor, uint64_t id);
+
+/*!
+ * \brief reactor_run runs the event loop in the calling thread until shutdown is set and reactor_wakeup() is called
+ * \param reactor the reactor
+ * \param shutdown stop flag
+ * \return 0 on shutdown, -1 on error
+ */
+int reactor_run(struct v2g_reactor* reactor, const std::atomic_bool& shutdown);
+
+/*!
+ * \brief reactor_wakeup interrupts a blocking epoll_wait() of the reactor thread
+ * \param reactor the reactor
+ */
+void reactor_wakeup(struct v2g_reactor* reactor);
+
+#endif // REACTOR_HPP_
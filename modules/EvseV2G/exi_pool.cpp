@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "exi_pool.hpp"
+
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+struct exi_document_pool {
+    std::mutex mutex;
+    struct exi_documents* free_list{NULL};
+};
+
+/* clears body member m if it is in use, the decoder/encoder marks exactly one member as used */
+#define EXI_BODY_RESET_MEMBER(body, m)                                                                                 \
+    if ((body)->m##_isUsed) {                                                                                          \
+        memset(&(body)->m, 0, sizeof((body)->m));                                                                      \
+        (body)->m##_isUsed = 0;                                                                                        \
+        return;                                                                                                        \
+    }
+
+/* clears the header, the large signature only if it is in use. The rest of the header is small and cleared as a
+ * whole, so this does not depend on the other header members. */
+#define EXI_HEADER_RESET(header)                                                                                       \
+    do {                                                                                                               \
+        if ((header)->Signature_isUsed) {                                                                              \
+            memset((header), 0, sizeof(*(header)));                                                                    \
+            break;                                                                                                     \
+        }                                                                                                              \
+        char* const begin = reinterpret_cast<char*>(header);                                                           \
+        char* const signature = reinterpret_cast<char*>(&(header)->Signature);                                         \
+        char* const signature_end = signature + sizeof((header)->Signature);                                           \
+        memset(begin, 0, signature - begin);                                                                           \
+        memset(signature_end, 0, begin + sizeof(*(header)) - signature_end);                                           \
+    } while (0)
+
+static void iso2_exi_body_reset(struct iso2_BodyType* body) {
+    EXI_BODY_RESET_MEMBER(body, CurrentDemandReq)
+    EXI_BODY_RESET_MEMBER(body, CurrentDemandRes)
+    EXI_BODY_RESET_MEMBER(body, ChargingStatusReq)
+    EXI_BODY_RESET_MEMBER(body, ChargingStatusRes)
+    EXI_BODY_RESET_MEMBER(body, SessionSetupReq)
+    EXI_BODY_RESET_MEMBER(body, SessionSetupRes)
+    EXI_BODY_RESET_MEMBER(body, ServiceDiscoveryReq)
+    EXI_BODY_RESET_MEMBER(body, ServiceDiscoveryRes)
+    EXI_BODY_RESET_MEMBER(body, ServiceDetailReq)
+    EXI_BODY_RESET_MEMBER(body, ServiceDetailRes)
+    EXI_BODY_RESET_MEMBER(body, PaymentServiceSelectionReq)
+    EXI_BODY_RESET_MEMBER(body, PaymentServiceSelectionRes)
+    EXI_BODY_RESET_MEMBER(body, PaymentDetailsReq)
+    EXI_BODY_RESET_MEMBER(body, PaymentDetailsRes)
+    EXI_BODY_RESET_MEMBER(body, AuthorizationReq)
+    EXI_BODY_RESET_MEMBER(body, AuthorizationRes)
+    EXI_BODY_RESET_MEMBER(body, ChargeParameterDiscoveryReq)
+    EXI_BODY_RESET_MEMBER(body, ChargeParameterDiscoveryRes)
+    EXI_BODY_RESET_MEMBER(body, PowerDeliveryReq)
+    EXI_BODY_RESET_MEMBER(body, PowerDeliveryRes)
+    EXI_BODY_RESET_MEMBER(body, MeteringReceiptReq)
+    EXI_BODY_RESET_MEMBER(body, MeteringReceiptRes)
+    EXI_BODY_RESET_MEMBER(body, CertificateUpdateReq)
+    EXI_BODY_RESET_MEMBER(body, CertificateUpdateRes)
+    EXI_BODY_RESET_MEMBER(body, CertificateInstallationReq)
+    EXI_BODY_RESET_MEMBER(body, CertificateInstallationRes)
+    EXI_BODY_RESET_MEMBER(body, CableCheckReq)
+    EXI_BODY_RESET_MEMBER(body, CableCheckRes)
+    EXI_BODY_RESET_MEMBER(body, PreChargeReq)
+    EXI_BODY_RESET_MEMBER(body, PreChargeRes)
+    EXI_BODY_RESET_MEMBER(body, WeldingDetectionReq)
+    EXI_BODY_RESET_MEMBER(body, WeldingDetectionRes)
+    EXI_BODY_RESET_MEMBER(body, SessionStopReq)
+    EXI_BODY_RESET_MEMBER(body, SessionStopRes)
+
+    /* nothing or a member which is not handled by the V2G server is in use */
+    memset(body, 0, sizeof(*body));
+}
+
+static void din_exi_body_reset(struct din_BodyType* body) {
+    EXI_BODY_RESET_MEMBER(body, CurrentDemandReq)
+    EXI_BODY_RESET_MEMBER(body, CurrentDemandRes)
+    EXI_BODY_RESET_MEMBER(body, ChargingStatusReq)
+    EXI_BODY_RESET_MEMBER(body, ChargingStatusRes)
+    EXI_BODY_RESET_MEMBER(body, SessionSetupReq)
+    EXI_BODY_RESET_MEMBER(body, SessionSetupRes)
+    EXI_BODY_RESET_MEMBER(body, ServiceDiscoveryReq)
+    EXI_BODY_RESET_MEMBER(body, ServiceDiscoveryRes)
+    EXI_BODY_RESET_MEMBER(body, ServicePaymentSelectionReq)
+    EXI_BODY_RESET_MEMBER(body, ServicePaymentSelectionRes)
+    EXI_BODY_RESET_MEMBER(body, ContractAuthenticationReq)
+    EXI_BODY_RESET_MEMBER(body, ContractAuthenticationRes)
+    EXI_BODY_RESET_MEMBER(body, ChargeParameterDiscoveryReq)
+    EXI_BODY_RESET_MEMBER(body, ChargeParameterDiscoveryRes)
+    EXI_BODY_RESET_MEMBER(body, PowerDeliveryReq)
+    EXI_BODY_RESET_MEMBER(body, PowerDeliveryRes)
+    EXI_BODY_RESET_MEMBER(body, CableCheckReq)
+    EXI_BODY_RESET_MEMBER(body, CableCheckRes)
+    EXI_BODY_RESET_MEMBER(body, PreChargeReq)
+    EXI_BODY_RESET_MEMBER(body, PreChargeRes)
+    EXI_BODY_RESET_MEMBER(body, WeldingDetectionReq)
+    EXI_BODY_RESET_MEMBER(body, WeldingDetectionRes)
+    EXI_BODY_RESET_MEMBER(body, SessionStopReq)
+    EXI_BODY_RESET_MEMBER(body, SessionStopRes)
+
+    /* nothing or a member which is not handled by the V2G server is in use */
+    memset(body, 0, sizeof(*body));
+}
+
+void iso2_exi_document_reset(struct iso2_exiDocument* doc) {
+    EXI_HEADER_RESET(&doc->V2G_Message.Header);
+    iso2_exi_body_reset(&doc->V2G_Message.Body);
+}
+
+void din_exi_document_reset(struct din_exiDocument* doc) {
+    EXI_HEADER_RESET(&doc->V2G_Message.Header);
+    din_exi_body_reset(&doc->V2G_Message.Body);
+}
+
+struct exi_document_pool* exi_pool_create() {
+    return new (std::nothrow) exi_document_pool;
+}
+
+void exi_pool_free(struct exi_document_pool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    while (pool->free_list != NULL) {
+        struct exi_documents* documents = pool->free_list;
+        pool->free_list = documents->next;
+        free(documents);
+    }
+
+    delete pool;
+}
+
+struct exi_documents* exi_pool_acquire(struct exi_document_pool* pool) {
+    {
+        std::scoped_lock lock(pool->mutex);
+
+        if (pool->free_list != NULL) {
+            struct exi_documents* documents = pool->free_list;
+            pool->free_list = documents->next;
+            documents->next = NULL;
+            return documents;
+        }
+    }
+
+    return static_cast<struct exi_documents*>(calloc(1, sizeof(struct exi_documents)));
+}
+
+void exi_pool_release(struct exi_document_pool* pool, struct exi_documents* documents, enum v2g_protocol protocol) {
+    if (documents == NULL) {
+        return;
+    }
+
+    switch (protocol) {
+    case V2G_PROTO_DIN70121:
+    case V2G_PROTO_ISO15118_2010:
+        din_exi_document_reset(&documents->in.din);
+        din_exi_document_reset(&documents->out.din);
+        break;
+    case V2G_PROTO_ISO15118_2013:
+        iso2_exi_document_reset(&documents->in.iso2);
+        iso2_exi_document_reset(&documents->out.iso2);
+        break;
+    default:
+        memset(&documents->in, 0, sizeof(documents->in));
+        memset(&documents->out, 0, sizeof(documents->out));
+        break;
+    }
+
+    std::scoped_lock lock(pool->mutex);
+    documents->next = pool->free_list;
+    pool->free_list = documents;
+}
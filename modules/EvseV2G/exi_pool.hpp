@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef EXI_POOL_H
+#define EXI_POOL_H
+
+#include "v2g.hpp"
+
+/*
+ * The EXI in/out documents are unions sized for the largest message (e.g. certificate installation). Instead of
+ * clearing them completely for every message, only the header and the body member used by the previous message are
+ * cleared (see iso2_exi_document_reset()). The documents are kept in a pool and reused by later connections.
+ *
+ * Invariant: a document that is handed out or reset is all zero, except what the decoder or the message handler writes
+ * into it afterwards.
+ */
+
+/* in and out documents of a connection, a set can be used for DIN and ISO */
+struct exi_documents {
+    union {
+        struct din_exiDocument din;
+        struct iso2_exiDocument iso2;
+    } in, out;
+
+    struct exi_documents* next; /* free list of the pool */
+};
+
+struct exi_document_pool;
+
+/*!
+ * \brief exi_pool_create creates an empty pool, documents are allocated on demand
+ * \return Returns the pool, \c NULL on error.
+ */
+struct exi_document_pool* exi_pool_create();
+
+/*!
+ * \brief exi_pool_free frees the pool and all documents that were released to it
+ * \param pool is the pool, may be \c NULL.
+ */
+void exi_pool_free(struct exi_document_pool* pool);
+
+/*!
+ * \brief exi_pool_acquire takes a zeroed set of documents from the pool or allocates a new one
+ * \param pool is the pool.
+ * \return Returns the documents, \c NULL if out-of-memory.
+ */
+struct exi_documents* exi_pool_acquire(struct exi_document_pool* pool);
+
+/*!
+ * \brief exi_pool_release resets the documents and gives them back to the pool
+ * \param pool is the pool.
+ * \param documents are the documents, may be \c NULL.
+ * \param protocol is the protocol the documents were used for, they are cleared completely if it is unknown.
+ */
+void exi_pool_release(struct exi_document_pool* pool, struct exi_documents* documents, enum v2g_protocol protocol);
+
+/*!
+ * \brief iso2_exi_document_reset clears the header and the body member used by the last decoded or encoded message.
+ * If no known body member is in use, the whole body is cleared.
+ * \param doc is the document.
+ */
+void iso2_exi_document_reset(struct iso2_exiDocument* doc);
+
+/*!
+ * \brief din_exi_document_reset clears the header and the body member used by the last decoded or encoded message.
+ * If no known body member is in use, the whole body is cleared.
+ * \param doc is the document.
+ */
+void din_exi_document_reset(struct din_exiDocument* doc);
+
+#endif /* EXI_POOL_H */
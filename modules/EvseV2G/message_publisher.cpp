@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#include "message_publisher.hpp"
+#include "log.hpp"
+#include "tools.hpp"
+#include "v2g.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+/* a request/response pair per connection plus some slack for a slow MQTT connection */
+#define MESSAGE_PUBLISHER_QUEUE_SIZE 8
+
+struct queued_message {
+    types::iso15118_charger::V2gMessageId id;
+    size_t len;
+    uint8_t frame[DEFAULT_BUFFER_SIZE];
+};
+
+struct v2g_message_publisher {
+    ISO15118_chargerImplBase* p_charger;
+
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::vector<queued_message> queue; /* ring buffer, allocated with the worker thread */
+    size_t head{0};
+    size_t count{0};
+    size_t dropped{0};
+    bool shutdown{false};
+    std::thread worker;
+
+    /* only used by the worker thread */
+    char hex[2 * DEFAULT_BUFFER_SIZE];
+    char base64[BASE64_ENCODED_LEN(DEFAULT_BUFFER_SIZE)];
+};
+
+static void message_publisher_publish(struct v2g_message_publisher* publisher, const struct queued_message& message) {
+    types::iso15118_charger::V2gMessages v2g_message;
+
+    v2g_message.id = message.id;
+    v2g_message.exi = std::string(publisher->hex, convert_to_hex_buf(message.frame, message.len, publisher->hex));
+    v2g_message.exi_base64 =
+        std::string(publisher->base64, convert_to_base64_buf(message.frame, message.len, publisher->base64));
+
+    publisher->p_charger->publish_v2g_messages(v2g_message);
+}
+
+static void message_publisher_run(struct v2g_message_publisher* publisher) {
+    std::unique_lock<std::mutex> lock(publisher->mutex);
+
+    while (true) {
+        publisher->queued.wait(lock, [publisher] { return publisher->count != 0 || publisher->shutdown; });
+
+        if (publisher->count == 0) {
+            break; /* shutdown and all messages published */
+        }
+
+        if (publisher->dropped != 0) {
+            dlog(DLOG_LEVEL_WARNING, "Dropped %zu V2G messages, the publisher could not keep up", publisher->dropped);
+            publisher->dropped = 0;
+        }
+
+        /* the slot stays occupied until it is published, so message_publisher_push() does not overwrite it */
+        const auto& message = publisher->queue[publisher->head];
+        lock.unlock();
+        message_publisher_publish(publisher, message);
+        lock.lock();
+
+        publisher->head = (publisher->head + 1) % MESSAGE_PUBLISHER_QUEUE_SIZE;
+        publisher->count--;
+    }
+}
+
+struct v2g_message_publisher* message_publisher_create(ISO15118_chargerImplBase* p_charger) {
+    auto* publisher = new (std::nothrow) v2g_message_publisher;
+
+    if (publisher != NULL) {
+        publisher->p_charger = p_charger;
+    }
+
+    return publisher;
+}
+
+void message_publisher_free(struct v2g_message_publisher* publisher) {
+    if (publisher == NULL) {
+        return;
+    }
+
+    {
+        std::scoped_lock lock(publisher->mutex);
+        publisher->shutdown = true;
+    }
+    publisher->queued.notify_one();
+
+    if (publisher->worker.joinable()) {
+        publisher->worker.join();
+    }
+
+    delete publisher;
+}
+
+void message_publisher_push(struct v2g_message_publisher* publisher, types::iso15118_charger::V2gMessageId id,
+                            const uint8_t* frame, size_t len) {
+    if (len > DEFAULT_BUFFER_SIZE) {
+        dlog(DLOG_LEVEL_WARNING, "V2G message of %zu bytes is too long to be published", len);
+        return;
+    }
+
+    {
+        std::scoped_lock lock(publisher->mutex);
+
+        if (publisher->shutdown) {
+            return;
+        }
+
+        if (!publisher->worker.joinable()) {
+            publisher->queue.resize(MESSAGE_PUBLISHER_QUEUE_SIZE);
+            publisher->worker = std::thread(message_publisher_run, publisher);
+        }
+
+        if (publisher->count == MESSAGE_PUBLISHER_QUEUE_SIZE) {
+            publisher->dropped++;
+            return;
+        }
+
+        auto& message = publisher->queue[(publisher->head + publisher->count) % MESSAGE_PUBLISHER_QUEUE_SIZE];
+        message.id = id;
+        message.len = len;
+        memcpy(message.frame, frame, len);
+        publisher->count++;
+    }
+
+    publisher->queued.notify_one();
+}
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+#ifndef MESSAGE_PUBLISHER_H
+#define MESSAGE_PUBLISHER_H
+
+#include <generated/interfaces/ISO15118_charger/Implementation.hpp>
+#include <generated/types/iso15118_charger.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Publishes the raw V2G messages (var v2g_messages) as hex and base64 in a background thread, so the session thread
+ * only has to copy the frame. The thread and the queue are created with the first message, i.e. only if debug mode
+ * (session logging of the EvseManager) is on.
+ */
+
+struct v2g_message_publisher;
+
+/*!
+ * \brief message_publisher_create creates the publisher, the worker thread is started with the first message
+ * \param p_charger is the interface the messages are published on.
+ * \return Returns the publisher, \c NULL on error.
+ */
+struct v2g_message_publisher* message_publisher_create(ISO15118_chargerImplBase* p_charger);
+
+/*!
+ * \brief message_publisher_free publishes the queued messages, stops the worker thread and frees the publisher
+ * \param publisher is the publisher, may be \c NULL.
+ */
+void message_publisher_free(struct v2g_message_publisher* publisher);
+
+/*!
+ * \brief message_publisher_push queues a copy of a V2GTP frame. If the queue is full, the frame is dropped.
+ * \param publisher is the publisher.
+ * \param id is the V2G message id.
+ * \param frame is the V2GTP frame (header and EXI payload).
+ * \param len is the length of the frame, at most DEFAULT_BUFFER_SIZE.
+ */
+void message_publisher_push(struct v2g_message_publisher* publisher, types::iso15118_charger::V2gMessageId id,
+                            const uint8_t* frame, size_t len);
+
+#endif /* MESSAGE_PUBLISHER_H */
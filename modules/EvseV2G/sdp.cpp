@@ -3,6 +3,7 @@
 // Copyright (C) 2022-2023 Contributors to EVerest
 #include "sdp.hpp"
 #include "log.hpp"
+#include "reactor.hpp"
 
 #include <arpa/inet.h>
 #include <errno.h>
@@ -10,11 +11,11 @@
 #include <inttypes.h>
 #include <net/if.h>
 #include <netinet/in.h>
-#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -34,8 +35,6 @@
 #define SDP_REQUEST_TYPE  0x9000
 #define SDP_RESPONSE_TYPE 0x9001
 
-#define POLL_TIMEOUT 20
-
 enum sdp_security {
     SDP_SECURITY_TLS = 0x00,
     SDP_SECURITY_NONE = 0x10,
@@ -265,67 +264,71 @@ int sdp_init(struct v2g_context* v2g_ctx) {
     return 0;
 }
 
+/*!
+ * \brief sdp_handle_request This function is called by the reactor when the SDP socket is readable
+ * \param v2g_ctx is the V2G context
+ */
+static void sdp_handle_request(struct v2g_context* v2g_ctx) {
+    uint8_t buffer[SDP_HEADER_LEN + SDP_REQUEST_PAYLOAD_LEN];
+    char addrbuf[INET6_ADDRSTRLEN] = {0};
+    const char* addr = addrbuf;
+    struct sdp_query sdp_query = {
+        .v2g_ctx = v2g_ctx,
+    };
+    socklen_t addrlen = sizeof(sdp_query.remote_addr);
+
+    ssize_t len =
+        recvfrom(v2g_ctx->sdp_socket, buffer, sizeof(buffer), 0, (struct sockaddr*)&sdp_query.remote_addr, &addrlen);
+    if (len == -1) {
+        if ((errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+            dlog(DLOG_LEVEL_ERROR, "recvfrom() failed: %s", strerror(errno));
+        return;
+    }
+
+    addr = inet_ntop(AF_INET6, &sdp_query.remote_addr.sin6_addr, addrbuf, sizeof(addrbuf));
+
+    if (len != sizeof(buffer)) {
+        dlog(DLOG_LEVEL_WARNING, "Discarded packet from [%s]:%" PRIu16 " due to unexpected length %zd", addr,
+             ntohs(sdp_query.remote_addr.sin6_port), len);
+        return;
+    }
+
+    if (sdp_validate_header(buffer, SDP_REQUEST_TYPE, SDP_REQUEST_PAYLOAD_LEN)) {
+        dlog(DLOG_LEVEL_WARNING, "Packet with invalid SDP header received from [%s]:%" PRIu16, addr,
+             ntohs(sdp_query.remote_addr.sin6_port));
+        return;
+    }
+
+    sdp_query.security_requested = (sdp_security)buffer[SDP_HEADER_LEN + 0];
+    sdp_query.proto_requested = (sdp_transport_protocol)buffer[SDP_HEADER_LEN + 1];
+
+    dlog(DLOG_LEVEL_INFO, "Received packet from [%s]:%" PRIu16 " with security 0x%02x and protocol 0x%02x", addr,
+         ntohs(sdp_query.remote_addr.sin6_port), sdp_query.security_requested, sdp_query.proto_requested);
+
+    sdp_send_response(v2g_ctx->sdp_socket, &sdp_query);
+}
+
 int sdp_listen(struct v2g_context* v2g_ctx) {
-    /* Init pollfd struct */
-    struct pollfd pollfd = {v2g_ctx->sdp_socket, POLLIN, 0};
+    int rv;
 
-    while (!v2g_ctx->shutdown) {
-        uint8_t buffer[SDP_HEADER_LEN + SDP_REQUEST_PAYLOAD_LEN];
-        char addrbuf[INET6_ADDRSTRLEN] = {0};
-        const char* addr = addrbuf;
-        struct sdp_query sdp_query = {
-            .v2g_ctx = v2g_ctx,
-        };
-        socklen_t addrlen = sizeof(sdp_query.remote_addr);
-
-        /* Check if data was received on socket */
-        signed status = poll(&pollfd, 1, POLL_TIMEOUT);
-
-        if (status == -1) {
-            if (errno == EINTR) { // If the call did not succeed because it was interrupted
-                continue;
-            } else {
-                dlog(DLOG_LEVEL_ERROR, "poll() failed: %s", strerror(errno));
-                continue;
-            }
-        }
-        /* If new data was received, handle sdp request */
-        if (status > 0) {
-            ssize_t len = recvfrom(v2g_ctx->sdp_socket, buffer, sizeof(buffer), 0,
-                                   (struct sockaddr*)&sdp_query.remote_addr, &addrlen);
-            if (len == -1) {
-                if (errno != EINTR)
-                    dlog(DLOG_LEVEL_ERROR, "recvfrom() failed: %s", strerror(errno));
-                continue;
-            }
-
-            addr = inet_ntop(AF_INET6, &sdp_query.remote_addr.sin6_addr, addrbuf, sizeof(addrbuf));
-
-            if (len != sizeof(buffer)) {
-                dlog(DLOG_LEVEL_WARNING, "Discarded packet from [%s]:%" PRIu16 " due to unexpected length %zd", addr,
-                     ntohs(sdp_query.remote_addr.sin6_port), len);
-                continue;
-            }
-
-            if (sdp_validate_header(buffer, SDP_REQUEST_TYPE, SDP_REQUEST_PAYLOAD_LEN)) {
-                dlog(DLOG_LEVEL_WARNING, "Packet with invalid SDP header received from [%s]:%" PRIu16, addr,
-                     ntohs(sdp_query.remote_addr.sin6_port));
-                continue;
-            }
-
-            sdp_query.security_requested = (sdp_security)buffer[SDP_HEADER_LEN + 0];
-            sdp_query.proto_requested = (sdp_transport_protocol)buffer[SDP_HEADER_LEN + 1];
-
-            dlog(DLOG_LEVEL_INFO, "Received packet from [%s]:%" PRIu16 " with security 0x%02x and protocol 0x%02x",
-                 addr, ntohs(sdp_query.remote_addr.sin6_port), sdp_query.security_requested, sdp_query.proto_requested);
-
-            sdp_send_response(v2g_ctx->sdp_socket, &sdp_query);
+    if (v2g_ctx->sdp_socket != -1) {
+        rv = reactor_add_fd(v2g_ctx->reactor, v2g_ctx->sdp_socket, EPOLLIN,
+                            [v2g_ctx](uint32_t) { sdp_handle_request(v2g_ctx); });
+        if (rv == -1) {
+            return -1;
         }
     }
 
-    if (close(v2g_ctx->sdp_socket) == -1) {
-        dlog(DLOG_LEVEL_ERROR, "close() failed: %s", strerror(errno));
+    /* SDP requests, TCP connections and timers are all handled in this thread from now on */
+    rv = reactor_run(v2g_ctx->reactor, v2g_ctx->shutdown);
+
+    if (v2g_ctx->sdp_socket != -1) {
+        reactor_remove_fd(v2g_ctx->reactor, v2g_ctx->sdp_socket);
+
+        if (close(v2g_ctx->sdp_socket) == -1) {
+            dlog(DLOG_LEVEL_ERROR, "close() failed: %s", strerror(errno));
+        }
     }
 
-    return 0;
+    return rv;
 }
@@ -7,6 +7,12 @@
 #include "v2g.hpp"
 
 int sdp_init(struct v2g_context* v2g_ctx);
+
+/*!
+ * \brief sdp_listen adds the SDP socket to the reactor and runs the reactor in the calling thread until shutdown
+ * \param v2g_ctx the V2G context
+ * \return 0 on shutdown, -1 on error
+ */
 int sdp_listen(struct v2g_context* v2g_ctx);
 
 #endif /* SDP_H */
@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include "gtest/gtest.h"
+#include <exi_pool.hpp>
+
+#include <cbv2g/common/exi_bitstream.h>
+#include <cbv2g/din/din_msgDefDatatypes.h>
+#include <cbv2g/din/din_msgDefDecoder.h>
+#include <cbv2g/din/din_msgDefEncoder.h>
+#include <cbv2g/iso_2/iso2_msgDefDatatypes.h>
+#include <cbv2g/iso_2/iso2_msgDefDecoder.h>
+#include <cbv2g/iso_2/iso2_msgDefEncoder.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+// The messages are built into zeroed documents, only the members the V2G server also reads or writes are set.
+
+namespace {
+
+template <typename T> void setCharacters(T& dest, const std::string& s) {
+    dest.charactersLen = s.size();
+    std::memcpy(&dest.characters[0], s.c_str(), s.size());
+}
+
+template <typename T> void setBytes(T& dest, std::uint8_t value) {
+    dest.bytesLen = sizeof(dest.bytes);
+    std::memset(&dest.bytes[0], value, sizeof(dest.bytes));
+}
+
+iso2_PhysicalValueType iso2_physical_value(std::int16_t value, std::int8_t multiplier, iso2_unitSymbolType unit) {
+    iso2_PhysicalValueType v{};
+    v.Value = value;
+    v.Multiplier = multiplier;
+    v.Unit = unit;
+    return v;
+}
+
+template <typename Unit>
+din_PhysicalValueType din_physical_value(std::int16_t value, std::int8_t multiplier, Unit unit) {
+    din_PhysicalValueType v{};
+    v.Value = value;
+    v.Multiplier = multiplier;
+    v.Unit = unit;
+    v.Unit_isUsed = 1;
+    return v;
+}
+
+void iso2_message(struct iso2_exiDocument& doc) {
+    init_iso2_exiDocument(&doc);
+    init_iso2_MessageHeaderType(&doc.V2G_Message.Header);
+    doc.V2G_Message.Header.SessionID.bytesLen = iso2_sessionIDType_BYTES_SIZE;
+    std::memset(doc.V2G_Message.Header.SessionID.bytes, 0x5a, iso2_sessionIDType_BYTES_SIZE);
+    init_iso2_BodyType(&doc.V2G_Message.Body);
+}
+
+void iso2_current_demand_req(struct iso2_exiDocument& doc) {
+    iso2_message(doc);
+    doc.V2G_Message.Body.CurrentDemandReq_isUsed = 1;
+
+    auto& req = doc.V2G_Message.Body.CurrentDemandReq;
+    req.DC_EVStatus.EVReady = 1;
+    req.DC_EVStatus.EVRESSSOC = 42;
+    req.EVTargetCurrent = iso2_physical_value(1250, -1, iso2_unitSymbolType_A);
+    req.EVTargetVoltage = iso2_physical_value(4010, -1, iso2_unitSymbolType_V);
+    req.EVMaximumCurrentLimit = iso2_physical_value(200, 0, iso2_unitSymbolType_A);
+    req.EVMaximumCurrentLimit_isUsed = 1;
+    req.EVMaximumPowerLimit = iso2_physical_value(150, 3, iso2_unitSymbolType_W);
+    req.EVMaximumPowerLimit_isUsed = 1;
+    req.EVMaximumVoltageLimit = iso2_physical_value(450, 0, iso2_unitSymbolType_V);
+    req.EVMaximumVoltageLimit_isUsed = 1;
+    req.BulkChargingComplete = 0;
+    req.BulkChargingComplete_isUsed = 1;
+    req.ChargingComplete = 0;
+    req.RemainingTimeToFullSoC = iso2_physical_value(1800, 0, iso2_unitSymbolType_s);
+    req.RemainingTimeToFullSoC_isUsed = 1;
+}
+
+// one of the largest messages the EVCC sends, the certificates fill their buffers
+void iso2_payment_details_req(struct iso2_exiDocument& doc) {
+    iso2_message(doc);
+    doc.V2G_Message.Body.PaymentDetailsReq_isUsed = 1;
+
+    auto& req = doc.V2G_Message.Body.PaymentDetailsReq;
+    setCharacters(req.eMAID, "DEPNXC12345678");
+    auto& chain = req.ContractSignatureCertChain;
+    setBytes(chain.Certificate, 0x11);
+    chain.SubCertificates.Certificate.arrayLen = 2;
+    for (std::uint16_t i = 0; i < chain.SubCertificates.Certificate.arrayLen; i++) {
+        setBytes(chain.SubCertificates.Certificate.array[i], 0x12 + i);
+    }
+    chain.SubCertificates_isUsed = 1;
+}
+
+void din_current_demand_req(struct din_exiDocument& doc) {
+    init_din_exiDocument(&doc);
+    init_din_MessageHeaderType(&doc.V2G_Message.Header);
+    doc.V2G_Message.Header.SessionID.bytesLen = din_sessionIDType_BYTES_SIZE;
+    std::memset(doc.V2G_Message.Header.SessionID.bytes, 0xa5, din_sessionIDType_BYTES_SIZE);
+    init_din_BodyType(&doc.V2G_Message.Body);
+    doc.V2G_Message.Body.CurrentDemandReq_isUsed = 1;
+
+    auto& req = doc.V2G_Message.Body.CurrentDemandReq;
+    req.DC_EVStatus.EVReady = 1;
+    req.DC_EVStatus.EVRESSSOC = 57;
+    req.EVTargetCurrent = din_physical_value(80, 0, din_unitSymbolType_A);
+    req.EVTargetVoltage = din_physical_value(398, 0, din_unitSymbolType_V);
+    req.EVMaximumCurrentLimit = din_physical_value(125, 0, din_unitSymbolType_A);
+    req.EVMaximumCurrentLimit_isUsed = 1;
+    req.EVMaximumVoltageLimit = din_physical_value(410, 0, din_unitSymbolType_V);
+    req.EVMaximumVoltageLimit_isUsed = 1;
+    req.ChargingComplete = 0;
+    req.RemainingTimeToFullSoC = din_physical_value(1200, 0, din_unitSymbolType_s);
+    req.RemainingTimeToFullSoC_isUsed = 1;
+}
+
+class ExiPoolTest : public testing::Test {
+protected:
+    struct exi_document_pool* pool{nullptr};
+    struct exi_documents* documents{nullptr};
+    std::uint8_t buffer[DEFAULT_BUFFER_SIZE];
+
+    void SetUp() override {
+        pool = exi_pool_create();
+        ASSERT_NE(pool, nullptr);
+        documents = exi_pool_acquire(pool);
+        ASSERT_NE(documents, nullptr);
+    }
+
+    void TearDown() override {
+        exi_pool_release(pool, documents, V2G_PROTO_ISO15118_2013);
+        exi_pool_free(pool);
+    }
+
+    // what a reset document has to look like
+    template <typename T> bool is_zero(const T& doc) {
+        const std::unique_ptr<T> zero(new T);
+        std::memset(zero.get(), 0, sizeof(T));
+        return std::memcmp(&doc, zero.get(), sizeof(T)) == 0;
+    }
+
+    exi_bitstream_t stream(std::size_t len) {
+        exi_bitstream_t stream;
+        exi_bitstream_init(&stream, buffer, len, 0, nullptr);
+        return stream;
+    }
+
+    // encodes doc like the V2G server does and returns the length of the EXI stream
+    std::size_t encode(struct iso2_exiDocument& doc) {
+        auto s = stream(sizeof(buffer));
+        EXPECT_EQ(encode_iso2_exiDocument(&s, &doc), 0);
+        return exi_bitstream_get_length(&s);
+    }
+
+    std::size_t encode(struct din_exiDocument& doc) {
+        auto s = stream(sizeof(buffer));
+        EXPECT_EQ(encode_din_exiDocument(&s, &doc), 0);
+        return exi_bitstream_get_length(&s);
+    }
+
+    void decode(std::size_t len, struct iso2_exiDocument& doc) {
+        auto s = stream(len);
+        ASSERT_EQ(decode_iso2_exiDocument(&s, &doc), 0);
+    }
+
+    void decode(std::size_t len, struct din_exiDocument& doc) {
+        auto s = stream(len);
+        ASSERT_EQ(decode_din_exiDocument(&s, &doc), 0);
+    }
+};
+
+TEST_F(ExiPoolTest, acquired_documents_are_zero) {
+    EXPECT_TRUE(is_zero(documents->in.iso2));
+    EXPECT_TRUE(is_zero(documents->out.iso2));
+    EXPECT_TRUE(is_zero(documents->in.din));
+    EXPECT_TRUE(is_zero(documents->out.din));
+}
+
+TEST_F(ExiPoolTest, iso2_current_demand_req) {
+    auto& out = documents->out.iso2;
+    auto& in = documents->in.iso2;
+
+    iso2_current_demand_req(out);
+    const auto len = encode(out);
+    ASSERT_GT(len, 0);
+    decode(len, in);
+
+    ASSERT_TRUE(in.V2G_Message.Body.CurrentDemandReq_isUsed);
+    const auto& req = in.V2G_Message.Body.CurrentDemandReq;
+    EXPECT_EQ(req.DC_EVStatus.EVRESSSOC, 42);
+    EXPECT_EQ(req.EVTargetCurrent.Value, 1250);
+    EXPECT_EQ(req.EVTargetVoltage.Value, 4010);
+    EXPECT_TRUE(req.RemainingTimeToFullSoC_isUsed);
+    EXPECT_FALSE(req.RemainingTimeToBulkSoC_isUsed);
+    EXPECT_EQ(in.V2G_Message.Header.SessionID.bytesLen, iso2_sessionIDType_BYTES_SIZE);
+
+    iso2_exi_document_reset(&in);
+    EXPECT_TRUE(is_zero(in));
+    iso2_exi_document_reset(&out);
+    EXPECT_TRUE(is_zero(out));
+}
+
+TEST_F(ExiPoolTest, iso2_payment_details_req) {
+    auto& out = documents->out.iso2;
+    auto& in = documents->in.iso2;
+
+    iso2_payment_details_req(out);
+    const auto len = encode(out);
+    ASSERT_GT(len, 3 * sizeof(out.V2G_Message.Body.PaymentDetailsReq.ContractSignatureCertChain.Certificate.bytes));
+    decode(len, in);
+
+    ASSERT_TRUE(in.V2G_Message.Body.PaymentDetailsReq_isUsed);
+    const auto& chain = in.V2G_Message.Body.PaymentDetailsReq.ContractSignatureCertChain;
+    EXPECT_EQ(chain.Certificate.bytesLen, sizeof(chain.Certificate.bytes));
+    ASSERT_TRUE(chain.SubCertificates_isUsed);
+    EXPECT_EQ(chain.SubCertificates.Certificate.arrayLen, 2);
+    EXPECT_EQ(chain.SubCertificates.Certificate.array[1].bytes[0], 0x13);
+    const auto& emaid = in.V2G_Message.Body.PaymentDetailsReq.eMAID;
+    EXPECT_EQ(std::string(emaid.characters, emaid.charactersLen), "DEPNXC12345678");
+
+    iso2_exi_document_reset(&in);
+    EXPECT_TRUE(is_zero(in));
+    iso2_exi_document_reset(&out);
+    EXPECT_TRUE(is_zero(out));
+}
+
+TEST_F(ExiPoolTest, din_current_demand_req) {
+    auto& out = documents->out.din;
+    auto& in = documents->in.din;
+
+    din_current_demand_req(out);
+    const auto len = encode(out);
+    ASSERT_GT(len, 0);
+    decode(len, in);
+
+    ASSERT_TRUE(in.V2G_Message.Body.CurrentDemandReq_isUsed);
+    const auto& req = in.V2G_Message.Body.CurrentDemandReq;
+    EXPECT_EQ(req.DC_EVStatus.EVRESSSOC, 57);
+    EXPECT_EQ(req.EVTargetCurrent.Value, 80);
+    EXPECT_EQ(req.EVTargetVoltage.Value, 398);
+    EXPECT_TRUE(req.EVMaximumCurrentLimit_isUsed);
+    EXPECT_FALSE(req.EVMaximumPowerLimit_isUsed);
+    EXPECT_EQ(in.V2G_Message.Header.SessionID.bytesLen, din_sessionIDType_BYTES_SIZE);
+
+    // released as DIN, the documents come back reset
+    exi_pool_release(pool, documents, V2G_PROTO_DIN70121);
+    documents = exi_pool_acquire(pool);
+    EXPECT_TRUE(is_zero(documents->in.din));
+    EXPECT_TRUE(is_zero(documents->out.din));
+}
+
+TEST_F(ExiPoolTest, reused_after_release) {
+    iso2_payment_details_req(documents->out.iso2);
+    decode(encode(documents->out.iso2), documents->in.iso2);
+    exi_pool_release(pool, documents, V2G_PROTO_ISO15118_2013);
+
+    // the same documents come back reset
+    auto* reused = exi_pool_acquire(pool);
+    EXPECT_EQ(reused, documents);
+    documents = reused;
+    EXPECT_TRUE(is_zero(documents->in.iso2));
+    EXPECT_TRUE(is_zero(documents->out.iso2));
+
+    // a smaller message afterwards is not affected by the larger one before
+    iso2_current_demand_req(documents->out.iso2);
+    decode(encode(documents->out.iso2), documents->in.iso2);
+    EXPECT_EQ(documents->in.iso2.V2G_Message.Body.CurrentDemandReq.DC_EVStatus.EVRESSSOC, 42);
+}
+
+} // namespace
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include "gtest/gtest.h"
+#include <reactor.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <string>
+#include <sys/epoll.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+class ReactorTest : public testing::Test {
+protected:
+    struct v2g_reactor* reactor{nullptr};
+    std::atomic_bool shutdown{false};
+    std::thread loop;
+
+    void SetUp() override {
+        reactor = reactor_create();
+        ASSERT_NE(reactor, nullptr);
+    }
+
+    void TearDown() override {
+        stop();
+        reactor_free(reactor);
+    }
+
+    void start() {
+        loop = std::thread([this]() { EXPECT_EQ(reactor_run(reactor, shutdown), 0); });
+    }
+
+    void stop() {
+        shutdown = true;
+        reactor_wakeup(reactor);
+        if (loop.joinable()) {
+            loop.join();
+        }
+    }
+};
+
+TEST_F(ReactorTest, timers_run_in_due_order) {
+    std::vector<int> fired;
+    reactor_add_timer(reactor, 30, [&fired]() { fired.push_back(3); });
+    reactor_add_timer(reactor, 10, [&fired]() { fired.push_back(1); });
+    const auto cancelled = reactor_add_timer(reactor, 20, [&fired]() { fired.push_back(2); });
+    EXPECT_NE(cancelled, 0);
+    reactor_cancel_timer(reactor, cancelled);
+    reactor_cancel_timer(reactor, 0);
+
+    std::atomic_bool done{false};
+    reactor_add_timer(reactor, 40, [&done]() { done = true; });
+    start();
+
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (!done && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(5ms);
+    }
+    stop();
+
+    ASSERT_TRUE(done);
+    EXPECT_EQ(fired, (std::vector<int>{1, 3}));
+}
+
+TEST_F(ReactorTest, fd_handler_and_remove) {
+    int fds[2];
+    ASSERT_EQ(pipe2(fds, O_NONBLOCK), 0);
+
+    std::atomic_int calls{0};
+    std::atomic_bool in_handler{false};
+    ASSERT_EQ(reactor_add_fd(reactor, fds[0], EPOLLIN,
+                             [&](uint32_t events) {
+                                 EXPECT_TRUE(events & EPOLLIN);
+                                 in_handler = true;
+                                 char buffer[16];
+                                 EXPECT_GT(read(fds[0], buffer, sizeof(buffer)), 0);
+                                 std::this_thread::sleep_for(50ms);
+                                 calls++;
+                                 in_handler = false;
+                             }),
+              0);
+    start();
+
+    ASSERT_EQ(write(fds[1], "x", 1), 1);
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (!in_handler && calls == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+
+    // waits for the running handler
+    reactor_remove_fd(reactor, fds[0]);
+    EXPECT_FALSE(in_handler);
+    EXPECT_EQ(calls, 1);
+
+    // not watched anymore
+    ASSERT_EQ(write(fds[1], "x", 1), 1);
+    std::this_thread::sleep_for(50ms);
+    EXPECT_EQ(calls, 1);
+
+    stop();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+} // namespace
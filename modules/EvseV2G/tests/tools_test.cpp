@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Pionix GmbH and Contributors to EVerest
+
+#include "gtest/gtest.h"
+#include <tools.hpp>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string to_hex(const std::vector<uint8_t>& data) {
+    std::string out(2 * data.size() + 1, '#');
+    const auto len = convert_to_hex_buf(data.data(), data.size(), out.data());
+    EXPECT_EQ(len, 2 * data.size());
+    EXPECT_EQ(out.back(), '#'); // nothing written behind the result
+    out.resize(len);
+    return out;
+}
+
+std::string to_base64(const std::vector<uint8_t>& data) {
+    std::string out(BASE64_ENCODED_LEN(data.size()) + 1, '#');
+    const auto len = convert_to_base64_buf(data.data(), data.size(), out.data());
+    EXPECT_EQ(len, BASE64_ENCODED_LEN(data.size()));
+    EXPECT_EQ(out.back(), '#');
+    out.resize(len);
+    return out;
+}
+
+TEST(ToolsTest, empty_input) {
+    EXPECT_EQ(to_hex({}), "");
+    EXPECT_EQ(to_base64({}), "");
+}
+
+TEST(ToolsTest, base64_tails) {
+    EXPECT_EQ(to_base64({0xff}), "/w==");
+    EXPECT_EQ(to_base64({0xff, 0x00}), "/wA=");
+    EXPECT_EQ(to_base64({0xff, 0x00, 0x7f}), "/wB/");
+    EXPECT_EQ(to_base64({0x14, 0xfb, 0x9c, 0x03, 0xd9, 0x7e}), "FPucA9l+");
+    EXPECT_EQ(to_base64({0x14, 0xfb, 0x9c, 0x03}), "FPucAw==");
+}
+
+TEST(ToolsTest, hex_bytes) {
+    EXPECT_EQ(to_hex({0x00}), "00");
+    EXPECT_EQ(to_hex({0xff, 0x0a}), "ff0a");
+    EXPECT_EQ(to_hex({0x01, 0xab, 0xf0}), "01abf0");
+}
+
+TEST(ToolsTest, v2gtp_frame) {
+    // V2GTP header (version 0x01, payload type 0x8001 EXI, payload length 19) followed by the EXI payload
+    const std::vector<uint8_t> frame = {0x01, 0xfe, 0x80, 0x01, 0x00, 0x00, 0x00, 0x13, 0x80, 0x98, 0x02, 0x10, 0x50,
+                                        0x90, 0x8c, 0x0c, 0x0c, 0x0c, 0x0c, 0x51, 0xe0, 0x00, 0x04, 0x00, 0x80, 0x40, 0x00};
+
+    EXPECT_EQ(to_hex(frame), "01fe8001000000138098021050908c0c0c0c0c51e0000400804000");
+    EXPECT_EQ(to_hex(frame), convert_to_hex_str(frame.data(), frame.size()));
+    EXPECT_EQ(to_base64(frame), "Af6AAQAAABOAmAIQUJCMDAwMDFHgAAQAgEAA");
+}
+
+} // namespace
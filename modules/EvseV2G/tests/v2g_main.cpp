@@ -158,8 +158,6 @@ int main(int argc, char** argv) {
         stop.join();
         tls::ServerConnection::wait_all_closed();
 
-        // wait for v2g_ctx_start_events thread to stop
-        std::this_thread::sleep_for(2s);
         v2g_ctx_free(ctx);
     }
 
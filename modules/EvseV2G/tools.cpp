@@ -348,6 +348,42 @@ std::string convert_to_hex_str(const uint8_t* data, int len) {
     return string_stream.str();
 }
 
+size_t convert_to_hex_buf(const uint8_t* data, size_t len, char* out) {
+    static const char hex_digits[] = "0123456789abcdef";
+
+    for (size_t idx = 0; idx < len; ++idx) {
+        out[2 * idx] = hex_digits[data[idx] >> 4];
+        out[2 * idx + 1] = hex_digits[data[idx] & 0x0f];
+    }
+
+    return 2 * len;
+}
+
+size_t convert_to_base64_buf(const uint8_t* data, size_t len, char* out) {
+    static const char base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char* pos = out;
+    size_t idx = 0;
+
+    for (; idx + 2 < len; idx += 3) {
+        const uint32_t triple = (data[idx] << 16) | (data[idx + 1] << 8) | data[idx + 2];
+        *pos++ = base64_digits[(triple >> 18) & 0x3f];
+        *pos++ = base64_digits[(triple >> 12) & 0x3f];
+        *pos++ = base64_digits[(triple >> 6) & 0x3f];
+        *pos++ = base64_digits[triple & 0x3f];
+    }
+
+    /* 1 or 2 remaining bytes are padded with '=' */
+    if (idx < len) {
+        const uint32_t triple = (data[idx] << 16) | ((idx + 1 < len) ? (data[idx + 1] << 8) : 0);
+        *pos++ = base64_digits[(triple >> 18) & 0x3f];
+        *pos++ = base64_digits[(triple >> 12) & 0x3f];
+        *pos++ = (idx + 1 < len) ? base64_digits[(triple >> 6) & 0x3f] : '=';
+        *pos++ = '=';
+    }
+
+    return pos - out;
+}
+
 types::iso15118_charger::HashAlgorithm
 convert_to_hash_algorithm(const types::evse_security::HashAlgorithm hash_algorithm) {
     switch (hash_algorithm) {
@@ -120,6 +120,29 @@ uint8_t get_dir_numbered_file_names(char file_names[MAX_PKI_CA_LENGTH][MAX_FILE_
  */
 std::string convert_to_hex_str(const uint8_t* data, int len);
 
+/*!
+ * \brief convert_to_hex_buf This function converts an array of binary data to lower case hex characters.
+ * \param data is the array of binary data.
+ * \param len is length of the array.
+ * \param out is the output buffer, it must hold at least 2 * len characters. It is not null terminated.
+ * \return Returns the number of characters written.
+ */
+size_t convert_to_hex_buf(const uint8_t* data, size_t len, char* out);
+
+/* number of characters convert_to_base64_buf() writes for N bytes */
+#define BASE64_ENCODED_LEN(N) (4 * ROUND_UP_ELEMENTS(N, 3))
+
+/*!
+ * \brief convert_to_base64_buf This function converts an array of binary data to base64 (with padding, without line
+ * breaks).
+ * \param data is the array of binary data.
+ * \param len is length of the array.
+ * \param out is the output buffer, it must hold at least BASE64_ENCODED_LEN(len) characters. It is not null
+ * terminated.
+ * \return Returns the number of characters written.
+ */
+size_t convert_to_base64_buf(const uint8_t* data, size_t len, char* out);
+
 /**
  * \brief convert the given \p hash_algorithm to type types::iso15118_charger::HashAlgorithm
  * \param hash_algorithm
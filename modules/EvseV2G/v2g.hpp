@@ -36,9 +36,6 @@
 #include <cbv2g/din/din_msgDefDatatypes.h>
 #include <cbv2g/iso_2/iso2_msgDefDatatypes.h>
 
-#include <event2/event.h>
-#include <event2/thread.h>
-
 /* timeouts in milliseconds */
 #define V2G_SEQUENCE_TIMEOUT_60S              60000 /* [V2G2-443] et.al. */
 #define V2G_SEQUENCE_TIMEOUT_10S              10000
@@ -189,10 +186,11 @@ struct v2g_context {
     evse_securityIntf* r_security;
     ISO15118_chargerImplBase* p_charger;
 
-    struct event_base* event_base;
-    pthread_t event_thread;
+    struct v2g_reactor* reactor; /* event loop for sockets and timers, see reactor.hpp */
+    struct v2g_message_publisher* message_publisher; /* publishes var v2g_messages, see message_publisher.hpp */
+    struct exi_document_pool* exi_pool;              /* EXI documents of the connections, see exi_pool.hpp */
 
-    struct event* com_setup_timeout;
+    uint64_t com_setup_timeout; /* reactor timer id, 0 if not running */
 
     const char* if_name;
     struct sockaddr_in6* local_tcp_addr;
@@ -212,8 +210,6 @@ struct v2g_context {
     int udp_port;
     int udp_socket;
 
-    pthread_t tcp_thread;
-
 #ifdef EVEREST_MBED_TLS
     mbedtls_ssl_config ssl_config;
     mbedtls_x509_crt* evseTlsCrt;
@@ -406,6 +402,8 @@ struct v2g_connection {
     openssl::pkey_ptr* pubkey;
 #endif // EVEREST_MBED_TLS
 
+    struct tcp_stream* tcp_stream; /* received V2GTP messages of non-TLS connections, see connection.cpp */
+
     ssize_t (*read)(struct v2g_connection* conn, unsigned char* buf, std::size_t count);
     ssize_t (*write)(struct v2g_connection* conn, unsigned char* buf, std::size_t count);
 
@@ -427,6 +425,8 @@ struct v2g_connection {
         struct iso2_exiDocument* iso2EXIDocument;
     } exi_out;
 
+    struct exi_documents* exi_documents; /* backing of exi_in and exi_out, taken from ctx->exi_pool */
+
     enum mqtt_dlink_action dlink_action; /* signaled action after connection is closed */
 };
 
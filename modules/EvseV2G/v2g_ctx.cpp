@@ -7,9 +7,12 @@
 #include <dirent.h>
 #include <errno.h>
 #include <math.h>
-#include <unistd.h> // sleep
+#include <unistd.h>
 
 #include "log.hpp"
+#include "exi_pool.hpp"
+#include "message_publisher.hpp"
+#include "reactor.hpp"
 #include "v2g_ctx.hpp"
 
 #include <cbv2g/iso_2/iso2_msgDefDatatypes.h>
@@ -81,42 +84,6 @@ void setMinPhysicalValue(struct iso2_PhysicalValueType* ADstPhyValue, const stru
     }
 }
 
-static void* v2g_ctx_eventloop(void* data) {
-    struct v2g_context* ctx = static_cast<struct v2g_context*>(data);
-
-    while (!ctx->shutdown) {
-        int rv;
-
-        rv = event_base_loop(ctx->event_base, 0);
-        if (rv == -1)
-            break;
-
-        /* if no events are registered, restart looping */
-        if (rv == 1)
-            sleep(1); /* FIXME this is bad since we actually do busy-waiting here */
-    }
-
-    return NULL;
-}
-
-static int v2g_ctx_start_events(struct v2g_context* ctx) {
-    pthread_attr_t attr;
-    int rv;
-
-    /* create the thread in detached state so we don't need to join it later */
-    if (pthread_attr_init(&attr) != 0) {
-        dlog(DLOG_LEVEL_ERROR, "pthread_attr_init failed: %s", strerror(errno));
-        return -1;
-    }
-    if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) != 0) {
-        dlog(DLOG_LEVEL_ERROR, "pthread_attr_setdetachstate failed: %s", strerror(errno));
-        return -1;
-    }
-
-    rv = pthread_create(&ctx->event_thread, NULL, v2g_ctx_eventloop, ctx);
-    return rv ? -1 : 0;
-}
-
 void v2g_ctx_init_charging_session(struct v2g_context* const ctx, bool is_connection_terminated) {
     v2g_ctx_init_charging_state(ctx, is_connection_terminated); // Init charging state
     v2g_ctx_init_charging_values(ctx);                          // Loads the internal default config
@@ -134,9 +101,9 @@ void v2g_ctx_init_charging_state(struct v2g_context* const ctx, bool is_connecti
     ctx->session.is_charging = false;
 
     /* Reset timer */
-    if (ctx->com_setup_timeout != NULL) {
-        event_free(ctx->com_setup_timeout);
-        ctx->com_setup_timeout = NULL;
+    if (ctx->com_setup_timeout != 0) {
+        reactor_cancel_timer(ctx->reactor, ctx->com_setup_timeout);
+        ctx->com_setup_timeout = 0;
     }
 }
 
@@ -332,32 +299,36 @@ struct v2g_context* v2g_ctx_create(ISO15118_chargerImplBase* p_chargerImplBase,
     ctx->debugMode = false;
 
     /* according to man page, both functions never return an error */
-    evthread_use_pthreads();
     pthread_mutex_init(&ctx->mqtt_lock, NULL);
     pthread_condattr_init(&ctx->mqtt_attr);
     pthread_condattr_setclock(&ctx->mqtt_attr, CLOCK_MONOTONIC);
     pthread_cond_init(&ctx->mqtt_cond, &ctx->mqtt_attr);
 
-    ctx->event_base = event_base_new();
-    if (!ctx->event_base) {
-        dlog(DLOG_LEVEL_ERROR, "event_base_new failed");
+    ctx->reactor = reactor_create();
+    if (!ctx->reactor) {
+        goto free_out;
+    }
+
+    ctx->message_publisher = message_publisher_create(p_chargerImplBase);
+    if (!ctx->message_publisher) {
         goto free_out;
     }
 
-    if (v2g_ctx_start_events(ctx) != 0)
+    ctx->exi_pool = exi_pool_create();
+    if (!ctx->exi_pool) {
         goto free_out;
+    }
 
-    ctx->com_setup_timeout = NULL;
+    ctx->com_setup_timeout = 0;
 
     ctx->hlc_pause_active = false;
 
     return ctx;
 
 free_out:
-    if (ctx->event_base) {
-        event_base_loopbreak(ctx->event_base);
-        event_base_free(ctx->event_base);
-    }
+    exi_pool_free(ctx->exi_pool);
+    message_publisher_free(ctx->message_publisher);
+    reactor_free(ctx->reactor);
     free(ctx->local_tls_addr);
     free(ctx->local_tcp_addr);
     free(ctx);
@@ -389,10 +360,9 @@ static void v2g_ctx_free_tls(struct v2g_context* ctx) {
 }
 
 void v2g_ctx_free(struct v2g_context* ctx) {
-    if (ctx->event_base) {
-        event_base_loopbreak(ctx->event_base);
-        event_base_free(ctx->event_base);
-    }
+    exi_pool_free(ctx->exi_pool);
+    message_publisher_free(ctx->message_publisher);
+    reactor_free(ctx->reactor);
 
     pthread_cond_destroy(&ctx->mqtt_cond);
     pthread_mutex_destroy(&ctx->mqtt_lock);
@@ -406,11 +376,11 @@ void v2g_ctx_free(struct v2g_context* ctx) {
     free(ctx);
 }
 
-void stop_timer(struct event** event_timer, char const* const timer_name, struct v2g_context* ctx) {
+void stop_timer(uint64_t* timer, char const* const timer_name, struct v2g_context* ctx) {
     pthread_mutex_lock(&ctx->mqtt_lock);
-    if (NULL != *event_timer) {
-        event_free(*event_timer);
-        *event_timer = NULL; // Reset timer pointer
+    if (0 != *timer) {
+        reactor_cancel_timer(ctx->reactor, *timer);
+        *timer = 0; // Reset timer id
         if (NULL != timer_name) {
             dlog(DLOG_LEVEL_TRACE, "%s stopped", (timer_name == NULL) ? "Timer" : timer_name);
         }
@@ -9,10 +9,6 @@
 #include <string.h>
 #include <unistd.h>
 
-#ifdef EVEREST_MBED_TLS
-#include <mbedtls/base64.h>
-#endif // EVEREST_MBED_TLS
-
 #include <cbv2g/app_handshake/appHand_Decoder.h>
 #include <cbv2g/app_handshake/appHand_Encoder.h>
 #include <cbv2g/common/exi_basetypes.h>
@@ -24,8 +20,10 @@
 
 #include "connection.hpp"
 #include "din_server.hpp"
+#include "exi_pool.hpp"
 #include "iso_server.hpp"
 #include "log.hpp"
+#include "message_publisher.hpp"
 #include "tools.hpp"
 
 #define MAX_RES_TIME 98
@@ -102,52 +100,23 @@ static types::iso15118_charger::V2gMessageId get_v2g_message_id(enum V2gMsgTypeI
 }
 
 /*!
- * \brief publish_var_V2G_Message This function fills a V2gMessages type with the V2G EXI message as HEX and Base64
+ * \brief publish_var_V2G_Message This function queues the V2G EXI message for publishing as HEX and Base64. The
+ * encoding is done by the message publisher thread.
  * \param conn hold the context of the V2G-connection.
  * \param is_req if it is a V2G request or response: 'true' if a request, and 'false' if a response
  */
 static void publish_var_V2G_Message(v2g_connection* conn, bool is_req) {
-    types::iso15118_charger::V2gMessages v2g_message;
-
-    u_int8_t* tempbuff = conn->buffer;
-    std::string msg_as_hex_string;
-    for (int i = 0; ((tempbuff != NULL) && (i < conn->payload_len + V2GTP_HEADER_LENGTH)); i++) {
-        char hex[4];
-        snprintf(hex, 4, "%x", *tempbuff); // to hex
-        if (std::string(hex).size() == 1)
-            msg_as_hex_string += '0';
-        msg_as_hex_string += hex;
-        tempbuff++;
-    }
+    size_t len = (size_t)conn->payload_len + V2GTP_HEADER_LENGTH;
 
-    std::string EXI_Base64;
-
-#ifdef EVEREST_MBED_TLS
-    unsigned char* base64_buffer = NULL;
-    size_t base64_buffer_len = 0;
-    mbedtls_base64_encode(NULL, 0, &base64_buffer_len, conn->buffer, (size_t)conn->payload_len + V2GTP_HEADER_LENGTH);
-    base64_buffer = static_cast<unsigned char*>(malloc(base64_buffer_len));
-    if ((base64_buffer == NULL) || (mbedtls_base64_encode(base64_buffer, base64_buffer_len, &base64_buffer_len,
-                                                          static_cast<unsigned char*>(conn->buffer),
-                                                          (size_t)conn->payload_len + V2GTP_HEADER_LENGTH) != 0)) {
-        dlog(DLOG_LEVEL_WARNING, "Unable to base64 encode EXI buffer");
+    if (is_req == false) {
+        /* responses are published before v2g_outgoing_v2gtp() sends them, so write the header here */
+        len = exi_bitstream_get_length(&conn->stream);
+        V2GTP_WriteHeader(conn->buffer, len - V2GTP_HEADER_LENGTH);
     }
 
-    EXI_Base64 = std::string(reinterpret_cast<char const*>(base64_buffer), base64_buffer_len);
-    if (base64_buffer != NULL) {
-        free(base64_buffer);
-    }
-#else
-    EXI_Base64 = openssl::base64_encode(conn->buffer, conn->payload_len + V2GTP_HEADER_LENGTH);
-    if (EXI_Base64.size() == 0) {
-        dlog(DLOG_LEVEL_WARNING, "Unable to base64 encode EXI buffer");
-    }
-#endif // EVEREST_MBED_TLS
-
-    v2g_message.exi_base64 = EXI_Base64;
-    v2g_message.id = get_v2g_message_id(conn->ctx->current_v2g_msg, conn->ctx->selected_protocol, is_req);
-    v2g_message.exi = msg_as_hex_string;
-    conn->ctx->p_charger->publish_v2g_messages(v2g_message);
+    message_publisher_push(conn->ctx->message_publisher,
+                           get_v2g_message_id(conn->ctx->current_v2g_msg, conn->ctx->selected_protocol, is_req),
+                           conn->buffer, len);
 }
 
 /*!
@@ -445,34 +414,22 @@ int v2g_handle_connection(struct v2g_connection* conn) {
     /* Backup the selected protocol, because this value is shared and can be reseted while unplugging. */
     selected_protocol = conn->ctx->selected_protocol;
 
-    /* allocate in/out documents dynamically */
+    /* take zeroed in/out documents from the pool */
+    conn->exi_documents = exi_pool_acquire(conn->ctx->exi_pool);
+    if (conn->exi_documents == NULL) {
+        dlog(DLOG_LEVEL_ERROR, "out-of-memory");
+        goto error_out;
+    }
+
     switch (selected_protocol) {
     case V2G_PROTO_DIN70121:
     case V2G_PROTO_ISO15118_2010:
-        conn->exi_in.dinEXIDocument = static_cast<struct din_exiDocument*>(calloc(1, sizeof(struct din_exiDocument)));
-        if (conn->exi_in.dinEXIDocument == NULL) {
-            dlog(DLOG_LEVEL_ERROR, "out-of-memory");
-            goto error_out;
-        }
-        conn->exi_out.dinEXIDocument = static_cast<struct din_exiDocument*>(calloc(1, sizeof(struct din_exiDocument)));
-        if (conn->exi_out.dinEXIDocument == NULL) {
-            dlog(DLOG_LEVEL_ERROR, "out-of-memory");
-            goto error_out;
-        }
+        conn->exi_in.dinEXIDocument = &conn->exi_documents->in.din;
+        conn->exi_out.dinEXIDocument = &conn->exi_documents->out.din;
         break;
     case V2G_PROTO_ISO15118_2013:
-        conn->exi_in.iso2EXIDocument =
-            static_cast<struct iso2_exiDocument*>(calloc(1, sizeof(struct iso2_exiDocument)));
-        if (conn->exi_in.iso2EXIDocument == NULL) {
-            dlog(DLOG_LEVEL_ERROR, "out-of-memory");
-            goto error_out;
-        }
-        conn->exi_out.iso2EXIDocument =
-            static_cast<struct iso2_exiDocument*>(calloc(1, sizeof(struct iso2_exiDocument)));
-        if (conn->exi_out.iso2EXIDocument == NULL) {
-            dlog(DLOG_LEVEL_ERROR, "out-of-memory");
-            goto error_out;
-        }
+        conn->exi_in.iso2EXIDocument = &conn->exi_documents->in.iso2;
+        conn->exi_out.iso2EXIDocument = &conn->exi_documents->out.iso2;
         break;
     default:
         goto error_out; //     if protocol is unknown
@@ -504,35 +461,41 @@ int v2g_handle_connection(struct v2g_connection* conn) {
         switch (selected_protocol) {
         case V2G_PROTO_DIN70121:
         case V2G_PROTO_ISO15118_2010:
-            memset(conn->exi_in.dinEXIDocument, 0, sizeof(struct din_exiDocument));
+            /* only the header and body member of the previous message have to be cleared */
+            din_exi_document_reset(conn->exi_in.dinEXIDocument);
             rv = decode_din_exiDocument(&conn->stream, conn->exi_in.dinEXIDocument);
             if (rv != 0) {
                 dlog(DLOG_LEVEL_ERROR, "decode_dinExiDocument() (previous message \"%s\") failed: %d",
                      v2g_msg_type[conn->ctx->last_v2g_msg], rv);
+                /* a partially decoded body member may not be marked as used */
+                memset(conn->exi_in.dinEXIDocument, 0, sizeof(struct din_exiDocument));
                 /* we must ignore packet which we cannot decode, so reset rv to zero to stay in loop */
                 rv = 0;
                 v2gEvent = V2G_EVENT_IGNORE_MSG;
                 break;
             }
 
-            memset(conn->exi_out.dinEXIDocument, 0, sizeof(struct din_exiDocument));
+            din_exi_document_reset(conn->exi_out.dinEXIDocument);
 
             v2gEvent = din_handle_request(conn);
             break;
 
         case V2G_PROTO_ISO15118_2013:
-            memset(conn->exi_in.iso2EXIDocument, 0, sizeof(struct iso2_exiDocument));
+            /* only the header and body member of the previous message have to be cleared */
+            iso2_exi_document_reset(conn->exi_in.iso2EXIDocument);
             rv = decode_iso2_exiDocument(&conn->stream, conn->exi_in.iso2EXIDocument);
             if (rv != 0) {
                 dlog(DLOG_LEVEL_ERROR, "decode_iso2_exiDocument() (previous message \"%s\") failed: %d",
                      v2g_msg_type[conn->ctx->last_v2g_msg], rv);
+                /* a partially decoded body member may not be marked as used */
+                memset(conn->exi_in.iso2EXIDocument, 0, sizeof(struct iso2_exiDocument));
                 /* we must ignore packet which we cannot decode, so reset rv to zero to stay in loop */
                 rv = 0;
                 v2gEvent = V2G_EVENT_IGNORE_MSG;
                 break;
             }
             conn->stream.byte_pos = 0; // Reset pos for the case if exi msg will be configured over mqtt
-            memset(conn->exi_out.iso2EXIDocument, 0, sizeof(struct iso2_exiDocument));
+            iso2_exi_document_reset(conn->exi_out.iso2EXIDocument);
 
             v2gEvent = iso_handle_request(conn);
 
@@ -613,23 +576,10 @@ int v2g_handle_connection(struct v2g_connection* conn) {
     } while ((rv == 0) && (stop_receiving_loop == false));
 
 error_out:
-    switch (selected_protocol) {
-    case V2G_PROTO_DIN70121:
-    case V2G_PROTO_ISO15118_2010:
-        if (conn->exi_in.dinEXIDocument != NULL)
-            free(conn->exi_in.dinEXIDocument);
-        if (conn->exi_out.dinEXIDocument != NULL)
-            free(conn->exi_out.dinEXIDocument);
-        break;
-    case V2G_PROTO_ISO15118_2013:
-        if (conn->exi_in.iso2EXIDocument != NULL)
-            free(conn->exi_in.iso2EXIDocument);
-        if (conn->exi_out.iso2EXIDocument != NULL)
-            free(conn->exi_out.iso2EXIDocument);
-        break;
-    default:
-        break;
-    }
+    exi_pool_release(conn->ctx->exi_pool, conn->exi_documents, selected_protocol);
+    conn->exi_documents = NULL;
+    conn->exi_in.iso2EXIDocument = NULL;
+    conn->exi_out.iso2EXIDocument = NULL;
 
     if (conn->buffer != NULL) {
         free(conn->buffer);